@@ -19,6 +19,9 @@ QMAKE_CFLAGS_RELEASE -= -O3
 DEFINES += QT_DEPRECATED_WARNINGS
 DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000
 
+# Uncomment to time each subsystem every frame, see src/core/profiler.hpp
+#DEFINES += PROFILER_ENABLED
+
 target.path = /usr/local/bin/
 INSTALLS += target
 
@@ -53,6 +56,8 @@ SOURCES += ../../src/qt/main.cpp \
     ../../src/core/ee/intc.cpp \
     ../../src/core/iop/cdvd.cpp \
     ../../src/core/iop/cso_reader.cpp\
+    ../../src/core/iop/disc_reader.cpp \
+    ../../src/core/iop/iso_mapping.cpp \
     ../../src/core/iop/sio2.cpp \
     ../../src/core/ee/vu.cpp \
     ../../src/core/ee/emotion_vu0.cpp \
@@ -60,7 +65,9 @@ SOURCES += ../../src/qt/main.cpp \
     ../../src/core/iop/spu.cpp \
     ../../src/qt/emuthread.cpp \
     ../../src/core/tests/iop/alu.cpp \
+    ../../src/core/tests/vu/jit.cpp \
     ../../src/core/ee/vif.cpp \
+    ../../src/core/ee/vif_unpack.cpp \
     ../../src/core/ee/ipu/ipu.cpp \
     ../../src/core/ee/ipu/vlc_table.cpp \
     ../../src/core/ee/ipu/mac_addr_inc.cpp \
@@ -86,11 +93,18 @@ SOURCES += ../../src/qt/main.cpp \
     ../../src/qt/ee_debugwindow.cpp \
     ../../src/core/jitcommon/jitcache.cpp \
     ../../src/core/jitcommon/emitter64.cpp \
+    ../../src/core/jitcommon/hostcpu.cpp \
+    ../../src/core/ee/vu_jitopt.cpp \
     ../../src/core/ee/vu_jittrans.cpp \
     ../../src/core/jitcommon/ir_block.cpp \
     ../../src/core/jitcommon/ir_instr.cpp \
     ../../src/core/ee/vu_jit.cpp \
     ../../src/core/ee/vu_jit64.cpp \
+    ../../src/core/ee/vu_thread.cpp \
+    ../../src/core/movie.cpp \
+    ../../src/core/profiler.cpp \
+    ../../src/core/rewind.cpp \
+    ../../src/core/savestate.cpp \
     ../../src/core/scheduler.cpp \
     ../../src/qt/renderwidget.cpp \
     ../../src/qt/settingswindow.cpp \
@@ -108,6 +122,7 @@ HEADERS += \
     ../../src/core/ee/bios_hle.hpp \
     ../../src/core/gs.hpp \
     ../../src/core/circularFIFO.hpp \
+    ../../src/core/ringbuffer.hpp \
     ../../src/core/gsthread.hpp \
     ../../src/core/gsregisters.hpp \
     ../../src/core/ee/dmac.hpp \
@@ -126,12 +141,16 @@ HEADERS += \
     ../../src/core/ee/intc.hpp \
     ../../src/core/iop/cdvd.hpp \
     ../../src/core/iop/cso_reader.hpp\
+    ../../src/core/iop/disc_reader.hpp \
+    ../../src/core/iop/iso_mapping.hpp \
     ../../src/core/iop/sio2.hpp \
     ../../src/core/ee/vu.hpp \
     ../../src/core/iop/gamepad.hpp \
     ../../src/core/iop/spu.hpp \
     ../../src/qt/emuthread.hpp \
     ../../src/core/ee/vif.hpp \
+    ../../src/core/ee/vif_unpack.hpp \
+    ../../src/core/dirtypages.hpp \
     ../../src/core/int128.hpp \
     ../../src/core/ee/ipu/ipu.hpp \
     ../../src/core/ee/ipu/vlc_table.hpp \
@@ -157,11 +176,18 @@ HEADERS += \
     ../../src/qt/ee_debugwindow.hpp \
     ../../src/core/jitcommon/jitcache.hpp \
     ../../src/core/jitcommon/emitter64.hpp \
+    ../../src/core/jitcommon/hostcpu.hpp \
+    ../../src/core/ee/vu_jitopt.hpp \
     ../../src/core/ee/vu_jittrans.hpp \
     ../../src/core/jitcommon/ir_block.hpp \
     ../../src/core/jitcommon/ir_instr.hpp \
     ../../src/core/ee/vu_jit.hpp \
     ../../src/core/ee/vu_jit64.hpp \
+    ../../src/core/ee/vu_thread.hpp \
+    ../../src/core/movie.hpp \
+    ../../src/core/profiler.hpp \
+    ../../src/core/rewind.hpp \
+    ../../src/core/savestate.hpp \
     ../../src/core/scheduler.hpp \
     ../../src/qt/renderwidget.hpp \
     ../../src/qt/settingswindow.hpp \
@@ -54,8 +54,8 @@ HEADERS += \
 SOURCES += \
 	../../ext/libdeflate/lib/aligned_malloc.c \
 	../../ext/libdeflate/lib/deflate_decompress.c \
-# uncomment for compression support
-	#../../ext/libdeflate/lib/deflate_compress.c \
+# compression support, used by save states
+	../../ext/libdeflate/lib/deflate_compress.c \
 # uncomment for zlib format support
 	#../../ext/libdeflate/lib/adler32.c \
 	#../../ext/libdeflate/lib/zlib_decompress.c \
@@ -0,0 +1,115 @@
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <thread>
+#include "bench.hpp"
+
+using namespace std;
+
+static volatile uint64_t bench_sink;
+
+void bench_use(uint64_t value)
+{
+    bench_sink += value;
+}
+
+BenchRunner::BenchRunner(const string& filter, double min_time) : filter(filter), min_time(min_time)
+{
+
+}
+
+void BenchRunner::run(const string& name, const function<void()>& func, uint64_t items, uint64_t bytes)
+{
+    if (!filter.empty() && name.find(filter) == string::npos)
+        return;
+
+    //Once untimed, so the first timed call doesn't pay for page faults or JIT compiles
+    func();
+
+    uint64_t iterations = 1;
+    double real_s, cpu_s;
+    while (true)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        clock_t cpu_start = clock();
+        for (uint64_t i = 0; i < iterations; i++)
+            func();
+        cpu_s = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+        real_s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        if (real_s >= min_time || iterations >= (1ULL << 40))
+            break;
+
+        //Aim a little past min_time, but never grow more than 10x from a run that was too short to go by
+        double scale = (real_s > 0.0) ? min_time * 1.4 / real_s : 10.0;
+        scale = (scale > 10.0) ? 10.0 : ((scale < 2.0) ? 2.0 : scale);
+        iterations = (uint64_t)(iterations * scale);
+    }
+
+    BenchResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.real_ns = real_s * 1e9 / iterations;
+    result.cpu_ns = cpu_s * 1e9 / iterations;
+    result.items_per_second = items ? items * iterations / real_s : 0.0;
+    result.bytes_per_second = bytes ? bytes * iterations / real_s : 0.0;
+    results.push_back(result);
+
+    printf("%-40s %14.1f ns %12llu", name.c_str(), result.real_ns, (unsigned long long)iterations);
+    if (items)
+        printf(" %10.2f M items/s", result.items_per_second / 1e6);
+    if (bytes)
+        printf(" %10.2f MB/s", result.bytes_per_second / (1024.0 * 1024.0));
+    printf("\n");
+    fflush(stdout);
+}
+
+const vector<BenchResult>& BenchRunner::get_results() const
+{
+    return results;
+}
+
+bool BenchRunner::write_json(const char* file_name, const char* executable) const
+{
+    FILE* json = fopen(file_name, "w");
+    if (!json)
+        return false;
+
+    char date[64];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+
+    fprintf(json, "{\n  \"context\": {\n");
+    fprintf(json, "    \"date\": \"%s\",\n", date);
+    fprintf(json, "    \"executable\": \"%s\",\n", executable);
+    fprintf(json, "    \"num_cpus\": %u,\n", thread::hardware_concurrency());
+#ifdef NDEBUG
+    fprintf(json, "    \"library_build_type\": \"release\"\n");
+#else
+    fprintf(json, "    \"library_build_type\": \"debug\"\n");
+#endif
+    fprintf(json, "  },\n  \"benchmarks\": [");
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult& result = results[i];
+        fprintf(json, "%s\n    {\n", i ? "," : "");
+        fprintf(json, "      \"name\": \"%s\",\n", result.name.c_str());
+        fprintf(json, "      \"run_name\": \"%s\",\n", result.name.c_str());
+        fprintf(json, "      \"run_type\": \"iteration\",\n");
+        fprintf(json, "      \"iterations\": %llu,\n", (unsigned long long)result.iterations);
+        fprintf(json, "      \"real_time\": %.3f,\n", result.real_ns);
+        fprintf(json, "      \"cpu_time\": %.3f,\n", result.cpu_ns);
+        fprintf(json, "      \"time_unit\": \"ns\"");
+        if (result.items_per_second)
+            fprintf(json, ",\n      \"items_per_second\": %.3f", result.items_per_second);
+        if (result.bytes_per_second)
+            fprintf(json, ",\n      \"bytes_per_second\": %.3f", result.bytes_per_second);
+        fprintf(json, "\n    }");
+    }
+    fprintf(json, "\n  ]\n}\n");
+
+    bool ok = !ferror(json);
+    fclose(json);
+    return ok;
+}
@@ -0,0 +1,67 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class Emulator;
+class GraphicsSynthesizerThread;
+class VectorInterface;
+
+struct BenchResult
+{
+    std::string name;
+    uint64_t iterations;
+    double real_ns, cpu_ns; //Per iteration
+    double items_per_second, bytes_per_second;
+};
+
+/**
+Times each benchmark by calling it in a loop, doubling the number of calls until a run lasts at least min_time.
+An iteration should do enough work (a whole block, a whole triangle) that the loop around it doesn't show up.
+Results are written in the same JSON layout as Google Benchmark, so its comparison tools can be used on them.
+**/
+class BenchRunner
+{
+    private:
+        std::string filter;
+        double min_time;
+        std::vector<BenchResult> results;
+    public:
+        BenchRunner(const std::string& filter, double min_time);
+
+        //items and bytes are how much work one call of func does, for the throughput figures
+        void run(const std::string& name, const std::function<void()>& func, uint64_t items = 0, uint64_t bytes = 0);
+
+        const std::vector<BenchResult>& get_results() const;
+        bool write_json(const char* file_name, const char* executable) const;
+};
+
+//Keeps the compiler from throwing away a result that nothing else reads
+void bench_use(uint64_t value);
+
+//The kernels are private, so the core classes the benchmarks drive declare this a friend
+class CoreBench
+{
+    private:
+        static void gs_setup_context(GraphicsSynthesizerThread& gs);
+        static void gs_swizzle(BenchRunner& runner, GraphicsSynthesizerThread& gs);
+        static void gs_tex_lookup(BenchRunner& runner, GraphicsSynthesizerThread& gs);
+        static void gs_draw_pixel(BenchRunner& runner, GraphicsSynthesizerThread& gs);
+        static void gs_triangles(BenchRunner& runner, GraphicsSynthesizerThread& gs);
+
+        static void vif_handle_UNPACK(BenchRunner& runner, VectorInterface& vif, const uint32_t* data, int cmd,
+                                      const char* name);
+        static void vif_kernel(BenchRunner& runner, VectorInterface& vif, const uint32_t* data, int cmd,
+                               const char* name, bool masked, int mode);
+    public:
+        static void gs(BenchRunner& runner, Emulator& e);
+        static void vif(BenchRunner& runner, Emulator& e);
+        static void ipu(BenchRunner& runner, Emulator& e);
+        static void cso(BenchRunner& runner);
+        static void scheduler(BenchRunner& runner, Emulator& e);
+        static void vu_jit(BenchRunner& runner, Emulator& e);
+};
+
+#endif // BENCH_HPP
@@ -0,0 +1,126 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <libdeflate.h>
+#include "bench.hpp"
+#include "../core/iop/cso_reader.hpp"
+
+using namespace std;
+
+#define CSO_FILE_NAME "DobieBench.cso"
+#define CSO_BLOCK_SIZE 2048
+//Larger than the reader's block cache, so reading it start to end keeps decoding
+#define CSO_IMAGE_SIZE (16 * 1024 * 1024)
+#define CSO_READ_SIZE (64 * 1024)
+#define IDX_COMPRESS_BIT 0x80000000
+
+//Sectors that compress about as well as typical disc data: runs of text-like bytes broken up by noise
+static void fill_sector(uint8_t* sector, uint32_t block)
+{
+    uint32_t seed = block * 0x9E3779B1;
+    for (int i = 0; i < CSO_BLOCK_SIZE; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        if ((seed >> 28) < 3)
+            sector[i] = seed >> 16;
+        else
+            sector[i] = 'a' + ((i / 7 + block) % 26);
+    }
+}
+
+//Writes a v1 CISO with uncompressed blocks flagged in the index, as maxcso does
+static bool write_cso(const char* file_name)
+{
+    ofstream file(file_name, ios::binary);
+    if (!file.is_open())
+        return false;
+
+    uint32_t blocks = CSO_IMAGE_SIZE / CSO_BLOCK_SIZE;
+    uint8_t header[0x18] = {'C', 'I', 'S', 'O', 0x18};
+    uint64_t raw_len = CSO_IMAGE_SIZE;
+    uint32_t block_len = CSO_BLOCK_SIZE;
+    memcpy(&header[8], &raw_len, sizeof(raw_len));
+    memcpy(&header[16], &block_len, sizeof(block_len));
+    header[20] = 1; //Version
+    header[21] = 0; //Index shift
+
+    struct libdeflate_compressor* deflate = libdeflate_alloc_compressor(6);
+    vector<uint32_t> indices(blocks + 1);
+    vector<uint8_t> data;
+    uint8_t sector[CSO_BLOCK_SIZE], packed[CSO_BLOCK_SIZE];
+    uint32_t pos = sizeof(header) + indices.size() * sizeof(uint32_t);
+    for (uint32_t i = 0; i < blocks; i++)
+    {
+        fill_sector(sector, i);
+        size_t size = libdeflate_deflate_compress(deflate, sector, CSO_BLOCK_SIZE, packed, CSO_BLOCK_SIZE - 1);
+        indices[i] = pos;
+        if (size)
+            data.insert(data.end(), packed, packed + size);
+        else
+        {
+            indices[i] |= IDX_COMPRESS_BIT;
+            size = CSO_BLOCK_SIZE;
+            data.insert(data.end(), sector, sector + size);
+        }
+        pos += size;
+    }
+    indices[blocks] = pos;
+    libdeflate_free_compressor(deflate);
+
+    file.write((char*)header, sizeof(header));
+    file.write((char*)indices.data(), indices.size() * sizeof(uint32_t));
+    file.write((char*)data.data(), data.size());
+    return !file.fail();
+}
+
+void CoreBench::cso(BenchRunner& runner)
+{
+    if (!write_cso(CSO_FILE_NAME))
+    {
+        printf("[BENCH] Couldn't write %s, skipping CSO benchmarks\n", CSO_FILE_NAME);
+        return;
+    }
+
+    CSO_Reader reader;
+    if (reader.open(CSO_FILE_NAME))
+    {
+        vector<uint8_t> buffer(CSO_READ_SIZE);
+        runner.run("CSO/read/sequential", [&]
+        {
+            reader.seek(0, ios::beg);
+            uint64_t total = 0;
+            while (total < CSO_IMAGE_SIZE)
+                total += reader.read(buffer.data(), CSO_READ_SIZE);
+            bench_use(buffer[0]);
+        }, CSO_IMAGE_SIZE / CSO_BLOCK_SIZE, CSO_IMAGE_SIZE);
+
+        //The same 256 KB over and over, served from the block cache
+        runner.run("CSO/read/cached", [&]
+        {
+            reader.seek(0, ios::beg);
+            for (int i = 0; i < 4; i++)
+                reader.read(buffer.data(), CSO_READ_SIZE);
+            bench_use(buffer[0]);
+        }, 4 * CSO_READ_SIZE / CSO_BLOCK_SIZE, 4 * CSO_READ_SIZE);
+
+        //A sector at a time, jumping around like a game loading files from all over the disc
+        runner.run("CSO/read/random_sector", [&]
+        {
+            uint32_t block = 0;
+            for (int i = 0; i < 64; i++)
+            {
+                block = (block * 1103515245 + 12345) % (CSO_IMAGE_SIZE / CSO_BLOCK_SIZE);
+                reader.seek((int64_t)block * CSO_BLOCK_SIZE, ios::beg);
+                reader.read(buffer.data(), CSO_BLOCK_SIZE);
+            }
+            bench_use(buffer[0]);
+        }, 64, 64 * CSO_BLOCK_SIZE);
+
+        reader.close();
+    }
+    else
+        printf("[BENCH] Couldn't open %s, skipping CSO benchmarks\n", CSO_FILE_NAME);
+
+    remove(CSO_FILE_NAME);
+}
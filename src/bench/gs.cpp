@@ -0,0 +1,296 @@
+#include <cstdio>
+#include "bench.hpp"
+#include "../core/emulator.hpp"
+
+using namespace std;
+
+//GS register addresses, as written by the GIF
+#define GS_PRIM 0x00
+#define GS_TEX0_1 0x06
+#define GS_CLAMP_1 0x08
+#define GS_TEX1_1 0x14
+#define GS_XYOFFSET_1 0x18
+#define GS_SCISSOR_1 0x40
+#define GS_ALPHA_1 0x42
+#define GS_TEST_1 0x47
+#define GS_FRAME_1 0x4C
+#define GS_ZBUF_1 0x4E
+
+#define FRAME_WIDTH 640
+#define FRAME_HEIGHT 448
+
+//Frame at the bottom of local memory, Z at 2 MB, textures at 3.5 MB
+#define FBP 0x000
+#define ZBP 0x100
+#define TBP 0x3800
+#define CBP 0x3F00
+
+#define PSMCT32 0x00
+#define PSMT8 0x13
+
+enum TRIANGLE_SHADING
+{
+    SHADE_FLAT,
+    SHADE_GOURAUD,
+    SHADE_TEXTURED
+};
+
+static const char* shading_names[] = {"flat", "gouraud", "textured"};
+
+static uint64_t make_tex0(uint32_t psm, int log_width, int log_height)
+{
+    return TBP | ((uint64_t)(256 / 64) << 14) | ((uint64_t)psm << 20) | ((uint64_t)log_width << 26) |
+           ((uint64_t)log_height << 30) | (1ULL << 34) | ((uint64_t)CBP << 37);
+}
+
+//Puts the GS in a state every benchmark builds on: a 640x448 32-bit frame with a 32-bit Z buffer, no tests
+void CoreBench::gs_setup_context(GraphicsSynthesizerThread& gs)
+{
+    gs.write64(GS_FRAME_1, FBP | ((FRAME_WIDTH / 64) << 16) | ((uint64_t)PSMCT32 << 24));
+    gs.write64(GS_ZBUF_1, ZBP | (1ULL << 32)); //ZMSK
+    gs.write64(GS_XYOFFSET_1, 0);
+    gs.write64(GS_SCISSOR_1, ((uint64_t)(FRAME_WIDTH - 1) << 16) | ((uint64_t)(FRAME_HEIGHT - 1) << 48));
+    gs.write64(GS_TEST_1, 1ULL << 17); //ZTST = ALWAYS
+    gs.write64(GS_ALPHA_1, 0);
+    gs.write64(GS_CLAMP_1, 0);
+    gs.write64(GS_TEX1_1, 0);
+    gs.write64(GS_TEX0_1, make_tex0(PSMCT32, 8, 8));
+    gs.write64(GS_PRIM, 3);
+
+    //A texture and frame that aren't a single color, so lookups and blends see varied data
+    for (uint32_t i = 0; i < 4 * 1024 * 1024; i += 4)
+        gs.set_word(i, i * 0x9E3779B1);
+}
+
+static Vertex make_vertex(int x, int y, uint32_t z, int16_t r, int16_t g, int16_t b, int u, int v)
+{
+    Vertex vtx;
+    vtx.x = x << 4;
+    vtx.y = y << 4;
+    vtx.z = z;
+    vtx.rgbaq.r = r;
+    vtx.rgbaq.g = g;
+    vtx.rgbaq.b = b;
+    vtx.rgbaq.a = 0x80;
+    vtx.rgbaq.q = 1.0f;
+    vtx.uv.u = u << 4;
+    vtx.uv.v = v << 4;
+    vtx.s = 0.0f;
+    vtx.t = 0.0f;
+    vtx.fog = 0;
+    return vtx;
+}
+
+void CoreBench::gs_swizzle(BenchRunner& runner, GraphicsSynthesizerThread& gs)
+{
+    //A 64x64 region, which crosses pages in every format
+    const uint32_t pixels = 64 * 64;
+    struct AddrFunc
+    {
+        const char* name;
+        uint32_t (GraphicsSynthesizerThread::*func)(uint32_t, uint32_t, uint32_t, uint32_t);
+    };
+    static const AddrFunc funcs[] =
+    {
+        {"PSMCT32", &GraphicsSynthesizerThread::addr_PSMCT32},
+        {"PSMCT32Z", &GraphicsSynthesizerThread::addr_PSMCT32Z},
+        {"PSMCT16", &GraphicsSynthesizerThread::addr_PSMCT16},
+        {"PSMCT16S", &GraphicsSynthesizerThread::addr_PSMCT16S},
+        {"PSMCT16Z", &GraphicsSynthesizerThread::addr_PSMCT16Z},
+        {"PSMCT16SZ", &GraphicsSynthesizerThread::addr_PSMCT16SZ},
+        {"PSMT8", &GraphicsSynthesizerThread::addr_PSMCT8},
+        {"PSMT4", &GraphicsSynthesizerThread::addr_PSMCT4}
+    };
+
+    for (const AddrFunc& addr : funcs)
+    {
+        runner.run(string("GS/swizzle/") + addr.name, [&]
+        {
+            uint32_t sum = 0;
+            for (uint32_t y = 0; y < 64; y++)
+            {
+                for (uint32_t x = 0; x < 64; x++)
+                    sum += (gs.*addr.func)(0, FRAME_WIDTH, x, y);
+            }
+            bench_use(sum);
+        }, pixels);
+    }
+}
+
+void CoreBench::gs_tex_lookup(BenchRunner& runner, GraphicsSynthesizerThread& gs)
+{
+    struct Lookup
+    {
+        const char* name;
+        uint32_t psm;
+        bool bilinear;
+    };
+    static const Lookup lookups[] =
+    {
+        {"PSMCT32/nearest", PSMCT32, false},
+        {"PSMCT32/bilinear", PSMCT32, true},
+        {"PSMT8/nearest", PSMT8, false}
+    };
+
+    const uint32_t texels = 64 * 64;
+    for (const Lookup& lookup : lookups)
+    {
+        gs.write64(GS_TEX0_1, make_tex0(lookup.psm, 8, 8));
+        //MMAG and MMIN select bilinear filtering when enlarging and reducing
+        gs.write64(GS_TEX1_1, lookup.bilinear ? ((1 << 5) | (1 << 6)) : 0);
+        gs.write64(GS_PRIM, 3 | (1 << 4) | (1 << 8)); //Textured, UV coordinates
+        if (lookup.psm == PSMT8)
+            gs.reload_clut(*gs.current_ctx);
+
+        TexLookupInfo info;
+        info.vtx_color.r = info.vtx_color.g = info.vtx_color.b = info.vtx_color.a = 0x80;
+        info.vtx_color.q = 1.0f;
+        info.tex_base = gs.current_ctx->tex0.texture_base;
+        info.buffer_width = gs.current_ctx->tex0.width;
+        info.tex_width = gs.current_ctx->tex0.tex_width;
+        info.tex_height = gs.current_ctx->tex0.tex_height;
+        info.LOD = 0.0f;
+        info.mipmap_level = 0;
+        info.fog = 0;
+
+        runner.run(string("GS/tex_lookup/") + lookup.name, [&]
+        {
+            uint32_t sum = 0;
+            for (int v = 0; v < 64; v++)
+            {
+                //Steps of 1.5 texels, so neighboring lookups don't hit the same texel
+                for (int u = 0; u < 64; u++)
+                {
+                    info.new_lookup = true;
+                    gs.tex_lookup(u * 24 + 3, v * 24 + 5, info);
+                    sum += info.tex_color.r + info.tex_color.a;
+                }
+            }
+            bench_use(sum);
+        }, texels);
+    }
+
+    gs.write64(GS_TEX1_1, 0);
+    gs.write64(GS_TEX0_1, make_tex0(PSMCT32, 8, 8));
+    gs.write64(GS_PRIM, 3);
+}
+
+void CoreBench::gs_draw_pixel(BenchRunner& runner, GraphicsSynthesizerThread& gs)
+{
+    struct PixelState
+    {
+        const char* name;
+        uint64_t zbuf, test, alpha, prim;
+    };
+    static const PixelState states[] =
+    {
+        {"plain", ZBP | (1ULL << 32), 1ULL << 17, 0, 3},
+        //ZTE with GEQUAL, updating Z
+        {"depth", ZBP, (1ULL << 16) | (2ULL << 17), 0, 3},
+        //(Cs - Cd) * As + Cd
+        {"alpha_blend", ZBP | (1ULL << 32), 1ULL << 17, (0 << 0) | (1 << 2) | (0 << 4) | (1 << 6), 3 | (1 << 6)}
+    };
+
+    const uint32_t pixels = 64 * 64;
+    for (const PixelState& state : states)
+    {
+        gs.write64(GS_ZBUF_1, state.zbuf);
+        gs.write64(GS_TEST_1, state.test);
+        gs.write64(GS_ALPHA_1, state.alpha);
+        gs.write64(GS_PRIM, state.prim);
+
+        RGBAQ_REG color;
+        color.r = 0x40;
+        color.g = 0x80;
+        color.b = 0xC0;
+        color.a = 0x60;
+        color.q = 1.0f;
+        uint32_t z = 0;
+        runner.run(string("GS/draw_pixel/") + state.name, [&]
+        {
+            //Z climbs so the GEQUAL test keeps passing
+            z += 0x100;
+            for (int y = 0; y < 64; y++)
+            {
+                for (int x = 0; x < 64; x++)
+                    gs.draw_pixel(x << 4, y << 4, z, color);
+            }
+        }, pixels);
+    }
+
+    gs.write64(GS_ZBUF_1, ZBP | (1ULL << 32));
+    gs.write64(GS_TEST_1, 1ULL << 17);
+    gs.write64(GS_ALPHA_1, 0);
+    gs.write64(GS_PRIM, 3);
+}
+
+void CoreBench::gs_triangles(BenchRunner& runner, GraphicsSynthesizerThread& gs)
+{
+    struct TriangleSize
+    {
+        const char* name;
+        int size;
+    };
+    static const TriangleSize sizes[] =
+    {
+        {"small", 8},
+        {"medium", 64},
+        {"large", 384}
+    };
+
+    for (int shading = SHADE_FLAT; shading <= SHADE_TEXTURED; shading++)
+    {
+        uint64_t prim = 3;
+        if (shading != SHADE_FLAT)
+            prim |= 1 << 3;
+        if (shading == SHADE_TEXTURED)
+            prim |= (1 << 4) | (1 << 8);
+        gs.write64(GS_PRIM, prim);
+
+        for (const TriangleSize& size : sizes)
+        {
+            int s = size.size;
+            Vertex verts[3];
+            verts[0] = make_vertex(16, 16, 0x1000, 0xFF, 0x00, 0x00, 0, 0);
+            verts[1] = make_vertex(16 + s, 16 + s / 4, 0x2000, 0x00, 0xFF, 0x00, 255, 32);
+            verts[2] = make_vertex(16 + s / 3, 16 + s, 0x3000, 0x00, 0x00, 0xFF, 64, 255);
+            uint64_t pixels = (uint64_t)s * s * 11 / 24; //Area of the triangle above
+
+            string name = string("/") + shading_names[shading] + "/" + size.name;
+            runner.run("GS/render_triangle" + name, [&]
+            {
+                gs.vtx_queue[2] = verts[0];
+                gs.vtx_queue[1] = verts[1];
+                gs.vtx_queue[0] = verts[2];
+                gs.render_triangle();
+            }, pixels);
+            runner.run("GS/render_triangle2" + name, [&]
+            {
+                gs.vtx_queue[2] = verts[0];
+                gs.vtx_queue[1] = verts[1];
+                gs.vtx_queue[0] = verts[2];
+                gs.render_triangle2();
+            }, pixels);
+        }
+    }
+
+    gs.write64(GS_PRIM, 3);
+}
+
+/**
+The GS kernels are called on the GS thread's state directly, from this thread. That's only safe while the
+GS thread is asleep, so it's given a frame to render first and waited on, and nothing is sent to it until the end.
+**/
+void CoreBench::gs(BenchRunner& runner, Emulator& e)
+{
+    e.gs.render_CRT();
+    e.gs.get_framebuffer();
+
+    GraphicsSynthesizerThread& gs = e.gs.gs_thread;
+    gs_setup_context(gs);
+
+    gs_swizzle(runner, gs);
+    gs_tex_lookup(runner, gs);
+    gs_draw_pixel(runner, gs);
+    gs_triangles(runner, gs);
+}
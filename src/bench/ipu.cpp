@@ -0,0 +1,42 @@
+#include "bench.hpp"
+#include "../core/emulator.hpp"
+
+void CoreBench::ipu(BenchRunner& runner, Emulator& e)
+{
+    ImageProcessingUnit& ipu = e.ipu;
+
+    //Coefficients shaped like a dequantized block: a large DC term and AC terms falling off with frequency
+    int16_t coeffs[64];
+    for (int i = 0; i < 64; i++)
+    {
+        int freq = (i >> 3) + (i & 0x7);
+        coeffs[i] = (int16_t)(((i * 37) % 61 - 30) * 16 / (freq + 1));
+    }
+    coeffs[0] = 1024;
+
+    //A macroblock is four luma and two chroma blocks
+    int16_t blocks[6][64];
+    runner.run("IPU/perform_IDCT", [&]
+    {
+        for (int i = 0; i < 6; i++)
+            ipu.perform_IDCT(coeffs, blocks[i]);
+        bench_use(blocks[5][63]);
+    }, 6);
+
+    for (int i = 0; i < BLOCK_SIZE; i++)
+        ipu.csc.block[i] = (uint8_t)(i * 7 + (i >> 4));
+
+    alignas(16) uint32_t pixels[0x100];
+    runner.run("IPU/convert_macroblock", [&]
+    {
+        ipu.convert_macroblock(pixels);
+        bench_use(pixels[0xFF]);
+    }, 0x100, sizeof(pixels));
+
+    alignas(16) uint16_t colors[0x100];
+    runner.run("IPU/pack_RGB16", [&]
+    {
+        ipu.pack_RGB16(pixels, colors);
+        bench_use(colors[0xFF]);
+    }, 0x100, sizeof(pixels));
+}
@@ -0,0 +1,89 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "bench.hpp"
+#include "../core/emulator.hpp"
+#include "../core/errors.hpp"
+#include "../common/arg.h"
+
+#define DEFAULT_MIN_TIME 0.5
+
+using namespace std;
+
+/**
+Times the emulator's hot kernels in isolation: GS swizzling, texturing and rasterization, VIF unpacking,
+the IPU's IDCT and color conversion, CSO decoding, scheduler churn, and VU JIT compiles.
+No BIOS or game is needed. Pass -o to keep the results as JSON for comparing two builds.
+**/
+int main(int argc, char** argv)
+{
+    char* argv0;
+    char* filter = nullptr, *json_name = nullptr;
+    double min_time = DEFAULT_MIN_TIME;
+
+    ARGBEGIN {
+        case 'f':
+            filter = ARGF();
+            break;
+        case 'o':
+            json_name = ARGF();
+            break;
+        case 't':
+        {
+            char* time = ARGF();
+            if (time)
+                min_time = atof(time);
+            break;
+        }
+        case 'h':
+        default:
+            printf("usage: %s [options]\n\n", argv0);
+            printf("options:\n");
+            printf("-f {filter}\tonly run benchmarks whose name contains filter\n");
+            printf("-o {JSON}\twrite the results to a JSON file\n");
+            printf("-t {seconds}\tminimum time to run each benchmark (default %.1f)\n", DEFAULT_MIN_TIME);
+            printf("-h\t\tshow this message\n");
+            return 1;
+    } ARGEND
+
+    if (min_time <= 0.0)
+    {
+        printf("[BENCH] The minimum time must be positive\n");
+        return 1;
+    }
+
+    BenchRunner runner(filter ? filter : "", min_time);
+    Emulator* e = new Emulator();
+    e->reset();
+
+    int status = 0;
+    try
+    {
+        CoreBench::gs(runner, *e);
+        CoreBench::vif(runner, *e);
+        CoreBench::ipu(runner, *e);
+        CoreBench::cso(runner);
+        CoreBench::scheduler(runner, *e);
+        CoreBench::vu_jit(runner, *e);
+    }
+    catch (Emulation_error& error)
+    {
+        printf("[BENCH] Fatal emulation error\n%s\n", error.what());
+        status = 1;
+    }
+    catch (non_fatal_error& error)
+    {
+        printf("[BENCH] Emulation error\n%s\n", error.what());
+        status = 1;
+    }
+
+    if (json_name && !runner.write_json(json_name, argv0))
+    {
+        printf("[BENCH] Failed to write %s\n", json_name);
+        status = 1;
+    }
+
+    delete e;
+    return status;
+}
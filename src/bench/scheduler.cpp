@@ -0,0 +1,51 @@
+#include <string>
+#include "bench.hpp"
+#include "../core/emulator.hpp"
+
+using namespace std;
+
+#define SLICES 4096
+//EE cycles between events, about two run slices
+#define EVENT_SPACING 64
+
+/**
+Runs the scheduler the way Emulator::run does, with a set number of events queued. Each event that fires is
+replaced by one further out, like a periodic timer, so the queue stays the same length throughout.
+Uses its own Scheduler so the emulator's events are left alone; the events only check the EE's interrupt lines.
+**/
+static void bench_churn(BenchRunner& runner, Emulator& e, int pending)
+{
+    Scheduler scheduler;
+    SchedulerEvent event;
+    event.id = EE_IRQ_CHECK;
+    event.func = &Emulator::ee_irq_check;
+
+    runner.run("Scheduler/churn/" + to_string(pending), [&]
+    {
+        scheduler.reset();
+        for (int i = 1; i <= pending; i++)
+        {
+            event.time_to_run = i * EVENT_SPACING;
+            scheduler.add_event(event);
+        }
+
+        for (int i = 0; i < SLICES; i++)
+        {
+            scheduler.calculate_run_cycles();
+            scheduler.update_cycle_counts();
+            if (scheduler.events_pending())
+            {
+                scheduler.process_events(&e);
+                event.time_to_run = scheduler.get_ee_cycles() + pending * EVENT_SPACING;
+                scheduler.add_event(event);
+            }
+        }
+    }, SLICES);
+}
+
+void CoreBench::scheduler(BenchRunner& runner, Emulator& e)
+{
+    bench_churn(runner, e, 4);
+    bench_churn(runner, e, 16);
+    bench_churn(runner, e, 64);
+}
@@ -0,0 +1,124 @@
+#include <cstring>
+#include <vector>
+#include "bench.hpp"
+#include "../core/emulator.hpp"
+
+using namespace std;
+
+//Vectors written by each UNPACK, enough to fill a quarter of VU1 data memory
+#define UNPACK_NUM 256
+
+struct UnpackFormat
+{
+    int cmd;
+    const char* name;
+};
+
+static const UnpackFormat formats[] =
+{
+    {0x0, "S-32"},
+    {0x1, "S-16"},
+    {0x2, "S-8"},
+    {0x4, "V2-32"},
+    {0x5, "V2-16"},
+    {0x6, "V2-8"},
+    {0x8, "V3-32"},
+    {0x9, "V3-16"},
+    {0xA, "V3-8"},
+    {0xC, "V4-32"},
+    {0xD, "V4-16"},
+    {0xE, "V4-8"},
+    {0xF, "V4-5"}
+};
+
+static int unpack_words(int cmd, int num)
+{
+    int vl = cmd & 0x3;
+    int vn = (cmd >> 2) & 0x3;
+    int bits_per_op = (vl == 3 && vn == 3) ? 16 : (32 >> vl) * (vn + 1);
+    return (bits_per_op * num + 31) / 32;
+}
+
+//The word at a time path in handle_UNPACK, used for V3 formats, filling writes, and data split across DMA bursts
+void CoreBench::vif_handle_UNPACK(BenchRunner& runner, VectorInterface& vif, const uint32_t* data, int cmd,
+                                  const char* name)
+{
+    vif.CYCLE.CL = 1;
+    vif.CYCLE.WL = 1;
+    vif.MODE = 0;
+    vif.command = 0x60 | cmd;
+    vif.imm = 0;
+    vif.command_len = 0;
+    vif.init_UNPACK(((uint32_t)vif.command << 24) | ((UNPACK_NUM & 0xFF) << 16));
+
+    //Put the VIF back to the start of the UNPACK before every run, instead of decoding the VIFcode again
+    UNPACK_Command start = vif.unpack;
+    int command_len = vif.command_len;
+    int words = unpack_words(cmd, UNPACK_NUM);
+
+    runner.run(string("VIF/handle_UNPACK/") + name, [&]
+    {
+        vif.unpack = start;
+        vif.command_len = command_len;
+        vif.command = 0x60 | cmd;
+        vif.buffer_size = 0;
+        for (int i = 0; i < words; i++)
+            vif.handle_UNPACK(data[i]);
+    }, UNPACK_NUM, words * 4);
+
+    vif.command = 0;
+    vif.command_len = 0;
+    vif.unpack_kernel = nullptr;
+}
+
+//The kernels fast_UNPACK hands whole groups of words to
+void CoreBench::vif_kernel(BenchRunner& runner, VectorInterface& vif, const uint32_t* data, int cmd,
+                           const char* name, bool masked, int mode)
+{
+    VIF_UnpackKernel kernel = VIF_Unpack::get_kernel(cmd, true, masked, mode);
+    if (!kernel)
+        return;
+
+    VIF_UnpackFormat unpack_format = VIF_Unpack::get_format(cmd);
+    int groups = UNPACK_NUM / unpack_format.ops_per_group;
+    int words = groups * unpack_format.words_per_group;
+
+    uint32_t row[4] = {1, 2, 3, 4};
+    VIF_UnpackJob job;
+    job.mem = vif.vu->get_data_mem();
+    job.mem_mask = (vif.mem_mask << 4) | 0xF;
+    job.CL = 1;
+    job.WL = 1;
+    job.mask = masked ? 0x1B1B1B1B : 0; //Each vector gets one field from ROW, COL, and write protection
+    job.row = row;
+    job.col = vif.COL;
+
+    string full_name = string("VIF/kernel/") + name;
+    if (masked)
+        full_name += "/masked";
+    if (mode)
+        full_name += "/offset";
+    runner.run(full_name, [&]
+    {
+        job.addr = 0;
+        job.blocks_written = 0;
+        kernel(job, data, groups);
+    }, UNPACK_NUM, words * 4);
+}
+
+void CoreBench::vif(BenchRunner& runner, Emulator& e)
+{
+    VectorInterface& vif = e.vif1;
+
+    vector<uint32_t> data(unpack_words(0xC, UNPACK_NUM));
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (uint32_t)i * 0x9E3779B1;
+
+    for (const UnpackFormat& format : formats)
+        vif_handle_UNPACK(runner, vif, data.data(), format.cmd, format.name);
+
+    for (const UnpackFormat& format : formats)
+        vif_kernel(runner, vif, data.data(), format.cmd, format.name, false, 0);
+    vif_kernel(runner, vif, data.data(), 0xC, "V4-32", true, 0);
+    vif_kernel(runner, vif, data.data(), 0xC, "V4-32", false, 1);
+}
@@ -0,0 +1,106 @@
+#include "bench.hpp"
+#include "../core/emulator.hpp"
+#include "../core/ee/vu_jit.hpp"
+
+using namespace std;
+
+#define DEST_XYZW (0xFu << 21)
+
+#define UPPER_NOP 0x000002FF
+#define LOWER_NOP 0x8000033C
+#define E_BIT (1u << 30)
+
+#define LQ(ft, is, imm) ((0x00u << 25) | DEST_XYZW | ((ft) << 16) | ((is) << 11) | ((imm) & 0x7FF))
+#define SQ(fs, it, imm) ((0x01u << 25) | DEST_XYZW | ((it) << 16) | ((fs) << 11) | ((imm) & 0x7FF))
+#define IADDIU(it, is, imm) ((0x08u << 25) | ((it) << 16) | ((is) << 11) | ((imm) & 0x7FF))
+#define ISUBIU(it, is, imm) ((0x09u << 25) | ((it) << 16) | ((is) << 11) | ((imm) & 0x7FF))
+#define IBNE(it, is, offset) ((0x29u << 25) | ((it) << 16) | ((is) << 11) | ((offset) & 0x7FF))
+
+#define UPPER(op, fd, fs, ft) (DEST_XYZW | ((ft) << 16) | ((fs) << 11) | ((fd) << 6) | (op))
+#define UPPER_SPECIAL(op, fs, ft) (DEST_XYZW | ((ft) << 16) | ((fs) << 11) | (op))
+#define MADDbc(fd, fs, ft, bc) UPPER(0x08 + (bc), fd, fs, ft)
+#define MULbc(fd, fs, ft, bc) UPPER(0x18 + (bc), fd, fs, ft)
+#define ADD(fd, fs, ft) UPPER(0x28, fd, fs, ft)
+#define MADDAbc(fs, ft, bc) UPPER_SPECIAL(0x0BC + (bc), fs, ft)
+#define MULAbc(fs, ft, bc) UPPER_SPECIAL(0x1BC + (bc), fs, ft)
+
+//Transforms vi3 vertices by the matrix in vf20-vf23, two at a time: the usual shape of a VU1 microprogram
+const static uint32_t BENCH_PROGRAM[][2] =
+{
+    {LQ(1, 1, 0), UPPER_NOP},
+    {LQ(2, 1, 1), UPPER_NOP},
+    {IADDIU(1, 1, 2), MULAbc(20, 1, 0)},
+    {LOWER_NOP, MADDAbc(21, 1, 1)},
+    {LOWER_NOP, MADDAbc(22, 1, 2)},
+    {LOWER_NOP, MADDbc(3, 23, 1, 3)},
+    {LOWER_NOP, MULAbc(20, 2, 0)},
+    {LOWER_NOP, MADDAbc(21, 2, 1)},
+    {LOWER_NOP, MADDAbc(22, 2, 2)},
+    {LOWER_NOP, MADDbc(4, 23, 2, 3)},
+    {LOWER_NOP, ADD(5, 3, 30)},
+    {LOWER_NOP, MULbc(6, 4, 31, 0)},
+    {SQ(5, 2, 0), UPPER_NOP},
+    {SQ(6, 2, 1), UPPER_NOP},
+    {ISUBIU(3, 3, 2), UPPER_NOP},
+    {IBNE(3, 0, -16), UPPER_NOP},
+    {IADDIU(2, 2, 2), UPPER_NOP},
+    {LOWER_NOP, UPPER_NOP | E_BIT},
+    {LOWER_NOP, UPPER_NOP}
+};
+
+static void setup_program(VectorUnit& vu)
+{
+    int instr_count = sizeof(BENCH_PROGRAM) / sizeof(BENCH_PROGRAM[0]);
+    for (int i = 0; i < instr_count; i++)
+    {
+        vu.write_instr<uint32_t>(i * 8, BENCH_PROGRAM[i][0]);
+        vu.write_instr<uint32_t>(i * 8 + 4, BENCH_PROGRAM[i][1]);
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+        float value = i * 0.5f - 7.0f;
+        vu.write_data<uint32_t>(i * 4, *(uint32_t*)&value);
+    }
+
+    for (int i = 1; i < 32; i++)
+    {
+        for (int j = 0; j < 4; j++)
+            vu.set_gpr_f(i, j, (i * 3 + j) * 0.25f - 4.0f);
+    }
+}
+
+static void run_program(VectorUnit& vu, int vertices)
+{
+    vu.set_int(1, 0);
+    vu.set_int(2, 128);
+    vu.set_int(3, vertices);
+    vu.start_program(0);
+    for (int i = 0; i < 100000 && vu.is_running(); i++)
+        vu.run_jit(256);
+}
+
+/**
+compile_and_run throws away every compiled block first; run_cached reuses them.
+The difference between the two is what compiling the program costs.
+**/
+void CoreBench::vu_jit(BenchRunner& runner, Emulator& e)
+{
+    VectorUnit& vu = e.vu1;
+    vu.reset();
+    setup_program(vu);
+
+    const int vertices = 32;
+    runner.run("VU_JIT/compile_and_run", [&]
+    {
+        VU_JIT::reset();
+        run_program(vu, vertices);
+    }, vertices);
+
+    runner.run("VU_JIT/run_cached", [&]
+    {
+        run_program(vu, vertices);
+    }, vertices);
+
+    VU_JIT::reset();
+}
@@ -21,10 +21,13 @@ public:
     virtual ~CircularFifo() {}
 
     void push(const Element& item); // pushByMOve?
+    void push_bulk(const Element* items, size_t count);
     bool pop(Element& item);
+    size_t pop_bulk(Element* items, size_t count);
 
     bool was_empty() const;
     bool was_full() const;
+    size_t free_space() const;
     bool is_lock_free() const;
 
 private:
@@ -51,6 +54,27 @@ void CircularFifo<Element, Size>::push(const Element& item)
     }
 }
 
+// Publishes the whole run to the consumer with a single release store
+template<typename Element, size_t Size>
+void CircularFifo<Element, Size>::push_bulk(const Element* items, size_t count)
+{
+    auto current_tail = _tail.load(std::memory_order_relaxed);
+    auto head = _head.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; i++)
+    {
+        const auto next_tail = increment(current_tail);
+        if (next_tail == head)
+        {
+            head = _head.load(std::memory_order_acquire);
+            if (next_tail == head)
+                Errors::die("FIFO FULL!");
+        }
+        _array[current_tail] = items[i];
+        current_tail = next_tail;
+    }
+    _tail.store(current_tail, std::memory_order_release);
+}
+
 // Pop by Consumer can only update the head (load with relaxed, store with release)
 //     the tail must be accessed with at least aquire
 template<typename Element, size_t Size>
@@ -65,6 +89,22 @@ bool CircularFifo<Element, Size>::pop(Element& item)
     return true;
 }
 
+template<typename Element, size_t Size>
+size_t CircularFifo<Element, Size>::pop_bulk(Element* items, size_t count)
+{
+    auto current_head = _head.load(std::memory_order_relaxed);
+    const auto tail = _tail.load(std::memory_order_acquire);
+    size_t popped = 0;
+    while (popped < count && current_head != tail)
+    {
+        items[popped] = _array[current_head];
+        current_head = increment(current_head);
+        popped++;
+    }
+    _head.store(current_head, std::memory_order_release);
+    return popped;
+}
+
 template<typename Element, size_t Size>
 bool CircularFifo<Element, Size>::was_empty() const
 {
@@ -82,6 +122,15 @@ bool CircularFifo<Element, Size>::was_full() const
 }
 
 
+// snapshot from the producer's side, so the real amount of space can only be larger
+template<typename Element, size_t Size>
+size_t CircularFifo<Element, Size>::free_space() const
+{
+    const auto tail = _tail.load(std::memory_order_relaxed);
+    const auto head = _head.load(std::memory_order_acquire);
+    return (head + Capacity - tail - 1) % Capacity;
+}
+
 template<typename Element, size_t Size>
 bool CircularFifo<Element, Size>::is_lock_free() const
 {
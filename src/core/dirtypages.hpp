@@ -0,0 +1,71 @@
+#ifndef DIRTYPAGES_HPP
+#define DIRTYPAGES_HPP
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+One flag per 4 KB page of a block of emulated memory, set by everything that writes to the block directly.
+The rewind buffer only compares the pages flagged since its last capture, instead of the whole block.
+A write that doesn't mark its page is never captured, so anything new that writes to the block has to mark it.
+**/
+class DirtyPageMap
+{
+    private:
+        const uint8_t* base;
+        size_t size;
+        std::vector<uint8_t> pages;
+    public:
+        constexpr static int PAGE_SHIFT = 12;
+
+        DirtyPageMap() : base(nullptr), size(0) {}
+
+        void init(const uint8_t* base, size_t size);
+
+        void mark(const uint8_t* ptr);
+        void mark_range(const uint8_t* ptr, size_t len);
+        void mark_all();
+        void clear();
+
+        bool is_dirty(size_t page) const { return pages[page]; }
+};
+
+inline void DirtyPageMap::init(const uint8_t* base, size_t size)
+{
+    this->base = base;
+    this->size = size;
+    pages.assign(size >> PAGE_SHIFT, 1);
+}
+
+//Pointers outside the block, like the BIOS mapped through the TLB, are ignored
+inline void DirtyPageMap::mark(const uint8_t* ptr)
+{
+    uintptr_t offset = (uintptr_t)ptr - (uintptr_t)base;
+    if (offset < size)
+        pages[offset >> PAGE_SHIFT] = 1;
+}
+
+inline void DirtyPageMap::mark_range(const uint8_t* ptr, size_t len)
+{
+    if (!len)
+        return;
+    uintptr_t start = (uintptr_t)ptr - (uintptr_t)base;
+    for (uintptr_t page = start >> PAGE_SHIFT; page <= (start + len - 1) >> PAGE_SHIFT; page++)
+    {
+        if (page < pages.size())
+            pages[page] = 1;
+    }
+}
+
+inline void DirtyPageMap::mark_all()
+{
+    memset(pages.data(), 1, pages.size());
+}
+
+inline void DirtyPageMap::clear()
+{
+    memset(pages.data(), 0, pages.size());
+}
+
+#endif // DIRTYPAGES_HPP
@@ -1,7 +1,15 @@
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include "cop0.hpp"
 #include "dmac.hpp"
+#include "../errors.hpp"
+
+#define VTLB_PAGES (1024 * 1024)
+
+//Past this many TLB writes, resetting the whole VTLB is cheaper than undoing them one at a time
+#define MAX_VTLB_DIRTY_RANGES 1024
 
 Cop0::Cop0(DMAC* dmac) : dmac(dmac)
 {
@@ -12,14 +20,15 @@ Cop0::Cop0(DMAC* dmac) : dmac(dmac)
     sup_vtlb = nullptr;
     user_vtlb = nullptr;
     vtlb_info = nullptr;
+    vtlb_dirty_overflow = false;
 }
 
 Cop0::~Cop0()
 {
-    delete[] kernel_vtlb;
-    delete[] sup_vtlb;
-    delete[] user_vtlb;
-    delete[] vtlb_info;
+    free(kernel_vtlb);
+    free(sup_vtlb);
+    free(user_vtlb);
+    free(vtlb_info);
 }
 
 uint8_t** Cop0::get_vtlb_map()
@@ -85,33 +94,78 @@ void Cop0::init_mem_pointers(uint8_t *RDRAM, uint8_t *BIOS, uint8_t *spr)
     this->spr = spr;
 }
 
+/**
+ * A reset only puts back the pages TLB writes have changed since the last one.
+ * The VTLB is only built from scratch the first time, or when there were too many writes to keep track of.
+ */
 void Cop0::init_tlb()
 {
-    if (!kernel_vtlb)
-        kernel_vtlb = new uint8_t*[1024 * 1024];
-    if (!sup_vtlb)
-        sup_vtlb = new uint8_t*[1024 * 1024];
-    if (!user_vtlb)
-        user_vtlb = new uint8_t*[1024 * 1024];
-    if (!vtlb_info)
-        vtlb_info = new VTLB_Info[1024 * 1024];
-
-    memset(kernel_vtlb, 0, 1024 * 1024 * sizeof(uint8_t*));
-    memset(sup_vtlb, 0, 1024 * 1024 * sizeof(uint8_t*));
-    memset(user_vtlb, 0, 1024 * 1024 * sizeof(uint8_t*));
-    memset(vtlb_info, 0, 1024 * 1024 * sizeof(VTLB_Info));
-
-    //Kernel segments are unmapped to TLB, so we must define them explicitly
-    uint32_t unmapped_start = 0x80000000, unmapped_end = 0xC0000000;
-    for (uint32_t i = unmapped_start; i < unmapped_end; i += 4096)
+    if (kernel_vtlb && !vtlb_dirty_overflow)
+    {
+        for (auto& range : vtlb_dirty_ranges)
+        {
+            uint32_t end_page = range.first_page + range.page_count;
+            for (uint32_t page = range.first_page; page < end_page; page++)
+            {
+                kernel_vtlb[page] = nullptr;
+                sup_vtlb[page] = nullptr;
+                user_vtlb[page] = nullptr;
+                vtlb_info[page].cache_mode = 0;
+            }
+            map_kernel_segments(range.first_page, end_page);
+        }
+        vtlb_dirty_ranges.clear();
+        return;
+    }
+
+    //Fresh calloc'd memory is zeroed by the OS as it's first touched,
+    //so the bulk of the 25 MB that no mapping ever uses is never committed
+    free(kernel_vtlb);
+    free(sup_vtlb);
+    free(user_vtlb);
+    free(vtlb_info);
+    kernel_vtlb = (uint8_t**)calloc(VTLB_PAGES, sizeof(uint8_t*));
+    sup_vtlb = (uint8_t**)calloc(VTLB_PAGES, sizeof(uint8_t*));
+    user_vtlb = (uint8_t**)calloc(VTLB_PAGES, sizeof(uint8_t*));
+    vtlb_info = (VTLB_Info*)calloc(VTLB_PAGES, sizeof(VTLB_Info));
+    if (!kernel_vtlb || !sup_vtlb || !user_vtlb || !vtlb_info)
+        Errors::die("[COP0] Failed to allocate the VTLB");
+
+    map_kernel_segments(0, VTLB_PAGES);
+    vtlb_dirty_ranges.clear();
+    vtlb_dirty_overflow = false;
+}
+
+//Kernel segments are unmapped to TLB, so we must define them explicitly
+void Cop0::map_kernel_segments(uint32_t first_page, uint32_t end_page)
+{
+    const uint32_t unmapped_start = 0x80000000 / 4096, unmapped_end = 0xC0000000 / 4096;
+    first_page = std::max(first_page, unmapped_start);
+    end_page = std::min(end_page, unmapped_end);
+    for (uint32_t page = first_page; page < end_page; page++)
     {
-        int map_index = i / 4096;
-        kernel_vtlb[map_index] = get_mem_pointer(i & 0x1FFFFFFF);
-        if (i < 0xA0000000)
-            vtlb_info[map_index].cache_mode = CACHED;
+        uint32_t addr = page * 4096;
+        kernel_vtlb[page] = get_mem_pointer(addr & 0x1FFFFFFF);
+        if (addr < 0xA0000000)
+            vtlb_info[page].cache_mode = CACHED;
         else
-            vtlb_info[map_index].cache_mode = UNCACHED;
+            vtlb_info[page].cache_mode = UNCACHED;
+    }
+}
+
+void Cop0::mark_vtlb_dirty(uint32_t first_page, uint32_t page_count)
+{
+    if (vtlb_dirty_overflow || !page_count)
+        return;
+
+    if (vtlb_dirty_ranges.size() >= MAX_VTLB_DIRTY_RANGES || first_page >= VTLB_PAGES)
+    {
+        vtlb_dirty_overflow = true;
+        vtlb_dirty_ranges.clear();
+        return;
     }
+    page_count = std::min(page_count, VTLB_PAGES - first_page);
+    vtlb_dirty_ranges.push_back({first_page, page_count});
 }
 
 uint32_t Cop0::mfc(int index)
@@ -353,6 +407,7 @@ void Cop0::unmap_tlb(TLB_Entry *entry)
     {
         if (entry->valid[0])
         {
+            mark_vtlb_dirty(even_page, 4);
             for (uint32_t i = 0; i < 1024 * 16; i += 4096)
             {
                 int map_index = i / 4096;
@@ -366,6 +421,7 @@ void Cop0::unmap_tlb(TLB_Entry *entry)
     {
         if (entry->valid[0])
         {
+            mark_vtlb_dirty(even_page, entry->page_size / 4096);
             for (uint32_t i = 0; i < entry->page_size; i += 4096)
             {
                 int map_index = i / 4096;
@@ -377,6 +433,7 @@ void Cop0::unmap_tlb(TLB_Entry *entry)
 
         if (entry->valid[1])
         {
+            mark_vtlb_dirty(odd_page, entry->page_size / 4096);
             for (uint32_t i = 0; i < entry->page_size; i += 4096)
             {
                 int map_index = i / 4096;
@@ -404,6 +461,7 @@ void Cop0::map_tlb(TLB_Entry *entry)
     {
         if (entry->valid[0])
         {
+            mark_vtlb_dirty(even_virt_page, 4);
             for (uint32_t i = 0; i < 1024 * 16; i += 4096)
             {
                 int map_index = i / 4096;
@@ -418,6 +476,7 @@ void Cop0::map_tlb(TLB_Entry *entry)
     {
         if (entry->valid[0])
         {
+            mark_vtlb_dirty(even_virt_page, entry->page_size / 4096);
             for (uint32_t i = 0; i < entry->page_size; i += 4096)
             {
                 int map_index = i / 4096;
@@ -438,6 +497,7 @@ void Cop0::map_tlb(TLB_Entry *entry)
 
         if (entry->valid[1])
         {
+            mark_vtlb_dirty(odd_virt_page, entry->page_size / 4096);
             for (uint32_t i = 0; i < entry->page_size; i += 4096)
             {
                 int map_index = i / 4096;
@@ -2,6 +2,7 @@
 #define COP0_HPP
 #include <cstdint>
 #include <fstream>
+#include <vector>
 
 enum CACHE_MODE
 {
@@ -68,6 +69,13 @@ struct VTLB_Info
     uint8_t cache_mode;
 };
 
+//Pages of the VTLB changed by TLB writes, which are all init_tlb has to put back on a reset
+struct VTLB_Range
+{
+    uint32_t first_page;
+    uint32_t page_count;
+};
+
 class DMAC;
 
 class Cop0
@@ -84,6 +92,11 @@ class Cop0
 
         VTLB_Info* vtlb_info;
 
+        std::vector<VTLB_Range> vtlb_dirty_ranges;
+        bool vtlb_dirty_overflow;
+
+        void mark_vtlb_dirty(uint32_t first_page, uint32_t page_count);
+        void map_kernel_segments(uint32_t first_page, uint32_t end_page);
         void unmap_tlb(TLB_Entry* entry);
         void map_tlb(TLB_Entry* entry);
 
@@ -118,8 +131,8 @@ class Cop0
 
         void set_tlb(int index);
 
-        void load_state(std::ifstream &state);
-        void save_state(std::ofstream& state);
+        void load_state(std::istream &state);
+        void save_state(std::ostream& state);
 };
 
 inline bool Cop0::is_cached(uint32_t address)
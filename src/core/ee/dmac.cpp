@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include "dmac.hpp"
 
 #include "../emulator.hpp"
@@ -15,14 +16,15 @@ const char* DMAC::CHAN(int index)
 
 DMAC::DMAC(EmotionEngine* cpu, Emulator* e, GraphicsInterface* gif, ImageProcessingUnit* ipu, SubsystemInterface* sif,
            VectorInterface* vif0, VectorInterface* vif1, VectorUnit* vu0, VectorUnit* vu1) :
-    RDRAM(nullptr), scratchpad(nullptr), cpu(cpu), e(e), gif(gif), ipu(ipu), sif(sif), vif0(vif0), vif1(vif1), vu0(vu0), vu1(vu1)
+    RDRAM(nullptr), scratchpad(nullptr), RDRAM_pages(nullptr), cpu(cpu), e(e), gif(gif), ipu(ipu), sif(sif), vif0(vif0), vif1(vif1), vu0(vu0), vu1(vu1)
 {
     apply_dma_funcs();
 }
 
-void DMAC::reset(uint8_t* RDRAM, uint8_t* scratchpad)
+void DMAC::reset(uint8_t* RDRAM, uint8_t* scratchpad, DirtyPageMap* RDRAM_pages)
 {
     this->RDRAM = RDRAM;
+    this->RDRAM_pages = RDRAM_pages;
     this->scratchpad = scratchpad;
     master_disable = 0x1201; //SCPH-39001 requires this value to be set, possibly other BIOSes too
     control.master_enable = false;
@@ -30,9 +32,10 @@ void DMAC::reset(uint8_t* RDRAM, uint8_t* scratchpad)
     PCR = 0;
     STADR = 0;
     cycles_to_run = 0;
+    extra_cost = 0;
 
     active_channel = nullptr;
-    queued_channels.clear();
+    queued_count = 0;
 
     for (int i = 0; i < 15; i++)
     {
@@ -55,9 +58,21 @@ void DMAC::reset(uint8_t* RDRAM, uint8_t* scratchpad)
     channels[VIF1].dma_req = true;
 }
 
+//True if fetch128/store128 would send the address to the scratchpad
+static inline bool maps_to_SPR(uint32_t addr)
+{
+    return (addr & (1 << 31)) || (addr & 0x70000000) == 0x70000000;
+}
+
+//True if fetch128/store128 would send the address to main memory
+static inline bool maps_to_RDRAM(uint32_t addr)
+{
+    return !maps_to_SPR(addr) && !(addr >= 0x11000000 && addr < 0x11010000);
+}
+
 uint128_t DMAC::fetch128(uint32_t addr)
 {
-    if ((addr & (1 << 31)) || (addr & 0x70000000) == 0x70000000)
+    if (maps_to_SPR(addr))
     {
         addr &= 0x3FF0;
         return *(uint128_t*)&scratchpad[addr];
@@ -85,9 +100,30 @@ uint128_t DMAC::fetch128(uint32_t addr)
     }
 }
 
+/**
+ * Resolves a source address the same way fetch128 does, once for a whole burst.
+ * Bursts never cross a 128-byte boundary, so the quads that follow are contiguous in host memory.
+ */
+const uint128_t* DMAC::get_source_ptr(uint32_t addr)
+{
+    if (maps_to_SPR(addr))
+        return (const uint128_t*)&scratchpad[addr & 0x3FF0];
+    else if (addr >= 0x11000000 && addr < 0x11010000)
+    {
+        if (addr < 0x11004000)
+            return (const uint128_t*)&vu0->get_instr_mem()[addr & vu0->get_mem_mask()];
+        if (addr < 0x11008000)
+            return (const uint128_t*)&vu0->get_data_mem()[addr & vu0->get_mem_mask()];
+        if (addr < 0x1100C000)
+            return (const uint128_t*)&vu1->get_instr_mem()[addr & vu1->get_mem_mask()];
+        return (const uint128_t*)&vu1->get_data_mem()[addr & vu1->get_mem_mask()];
+    }
+    return (const uint128_t*)&RDRAM[addr & 0x01FFFFF0];
+}
+
 void DMAC::store128(uint32_t addr, uint128_t data)
 {
-    if ((addr & (1 << 31)) || (addr & 0x70000000) == 0x70000000)
+    if (maps_to_SPR(addr))
     {
         addr &= 0x3FF0;
         *(uint128_t*)&scratchpad[addr] = data;
@@ -115,6 +151,7 @@ void DMAC::store128(uint32_t addr, uint128_t data)
     else
     {
         addr &= 0x01FFFFF0;
+        RDRAM_pages->mark(&RDRAM[addr]);
         *(uint128_t*)&RDRAM[addr] = data;
     }
 }
@@ -130,16 +167,32 @@ void DMAC::run(int cycles)
         while (cycles_to_run > 0)
         {
             DMA_Channel* temp = active_channel;
+            uint32_t old_address = temp->address;
+            uint32_t old_qwc = temp->quadword_count;
+            uint32_t old_tag_address = temp->tag_address;
+
             int qwc_transferred = (this->*active_channel->func)();
-            cycles_to_run -= std::max(qwc_transferred, 1);
+            int cost = std::max(qwc_transferred, 1) + extra_cost;
             if (!temp->is_spr)
-                cycles_to_run -= 12;
+                cost += 12;
+            extra_cost = 0;
+            cycles_to_run -= cost;
 
             if (!active_channel)
             {
                 cycles_to_run = 0;
                 break;
             }
+
+            //The channel kept the bus without moving, so it's waiting on its device. Nothing else runs until this
+            //slice is over, so polling it again would just fail the same way - charge those polls and stop here.
+            if (active_channel == temp && !qwc_transferred && temp->address == old_address &&
+                temp->quadword_count == old_qwc && temp->tag_address == old_tag_address)
+            {
+                if (cycles_to_run > 0)
+                    cycles_to_run -= ((cycles_to_run + cost - 1) / cost) * cost;
+                break;
+            }
         }
     }
 }
@@ -229,13 +282,8 @@ int DMAC::process_VIF0()
     {
         uint32_t max_qwc = 8 - ((channels[VIF0].address >> 4) & 0x7);
         int quads_to_transfer = std::min(channels[VIF0].quadword_count, max_qwc);
-        while (count < quads_to_transfer)
-        {
-            if (!vif0->feed_DMA(fetch128(channels[VIF0].address)))
-                break;
-            advance_source_dma(VIF0);
-            count++;
-        }
+        count = vif0->feed_DMA_burst(get_source_ptr(channels[VIF0].address), quads_to_transfer);
+        advance_source_dma(VIF0, count);
     }
     if (!channels[VIF0].quadword_count)
     {
@@ -271,25 +319,28 @@ int DMAC::process_VIF1()
     {
         uint32_t max_qwc = 8 - ((channels[VIF1].address >> 4) & 0x7);
         int quads_to_transfer = std::min(channels[VIF1].quadword_count, max_qwc);
-        while (count < quads_to_transfer)
+        if (channels[VIF1].control & 0x1)
         {
-            if (channels[VIF1].control & 0x1)
+            //Stall drain: stop at the first quad whose 128-byte window reaches STADR
+            bool stalled = false;
+            if (control.stall_dest_channel == 1 && channels[VIF1].can_stall_drain)
             {
-                if (control.stall_dest_channel == 1 && channels[VIF1].can_stall_drain)
+                uint32_t address = channels[VIF1].address;
+                int allowed = (address + (8 * 16) > STADR) ? 0 : ((STADR - address - (8 * 16)) / 16) + 1;
+                if (allowed < quads_to_transfer)
                 {
-                    if (channels[VIF1].address + (8 * 16) > STADR)
-                    {
-                        active_channel = nullptr;
-                        break;
-                    }
+                    quads_to_transfer = allowed;
+                    stalled = true;
                 }
-
-                if (!vif1->feed_DMA(fetch128(channels[VIF1].address)))
-                    break;
             }
-            advance_source_dma(VIF1);
-            count++;
+
+            count = vif1->feed_DMA_burst(get_source_ptr(channels[VIF1].address), quads_to_transfer);
+            if (stalled && count == quads_to_transfer)
+                active_channel = nullptr;
         }
+        else
+            count = quads_to_transfer;
+        advance_source_dma(VIF1, count);
     }
     if (!channels[VIF1].quadword_count)
     {
@@ -387,24 +438,8 @@ int DMAC::process_GIF()
                 return 0;
             }
         }
-        while (count < quads_to_transfer)
-        {
-            gif->request_PATH(3, false);
-            if (gif->path_active(3) && !gif->fifo_full() && !gif->fifo_draining())
-            {
-                gif->dma_waiting(false);
-                gif->send_PATH3(fetch128(channels[GIF].address));
-                advance_source_dma(GIF);
-                count++;
-                if (gif->path3_done())
-                    break;
-            }
-            else
-            {
-                gif->dma_waiting(true);
-                break;
-            }
-        }
+        count = gif->send_PATH3_burst(get_source_ptr(channels[GIF].address), quads_to_transfer);
+        advance_source_dma(GIF, count);
     }
     //gif->intermittent_check();
     if (!channels[GIF].quadword_count)
@@ -523,14 +558,8 @@ int DMAC::process_IPU_TO()
     {
         uint32_t max_qwc = 8 - ((channels[IPU_TO].address >> 4) & 0x7);
         int quads_to_transfer = std::min(channels[IPU_TO].quadword_count, max_qwc);
-        while (count < quads_to_transfer)
-        {
-            if (!ipu->can_write_FIFO())
-                break;
-            ipu->write_FIFO(fetch128(channels[IPU_TO].address));
-            advance_source_dma(IPU_TO);
-            count++;
-        }
+        count = ipu->write_FIFO_burst(get_source_ptr(channels[IPU_TO].address), quads_to_transfer);
+        advance_source_dma(IPU_TO, count);
     }
     if (!channels[IPU_TO].quadword_count)
     {
@@ -576,7 +605,7 @@ int DMAC::process_SIF0()
             channels[EE_SIF0].quadword_count = DMAtag & 0xFFFF;
             channels[EE_SIF0].address = DMAtag >> 32;
             uint32_t addr = channels[EE_SIF0].address;
-            channels[EE_SIF0].is_spr = (addr & (1 << 31)) || (addr & 0x70000000) == 0x70000000;
+            channels[EE_SIF0].is_spr = maps_to_SPR(addr);
 
             channels[EE_SIF0].tag_id = (DMAtag >> 28) & 0x7;
 
@@ -647,6 +676,28 @@ int DMAC::process_SIF1()
     int count = 0;
     if (channels[EE_SIF1].quadword_count)
     {
+        //Blocks in main memory can go straight to the IOP if it's waiting on data.
+        //The IOP takes a word per IOP cycle (4 bus cycles), so the DMAC is held for as long as that would take,
+        //and the end of the block is left for the next step, once that's been paid for.
+        uint32_t addr = channels[EE_SIF1].address;
+        bool stall_drain = control.stall_dest_channel == 3 && channels[EE_SIF1].can_stall_drain;
+        if (!stall_drain && addr < 0x10000000)
+        {
+            int quads_to_transfer = channels[EE_SIF1].quadword_count;
+            int quads_to_wrap = (0x02000000 - (addr & 0x01FFFFF0)) / 16;
+            if (quads_to_transfer > quads_to_wrap)
+                quads_to_transfer = quads_to_wrap;
+            if (quads_to_transfer > SubsystemInterface::MAX_BULK_QUADS)
+                quads_to_transfer = SubsystemInterface::MAX_BULK_QUADS;
+            count = sif->write_SIF1_bulk(get_source_ptr(addr), quads_to_transfer);
+            if (count)
+            {
+                advance_source_dma(EE_SIF1, count);
+                extra_cost = (count * 16) - count;
+                return count;
+            }
+        }
+
         uint32_t max_qwc = 8 - ((channels[EE_SIF1].address >> 4) & 0x7);
         int quads_to_transfer = std::min(channels[EE_SIF1].quadword_count, max_qwc);
         while (count < quads_to_transfer)
@@ -705,6 +756,42 @@ int DMAC::process_SIF1()
     }*/
 }
 
+/**
+Takes SIF0 data straight from IOP RAM while the channel is in the middle of a block in main memory.
+Tags still come through the FIFO. Returns how many quads were taken.
+The last quad of a block is always left for the FIFO: the IOP only sends it once it's paid for the bulk move,
+so the block can't end on the EE side before the IOP's channel would have got that far.
+**/
+int DMAC::write_SIF0_direct(const uint8_t* data, int quads)
+{
+    DMA_Channel& channel = channels[EE_SIF0];
+    if (!control.master_enable || (master_disable & (1 << 16)) || !channel.started || !channel.quadword_count)
+        return 0;
+
+    if (channel.is_spr || channel.address >= 0x10000000)
+        return 0;
+
+    uint32_t addr = channel.address & 0x01FFFFF0;
+    int count = quads;
+    if (count >= (int)channel.quadword_count)
+        count = channel.quadword_count - 1;
+    if (count > (int)((0x02000000 - addr) / 16))
+        count = (0x02000000 - addr) / 16;
+    if (count <= 0)
+        return 0;
+
+    memcpy(&RDRAM[addr], data, count * 16);
+    RDRAM_pages->mark_range(&RDRAM[addr], count * 16);
+    channel.address += count * 16;
+    channel.quadword_count -= count;
+
+    //Same stall address update advance_dest_dma does for each quad
+    int mode = (channel.control >> 2) & 0x3;
+    if ((mode != 1 || channel.tag_id == 0) && control.stall_source_channel == 1)
+        update_stadr(channel.address);
+    return count;
+}
+
 int DMAC::process_SPR_FROM()
 {
     int count = 0;
@@ -718,6 +805,24 @@ int DMAC::process_SPR_FROM()
             {
                 channels[SPR_FROM].address = RBOR | (channels[SPR_FROM].address & RBSR);
             }
+
+            int run = get_SPR_run_length(SPR_FROM, quads_to_transfer - count);
+            if (run > 1 && maps_to_RDRAM(channels[SPR_FROM].address))
+            {
+                //Copy everything up to the next interleave, scratchpad or MFIFO wrap in one go.
+                //The last quad goes through the normal path below so the per-quad bookkeeping still happens once.
+                run--;
+                uint8_t* dest = &RDRAM[channels[SPR_FROM].address & 0x01FFFFF0];
+                memcpy(dest, &scratchpad[channels[SPR_FROM].scratchpad_address & 0x3FF0], run * 16);
+                RDRAM_pages->mark_range(dest, run * 16);
+                channels[SPR_FROM].scratchpad_address += run * 16;
+                channels[SPR_FROM].address += run * 16;
+                channels[SPR_FROM].quadword_count -= run;
+                if (((channels[SPR_FROM].control >> 2) & 0x3) == 0x2)
+                    channels[SPR_FROM].interleaved_qwc -= run;
+                count += run;
+            }
+
             uint128_t DMAData = fetch128(channels[SPR_FROM].scratchpad_address | (1 << 31));
             store128(channels[SPR_FROM].address, DMAData);
 
@@ -783,6 +888,21 @@ int DMAC::process_SPR_TO()
         int quads_to_transfer = std::min(channels[SPR_TO].quadword_count, max_qwc);
         while (count < quads_to_transfer)
         {
+            int run = get_SPR_run_length(SPR_TO, quads_to_transfer - count);
+            if (run > 1 && !maps_to_SPR(channels[SPR_TO].address))
+            {
+                //Same as SPR_FROM - bulk copy, then let the last quad do the bookkeeping
+                run--;
+                memcpy(&scratchpad[channels[SPR_TO].scratchpad_address & 0x3FF0],
+                       get_source_ptr(channels[SPR_TO].address), run * 16);
+                channels[SPR_TO].scratchpad_address += run * 16;
+                channels[SPR_TO].address += run * 16;
+                channels[SPR_TO].quadword_count -= run;
+                if (((channels[SPR_TO].control >> 2) & 0x3) == 0x2)
+                    channels[SPR_TO].interleaved_qwc -= run;
+                count += run;
+            }
+
             uint128_t DMAData = fetch128(channels[SPR_TO].address);
             store128(channels[SPR_TO].scratchpad_address | (1 << 31), DMAData);
             channels[SPR_TO].scratchpad_address += 16;
@@ -825,12 +945,44 @@ int DMAC::process_SPR_TO()
     return count;
 }
 
-void DMAC::advance_source_dma(int index)
+/**
+How many of the next quads of an SPR transfer are contiguous on both ends: no interleave skip, scratchpad wrap,
+or MFIFO ring wrap in between. The burst itself never crosses a 128-byte boundary in main memory.
+**/
+int DMAC::get_SPR_run_length(int index, int max_quads)
+{
+    DMA_Channel& channel = channels[index];
+    int run = max_quads;
+
+    if (((channel.control >> 2) & 0x3) == 0x2)
+    {
+        if (!channel.interleaved_qwc)
+            return 1;
+        run = std::min(run, (int)channel.interleaved_qwc);
+    }
+
+    run = std::min(run, (int)(0x4000 - (channel.scratchpad_address & 0x3FF0)) / 16);
+
+    if (index == SPR_FROM)
+        run = std::min(run, (int)(0x02000000 - (channel.address & 0x01FFFFF0)) / 16);
+
+    if (index == SPR_FROM && control.mem_drain_channel != 0)
+    {
+        //Only handle rings whose size mask is a contiguous run of low bits
+        uint32_t ring_size = (RBSR | 0xF) + 1;
+        if (ring_size & (ring_size - 1))
+            return 1;
+        run = std::min(run, (int)(ring_size - (channel.address & (ring_size - 1))) / 16);
+    }
+    return run;
+}
+
+void DMAC::advance_source_dma(int index, int quads)
 {
     int mode = (channels[index].control >> 2) & 0x3;
 
-    channels[index].address += 16;
-    channels[index].quadword_count--;
+    channels[index].address += 16 * quads;
+    channels[index].quadword_count -= quads;
 
     if (mode == 1) //Chain
     {
@@ -876,7 +1028,7 @@ void DMAC::handle_source_chain(int index)
 
     uint16_t quadword_count = DMAtag & 0xFFFF;
     uint32_t addr = (DMAtag >> 32) & 0xFFFFFFF0;
-    channels[index].is_spr = (addr & (1 << 31)) || (addr & 0x70000000) == 0x70000000;
+    channels[index].is_spr = maps_to_SPR(addr);
     bool IRQ_after_transfer = DMAtag & (1UL << 31);
     bool TIE = channels[index].control & (1 << 7);
     int PCR_toggle = (DMAtag >> 26) & 0x3;
@@ -1019,7 +1171,7 @@ void DMAC::start_DMA(int index)
             break;
     }
     uint32_t addr = channels[index].address;
-    channels[index].is_spr = (addr & (1 << 31)) || (addr & 0x70000000) == 0x70000000;
+    channels[index].is_spr = maps_to_SPR(addr);
     channels[index].started = true;
 
     if (!active_channel)
@@ -1657,11 +1809,25 @@ void DMAC::check_for_activation(int index)
 
         if (!active_channel)
             active_channel = &channels[index];
-        else
-        {
-            queued_channels.push_back(&channels[index]);
-        }
+        else if (active_channel != &channels[index])
+            queue_channel(&channels[index]);
+    }
+}
+
+void DMAC::queue_channel(DMA_Channel* channel)
+{
+    if (!is_queued(channel))
+        queued_channels[queued_count++] = channel;
+}
+
+bool DMAC::is_queued(DMA_Channel* channel)
+{
+    for (int i = 0; i < queued_count; i++)
+    {
+        if (queued_channels[i] == channel)
+            return true;
     }
+    return false;
 }
 
 void DMAC::deactivate_channel(int index)
@@ -1670,17 +1836,17 @@ void DMAC::deactivate_channel(int index)
     if (active_channel == &channels[index])
     {
         active_channel = nullptr;
-        if (queued_channels.size())
+        if (queued_count)
             find_new_active_channel();
     }
     else
     {
-        for (auto it = queued_channels.begin(); it != queued_channels.end(); it++)
+        for (int i = 0; i < queued_count; i++)
         {
-            DMA_Channel* channel = *it;
-            if (channel == &channels[index])
+            if (queued_channels[i] == &channels[index])
             {
-                queued_channels.erase(it);
+                std::copy(queued_channels + i + 1, queued_channels + queued_count, queued_channels + i);
+                queued_count--;
                 break;
             }
         }
@@ -1690,7 +1856,7 @@ void DMAC::deactivate_channel(int index)
 void DMAC::arbitrate()
 {
     //Only switch to a new channel if something is queued
-    if (queued_channels.size())
+    if (queued_count)
     {
         /*bool is_active = active_channel;
         if (is_active)
@@ -1708,10 +1874,11 @@ void DMAC::find_new_active_channel()
 {
     if (active_channel)
     {
-        queued_channels.push_back(active_channel);
+        queue_channel(active_channel);
         active_channel = nullptr;
     }
 
-    active_channel = queued_channels.front();
-    queued_channels.pop_front();
+    active_channel = queued_channels[0];
+    std::copy(queued_channels + 1, queued_channels + queued_count, queued_channels);
+    queued_count--;
 }
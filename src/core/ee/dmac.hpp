@@ -2,8 +2,8 @@
 #define DMAC_HPP
 #include <cstdint>
 #include <fstream>
-#include <list>
 
+#include "../dirtypages.hpp"
 #include "../int128.hpp"
 
 enum DMAC_CHANNELS
@@ -83,6 +83,7 @@ class DMAC
 {
     private:
         uint8_t* RDRAM, *scratchpad;
+        DirtyPageMap* RDRAM_pages;
         EmotionEngine* cpu;
         Emulator* e;
         GraphicsInterface* gif;
@@ -94,7 +95,10 @@ class DMAC
 
         DMA_Channel* active_channel;
         DMA_Channel* queued_VIF0; //TODO: VIF0 has a higher priority, so it needs its own slot
-        std::list<DMA_Channel*> queued_channels;
+
+        //Round-robin queue of channels waiting for the bus. Each channel appears at most once.
+        DMA_Channel* queued_channels[15];
+        int queued_count;
 
         D_CTRL control;
         D_STAT interrupt_stat;
@@ -105,6 +109,9 @@ class DMAC
         bool mfifo_empty_triggered;
         int cycles_to_run;
 
+        //Bus cycles the last step took beyond its quads, for transfers paced by the IOP instead of the DMAC
+        int extra_cost;
+
         uint32_t master_disable;
 
         void apply_dma_funcs();
@@ -120,13 +127,15 @@ class DMAC
         int process_SPR_TO();
 
         void handle_source_chain(int index);
-        void advance_source_dma(int index);
+        int get_SPR_run_length(int index, int max_quads);
+        void advance_source_dma(int index, int quads = 1);
         void advance_dest_dma(int index);
         bool mfifo_handler(int index);
         void transfer_end(int index);
         void int1_check();
 
         uint128_t fetch128(uint32_t addr);
+        const uint128_t* get_source_ptr(uint32_t addr);
         void store128(uint32_t addr, uint128_t data);
 
         void update_stadr(uint32_t addr);
@@ -134,11 +143,14 @@ class DMAC
         void deactivate_channel(int index);
         void arbitrate();
         void find_new_active_channel();
+        void queue_channel(DMA_Channel* channel);
+        bool is_queued(DMA_Channel* channel);
     public:
         static const char* CHAN(int index);
         DMAC(EmotionEngine* cpu, Emulator* e, GraphicsInterface* gif, ImageProcessingUnit* ipu, SubsystemInterface* sif,
              VectorInterface* vif0, VectorInterface* vif1, VectorUnit* vu0, VectorUnit* vu1);
-        void reset(uint8_t* RDRAM, uint8_t* scratchpad);
+        void reset(uint8_t* RDRAM, uint8_t* scratchpad, DirtyPageMap* RDRAM_pages);
+        bool is_idle();
         void run(int cycles);
         void start_DMA(int index);
 
@@ -154,8 +166,16 @@ class DMAC
         void set_DMA_request(int index);
         void clear_DMA_request(int index);
 
-        void load_state(std::ifstream& state);
-        void save_state(std::ofstream& state);
+        int write_SIF0_direct(const uint8_t* data, int quads);
+
+        void load_state(std::istream& state);
+        void save_state(std::ostream& state);
 };
 
+//Nothing can move until a channel is activated by a DMA request, a start, or an STADR update
+inline bool DMAC::is_idle()
+{
+    return !active_channel;
+}
+
 #endif // DMAC_HPP
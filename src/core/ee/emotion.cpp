@@ -13,8 +13,9 @@
 
 //#define printf(fmt, ...)(0)
 
-EmotionEngine::EmotionEngine(Cop0* cp0, Cop1* fpu, Emulator* e, VectorUnit* vu0, VectorUnit* vu1, EEBreakpointList* ee_breakpoints) :
-    cp0(cp0), fpu(fpu), e(e), vu0(vu0), vu1(vu1), ee_breakpoints(ee_breakpoints)
+EmotionEngine::EmotionEngine(Cop0* cp0, Cop1* fpu, Emulator* e, VectorUnit* vu0, VectorUnit* vu1, EEBreakpointList* ee_breakpoints,
+                             DirtyPageMap* RDRAM_pages) :
+    cp0(cp0), fpu(fpu), e(e), vu0(vu0), vu1(vu1), ee_breakpoints(ee_breakpoints), RDRAM_pages(RDRAM_pages)
 {
 
 }
@@ -426,7 +427,10 @@ void EmotionEngine::write8(uint32_t address, uint8_t value)
 {
     uint8_t* mem = tlb_map[address / 4096];
     if (mem > (uint8_t*)1)
+    {
+        RDRAM_pages->mark(mem);
         mem[address & 4095] = value;
+    }
     else if (mem == (uint8_t*)1)
         e->write8(address & 0x1FFFFFFF, value);
     else
@@ -439,7 +443,10 @@ void EmotionEngine::write16(uint32_t address, uint16_t value)
         Errors::die("[EE] Write16 to invalid address $%08X: $%04X", address, value);
     uint8_t* mem = tlb_map[address / 4096];
     if (mem > (uint8_t*)1)
+    {
+        RDRAM_pages->mark(mem);
         *(uint16_t*)&mem[address & 4095] = value;
+    }
     else if (mem == (uint8_t*)1)
         e->write16(address & 0x1FFFFFFF, value);
     else
@@ -452,7 +459,10 @@ void EmotionEngine::write32(uint32_t address, uint32_t value)
         Errors::die("[EE] Write32 to invalid address $%08X: $%08X", address, value);
     uint8_t* mem = tlb_map[address / 4096];
     if (mem > (uint8_t*)1)
+    {
+        RDRAM_pages->mark(mem);
         *(uint32_t*)&mem[address & 4095] = value;
+    }
     else if (mem == (uint8_t*)1)
         e->write32(address & 0x1FFFFFFF, value);
     else
@@ -465,7 +475,10 @@ void EmotionEngine::write64(uint32_t address, uint64_t value)
         Errors::die("[EE] Write64 to invalid address $%08X: $%08X_%08X", address, value >> 32, value);
     uint8_t* mem = tlb_map[address / 4096];
     if (mem > (uint8_t*)1)
+    {
+        RDRAM_pages->mark(mem);
         *(uint64_t*)&mem[address & 4095] = value;
+    }
     else if (mem == (uint8_t*)1)
         e->write64(address & 0x1FFFFFFF, value);
     else
@@ -476,7 +489,10 @@ void EmotionEngine::write128(uint32_t address, uint128_t value)
 {
     uint8_t* mem = tlb_map[address / 4096];
     if (mem > (uint8_t*)1)
+    {
+        RDRAM_pages->mark(mem);
         *(uint128_t*)&mem[address & 4095] = value;
+    }
     else if (mem == (uint8_t*)1)
         e->write128(address & 0x1FFFFFFF, value);
     else
@@ -586,6 +602,7 @@ void EmotionEngine::cfc(int cop_id, int reg, int cop_reg, uint32_t instruction)
             }
             if (cop_reg == 29)
             {
+                e->sync_vu1();
                 bark = vu0->is_running();
                 bark |= vu1->is_running() << 8;
                 bark |= vu0->stopped_by_tbit() << 2;
@@ -618,7 +635,10 @@ void EmotionEngine::ctc(int cop_id, int reg, int cop_reg, uint32_t instruction)
                 clear_interlock();
             }
             if (cop_reg == 31)
+            {
+                e->sync_vu1();
                 vu1->start_program(bark);
+            }
             else
                 vu0->ctc(cop_reg, bark);
             break;
@@ -1051,6 +1071,7 @@ void EmotionEngine::fpu_bc1(int32_t offset, bool test_true, bool likely)
 void EmotionEngine::cop2_bc2(int32_t offset, bool test_true, bool likely)
 {
     bool passed = false;
+    e->sync_vu1();
     if (test_true)
         passed = vu1->is_running();
     else
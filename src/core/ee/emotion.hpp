@@ -6,6 +6,8 @@
 #include "cop1.hpp"
 #include "emotion_breakpoint.hpp"
 
+#include "../dirtypages.hpp"
+
 #include "../int128.hpp"
 
 class Emulator;
@@ -41,6 +43,7 @@ class EmotionEngine
         EEBreakpointList* ee_breakpoints = nullptr;
 
         uint8_t** tlb_map;
+        DirtyPageMap* RDRAM_pages;
 
         //Each register is 128-bit
         uint8_t gpr[32 * sizeof(uint64_t) * 2];
@@ -62,7 +65,8 @@ class EmotionEngine
         void handle_exception(uint32_t new_addr, uint8_t code);
         void deci2call(uint32_t func, uint32_t param);
     public:
-        EmotionEngine(Cop0* cp0, Cop1* fpu, Emulator* e, VectorUnit* vu0, VectorUnit* vu1, EEBreakpointList* ee_breakpoints);
+        EmotionEngine(Cop0* cp0, Cop1* fpu, Emulator* e, VectorUnit* vu0, VectorUnit* vu1, EEBreakpointList* ee_breakpoints,
+                      DirtyPageMap* RDRAM_pages);
         static const char* REG(int id);
         static const char* COP0_REG(int id);
         static const char* SYSCALL(int id);
@@ -169,8 +173,8 @@ class EmotionEngine
         void cop2_special(EmotionEngine &cpu, uint32_t instruction);
         void cop2_updatevu0();
 
-        void load_state(std::ifstream& state);
-        void save_state(std::ofstream& state);
+        void load_state(std::istream& state);
+        void save_state(std::ostream& state);
 };
 
 template <typename T>
@@ -48,8 +48,8 @@ class INTC
         void assert_IRQ(int id);
         void deassert_IRQ(int id);
 
-        void load_state(std::ifstream& state);
-        void save_state(std::ofstream& state);
+        void load_state(std::istream& state);
+        void save_state(std::ostream& state);
 };
 
 #endif // INTC_HPP
@@ -1,7 +1,8 @@
-#include <cmath>
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <emmintrin.h>
 #include "ipu.hpp"
 #include "../dmac.hpp"
 #include "../intc.hpp"
@@ -99,7 +100,6 @@ void ImageProcessingUnit::reset()
     VDEC_table = nullptr;
     in_FIFO.reset();
     out_FIFO.reset();
-    prepare_IDCT();
 
     ctrl.error_code = false;
     ctrl.start_code = false;
@@ -446,6 +446,9 @@ bool ImageProcessingUnit::process_BDEC()
             case BDEC_STATE::DONE:
             {
                 printf("[IPU] BDEC done!\n");
+                //Wait for the output FIFO to drain enough to take the whole macroblock
+                if (bdec.out_fifo->f.free_space() < 48)
+                    return false;
                 uint128_t quad;
                 for (int i = 0; i < 8; i++)
                 {
@@ -610,67 +613,144 @@ void ImageProcessingUnit::dequantize(int16_t *block)
 //IDCT code here taken from mpeg2decode
 //Copyright (C) 1996, MPEG Software Simulation Group. All Rights Reserved.
 
-#ifndef PI
-#	ifdef M_PI
-#		define PI M_PI
-#	else
-#		define PI 3.14159265358979323846
-#	endif
-#endif
-void ImageProcessingUnit::prepare_IDCT()
+//Chen-Wang integer IDCT, accurate to within one unit of the IEEE 1180 reference.
+//The row pass keeps three extra bits of precision, which the column pass removes.
+#define W1 2841 // 2048*sqrt(2)*cos(1*pi/16)
+#define W2 2676 // 2048*sqrt(2)*cos(2*pi/16)
+#define W3 2408 // 2048*sqrt(2)*cos(3*pi/16)
+#define W5 1609 // 2048*sqrt(2)*cos(5*pi/16)
+#define W6 1108 // 2048*sqrt(2)*cos(6*pi/16)
+#define W7 565  // 2048*sqrt(2)*cos(7*pi/16)
+
+static void IDCT_row(int* blk)
 {
-    int freq, time;
-    double scale;
+    int x0, x1, x2, x3, x4, x5, x6, x7, x8;
 
-    for (freq=0; freq < 8; freq++)
+    //Shortcut for rows that only have a DC term
+    if (!((x1 = blk[4] << 11) | (x2 = blk[6]) | (x3 = blk[2]) |
+          (x4 = blk[1]) | (x5 = blk[7]) | (x6 = blk[5]) | (x7 = blk[3])))
     {
-        scale = (freq == 0) ? sqrt(0.125) : 0.5;
-        for (time=0; time<8; time++)
-        {
-            IDCT_table[freq][time] = scale*cos((PI/8.0)*freq*(time + 0.5));
-        }
+        int dc = blk[0] << 3;
+        for (int i = 0; i < 8; i++)
+            blk[i] = dc;
+        return;
     }
+
+    x0 = (blk[0] << 11) + 128; //For proper rounding in the fourth stage
+
+    //First stage
+    x8 = W7 * (x4 + x5);
+    x4 = x8 + (W1 - W7) * x4;
+    x5 = x8 - (W1 + W7) * x5;
+    x8 = W3 * (x6 + x7);
+    x6 = x8 - (W3 - W5) * x6;
+    x7 = x8 - (W3 + W5) * x7;
+
+    //Second stage
+    x8 = x0 + x1;
+    x0 -= x1;
+    x1 = W6 * (x3 + x2);
+    x2 = x1 - (W2 + W6) * x2;
+    x3 = x1 + (W2 - W6) * x3;
+    x1 = x4 + x6;
+    x4 -= x6;
+    x6 = x5 + x7;
+    x5 -= x7;
+
+    //Third stage
+    x7 = x8 + x3;
+    x8 -= x3;
+    x3 = x0 + x2;
+    x0 -= x2;
+    x2 = (int)((181 * (int64_t)(x4 + x5) + 128) >> 8);
+    x4 = (int)((181 * (int64_t)(x4 - x5) + 128) >> 8);
+
+    //Fourth stage
+    blk[0] = (x7 + x1) >> 8;
+    blk[1] = (x3 + x2) >> 8;
+    blk[2] = (x0 + x4) >> 8;
+    blk[3] = (x8 + x6) >> 8;
+    blk[4] = (x8 - x6) >> 8;
+    blk[5] = (x0 - x4) >> 8;
+    blk[6] = (x3 - x2) >> 8;
+    blk[7] = (x7 - x1) >> 8;
 }
 
-void ImageProcessingUnit::perform_IDCT(const int16_t* pUV, int16_t* pXY)
+static void IDCT_col(int* blk)
 {
-    int i, j, k, v;
-    double partial_product;
-    double tmp[64];
+    int x0, x1, x2, x3, x4, x5, x6, x7, x8;
 
-    for (i=0; i<8; i++)
+    if (!((x1 = blk[8 * 4] << 8) | (x2 = blk[8 * 6]) | (x3 = blk[8 * 2]) |
+          (x4 = blk[8 * 1]) | (x5 = blk[8 * 7]) | (x6 = blk[8 * 5]) | (x7 = blk[8 * 3])))
     {
-        for (j=0; j<8; j++)
-        {
-            partial_product = 0.0;
+        int dc = (blk[0] + 32) >> 6;
+        for (int i = 0; i < 8; i++)
+            blk[8 * i] = dc;
+        return;
+    }
 
-            for (k=0; k<8; k++)
-            {
-                partial_product+= IDCT_table[k][j]*pUV[8*i+k];
-            }
+    x0 = (blk[8 * 0] << 8) + 8192;
+
+    //First stage
+    x8 = W7 * (x4 + x5) + 4;
+    x4 = (x8 + (W1 - W7) * x4) >> 3;
+    x5 = (x8 - (W1 + W7) * x5) >> 3;
+    x8 = W3 * (x6 + x7) + 4;
+    x6 = (x8 - (W3 - W5) * x6) >> 3;
+    x7 = (x8 - (W3 + W5) * x7) >> 3;
+
+    //Second stage
+    x8 = x0 + x1;
+    x0 -= x1;
+    x1 = W6 * (x3 + x2) + 4;
+    x2 = (x1 - (W2 + W6) * x2) >> 3;
+    x3 = (x1 + (W2 - W6) * x3) >> 3;
+    x1 = x4 + x6;
+    x4 -= x6;
+    x6 = x5 + x7;
+    x5 -= x7;
+
+    //Third stage
+    x7 = x8 + x3;
+    x8 -= x3;
+    x3 = x0 + x2;
+    x0 -= x2;
+    x2 = (int)((181 * (int64_t)(x4 + x5) + 128) >> 8);
+    x4 = (int)((181 * (int64_t)(x4 - x5) + 128) >> 8);
+
+    //Fourth stage
+    blk[8 * 0] = (x7 + x1) >> 14;
+    blk[8 * 1] = (x3 + x2) >> 14;
+    blk[8 * 2] = (x0 + x4) >> 14;
+    blk[8 * 3] = (x8 + x6) >> 14;
+    blk[8 * 4] = (x8 - x6) >> 14;
+    blk[8 * 5] = (x0 - x4) >> 14;
+    blk[8 * 6] = (x3 - x2) >> 14;
+    blk[8 * 7] = (x7 - x1) >> 14;
+}
 
-            tmp[8*i+j] = partial_product;
-        }
-    }
+#undef W1
+#undef W2
+#undef W3
+#undef W5
+#undef W6
+#undef W7
 
-  /* Transpose operation is integrated into address mapping by switching
-     loop order of i and j */
+void ImageProcessingUnit::perform_IDCT(const int16_t* pUV, int16_t* pXY)
+{
+    //Dequantized coefficients can be large enough that the intermediate rows overflow 16 bits
+    int temp[64];
+    for (int i = 0; i < 64; i++)
+        temp[i] = pUV[i];
 
-    for (j=0; j<8; j++)
-    {
-        for (i=0; i<8; i++)
-        {
-            partial_product = 0.0;
+    for (int i = 0; i < 8; i++)
+        IDCT_row(temp + (8 * i));
 
-            for (k=0; k<8; k++)
-            {
-                partial_product+= IDCT_table[k][i]*tmp[8*k+j];
-            }
+    for (int i = 0; i < 8; i++)
+        IDCT_col(temp + i);
 
-            v = (int) floor(partial_product+0.5);
-            pXY[8*i+j] = v;
-        }
-    }
+    for (int i = 0; i < 64; i++)
+        pXY[i] = temp[i];
 }
 
 //End IDCT code
@@ -908,75 +988,21 @@ bool ImageProcessingUnit::process_CSC()
                 break;
             case CSC_STATE::CONVERT:
             {
-                uint32_t pixels[0x100];
-
-                uint8_t* lum_block = csc.block;
-                uint8_t* cb_block = csc.block + 0x100;
-                uint8_t* cr_block = csc.block + 0x140;
-
-                uint32_t alpha_thresh0 = (TH0 & 0xFF) | ((TH0 & 0xFF) << 8) | ((TH0 & 0xFF) << 16);
-                uint32_t alpha_thresh1 = (TH1 & 0xFF) | ((TH1 & 0xFF) << 8) | ((TH1 & 0xFF) << 16);
-
-                for (int i = 0; i < 16; i++)
-                {
-                    for (int j = 0; j < 16; j++)
-                    {
-                        int index = j + (i * 16);
-                        float lum = lum_block[index];
-                        float cb = cb_block[crcb_map[index]];
-                        float cr = cr_block[crcb_map[index]];
-
-                        float r = lum + 1.402f * (cr - 128);
-                        float g = lum - 0.34414f * (cb - 128) - 0.71414f * (cr - 128);
-                        float b = lum + 1.772f * (cb - 128);
-
-                        if (r < 0)
-                            r = 0;
-                        if (r > 255)
-                            r = 255;
-                        if (g < 0)
-                            g = 0;
-                        if (g > 255)
-                            g = 255;
-                        if (b < 0)
-                            b = 0;
-                        if (b > 255)
-                            b = 255;
-
-                        uint32_t color = (uint8_t)r;
-                        color |= ((uint8_t)g) << 8;
-                        color |= ((uint8_t)b) << 16;
-
-                        uint32_t alpha;
-                        if (r < (TH0 & 0xFF) && g < ((TH0 >> 8) & 0xFF) && b < ((TH0 >> 16) & 0xFF))
-                            alpha = 0;
-                        else if (r < (TH1 & 0xFF) && g < ((TH1 >> 8) & 0xFF) && b < ((TH1 >> 16) & 0xFF))
-                            alpha = 1 << 30;
-                        else
-                            alpha = 1 << 31;
-
-                        pixels[index] = color | alpha;
-                        //printf("Pixel: $%08X (%d, %d)\n", pixels[index], i, j);
-                    }
-                }
+                if (out_FIFO.f.free_space() < 0x100 / 4)
+                    return false;
+                alignas(16) uint32_t pixels[0x100];
+                convert_macroblock(pixels);
 
                 uint128_t quad;
                 if (csc.use_RGB16)
                 {
                     //We must convert from RGB32 to RGB16.
                     //It's worth noting that bit 30 is the alpha bit for RGB16, not bit 31.
-                    //TODO: Figure out how dithering works. It uses "pixel position"
+                    alignas(16) uint16_t colors[0x100];
+                    pack_RGB16(pixels, colors);
                     for (int i = 0; i < 0x100 / 8; i++)
                     {
-                        for (int j = 0; j < 8; j++)
-                        {
-                            uint32_t color32 = pixels[j + (i * 8)];
-                            uint16_t color16 = (color32 >> 3) & 0x1F;
-                            color16 |= ((color32 >> 11) & 0x1F) << 5;
-                            color16 |= ((color32 >> 19) & 0x1F) << 10;
-                            color16 |= ((color32 >> 30) & 0x1) << 15;
-                            quad._u16[j] = color16;
-                        }
+                        memcpy(&quad, &colors[i * 8], sizeof(quad));
                         out_FIFO.f.push(quad);
                     }
                 }
@@ -984,10 +1010,7 @@ bool ImageProcessingUnit::process_CSC()
                 {
                     for (int i = 0; i < 0x100 / 4; i++)
                     {
-                        for (int j = 0; j < 4; j++)
-                        {
-                            quad._u32[j] = pixels[j + (i * 4)];
-                        }
+                        memcpy(&quad, &pixels[i * 4], sizeof(quad));
                         out_FIFO.f.push(quad);
                     }
                 }
@@ -1003,6 +1026,119 @@ bool ImageProcessingUnit::process_CSC()
     }
 }
 
+/**
+Converts the YCbCr macroblock in csc.block to RGBA32, four pixels at a time.
+The arithmetic is done in single precision in the same order as the old per-pixel code,
+so the output is bit-for-bit the same.
+**/
+void ImageProcessingUnit::convert_macroblock(uint32_t* pixels)
+{
+    const uint8_t* lum_block = csc.block;
+    const uint8_t* cb_block = csc.block + 0x100;
+    const uint8_t* cr_block = csc.block + 0x140;
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 max = _mm_set1_ps(255.0f);
+    const __m128 bias = _mm_set1_ps(128.0f);
+
+    const __m128 th0_r = _mm_set1_ps((float)(TH0 & 0xFF));
+    const __m128 th0_g = _mm_set1_ps((float)((TH0 >> 8) & 0xFF));
+    const __m128 th0_b = _mm_set1_ps((float)((TH0 >> 16) & 0xFF));
+    const __m128 th1_r = _mm_set1_ps((float)(TH1 & 0xFF));
+    const __m128 th1_g = _mm_set1_ps((float)((TH1 >> 8) & 0xFF));
+    const __m128 th1_b = _mm_set1_ps((float)((TH1 >> 16) & 0xFF));
+    const __m128i half_alpha = _mm_set1_epi32(1 << 30);
+    const __m128i full_alpha = _mm_set1_epi32(1 << 31);
+
+    for (int index = 0; index < 0x100; index += 4)
+    {
+        uint32_t lum_data;
+        memcpy(&lum_data, &lum_block[index], sizeof(lum_data));
+        __m128i lum_i = _mm_unpacklo_epi8(_mm_cvtsi32_si128(lum_data), _mm_setzero_si128());
+        __m128 lum = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lum_i, _mm_setzero_si128()));
+
+        //Each chroma sample covers two horizontally adjacent pixels
+        float cb0 = cb_block[crcb_map[index]], cb1 = cb_block[crcb_map[index + 2]];
+        float cr0 = cr_block[crcb_map[index]], cr1 = cr_block[crcb_map[index + 2]];
+        __m128 cb = _mm_sub_ps(_mm_setr_ps(cb0, cb0, cb1, cb1), bias);
+        __m128 cr = _mm_sub_ps(_mm_setr_ps(cr0, cr0, cr1, cr1), bias);
+
+        __m128 r = _mm_add_ps(lum, _mm_mul_ps(_mm_set1_ps(1.402f), cr));
+        __m128 g = _mm_sub_ps(_mm_sub_ps(lum, _mm_mul_ps(_mm_set1_ps(0.34414f), cb)),
+                              _mm_mul_ps(_mm_set1_ps(0.71414f), cr));
+        __m128 b = _mm_add_ps(lum, _mm_mul_ps(_mm_set1_ps(1.772f), cb));
+
+        r = _mm_min_ps(_mm_max_ps(r, zero), max);
+        g = _mm_min_ps(_mm_max_ps(g, zero), max);
+        b = _mm_min_ps(_mm_max_ps(b, zero), max);
+
+        __m128i color = _mm_cvttps_epi32(r);
+        color = _mm_or_si128(color, _mm_slli_epi32(_mm_cvttps_epi32(g), 8));
+        color = _mm_or_si128(color, _mm_slli_epi32(_mm_cvttps_epi32(b), 16));
+
+        //Alpha is 0 below TH0, half below TH1, and full otherwise
+        __m128 below_th0 = _mm_and_ps(_mm_and_ps(_mm_cmplt_ps(r, th0_r), _mm_cmplt_ps(g, th0_g)),
+                                      _mm_cmplt_ps(b, th0_b));
+        __m128 below_th1 = _mm_and_ps(_mm_and_ps(_mm_cmplt_ps(r, th1_r), _mm_cmplt_ps(g, th1_g)),
+                                      _mm_cmplt_ps(b, th1_b));
+        __m128i th1_mask = _mm_castps_si128(below_th1);
+        __m128i alpha = _mm_or_si128(_mm_and_si128(th1_mask, half_alpha), _mm_andnot_si128(th1_mask, full_alpha));
+        alpha = _mm_andnot_si128(_mm_castps_si128(below_th0), alpha);
+
+        _mm_store_si128((__m128i*)&pixels[index], _mm_or_si128(color, alpha));
+    }
+}
+
+/**
+Packs RGBA32 pixels down to RGBA5551, eight at a time.
+With dithering enabled, each pixel is offset by its entry in the 4x4 dither matrix before truncation.
+The matrix is in half steps, so the colour is doubled to keep that extra bit of precision.
+**/
+void ImageProcessingUnit::pack_RGB16(const uint32_t* pixels, uint16_t* colors)
+{
+    const __m128i channel_mask = _mm_set1_epi32(0xFF);
+    const __m128i max = _mm_set1_epi16(0x1FF);
+
+    for (int index = 0; index < 0x100; index += 8)
+    {
+        __m128i lo = _mm_load_si128((const __m128i*)&pixels[index]);
+        __m128i hi = _mm_load_si128((const __m128i*)&pixels[index + 4]);
+
+        //Split each channel into its own set of eight 16-bit lanes
+        __m128i r = _mm_packs_epi32(_mm_and_si128(lo, channel_mask), _mm_and_si128(hi, channel_mask));
+        __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), channel_mask),
+                                    _mm_and_si128(_mm_srli_epi32(hi, 8), channel_mask));
+        __m128i b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), channel_mask),
+                                    _mm_and_si128(_mm_srli_epi32(hi, 16), channel_mask));
+        __m128i a = _mm_packs_epi32(_mm_srli_epi32(_mm_slli_epi32(lo, 1), 31),
+                                    _mm_srli_epi32(_mm_slli_epi32(hi, 1), 31));
+
+        int shift = 3;
+        if (csc.use_dithering)
+        {
+            //Rows are 16 pixels wide, so eight pixels never straddle two rows
+            const int8_t* row = dither_mtx[(index / 16) & 0x3];
+            __m128i dither = _mm_setr_epi16(row[0], row[1], row[2], row[3], row[0], row[1], row[2], row[3]);
+
+            r = _mm_add_epi16(_mm_slli_epi16(r, 1), dither);
+            g = _mm_add_epi16(_mm_slli_epi16(g, 1), dither);
+            b = _mm_add_epi16(_mm_slli_epi16(b, 1), dither);
+
+            r = _mm_min_epi16(_mm_max_epi16(r, _mm_setzero_si128()), max);
+            g = _mm_min_epi16(_mm_max_epi16(g, _mm_setzero_si128()), max);
+            b = _mm_min_epi16(_mm_max_epi16(b, _mm_setzero_si128()), max);
+            shift = 4;
+        }
+
+        __m128i color = _mm_srli_epi16(r, shift);
+        color = _mm_or_si128(color, _mm_slli_epi16(_mm_srli_epi16(g, shift), 5));
+        color = _mm_or_si128(color, _mm_slli_epi16(_mm_srli_epi16(b, shift), 10));
+        color = _mm_or_si128(color, _mm_slli_epi16(a, 15));
+
+        _mm_store_si128((__m128i*)&colors[index], color);
+    }
+}
+
 uint64_t ImageProcessingUnit::read_command()
 {
     uint64_t reg = 0;
@@ -1084,6 +1220,7 @@ void ImageProcessingUnit::write_command(uint32_t value)
                 idec.qsc = (command_option >> 16) & 0x1F;
                 idec.decodes_dct = command_option & (1 << 24);
                 idec.blocks_decoded = 0;
+                csc.use_dithering = command_option & (1 << 26);
                 csc.use_RGB16 = command_option & (1 << 27);
                 break;
             case 0x02:
@@ -1120,6 +1257,7 @@ void ImageProcessingUnit::write_command(uint32_t value)
                 printf("[IPU] CSC\n");
                 csc.state = CSC_STATE::BEGIN;
                 csc.macroblocks = command_option & 0x7FF;
+                csc.use_dithering = command_option & (1 << 26);
                 csc.use_RGB16 = command_option & (1 << 27);
                 break;
             case 0x09:
@@ -1174,6 +1312,19 @@ uint128_t ImageProcessingUnit::read_FIFO()
     return quad;
 }
 
+//Takes as many of the quads as fit in the input FIFO and returns how many that was
+int ImageProcessingUnit::write_FIFO_burst(const uint128_t* quads, int count)
+{
+    int accepted = std::min(count, 8 - (int)in_FIFO.f.size());
+    if (accepted <= 0)
+        return 0;
+
+    dmac->clear_DMA_request(IPU_TO);
+    in_FIFO.f.push_bulk(quads, accepted);
+    in_FIFO.bit_cache_dirty = true;
+    return accepted;
+}
+
 void ImageProcessingUnit::write_FIFO(uint128_t quad)
 {
     printf("[IPU] Write FIFO: $%08X_%08X_%08X_%08X\n", quad._u32[3], quad._u32[2], quad._u32[1], quad._u32[0]);
@@ -133,6 +133,7 @@ struct CSC_Command
     CSC_STATE state;
     int macroblocks;
     bool use_RGB16;
+    bool use_dithering;
 
     uint8_t block[BLOCK_SIZE];
     int block_index;
@@ -186,8 +187,6 @@ class ImageProcessingUnit
         VDEC_STATE vdec_state, fdec_state;
         CSC_Command csc;
 
-        double IDCT_table[8][8];
-
         void finish_command();
 
         bool process_IDEC();
@@ -195,7 +194,6 @@ class ImageProcessingUnit
         bool process_BDEC();
         void inverse_scan(int16_t* block);
         void dequantize(int16_t* block);
-        void prepare_IDCT();
         void perform_IDCT(const int16_t* pUV, int16_t* pXY);
         bool BDEC_read_coeffs();
         bool BDEC_read_diff();
@@ -203,6 +201,10 @@ class ImageProcessingUnit
         void process_VDEC();
         void process_FDEC();
         bool process_CSC();
+        void convert_macroblock(uint32_t* pixels);
+        void pack_RGB16(const uint32_t* pixels, uint16_t* colors);
+
+        friend class CoreBench;
     public:
         ImageProcessingUnit(INTC* intc, DMAC* dmac);
 
@@ -221,6 +223,7 @@ class ImageProcessingUnit
         bool can_write_FIFO();
         uint128_t read_FIFO();
         void write_FIFO(uint128_t quad);
+        int write_FIFO_burst(const uint128_t* quads, int count);
 };
 
 #endif // IPU_HPP
@@ -3,43 +3,30 @@
 #include "ipu_fifo.hpp"
 #include "../../errors.hpp"
 
+//MPEG is big-endian...
+static inline uint32_t swap_bytes(uint32_t value)
+{
+    return (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+}
+
 bool IPU_FIFO::get_bits(uint32_t &data, int bits)
 {
-    int bits_available = (f.size() * 128) - bit_pointer;
+    int bits_left = bits_available();
 
-    if (bits_available < bits || bits_available == 0)
+    if (bits_left < bits || bits_left == 0)
     {
         data = 0;
         return false;
     }
 
-    if (bit_cache_dirty)
+    int offset = bit_pointer - cache_start;
+    if (bit_cache_dirty || offset + bits > cache_size)
     {
-        std::queue<uint128_t> temp_fifo = f;
-        uint8_t temp[32];
-        *(uint128_t*)&temp[0] = temp_fifo.front();
-        if (temp_fifo.size() > 1)
-        {
-            temp_fifo.pop();
-            *(uint128_t*)&temp[16] = temp_fifo.front();
-        }
-
-        uint8_t blorp[8];
-        int index = (bit_pointer & ~0x1F) / 8;
-
-        //MPEG is big-endian...
-        for (int i = 0; i < 8; i++)
-        {
-            int fifo_index = index + i;
-            blorp[7 - i] = temp[fifo_index];
-        }
-        bit_cache_dirty = false;
-        cached_bits = *(uint64_t*)&blorp[0];
+        refill_cache();
+        offset = bit_pointer - cache_start;
     }
-    int shift = 64 - (bit_pointer % 32) - bits;
-    uint64_t mask = ~0x0ULL >> (64 - bits);
-    data = (cached_bits >> shift) & mask;
 
+    data = (cached_bits << offset) >> (64 - bits);
     return true;
 }
 
@@ -56,9 +43,6 @@ bool IPU_FIFO::advance_stream(uint8_t amount)
         return false;
     }
 
-    uint32_t old_words = bit_pointer / 32;
-    uint32_t new_words = (bit_pointer + amount) / 32;
-    bit_cache_dirty |= (old_words != new_words);
     bit_pointer += amount;
 
     while (bit_pointer >= 128)
@@ -70,11 +54,35 @@ bool IPU_FIFO::advance_stream(uint8_t amount)
     return true;
 }
 
+/**
+Loads the two 32-bit words at the bit pointer, which covers any read of up to 32 bits.
+If the second word is in a quad that hasn't arrived yet, only the first is valid until the next write marks the cache dirty.
+**/
+void IPU_FIFO::refill_cache()
+{
+    int word = bit_pointer / 32;
+    const uint128_t& front = f.peek(0);
+
+    uint32_t next = 0;
+    cache_size = 64;
+    if (word < 3)
+        next = front._u32[word + 1];
+    else if (f.size() > 1)
+        next = f.peek(1)._u32[0];
+    else
+        cache_size = 32;
+
+    cached_bits = ((uint64_t)swap_bytes(front._u32[word]) << 32) | swap_bytes(next);
+    cache_start = word * 32;
+    bit_cache_dirty = false;
+}
+
 void IPU_FIFO::reset()
 {
-    std::queue<uint128_t> empty;
-    f.swap(empty);
+    f.clear();
     bit_pointer = 0;
     cached_bits = 0;
+    cache_start = 0;
+    cache_size = 0;
     bit_cache_dirty = true;
 }
@@ -1,19 +1,27 @@
 #ifndef IPU_FIFO_HPP
 #define IPU_FIFO_HPP
 #include <cstdint>
-#include <queue>
 
 #include "../../int128.hpp"
+#include "../../ringbuffer.hpp"
 
 struct IPU_FIFO
 {
-    std::queue<uint128_t> f;
+    //The real input/output FIFOs are 8 quads, but the output side needs room for a whole converted macroblock
+    constexpr static int CAPACITY = 128;
+    RingBuffer<uint128_t, CAPACITY> f;
     int bit_pointer;
+
+    //Up to 64 bits of the stream in MPEG (big-endian) order, starting at the 32-bit word cache_start in the front quad
     uint64_t cached_bits;
+    int cache_start, cache_size;
     bool bit_cache_dirty;
+
+    int bits_available() const { return (f.size() * 128) - bit_pointer; }
     bool get_bits(uint32_t& data, int bits);
     bool advance_stream(uint8_t amount);
 
+    void refill_cache();
     void reset();
 };
 
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstdlib>
 #include <cstdio>
 #include "vlc_table.hpp"
@@ -6,31 +7,90 @@
 VLC_Table::VLC_Table(VLC_Entry* table, int table_size, int max_bits) :
     table(table), table_size(table_size), max_bits(max_bits)
 {
-
+    build_lookup();
 }
 
-bool VLC_Table::peek_symbol(IPU_FIFO &FIFO, VLC_Entry &entry)
+/**
+Expands the code list into direct lookup tables.
+Codes are inserted shortest first, and a slot that's already taken is never overwritten,
+so a lookup always finds the same entry a bit-by-bit search of the list would.
+**/
+void VLC_Table::build_lookup()
 {
-    uint32_t key;
-    for (int i = 0; i < max_bits; i++)
+    primary_bits = (max_bits < PRIMARY_BITS) ? max_bits : PRIMARY_BITS;
+    int sub_bits = max_bits - primary_bits;
+
+    lookup.assign(1 << primary_bits, {0, LOOKUP_INVALID});
+
+    for (int bits = 1; bits <= max_bits; bits++)
     {
-        int bits = i + 1;
-        if (!FIFO.get_bits(key, bits))
-            return false;
-        for (int j = 0; j < table_size; j++)
+        for (int i = 0; i < table_size; i++)
         {
-            if (bits != table[j].bits)
+            if (table[i].bits != bits)
+                continue;
+
+            uint32_t key = table[i].key;
+            if (bits <= primary_bits)
+            {
+                int shift = primary_bits - bits;
+                for (uint32_t j = 0; j < (1U << shift); j++)
+                {
+                    VLC_Lookup& slot = lookup[(key << shift) | j];
+                    if (slot.bits == LOOKUP_INVALID)
+                        slot = {(uint16_t)i, (uint8_t)bits};
+                }
+                continue;
+            }
+
+            int prefix = key >> (bits - primary_bits);
+            if (lookup[prefix].bits == LOOKUP_INVALID)
+            {
+                lookup[prefix] = {(uint16_t)lookup.size(), LOOKUP_SUBTABLE};
+                lookup.resize(lookup.size() + (1 << sub_bits), {0, LOOKUP_INVALID});
+            }
+
+            //A shorter code already claims this prefix
+            if (lookup[prefix].bits != LOOKUP_SUBTABLE)
                 continue;
 
-            if (key == table[j].key)
+            int base = lookup[prefix].index;
+            int shift = max_bits - bits;
+            uint32_t suffix = key & ((1 << (bits - primary_bits)) - 1);
+            for (uint32_t j = 0; j < (1U << shift); j++)
             {
-                entry = table[j];
-                return true;
+                VLC_Lookup& slot = lookup[base + ((suffix << shift) | j)];
+                if (slot.bits == LOOKUP_INVALID)
+                    slot = {(uint16_t)i, (uint8_t)bits};
             }
         }
     }
-    throw VLC_Error("VLC symbol not found");
-    return false;
+
+    if (lookup.size() > 0xFFFF)
+        Errors::die("[IPU] VLC lookup table too large (%d entries)\n", (int)lookup.size());
+}
+
+bool VLC_Table::peek_symbol(IPU_FIFO &FIFO, VLC_Entry &entry)
+{
+    //Near the end of the FIFO, decode from whatever is there. A code that runs past the end means we need more data.
+    int bits = std::min(max_bits, FIFO.bits_available());
+    uint32_t key;
+    if (!FIFO.get_bits(key, bits))
+        return false;
+    key <<= max_bits - bits;
+
+    const VLC_Lookup* slot = &lookup[key >> (max_bits - primary_bits)];
+    if (slot->bits == LOOKUP_SUBTABLE)
+        slot = &lookup[slot->index + (key & ((1 << (max_bits - primary_bits)) - 1))];
+
+    if (slot->bits == LOOKUP_INVALID || slot->bits > bits)
+    {
+        if (bits < max_bits)
+            return false;
+        throw VLC_Error("VLC symbol not found");
+    }
+
+    entry = table[slot->index];
+    return true;
 }
 
 bool VLC_Table::get_symbol(IPU_FIFO& FIFO, uint32_t &result)
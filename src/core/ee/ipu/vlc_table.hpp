@@ -2,7 +2,7 @@
 #define VLC_TABLE_HPP
 #include <stdexcept>
 #include <cstdint>
-#include <queue>
+#include <vector>
 #include "ipu_fifo.hpp"
 
 struct VLC_Entry
@@ -17,11 +17,28 @@ class VLC_Error : public std::runtime_error
     using std::runtime_error::runtime_error;
 };
 
+//A slot in the decode table: either a code (an index into the VLC_Entry table) or a link to a second-level table
+struct VLC_Lookup
+{
+    uint16_t index;
+    uint8_t bits;
+};
+
 class VLC_Table
 {
     private:
         VLC_Entry* table;
         int table_size, max_bits;
+
+        //Symbols are decoded by indexing with the first primary_bits of the stream.
+        //Longer codes go through a second-level table indexed by the remaining max_bits - primary_bits.
+        constexpr static int PRIMARY_BITS = 9;
+        constexpr static uint8_t LOOKUP_INVALID = 0;
+        constexpr static uint8_t LOOKUP_SUBTABLE = 0xFF;
+        int primary_bits;
+        std::vector<VLC_Lookup> lookup;
+
+        void build_lookup();
     protected:
         VLC_Table(VLC_Entry* table, int table_size, int max_bits);
     public:
@@ -60,8 +60,8 @@ class EmotionTiming
         uint32_t read32(uint32_t addr);
         void write32(uint32_t addr, uint32_t value);
 
-        void load_state(std::ifstream& state);
-        void save_state(std::ofstream& state);
+        void load_state(std::istream& state);
+        void save_state(std::ostream& state);
 };
 
 #endif // TIMERS_HPP
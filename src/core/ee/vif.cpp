@@ -17,11 +17,11 @@ VectorInterface::VectorInterface(GraphicsInterface* gif, VectorUnit* vu, INTC* i
 
 void VectorInterface::reset()
 {
-    std::queue<uint32_t> empty;
-    FIFO.swap(empty);
+    FIFO.clear();
     command = 0;
     command_len = 0;
     buffer_size = 0;
+    unpack_kernel = nullptr;
     DBF = false;
     MODE = 0;
     MASK = 0;
@@ -81,15 +81,11 @@ void VectorInterface::update(int cycles)
     //This allows us to process one quadword per bus cycle
     if (fifo_reverse)
     {
-        if (FIFO.size() <= 60)
+        uint128_t fifo_data;
+        while (cycles-- && FIFO.size() <= 60)
         {
-            uint128_t fifo_data;
-            while (cycles--)
-            {
-                fifo_data = gif->read_GSFIFO();
-                for (int i = 0; i < 4; i++)
-                    FIFO.push(fifo_data._u32[i]);
-            }
+            fifo_data = gif->read_GSFIFO();
+            FIFO.push_bulk(fifo_data._u32, 4);
         }
         return;
     }
@@ -131,6 +127,17 @@ void VectorInterface::update(int cycles)
         if(check_vif_stall(CODE) || !FIFO.size())
             return;
 
+        //Hand whole groups of UNPACK data to the kernel instead of going a word at a time
+        if (unpack_kernel && (command & 0x60) == 0x60 && !buffer_size && !unpack.offset)
+        {
+            int words = fast_UNPACK(run_cycles + 1);
+            if (words)
+            {
+                run_cycles -= words - 1;
+                continue;
+            }
+        }
+
         uint32_t value = FIFO.front();
 
         //If process_data_word returns false, this means the word was not processed, so don't pop the FIFO.
@@ -451,10 +458,62 @@ void VectorInterface::init_UNPACK(uint32_t value)
     data_read /= 32;
 
     command_len += data_read;
+    select_UNPACK_kernel();
 
     //printf("[VIF] UNPACK V%d-%d addr: %x num: %d masked: %d word per op: %d command_len = %d\n", (vn + 1), (32 >> vl), unpack.addr, unpack.num, unpack.masked, unpack.words_per_op, command_len);
 }
 
+void VectorInterface::select_UNPACK_kernel()
+{
+    //Filling writes are left to handle_UNPACK
+    if ((command & 0x60) != 0x60 || !CYCLE.WL || CYCLE.CL < CYCLE.WL)
+        unpack_kernel = nullptr;
+    else
+        unpack_kernel = VIF_Unpack::get_kernel(unpack.cmd, unpack.sign_extend, unpack.masked, MODE);
+}
+
+/**
+ * Expands as many whole groups of words (e.g. one word of S-16 is two vectors) as are in the FIFO straight
+ * into VU memory. Partial words, the V3 formats, and filling writes go through handle_UNPACK.
+ * Returns the number of words consumed.
+ */
+int VectorInterface::fast_UNPACK(int max_words)
+{
+    VIF_UnpackFormat format = VIF_Unpack::get_format(unpack.cmd);
+
+    uint32_t data[64];
+    int words = std::min(std::min((int)FIFO.size(), max_words), std::min(command_len, 64));
+    int groups = std::min(words / format.words_per_group, unpack.num / format.ops_per_group);
+    if (!groups)
+        return 0;
+
+    words = groups * format.words_per_group;
+    FIFO.pop_bulk(data, words);
+
+    VIF_UnpackJob job;
+    job.mem = vu->get_data_mem();
+    job.mem_mask = (mem_mask << 4) | 0xF;
+    job.addr = unpack.addr;
+    job.blocks_written = unpack.blocks_written;
+    job.CL = CYCLE.CL;
+    job.WL = CYCLE.WL;
+    job.mask = MASK;
+    job.row = ROW;
+    job.col = COL;
+    unpack_kernel(job, data, groups);
+
+    unpack.addr = job.addr;
+    unpack.blocks_written = job.blocks_written;
+    unpack.num -= groups * format.ops_per_group;
+    command_len -= words;
+    if (unpack.num == 0)
+        command = 0;
+
+    if (FIFO.size() <= 32)
+        dmac->set_DMA_request(id);
+    return words;
+}
+
 void VectorInterface::handle_UNPACK_masking(uint128_t& quad)
 {
     if (unpack.masked || is_filling_write())
@@ -864,8 +923,7 @@ bool VectorInterface::transfer_DMAtag(uint128_t tag)
         return false;
     }
     printf("[VIF] Transfer tag: $%08X_%08X_%08X_%08X\n", tag._u32[3], tag._u32[2], tag._u32[1], tag._u32[0]);
-    for (int i = 2; i < 4; i++)
-        FIFO.push(tag._u32[i]);
+    FIFO.push_bulk(&tag._u32[2], 2);
     return true;
 }
 
@@ -877,22 +935,32 @@ bool VectorInterface::feed_DMA(uint128_t quad)
         return false;
     }
     printf("[VIF] Feed DMA: $%08X_%08X_%08X_%08X\n", quad._u32[3], quad._u32[2], quad._u32[1], quad._u32[0]);
-    for (int i = 0; i < 4; i++)
-        FIFO.push(quad._u32[i]);
+    FIFO.push_bulk(quad._u32, 4);
     return true;
 }
 
+//Takes as many of the quads as fit in the FIFO and returns how many that was
+int VectorInterface::feed_DMA_burst(const uint128_t* quads, int count)
+{
+    int accepted = 0;
+    while (accepted < count && FIFO.size() <= 60)
+    {
+        FIFO.push_bulk(quads[accepted]._u32, 4);
+        accepted++;
+    }
+
+    if (accepted < count)
+        dmac->clear_DMA_request(id);
+    return accepted;
+}
+
 uint128_t VectorInterface::readFIFO()
 {
     uint128_t quad;
     if (FIFO.empty())
         return gif->read_GSFIFO();
 
-    for (int i = 0; i < 4; i++)
-    {
-        quad._u32[i] = FIFO.front();
-        FIFO.pop();
-    }
+    FIFO.pop_bulk(quad._u32, 4);
     return quad;
 }
 
@@ -952,8 +1020,7 @@ void VectorInterface::set_stat(uint32_t value)
 {
     if ((!fifo_reverse && ((value >> 23) & 0x1)) || (fifo_reverse && !((value >> 23) & 0x1)))
     {
-        while (!FIFO.empty())
-            FIFO.pop();
+        FIFO.clear();
     }
     fifo_reverse = (value >> 23) & 0x1;
 }
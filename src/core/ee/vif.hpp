@@ -1,14 +1,15 @@
 #ifndef VIF_HPP
 #define VIF_HPP
 #include <cstdint>
-#include <queue>
 #include <fstream>
 #include <unordered_set>
 
 #include "intc.hpp"
+#include "vif_unpack.hpp"
 #include "vu.hpp"
 
 #include "../int128.hpp"
+#include "../ringbuffer.hpp"
 
 class GraphicsInterface;
 class DMAC;
@@ -53,13 +54,14 @@ class VectorInterface
         VectorUnit* vu;
         INTC* intc;
         DMAC* dmac;
-        std::queue<uint32_t> FIFO;
+        RingBuffer<uint32_t, 64> FIFO;
         int id;
         uint16_t imm;
         uint8_t command;
 
         MPG_Command mpg;
         UNPACK_Command unpack;
+        VIF_UnpackKernel unpack_kernel; //Not saved: depends on state that is, so it's chosen again on load
 
         bool vif_ibit_detected;
         uint8_t vif_stalled;
@@ -96,6 +98,8 @@ class VectorInterface
         void handle_wait_cmd(uint32_t value);
         void MSCAL(uint32_t addr);
         void init_UNPACK(uint32_t value);
+        void select_UNPACK_kernel();
+        int fast_UNPACK(int max_words);
         bool is_filling_write();
         void handle_UNPACK(uint32_t value);
         void handle_UNPACK_masking(uint128_t& quad);
@@ -103,6 +107,8 @@ class VectorInterface
         void process_UNPACK_quad(uint128_t& quad);
 
         bool process_data_word(uint32_t value);
+
+        friend class CoreBench;
     public:
         VectorInterface(GraphicsInterface* gif, VectorUnit* vu, INTC* intc, DMAC* dmac, int id);
         int get_id();
@@ -112,6 +118,7 @@ class VectorInterface
 
         bool transfer_DMAtag(uint128_t tag);
         bool feed_DMA(uint128_t quad);
+        int feed_DMA_burst(const uint128_t* quads, int count);
         uint128_t readFIFO();
 
         uint32_t get_stat();
@@ -127,8 +134,8 @@ class VectorInterface
         void set_err(uint32_t value);
         void set_fbrst(uint32_t value);
 
-        void load_state(std::ifstream& state);
-        void save_state(std::ofstream& state);
+        void load_state(std::istream& state);
+        void save_state(std::ostream& state);
 };
 
 inline int VectorInterface::get_id()
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <emmintrin.h>
+#include "vif_unpack.hpp"
+
+namespace VIF_Unpack
+{
+
+static constexpr int words_per_group(int cmd)
+{
+    return (cmd == 0xC) ? 4 : ((cmd == 0x4 || cmd == 0xD) ? 2 : 1);
+}
+
+static constexpr int ops_per_group(int cmd)
+{
+    return (cmd == 0x2) ? 4 : ((cmd == 0x1 || cmd == 0x6 || cmd == 0xF) ? 2 : 1);
+}
+
+//Widens the low four 16-bit lanes to 32 bits
+template <bool SIGNED>
+static inline __m128i expand16(__m128i value)
+{
+    if (SIGNED)
+        return _mm_srai_epi32(_mm_unpacklo_epi16(value, value), 16);
+    return _mm_unpacklo_epi16(value, _mm_setzero_si128());
+}
+
+//Widens the low four 8-bit lanes to 32 bits
+template <bool SIGNED>
+static inline __m128i expand8(__m128i value)
+{
+    if (SIGNED)
+    {
+        value = _mm_unpacklo_epi8(value, value);
+        return _mm_srai_epi32(_mm_unpacklo_epi16(value, value), 24);
+    }
+    value = _mm_unpacklo_epi8(value, _mm_setzero_si128());
+    return _mm_unpacklo_epi16(value, _mm_setzero_si128());
+}
+
+template <bool SIGNED>
+static inline uint32_t extend16(uint16_t value)
+{
+    return SIGNED ? (uint32_t)(int32_t)(int16_t)value : value;
+}
+
+template <bool SIGNED>
+static inline uint32_t extend8(uint8_t value)
+{
+    return SIGNED ? (uint32_t)(int32_t)(int8_t)value : value;
+}
+
+//Decodes the op'th vector of a group. Matches the per-format cases in VectorInterface::handle_UNPACK.
+template <int CMD, bool SIGNED>
+static inline __m128i decode(const uint32_t* src, int op)
+{
+    switch (CMD)
+    {
+        case 0x0:
+            //S-32
+            return _mm_set1_epi32(src[0]);
+        case 0x1:
+            //S-16
+            return _mm_set1_epi32(extend16<SIGNED>(src[0] >> (op * 16)));
+        case 0x2:
+            //S-8
+            return _mm_set1_epi32(extend8<SIGNED>(src[0] >> (op * 8)));
+        case 0x4:
+            //V2-32 - Z and W repeat X and Y
+            return _mm_shuffle_epi32(_mm_loadl_epi64((const __m128i*)src), _MM_SHUFFLE(1, 0, 1, 0));
+        case 0x5:
+            //V2-16
+            return _mm_shuffle_epi32(expand16<SIGNED>(_mm_cvtsi32_si128(src[0])), _MM_SHUFFLE(1, 0, 1, 0));
+        case 0x6:
+            //V2-8
+            return _mm_shuffle_epi32(expand8<SIGNED>(_mm_cvtsi32_si128(src[0] >> (op * 16))), _MM_SHUFFLE(1, 0, 1, 0));
+        case 0xC:
+            //V4-32
+            return _mm_loadu_si128((const __m128i*)src);
+        case 0xD:
+            //V4-16
+            return expand16<SIGNED>(_mm_loadl_epi64((const __m128i*)src));
+        case 0xE:
+            //V4-8
+            return expand8<SIGNED>(_mm_cvtsi32_si128(src[0]));
+        case 0xF:
+            //V4-5
+        {
+            uint32_t data = src[0] >> (op * 16);
+            return _mm_setr_epi32((data & 0x1F) << 3, ((data >> 5) & 0x1F) << 3,
+                                  ((data >> 10) & 0x1F) << 3, ((data >> 15) & 0x1) << 7);
+        }
+    }
+    return _mm_setzero_si128();
+}
+
+template <int CMD, bool SIGNED, bool MASKED, int MODE>
+static void unpack_kernel(VIF_UnpackJob& job, const uint32_t* src, int groups)
+{
+    //Lane selects for each row of MASK. Every block past the fourth uses the last row.
+    __m128i data_sel[4], row_sel[4], col_val[4], protect_sel[4];
+    if (MASKED)
+    {
+        for (int block = 0; block < 4; block++)
+        {
+            int32_t sel[4][4];
+            for (int i = 0; i < 4; i++)
+            {
+                int tempmask = (job.mask >> ((i * 2) + (block * 8))) & 0x3;
+                for (int j = 0; j < 4; j++)
+                    sel[j][i] = (tempmask == j) ? -1 : 0;
+            }
+            data_sel[block] = _mm_loadu_si128((__m128i*)sel[0]);
+            row_sel[block] = _mm_loadu_si128((__m128i*)sel[1]);
+            col_val[block] = _mm_and_si128(_mm_loadu_si128((__m128i*)sel[2]), _mm_set1_epi32(job.col[block]));
+            protect_sel[block] = _mm_loadu_si128((__m128i*)sel[3]);
+        }
+    }
+
+    __m128i row = _mm_loadu_si128((__m128i*)job.row);
+
+    for (int group = 0; group < groups; group++)
+    {
+        for (int op = 0; op < ops_per_group(CMD); op++)
+        {
+            __m128i quad = decode<CMD, SIGNED>(src, op);
+            __m128i* dest = (__m128i*)&job.mem[job.addr & job.mem_mask];
+
+            __m128i sel = _mm_set1_epi32(-1);
+            if (MASKED)
+            {
+                int block = std::min(job.blocks_written, 3);
+                sel = data_sel[block];
+
+                __m128i masked = _mm_or_si128(_mm_and_si128(quad, sel), _mm_and_si128(row, row_sel[block]));
+                masked = _mm_or_si128(masked, col_val[block]);
+                quad = _mm_or_si128(masked, _mm_and_si128(_mm_load_si128(dest), protect_sel[block]));
+            }
+
+            //Masked lanes skip the addition decompression
+            switch (MODE)
+            {
+                case 1:
+                    //Offset mode - VU Mem = Input + Row
+                    quad = _mm_add_epi32(quad, _mm_and_si128(row, sel));
+                    break;
+                case 2:
+                    //Difference mode - VU Mem = Row = Input + Row
+                    quad = _mm_add_epi32(quad, _mm_and_si128(row, sel));
+                    row = _mm_or_si128(_mm_and_si128(quad, sel), _mm_andnot_si128(sel, row));
+                    break;
+                case 3:
+                    row = _mm_or_si128(_mm_and_si128(quad, sel), _mm_andnot_si128(sel, row));
+                    break;
+                default:
+                    break;
+            }
+
+            _mm_store_si128(dest, quad);
+
+            job.addr += 16;
+            job.blocks_written++;
+            if (job.blocks_written >= job.WL)
+            {
+                if (job.CL > job.WL)
+                    job.addr += (job.CL - job.blocks_written) * 16;
+                job.blocks_written = 0;
+            }
+        }
+        src += words_per_group(CMD);
+    }
+
+    if (MODE >= 2)
+        _mm_storeu_si128((__m128i*)job.row, row);
+}
+
+template <int CMD, bool SIGNED>
+static VIF_UnpackKernel select_mode(bool masked, int mode)
+{
+    switch (mode | (masked << 2))
+    {
+        case 0:
+            return &unpack_kernel<CMD, SIGNED, false, 0>;
+        case 1:
+            return &unpack_kernel<CMD, SIGNED, false, 1>;
+        case 2:
+            return &unpack_kernel<CMD, SIGNED, false, 2>;
+        case 3:
+            return &unpack_kernel<CMD, SIGNED, false, 3>;
+        case 4:
+            return &unpack_kernel<CMD, SIGNED, true, 0>;
+        case 5:
+            return &unpack_kernel<CMD, SIGNED, true, 1>;
+        case 6:
+            return &unpack_kernel<CMD, SIGNED, true, 2>;
+        case 7:
+            return &unpack_kernel<CMD, SIGNED, true, 3>;
+    }
+    return nullptr;
+}
+
+template <int CMD>
+static VIF_UnpackKernel select_sign(bool sign_extend, bool masked, int mode)
+{
+    if (sign_extend)
+        return select_mode<CMD, true>(masked, mode);
+    return select_mode<CMD, false>(masked, mode);
+}
+
+VIF_UnpackKernel get_kernel(int cmd, bool sign_extend, bool masked, int mode)
+{
+    mode &= 0x3;
+    switch (cmd)
+    {
+        case 0x0:
+            return select_mode<0x0, false>(masked, mode);
+        case 0x1:
+            return select_sign<0x1>(sign_extend, masked, mode);
+        case 0x2:
+            return select_sign<0x2>(sign_extend, masked, mode);
+        case 0x4:
+            return select_mode<0x4, false>(masked, mode);
+        case 0x5:
+            return select_sign<0x5>(sign_extend, masked, mode);
+        case 0x6:
+            return select_sign<0x6>(sign_extend, masked, mode);
+        case 0xC:
+            return select_mode<0xC, false>(masked, mode);
+        case 0xD:
+            return select_sign<0xD>(sign_extend, masked, mode);
+        case 0xE:
+            return select_sign<0xE>(sign_extend, masked, mode);
+        case 0xF:
+            //Addition decompression is never applied to V4-5
+            return select_mode<0xF, false>(masked, 0);
+        default:
+            return nullptr;
+    }
+}
+
+VIF_UnpackFormat get_format(int cmd)
+{
+    return { words_per_group(cmd), ops_per_group(cmd) };
+}
+
+};
@@ -0,0 +1,39 @@
+#ifndef VIF_UNPACK_HPP
+#define VIF_UNPACK_HPP
+#include <cstdint>
+
+//Everything an UNPACK kernel needs to write a run of quadwords, copied in and out of the VIF around each call
+struct VIF_UnpackJob
+{
+    uint8_t* mem;
+    uint16_t mem_mask; //In bytes
+
+    uint32_t addr;
+    int blocks_written;
+    uint8_t CL, WL;
+
+    uint32_t mask;
+    uint32_t* row; //Updated by the difference and accumulate modes
+    const uint32_t* col;
+};
+
+//Expands groups of whole input words. Each group produces VIF_UnpackFormat::ops_per_group quadwords.
+typedef void (*VIF_UnpackKernel)(VIF_UnpackJob& job, const uint32_t* src, int groups);
+
+struct VIF_UnpackFormat
+{
+    int words_per_group;
+    int ops_per_group;
+};
+
+namespace VIF_Unpack
+{
+
+//Returns nullptr for formats that have no kernel (the V3 formats, whose W field depends on data
+//beyond the current vector). Kernels only handle skipping writes, where CL >= WL.
+VIF_UnpackKernel get_kernel(int cmd, bool sign_extend, bool masked, int mode);
+VIF_UnpackFormat get_format(int cmd);
+
+};
+
+#endif // VIF_UNPACK_HPP
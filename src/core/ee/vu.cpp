@@ -149,6 +149,11 @@ VectorUnit::VectorUnit(int id, Emulator* e, INTC* intc, EmotionEngine* cpu) : id
     VIF_TOP = nullptr;
     VIF_ITOP = nullptr;
 
+    defer_IRQ = false;
+    IRQ_pending = false;
+    slice_cop2_last_cycle = 0;
+    slice_FBRST = 0;
+
     MAC_flags = &MAC_pipeline[3];
     CLIP_flags = &CLIP_pipeline[3];
 }
@@ -165,6 +170,7 @@ void VectorUnit::reset()
     run_event = 0;
     running = false;
     tbit_stop = false;
+    IRQ_pending = false;
     vumem_is_dirty = true; //assume we don't know the contents on reset
     finish_on = false;
     branch_on = false;
@@ -373,7 +379,10 @@ void VectorUnit::run(int cycles)
                 running = false;
                 finish_on = false;
                 flush_pipes();
-                cycle_count = eecpu->get_cop2_last_cycle() >> 1;
+                if (defer_IRQ)
+                    cycle_count = slice_cop2_last_cycle >> 1;
+                else
+                    cycle_count = eecpu->get_cop2_last_cycle() >> 1;
             }
             else
                 ebit_delay_slot--;
@@ -382,14 +391,7 @@ void VectorUnit::run(int cycles)
         {
             if (read_fbrst() & (1 << (3 + (get_id() * 8))))
             {
-                if (!get_id())
-                {
-                    intc->assert_IRQ((int)Interrupt::VU0);
-                }
-                else
-                {
-                    intc->assert_IRQ((int)Interrupt::VU1);
-                }
+                assert_IRQ();
                 tbit_stop = true;
                 running = false;
                 finish_on = false;
@@ -716,6 +718,8 @@ void VectorUnit::restore_vf(bool newvf, int index)
 
 uint32_t VectorUnit::read_fbrst()
 {
+    if (defer_IRQ)
+        return slice_FBRST;
     return FBRST;
 }
 
@@ -870,14 +874,37 @@ void VectorUnit::stop_by_tbit()
     tbit_stop = true;
     running = false;
     flush_pipes();
+    assert_IRQ();
+}
 
-    if (!get_id())
-    {
-        intc->assert_IRQ((int)Interrupt::VU0);
-    }
+void VectorUnit::assert_IRQ()
+{
+    if (defer_IRQ)
+        IRQ_pending = true;
     else
+        intc->assert_IRQ((int)(get_id() ? Interrupt::VU1 : Interrupt::VU0));
+}
+
+void VectorUnit::set_defer_IRQ(bool defer)
+{
+    defer_IRQ = defer;
+    if (!defer)
+        raise_deferred_IRQ();
+}
+
+//Called on the EE thread before a slice is handed over, so the VU sees the same values it would running inline
+void VectorUnit::begin_threaded_slice()
+{
+    slice_cop2_last_cycle = eecpu->get_cop2_last_cycle();
+    slice_FBRST = FBRST;
+}
+
+void VectorUnit::raise_deferred_IRQ()
+{
+    if (IRQ_pending)
     {
-        intc->assert_IRQ((int)Interrupt::VU1);
+        IRQ_pending = false;
+        intc->assert_IRQ((int)(get_id() ? Interrupt::VU1 : Interrupt::VU0));
     }
 }
 
@@ -107,6 +107,15 @@ class VectorUnit
 
         bool running;
         bool tbit_stop;
+
+        //Set while running on a VectorUnitThread, as the INTC belongs to the EE thread
+        bool defer_IRQ;
+        bool IRQ_pending;
+
+        //EE-owned state the VU reads mid-program, copied when a slice is handed to the thread
+        uint64_t slice_cop2_last_cycle;
+        uint32_t slice_FBRST;
+
         bool vumem_is_dirty;
         uint16_t PC, new_PC, secondbranch_PC;
         bool branch_on, branch_on_delay;
@@ -175,6 +184,7 @@ class VectorUnit
         
         void update_status();
         void advance_r();
+        void assert_IRQ();
         void print_vectors(uint8_t a, uint8_t b);
     public:
         VectorUnit(int id, Emulator* e, INTC* intc, EmotionEngine* eecpu);
@@ -187,6 +197,9 @@ class VectorUnit
 
         void set_TOP_regs(uint16_t* TOP, uint16_t* ITOP);
         void set_GIF(GraphicsInterface* gif);
+        void set_defer_IRQ(bool defer);
+        void raise_deferred_IRQ();
+        void begin_threaded_slice();
 
         void update_mac_pipeline();
         void update_DIV_EFU_pipes();
@@ -238,6 +251,8 @@ class VectorUnit
         void set_Q(uint32_t value);
 
         uint8_t* get_instr_mem();
+        uint8_t* get_data_mem();
+        uint16_t get_mem_mask();
 
         uint32_t cfc(int index);
         void ctc(int index, uint32_t value);
@@ -368,8 +383,8 @@ class VectorUnit
         void xitop(uint32_t instr);
         void xtop(uint32_t instr);
 
-        void load_state(std::ifstream& state);
-        void save_state(std::ofstream& state);
+        void load_state(std::istream& state);
+        void save_state(std::ostream& state);
 
         //Friends needed for JIT convenience
         friend class VU_JIT64;
@@ -500,6 +515,16 @@ inline uint8_t* VectorUnit::get_instr_mem()
     return (uint8_t*)instr_mem.m;
 }
 
+inline uint8_t* VectorUnit::get_data_mem()
+{
+    return (uint8_t*)data_mem.m;
+}
+
+inline uint16_t VectorUnit::get_mem_mask()
+{
+    return mem_mask;
+}
+
 inline uint64_t VectorUnit::get_cycle_count()
 {
     return cycle_count;
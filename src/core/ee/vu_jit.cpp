@@ -28,4 +28,29 @@ void set_current_program(uint32_t crc)
     jit64.set_current_program(crc);
 }
 
+const VU_JitOptStats& get_opt_stats()
+{
+    return jit64.get_opt_stats();
+}
+
+const VU_JitCacheStats& get_cache_stats()
+{
+    return jit64.get_cache_stats();
+}
+
+int get_block_variants(uint16_t pc)
+{
+    return jit64.get_block_variants(pc);
+}
+
+bool get_avx()
+{
+    return jit64.get_avx();
+}
+
+void set_avx(bool enabled)
+{
+    jit64.set_avx(enabled);
+}
+
 };
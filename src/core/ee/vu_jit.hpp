@@ -3,6 +3,8 @@
 #include <cstdint>
 
 class VectorUnit;
+struct VU_JitOptStats;
+struct VU_JitCacheStats;
 
 namespace VU_JIT
 {
@@ -10,6 +12,14 @@ namespace VU_JIT
 uint16_t run(VectorUnit* vu);
 void reset();
 void set_current_program(uint32_t crc);
+const VU_JitOptStats& get_opt_stats();
+const VU_JitCacheStats& get_cache_stats();
+
+//Number of blocks compiled at a PC of the current program, one for each distinct entry pipeline state
+int get_block_variants(uint16_t pc);
+
+bool get_avx();
+void set_avx(bool enabled);
 
 };
 
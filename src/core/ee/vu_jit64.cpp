@@ -1,9 +1,11 @@
 #include <cmath>
 #include <algorithm>
+#include <cstring>
 
 #include "vu_jit64.hpp"
 #include "vu_interpreter.hpp"
 #include "../gif.hpp"
+#include "../jitcommon/hostcpu.hpp"
 
 #include "../errors.hpp"
 
@@ -53,6 +55,12 @@ VU_JIT64::VU_JIT64() : emitter(&cache)
         max_flt_constant.u[i] = 0x7F7FFFFF;
         min_flt_constant.u[i] = 0xFF7FFFFF;
     }
+
+    cur_instr = 0;
+    memset(&alloc_stats, 0, sizeof(alloc_stats));
+    memset(&cache_stats, 0, sizeof(cache_stats));
+
+    use_avx = HostCPU::get_features().avx;
 }
 
 uint8_t convert_field(uint8_t value)
@@ -147,12 +155,12 @@ void VU_JIT64::reset(bool clear_cache)
     {
         xmm_regs[i].used = false;
         xmm_regs[i].locked = false;
-        xmm_regs[i].age = 0;
+        xmm_regs[i].last_use = -1;
         xmm_regs[i].needs_clamping = false;
 
         int_regs[i].used = false;
         int_regs[i].locked = false;
-        int_regs[i].age = 0;
+        int_regs[i].last_use = -1;
     }
 
     //Lock special registers to prevent them from being used
@@ -167,8 +175,44 @@ void VU_JIT64::reset(bool clear_cache)
     xmm_regs[REG_64::XMM1].locked = true;
 
     if(clear_cache)
+    {
+        if (cache_stats.blocks_compiled)
+        {
+            uint32_t program, pc;
+            int variants = cache.get_max_variants(program, pc);
+            printf("[VU_JIT64] Compiled %llu blocks, normalized %llu of %llu entry states, %llu full cache flushes\n",
+                   (unsigned long long)cache_stats.blocks_compiled, (unsigned long long)cache_stats.states_normalized,
+                   (unsigned long long)cache_stats.lookups, (unsigned long long)cache.get_flush_count());
+            printf("[VU_JIT64] Most variants: %d at $%04X (program $%08X)\n", variants, pc, program);
+        }
+        memset(&cache_stats, 0, sizeof(cache_stats));
+
         cache.flush_all_blocks();
 
+        const VU_JitOptStats& stats = optimizer.get_stats();
+        if (stats.blocks)
+        {
+            printf("[VU_JIT64] Optimized %llu blocks: %llu -> %llu IR instructions\n",
+                   (unsigned long long)stats.blocks, (unsigned long long)stats.instrs_in,
+                   (unsigned long long)stats.instrs_out);
+            printf("[VU_JIT64] Folded %llu, propagated %llu, forwarded %llu loads, removed %llu dead flags, "
+                   "merged %llu pipeline updates, removed %llu dead writes and %llu moves\n",
+                   (unsigned long long)stats.constants_folded, (unsigned long long)stats.copies_propagated,
+                   (unsigned long long)stats.loads_forwarded, (unsigned long long)stats.dead_flags_removed,
+                   (unsigned long long)stats.pipeline_updates_merged, (unsigned long long)stats.dead_writes_removed,
+                   (unsigned long long)stats.moves_removed);
+        }
+        optimizer.reset_stats();
+
+        if (alloc_stats.blocks)
+        {
+            printf("[VU_JIT64] Register allocation: %llu spills (%llu stores), %llu registers kept across calls\n",
+                   (unsigned long long)alloc_stats.spills, (unsigned long long)alloc_stats.spill_stores,
+                   (unsigned long long)alloc_stats.call_saves);
+        }
+        memset(&alloc_stats, 0, sizeof(alloc_stats));
+    }
+
     ir.reset_instr_info();
 
     should_update_mac = false;
@@ -176,6 +220,47 @@ void VU_JIT64::reset(bool clear_cache)
     current_program = 0;
 }
 
+const VU_JitOptStats& VU_JIT64::get_opt_stats()
+{
+    return optimizer.get_stats();
+}
+
+const VU_JitAllocStats& VU_JIT64::get_alloc_stats()
+{
+    return alloc_stats;
+}
+
+const VU_JitCacheStats& VU_JIT64::get_cache_stats()
+{
+    return cache_stats;
+}
+
+int VU_JIT64::get_block_variants(uint16_t pc)
+{
+    return cache.get_variant_count(current_program, pc);
+}
+
+bool VU_JIT64::get_avx()
+{
+    return use_avx;
+}
+
+void VU_JIT64::set_avx(bool enabled)
+{
+    if (enabled && !HostCPU::get_features().avx)
+    {
+        Errors::print_warning("[VU_JIT64] AVX requested, but the host CPU does not support it\n");
+        enabled = false;
+    }
+
+    //Blocks compiled for the other backend would still work, but flush them so that every block uses the same one
+    if (enabled != use_avx)
+    {
+        use_avx = enabled;
+        reset(true);
+    }
+}
+
 void VU_JIT64::set_current_program(uint32_t crc)
 {
     reset(false);
@@ -218,12 +303,20 @@ void VU_JIT64::clamp_vfreg(uint8_t field, REG_64 xmm_reg)
         emitter.load_addr((uint64_t)&max_flt_constant, REG_64::RAX);
         emitter.load_addr((uint64_t)&min_flt_constant, REG_64::R15);
 
-        emitter.MOVAPS_REG(xmm_reg, temp_reg);
-        //reg = min_signed(reg, 0x7F7FFFFF)
-        emitter.PMINSD_XMM_FROM_MEM(REG_64::RAX, temp_reg);
+        if (use_avx)
+        {
+            emitter.VPMINSD_XMM_FROM_MEM(REG_64::RAX, xmm_reg, temp_reg);
+            emitter.VPMINUD_XMM_FROM_MEM(REG_64::R15, temp_reg, temp_reg);
+        }
+        else
+        {
+            emitter.MOVAPS_REG(xmm_reg, temp_reg);
+            //reg = min_signed(reg, 0x7F7FFFFF)
+            emitter.PMINSD_XMM_FROM_MEM(REG_64::RAX, temp_reg);
 
-        //reg = min_unsigned(reg, 0xFF7FFFFF)
-        emitter.PMINUD_XMM_FROM_MEM(REG_64::R15, temp_reg);
+            //reg = min_unsigned(reg, 0xFF7FFFFF)
+            emitter.PMINUD_XMM_FROM_MEM(REG_64::R15, temp_reg);
+        }
 
         emitter.BLENDPS(field, temp_reg, xmm_reg);
         set_clamping(xmm_reg, false, field);
@@ -233,8 +326,88 @@ void VU_JIT64::clamp_vfreg(uint8_t field, REG_64 xmm_reg)
 void VU_JIT64::sse_abs(REG_64 source, REG_64 dest)
 {
     emitter.load_addr((uint64_t)&abs_constant, REG_64::RAX);
-    emitter.MOVAPS_REG(source, dest);
-    emitter.PAND_XMM_MEM(REG_64::RAX, dest);
+    if (use_avx)
+        emitter.VPAND_XMM_MEM(REG_64::RAX, source, dest);
+    else
+    {
+        emitter.MOVAPS_REG(source, dest);
+        emitter.PAND_XMM_MEM(REG_64::RAX, dest);
+    }
+}
+
+//The helpers below compute dest = op1 OP op2.
+//Without AVX, op1 is copied into dest first, so dest must not be op2.
+void VU_JIT64::sse_broadcast(uint8_t bc, REG_64 source, REG_64 dest)
+{
+    //Fill dest with one field of source
+    bc |= (bc << 6) | (bc << 4) | (bc << 2);
+    if (use_avx)
+        emitter.VPERMILPS(bc, source, dest);
+    else
+    {
+        emitter.MOVAPS_REG(source, dest);
+        emitter.SHUFPS(bc, dest, dest);
+    }
+}
+
+void VU_JIT64::sse_add(REG_64 op1, REG_64 op2, REG_64 dest)
+{
+    if (use_avx)
+        emitter.VADDPS(op2, op1, dest);
+    else
+    {
+        if (op1 != dest)
+            emitter.MOVAPS_REG(op1, dest);
+        emitter.ADDPS(op2, dest);
+    }
+}
+
+void VU_JIT64::sse_sub(REG_64 op1, REG_64 op2, REG_64 dest)
+{
+    if (use_avx)
+        emitter.VSUBPS(op2, op1, dest);
+    else
+    {
+        if (op1 != dest)
+            emitter.MOVAPS_REG(op1, dest);
+        emitter.SUBPS(op2, dest);
+    }
+}
+
+void VU_JIT64::sse_mul(REG_64 op1, REG_64 op2, REG_64 dest)
+{
+    if (use_avx)
+        emitter.VMULPS(op2, op1, dest);
+    else
+    {
+        if (op1 != dest)
+            emitter.MOVAPS_REG(op1, dest);
+        emitter.MULPS(op2, dest);
+    }
+}
+
+void VU_JIT64::sse_max(REG_64 op1, REG_64 op2, REG_64 dest)
+{
+    if (use_avx)
+        emitter.VMAXPS(op2, op1, dest);
+    else
+    {
+        if (op1 != dest)
+            emitter.MOVAPS_REG(op1, dest);
+        emitter.MAXPS(op2, dest);
+    }
+}
+
+void VU_JIT64::sse_min(REG_64 op1, REG_64 op2, REG_64 dest)
+{
+    if (use_avx)
+        emitter.VMINPS(op2, op1, dest);
+    else
+    {
+        if (op1 != dest)
+            emitter.MOVAPS_REG(op1, dest);
+        emitter.MINPS(op2, dest);
+    }
 }
 
 void VU_JIT64::sse_div_check(REG_64 num, REG_64 denom, VU_R& dest)
@@ -1167,12 +1340,8 @@ void VU_JIT64::max_vector_by_scalar(VectorUnit &vu, IR::Instruction &instr)
     REG_64 bc_reg = alloc_sse_reg(vu, instr.get_source2(), REG_STATE::READ_WRITE);
     REG_64 dest = alloc_sse_reg(vu, instr.get_dest(), REG_STATE::READ_WRITE);
 
-    uint8_t bc = instr.get_bc();
-    bc |= (bc << 6) | (bc << 4) | (bc << 2);
-
     REG_64 temp = REG_64::XMM0;
-    emitter.MOVAPS_REG(bc_reg, temp);
-    emitter.SHUFPS(bc, temp, temp);
+    sse_broadcast(instr.get_bc(), bc_reg, temp);
     emitter.MAXPS(source, temp);
     emitter.BLENDPS(field, temp, dest);
 }
@@ -1187,8 +1356,7 @@ void VU_JIT64::max_vectors(VectorUnit &vu, IR::Instruction &instr)
     REG_64 temp = REG_64::XMM0;
 
     //GT4 has black screens during 3D if it isn't this way around
-    emitter.MOVAPS_REG(op2, temp);
-    emitter.MAXPS(op1, temp);
+    sse_max(op2, op1, temp);
     emitter.BLENDPS(field, temp, dest);
 }
 
@@ -1199,12 +1367,8 @@ void VU_JIT64::min_vector_by_scalar(VectorUnit &vu, IR::Instruction &instr)
     REG_64 bc_reg = alloc_sse_reg(vu, instr.get_source2(), REG_STATE::READ_WRITE);
     REG_64 dest = alloc_sse_reg(vu, instr.get_dest(), REG_STATE::READ_WRITE);
 
-    uint8_t bc = instr.get_bc();
-    bc |= (bc << 6) | (bc << 4) | (bc << 2);
-
     REG_64 temp = REG_64::XMM0;
-    emitter.MOVAPS_REG(bc_reg, temp);
-    emitter.SHUFPS(bc, temp, temp);
+    sse_broadcast(instr.get_bc(), bc_reg, temp);
     emitter.MINPS(source, temp);
     emitter.BLENDPS(field, temp, dest);
 }
@@ -1219,8 +1383,7 @@ void VU_JIT64::min_vectors(VectorUnit &vu, IR::Instruction &instr)
     REG_64 temp = REG_64::XMM0;
 
     //GT4 has black screens during 3D if it isn't this way around
-    emitter.MOVAPS_REG(op2, temp);
-    emitter.MINPS(op1, temp);
+    sse_min(op2, op1, temp);
     emitter.BLENDPS(field, temp, dest);
 }
 
@@ -1236,8 +1399,7 @@ void VU_JIT64::add_vectors(VectorUnit &vu, IR::Instruction &instr)
     clamp_vfreg(field, op1);
     clamp_vfreg(field, op2);
 
-    emitter.MOVAPS_REG(op1, temp);
-    emitter.ADDPS(op2, temp);
+    sse_add(op1, op2, temp);
 
     set_clamping(temp, true, field);
     clamp_vfreg(field, temp);
@@ -1260,14 +1422,10 @@ void VU_JIT64::add_vector_by_scalar(VectorUnit &vu, IR::Instruction &instr)
     REG_64 dest = alloc_sse_reg(vu, instr.get_dest(), REG_STATE::READ_WRITE);
 
 
-    uint8_t bc = instr.get_bc();
-
     clamp_vfreg(field, source);
-    bc |= (bc << 6) | (bc << 4) | (bc << 2);
 
     REG_64 temp = REG_64::XMM0;
-    emitter.MOVAPS_REG(bc_reg, temp);
-    emitter.SHUFPS(bc, temp, temp);
+    sse_broadcast(instr.get_bc(), bc_reg, temp);
     set_clamping(temp, true, field);
     clamp_vfreg(field, temp);
 
@@ -1297,8 +1455,7 @@ void VU_JIT64::sub_vectors(VectorUnit &vu, IR::Instruction &instr)
     clamp_vfreg(field, op1);
     clamp_vfreg(field, op2);
 
-    emitter.MOVAPS_REG(op1, temp);
-    emitter.SUBPS(op2, temp);
+    sse_sub(op1, op2, temp);
     set_clamping(temp, true, field);
     clamp_vfreg(field, temp);
 
@@ -1319,21 +1476,15 @@ void VU_JIT64::sub_vector_by_scalar(VectorUnit &vu, IR::Instruction &instr)
     REG_64 bc_reg = alloc_sse_reg(vu, instr.get_source2(), REG_STATE::READ_WRITE);
     REG_64 dest = alloc_sse_reg(vu, instr.get_dest(), REG_STATE::READ_WRITE);
 
-    uint8_t bc = instr.get_bc();
-
     clamp_vfreg(field, source);
 
-    bc |= (bc << 6) | (bc << 4) | (bc << 2);
-
     REG_64 temp = REG_64::XMM0;
     REG_64 temp2 = REG_64::XMM1;
-    emitter.MOVAPS_REG(bc_reg, temp);
-    emitter.MOVAPS_REG(source, temp2);
-    emitter.SHUFPS(bc, temp, temp);
+    sse_broadcast(instr.get_bc(), bc_reg, temp);
     set_clamping(temp, true, field);
     clamp_vfreg(field, temp);
 
-    emitter.SUBPS(temp, temp2);
+    sse_sub(source, temp, temp2);
     set_clamping(temp2, true, field);
     clamp_vfreg(field, temp2);
 
@@ -1359,8 +1510,7 @@ void VU_JIT64::mul_vectors(VectorUnit &vu, IR::Instruction &instr)
     clamp_vfreg(field, op1);
     clamp_vfreg(field, op2);
 
-    emitter.MOVAPS_REG(op1, temp);
-    emitter.MULPS(op2, temp);
+    sse_mul(op1, op2, temp);
     set_clamping(temp, true, field);
     clamp_vfreg(field, temp);
 
@@ -1381,15 +1531,10 @@ void VU_JIT64::mul_vector_by_scalar(VectorUnit &vu, IR::Instruction &instr)
     REG_64 bc_reg = alloc_sse_reg(vu, instr.get_source2(), REG_STATE::READ_WRITE);
     REG_64 dest = alloc_sse_reg(vu, instr.get_dest(), REG_STATE::READ_WRITE);
 
-    uint8_t bc = instr.get_bc();
-
     clamp_vfreg(field, source);
 
-    bc |= (bc << 6) | (bc << 4) | (bc << 2);
-
     REG_64 temp = REG_64::XMM0;
-    emitter.MOVAPS_REG(bc_reg, temp);
-    emitter.SHUFPS(bc, temp, temp);
+    sse_broadcast(instr.get_bc(), bc_reg, temp);
     set_clamping(temp, true, field);
     clamp_vfreg(field, temp);
 
@@ -1421,8 +1566,7 @@ void VU_JIT64::madd_vectors(VectorUnit &vu, IR::Instruction &instr)
     clamp_vfreg(field, op2);
     clamp_vfreg(field, acc);
 
-    emitter.MOVAPS_REG(op1, temp);
-    emitter.MULPS(op2, temp);
+    sse_mul(op1, op2, temp);
     emitter.ADDPS(acc, temp);
     set_clamping(temp, true, field);
     clamp_vfreg(field, temp);
@@ -1450,8 +1594,7 @@ void VU_JIT64::madd_acc_and_vectors(VectorUnit &vu, IR::Instruction &instr)
     clamp_vfreg(field, op2);
     clamp_vfreg(field, dest);
 
-    emitter.MOVAPS_REG(op1, temp);
-    emitter.MULPS(op2, temp);
+    sse_mul(op1, op2, temp);
     if (field == 0xF)
     {
         emitter.ADDPS(temp, dest);
@@ -1483,15 +1626,10 @@ void VU_JIT64::madd_vector_by_scalar(VectorUnit &vu, IR::Instruction &instr)
     REG_64 dest = alloc_sse_reg(vu, instr.get_dest(), REG_STATE::READ_WRITE);
     REG_64 acc = alloc_sse_reg(vu, VU_SpecialReg::ACC, REG_STATE::READ);
 
-    uint8_t bc = instr.get_bc();
-
     clamp_vfreg(field, source);
     clamp_vfreg(field, acc);
 
-    bc |= (bc << 6) | (bc << 4) | (bc << 2);
-
-    emitter.MOVAPS_REG(bc_reg, temp);
-    emitter.SHUFPS(bc, temp, temp);
+    sse_broadcast(instr.get_bc(), bc_reg, temp);
     set_clamping(temp, true, field);
     clamp_vfreg(field, temp);
 
@@ -1519,15 +1657,10 @@ void VU_JIT64::madd_acc_by_scalar(VectorUnit &vu, IR::Instruction &instr)
     REG_64 source = alloc_sse_reg(vu, instr.get_source(), REG_STATE::READ);
     REG_64 dest = alloc_sse_reg(vu, VU_SpecialReg::ACC, REG_STATE::READ_WRITE);
 
-    uint8_t bc = instr.get_bc();
-
     clamp_vfreg(field, source);
     clamp_vfreg(field, dest);
 
-    bc |= (bc << 6) | (bc << 4) | (bc << 2);
-
-    emitter.MOVAPS_REG(bc_reg, temp);
-    emitter.SHUFPS(bc, temp, temp);
+    sse_broadcast(instr.get_bc(), bc_reg, temp);
     set_clamping(temp, true, field);
     clamp_vfreg(field, temp);
 
@@ -1567,10 +1700,8 @@ void VU_JIT64::msub_vectors(VectorUnit &vu, IR::Instruction &instr)
     clamp_vfreg(field, op2);
     clamp_vfreg(field, acc);
 
-    emitter.MOVAPS_REG(acc, temp2);
-    emitter.MOVAPS_REG(op1, temp);
-    emitter.MULPS(op2, temp);
-    emitter.SUBPS(temp, temp2);
+    sse_mul(op1, op2, temp);
+    sse_sub(acc, temp, temp2);
     set_clamping(temp2, true, field);
     clamp_vfreg(field, temp2);
 
@@ -1594,22 +1725,15 @@ void VU_JIT64::msub_vector_by_scalar(VectorUnit &vu, IR::Instruction &instr)
     REG_64 dest = alloc_sse_reg(vu, instr.get_dest(), REG_STATE::READ_WRITE);
     REG_64 acc = alloc_sse_reg(vu, VU_SpecialReg::ACC, REG_STATE::READ);
 
-    uint8_t bc = instr.get_bc();
-
     clamp_vfreg(field, source);
     clamp_vfreg(field, acc);
 
-    bc |= (bc << 6) | (bc << 4) | (bc << 2);
-
-    emitter.MOVAPS_REG(bc_reg, temp);
-    emitter.MOVAPS_REG(acc, temp2);
-
-    emitter.SHUFPS(bc, temp, temp);
+    sse_broadcast(instr.get_bc(), bc_reg, temp);
     set_clamping(temp, true, field);
     clamp_vfreg(field, temp);
 
     emitter.MULPS(source, temp);
-    emitter.SUBPS(temp, temp2);
+    sse_sub(acc, temp, temp2);
     set_clamping(temp2, true, field);
     clamp_vfreg(field, temp2);
 
@@ -1633,15 +1757,10 @@ void VU_JIT64::msub_acc_by_scalar(VectorUnit &vu, IR::Instruction &instr)
     REG_64 source = alloc_sse_reg(vu, instr.get_source(), REG_STATE::READ);
     REG_64 dest = alloc_sse_reg(vu, VU_SpecialReg::ACC, REG_STATE::READ_WRITE);
 
-    uint8_t bc = instr.get_bc();
-
     clamp_vfreg(field, source);
     clamp_vfreg(field, dest);
 
-    bc |= (bc << 6) | (bc << 4) | (bc << 2);
-
-    emitter.MOVAPS_REG(bc_reg, temp);
-    emitter.SHUFPS(bc, temp, temp);
+    sse_broadcast(instr.get_bc(), bc_reg, temp);
     set_clamping(temp, true, field);
     clamp_vfreg(field, temp);
 
@@ -1655,8 +1774,7 @@ void VU_JIT64::msub_acc_by_scalar(VectorUnit &vu, IR::Instruction &instr)
     }
     else
     {
-        emitter.MOVAPS_REG(dest, temp2);
-        emitter.SUBPS(temp, temp2);
+        sse_sub(dest, temp, temp2);
         set_clamping(temp2, true, field);
         clamp_vfreg(field, temp2);
         set_clamping(dest, false, field);
@@ -1736,21 +1854,14 @@ void VU_JIT64::opmsub(VectorUnit &vu, IR::Instruction &instr)
 
 void VU_JIT64::clip(VectorUnit &vu, IR::Instruction &instr)
 {
-    flush_regs(vu);
-    for (int i = 0; i < 16; i++)
-    {
-        xmm_regs[i].used = false;
-        xmm_regs[i].age = 0;
-        int_regs[i].used = false;
-        int_regs[i].age = 0;
-    }
+    flush_touched_regs(vu, (1ULL << instr.get_source()) | (1ULL << instr.get_source2()), false);
 
     uint32_t imm = instr.get_source() << 11;
     imm |= instr.get_source2() << 16;
 
     prepare_abi(vu, (uint64_t)&vu);
     prepare_abi(vu, imm);
-    call_abi_func((uint64_t)vu_clip);
+    call_abi_func(vu, (uint64_t)vu_clip);
 }
 
 void VU_JIT64::div(VectorUnit &vu, IR::Instruction &instr)
@@ -2223,7 +2334,7 @@ void VU_JIT64::update_mac_pipeline(VectorUnit &vu, IR::Instruction &instr)
 {
     prepare_abi(vu, (uint64_t)&vu);
     prepare_abi(vu, instr.get_source());
-    call_abi_func((uint64_t)vu_update_pipelines);
+    call_abi_func(vu, (uint64_t)vu_update_pipelines);
 }
 
 void VU_JIT64::move_xtop(VectorUnit &vu, IR::Instruction &instr)
@@ -2309,23 +2420,16 @@ void VU_JIT64::xgkick(VectorUnit &vu, IR::Instruction &instr)
 
 void VU_JIT64::update_xgkick(VectorUnit &vu, IR::Instruction &instr)
 {
-    flush_regs(vu);
-    for (int i = 0; i < 16; i++)
-    {
-        xmm_regs[i].used = false;
-        xmm_regs[i].age = 0;
-        int_regs[i].used = false;
-        int_regs[i].age = 0;
-    }
+    //The transfer only reads VU memory, so registers can stay allocated across the call
     prepare_abi(vu, (uint64_t)&vu);
     prepare_abi(vu, instr.get_source());
-    call_abi_func((uint64_t)vu_update_xgkick);
+    call_abi_func(vu, (uint64_t)vu_update_xgkick);
 }
 
 void VU_JIT64::stop(VectorUnit &vu, IR::Instruction &instr)
 {
     prepare_abi(vu, (uint64_t)&vu);
-    call_abi_func((uint64_t)vu_stop_execution);
+    call_abi_func(vu, (uint64_t)vu_stop_execution);
 
     emitter.load_addr((uint64_t)&vu.PC, REG_64::RAX);
     emitter.MOV16_IMM_MEM(instr.get_jump_dest(), REG_64::RAX);
@@ -2340,7 +2444,7 @@ void VU_JIT64::stop(VectorUnit &vu, IR::Instruction &instr)
 void VU_JIT64::stop_by_tbit(VectorUnit &vu, IR::Instruction &instr)
 {
     prepare_abi(vu, (uint64_t)&vu);
-    call_abi_func((uint64_t)vu_tbit_stop_execution);
+    call_abi_func(vu, (uint64_t)vu_tbit_stop_execution);
 
     emitter.load_addr((uint64_t)&vu.PC, REG_64::RAX);
     emitter.MOV16_IMM_MEM(instr.get_jump_dest(), REG_64::RAX);
@@ -2392,11 +2496,22 @@ void VU_JIT64::move_delayed_branch(VectorUnit &vu, IR::Instruction &instr)
     vu_branch = true;
 }
 
+int VU_JIT64::next_use(AllocReg *regs, int vu_reg, int pos)
+{
+    //Returns the index of the first IR instruction at or after pos that uses vu_reg, or -1 if there is none
+    std::vector<int>& uses = (regs == xmm_regs) ? vf_uses[vu_reg] : vi_uses[vu_reg];
+    std::vector<int>::iterator it = std::lower_bound(uses.begin(), uses.end(), pos);
+    if (it == uses.end())
+        return -1;
+    return *it;
+}
+
 int VU_JIT64::search_for_register(AllocReg *regs, int vu_reg)
 {
-    //Returns the index of either a free register or the oldest allocated register, depending on availability
+    //Returns the index of either a free register or the one whose next use is furthest away.
+    //Registers already touched by the current instruction are only taken as a last resort.
     int reg = -1;
-    int age = 0;
+    int best_dist = -1;
     for (int i = 0; i < 16; i++)
     {
         if (regs[i].locked)
@@ -2405,12 +2520,30 @@ int VU_JIT64::search_for_register(AllocReg *regs, int vu_reg)
         if (!regs[i].used)
             return i;
 
-        if (regs[i].age > age)
+        int use = next_use(regs, regs[i].vu_reg, cur_instr);
+        int dist;
+        if (regs[i].last_use == cur_instr)
+            dist = 0;
+        else if (use < 0)
+            dist = 0x10000000;
+        else
+            dist = (use - cur_instr) * 4 + 1;
+
+        //Break ties with the register that doesn't need to be written back, then the least recently used one
+        dist = dist * 2 + !regs[i].modified;
+        if (dist > best_dist || (dist == best_dist && regs[i].last_use < regs[reg].last_use))
         {
             reg = i;
-            age = regs[i].age;
+            best_dist = dist;
         }
     }
+
+    if (regs[reg].vu_reg && next_use(regs, regs[reg].vu_reg, cur_instr) >= 0)
+    {
+        alloc_stats.spills++;
+        if (regs[reg].modified)
+            alloc_stats.spill_stores++;
+    }
     return reg;
 }
 
@@ -2425,17 +2558,11 @@ REG_64 VU_JIT64::alloc_int_reg(VectorUnit &vu, int vi_reg, REG_STATE state)
         {
             if (state != REG_STATE::READ)
                 int_regs[i].modified = true;
-            int_regs[i].age = 0;
+            int_regs[i].last_use = cur_instr;
             return (REG_64)i;
         }
     }
 
-    for (int i = 0; i < 16; i++)
-    {
-        if (int_regs[i].used)
-            int_regs[i].age++;
-    }
-
     int reg = search_for_register(int_regs, vi_reg);
 
     if (int_regs[reg].used && int_regs[reg].modified && int_regs[reg].vu_reg)
@@ -2458,7 +2585,7 @@ REG_64 VU_JIT64::alloc_int_reg(VectorUnit &vu, int vi_reg, REG_STATE state)
 
     int_regs[reg].vu_reg = vi_reg;
     int_regs[reg].used = true;
-    int_regs[reg].age = 0;
+    int_regs[reg].last_use = cur_instr;
 
     return (REG_64)reg;
 }
@@ -2475,18 +2602,11 @@ REG_64 VU_JIT64::alloc_sse_reg(VectorUnit &vu, int vf_reg, REG_STATE state)
         {
             if (state == REG_STATE::WRITE || state == REG_STATE::READ_WRITE)
                 xmm_regs[i].modified = true;
-            xmm_regs[i].age = 0;
+            xmm_regs[i].last_use = cur_instr;
             return (REG_64)i;
         }
     }
 
-    //Increase the age of each register if it's still allocated
-    for (int i = 0; i < 16; i++)
-    {
-        if (xmm_regs[i].used)
-            xmm_regs[i].age++;
-    }
-
     int xmm = search_for_register(xmm_regs, vf_reg);
 
     //If the chosen register is used, flush it back to the VU state.
@@ -2512,7 +2632,7 @@ REG_64 VU_JIT64::alloc_sse_reg(VectorUnit &vu, int vf_reg, REG_STATE state)
 
     xmm_regs[xmm].vu_reg = vf_reg;
     xmm_regs[xmm].used = true;
-    xmm_regs[xmm].age = 0;
+    xmm_regs[xmm].last_use = cur_instr;
     set_clamping(xmm, true, 0xF);
 
     return (REG_64)xmm;
@@ -2552,7 +2672,7 @@ REG_64 VU_JIT64::alloc_sse_scratchpad(VectorUnit &vu, int vf_reg)
     xmm_regs[xmm].modified = false;
     xmm_regs[xmm].vu_reg = vf_reg;
     xmm_regs[xmm].used = true;
-    xmm_regs[xmm].age = 0;
+    xmm_regs[xmm].last_use = cur_instr;
 
     return (REG_64)xmm;
 }
@@ -2609,12 +2729,106 @@ void VU_JIT64::flush_sse_reg(VectorUnit &vu, int vf_reg)
             emitter.MOVAPS_TO_MEM((REG_64)i, REG_64::RAX);
 
             xmm_regs[i].used = false;
-            xmm_regs[i].age = 0;
+            xmm_regs[i].last_use = -1;
             break;
         }
     }
 }
 
+void VU_JIT64::flush_touched_regs(VectorUnit &vu, uint64_t vf_mask, bool flush_vi)
+{
+    //Writes back and drops the registers that C++ code is about to read or write through the VU state.
+    //The special registers (ACC, I, Q, P, R) are always included.
+    vf_mask |= ~0ULL << VU_SpecialReg::ACC;
+    for (int i = 0; i < 16; i++)
+    {
+        int vf_reg = xmm_regs[i].vu_reg;
+        if (xmm_regs[i].used && (vf_mask & (1ULL << vf_reg)))
+        {
+            if (vf_reg && xmm_regs[i].modified)
+            {
+                emitter.load_addr(get_vf_addr(vu, vf_reg), REG_64::RAX);
+                emitter.MOVAPS_TO_MEM((REG_64)i, REG_64::RAX);
+            }
+            xmm_regs[i].used = false;
+            xmm_regs[i].last_use = -1;
+        }
+
+        int vi_reg = int_regs[i].vu_reg;
+        if (flush_vi && int_regs[i].used)
+        {
+            if (vi_reg && int_regs[i].modified)
+            {
+                emitter.load_addr((uint64_t)&vu.int_gpr[vi_reg], REG_64::RAX);
+                emitter.MOV16_TO_MEM((REG_64)i, REG_64::RAX);
+            }
+            int_regs[i].used = false;
+            int_regs[i].last_use = -1;
+        }
+    }
+}
+
+void VU_JIT64::expire_regs(VectorUnit &vu)
+{
+    //Release every register whose live range ended with the current instruction
+    for (int i = 0; i < 16; i++)
+    {
+        if (xmm_regs[i].used && next_use(xmm_regs, xmm_regs[i].vu_reg, cur_instr + 1) < 0)
+        {
+            int vf_reg = xmm_regs[i].vu_reg;
+            if (vf_reg && xmm_regs[i].modified)
+            {
+                emitter.load_addr(get_vf_addr(vu, vf_reg), REG_64::RAX);
+                emitter.MOVAPS_TO_MEM((REG_64)i, REG_64::RAX);
+            }
+            xmm_regs[i].used = false;
+            xmm_regs[i].last_use = -1;
+        }
+
+        if (int_regs[i].used && next_use(int_regs, int_regs[i].vu_reg, cur_instr + 1) < 0)
+        {
+            int vi_reg = int_regs[i].vu_reg;
+            if (vi_reg && int_regs[i].modified)
+            {
+                emitter.load_addr((uint64_t)&vu.int_gpr[vi_reg], REG_64::RAX);
+                emitter.MOV16_TO_MEM((REG_64)i, REG_64::RAX);
+            }
+            int_regs[i].used = false;
+            int_regs[i].last_use = -1;
+        }
+    }
+}
+
+void VU_JIT64::compute_live_ranges(std::vector<IR::Instruction>& instrs)
+{
+    for (int i = 0; i <= VU_SpecialReg::R; i++)
+        vf_uses[i].clear();
+    for (int i = 0; i < 16; i++)
+        vi_uses[i].clear();
+
+    VU_OpInfo info;
+    for (unsigned int i = 0; i < instrs.size(); i++)
+    {
+        VU_JitOptimizer::get_op_info(instrs[i], info);
+
+        for (int j = 0; j < info.vf_read_count; j++)
+            vf_uses[info.vf_read[j].reg].push_back(i);
+        if (info.vf_write >= 0)
+            vf_uses[info.vf_write].push_back(i);
+
+        for (int j = 0; j < info.vi_read_count; j++)
+            vi_uses[info.vi_read[j].reg].push_back(i);
+        for (int j = 0; j < info.vi_write_count; j++)
+            vi_uses[info.vi_write[j]].push_back(i);
+    }
+
+    //Instructions can name the same register more than once
+    for (int i = 0; i <= VU_SpecialReg::R; i++)
+        vf_uses[i].erase(std::unique(vf_uses[i].begin(), vf_uses[i].end()), vf_uses[i].end());
+    for (int i = 0; i < 16; i++)
+        vi_uses[i].erase(std::unique(vi_uses[i].begin(), vi_uses[i].end()), vi_uses[i].end());
+}
+
 void VU_JIT64::emit_prologue()
 {
 #ifdef _WIN32
@@ -2917,9 +3131,46 @@ void VU_JIT64::emit_instruction(VectorUnit &vu, IR::Instruction &instr)
     }
 }
 
+//Clears the field mask of each VF write in a stall pipeline entry that doesn't name a register.
+//The stall checks only look at the mask when the register matches a nonzero read.
+static uint64_t normalize_stall_entry(uint64_t entry)
+{
+    if (!(entry & 0x1F))
+        entry &= ~(0xFULL << 10);
+    if (!((entry >> 5) & 0x1F))
+        entry &= ~(0xFULL << 14);
+    return entry;
+}
+
+/**
+ * Builds the cache key for the block at the current PC.
+ * The translator only reads part of the pipeline state a block is entered with, so two entries that differ
+ * in the rest compile to the same code. Keying on the canonical state keeps them from becoming separate blocks:
+ * - Without a previous block the state is ignored, which is the same as an empty pipeline. The previous PC
+ *   itself is never looked at, so it doesn't need to be in the key at all.
+ * - The last stall stage is shifted out before the first instruction's stall check.
+ * - Write masks of empty VF write slots are never compared.
+ */
+BlockState VU_JIT64::get_block_state(VectorUnit &vu)
+{
+    uint64_t state[2] = {0, 0};
+    if (prev_pc != 0xFFFFFFFF)
+    {
+        for (int i = 0; i < 3; i++)
+            state[0] |= normalize_stall_entry((vu.pipeline_state[0] >> (i * 23)) & 0x7FFFFF) << (i * 23);
+
+        //Q/P delays and the delay slot flags are kept as is. The decoder writes use the stall entry layout.
+        state[1] = vu.pipeline_state[1] & ((0x3FFULL << 23) | (0x3ULL << 55));
+        state[1] |= normalize_stall_entry((vu.pipeline_state[1] >> 33) & 0x3FFFFF) << 33;
+    }
+
+    return BlockState { vu.get_PC(), 0, current_program, state[0], state[1] };
+}
+
 void VU_JIT64::recompile_block(VectorUnit& vu, IR::Block& block)
 {
-    cache.alloc_block(BlockState { vu.get_PC(), prev_pc, current_program, vu.pipeline_state[0], vu.pipeline_state[1] });
+    cache.alloc_block(get_block_state(vu));
+    cache_stats.blocks_compiled++;
 
     vu_branch = false;
     end_of_program = false;
@@ -2932,10 +3183,15 @@ void VU_JIT64::recompile_block(VectorUnit& vu, IR::Block& block)
     emitter.PUSH(REG_64::RBP);
     emitter.MOV64_MR(REG_64::RSP, REG_64::RBP);
 
-    while (block.get_instruction_count() > 0)
+    std::list<IR::Instruction>& list = block.get_instructions();
+    std::vector<IR::Instruction> instrs(list.begin(), list.end());
+    compute_live_ranges(instrs);
+    alloc_stats.blocks++;
+
+    for (cur_instr = 0; cur_instr < (int)instrs.size(); cur_instr++)
     {
-        IR::Instruction instr = block.get_next_instr();
-        emit_instruction(vu, instr);
+        emit_instruction(vu, instrs[cur_instr]);
+        expire_regs(vu);
     }
 
     if (vu_branch)
@@ -2957,9 +3213,9 @@ void VU_JIT64::cleanup_recompiler(VectorUnit& vu, bool clear_regs)
     {
         for (int i = 0; i < 16; i++)
         {
-            int_regs[i].age = 0;
+            int_regs[i].last_use = -1;
             int_regs[i].used = false;
-            xmm_regs[i].age = 0;
+            xmm_regs[i].last_use = -1;
             xmm_regs[i].used = false;
         }
     }
@@ -3023,13 +3279,13 @@ void VU_JIT64::prepare_abi(VectorUnit& vu, uint64_t value)
             emitter.MOV64_TO_MEM(arg, REG_64::RAX);
         }
         int_regs[arg].used = false;
-        int_regs[arg].age = 0;
+        int_regs[arg].last_use = -1;
     }
     emitter.load_addr(value, regs[abi_int_count]);
     abi_int_count++;
 }
 
-void VU_JIT64::call_abi_func(uint64_t addr)
+void VU_JIT64::call_abi_func(VectorUnit& vu, uint64_t addr)
 {
     const static REG_64 saved_regs[] = {RCX, RDX, R8, R9, R10, R11};
     int total_regs = sizeof(saved_regs) / sizeof(REG_64);
@@ -3045,6 +3301,35 @@ void VU_JIT64::call_abi_func(uint64_t addr)
         }
     }
   
+    //No XMM registers are preserved across calls, so stash the ones still needed by this block.
+    //Registers with no remaining uses are written back and dropped instead.
+    bool saved_xmm[16];
+    for (int i = 0; i < 16; i++)
+    {
+        saved_xmm[i] = false;
+        if (!xmm_regs[i].used || xmm_regs[i].locked)
+            continue;
+
+        int vf_reg = xmm_regs[i].vu_reg;
+        if (next_use(xmm_regs, vf_reg, cur_instr) >= 0)
+        {
+            emitter.load_addr((uint64_t)&xmm_spill[i], REG_64::RAX);
+            emitter.MOVAPS_TO_MEM((REG_64)i, REG_64::RAX);
+            saved_xmm[i] = true;
+            alloc_stats.call_saves++;
+        }
+        else
+        {
+            if (xmm_regs[i].modified && vf_reg)
+            {
+                emitter.load_addr(get_vf_addr(vu, vf_reg), REG_64::RAX);
+                emitter.MOVAPS_TO_MEM((REG_64)i, REG_64::RAX);
+            }
+            xmm_regs[i].used = false;
+            xmm_regs[i].last_use = -1;
+        }
+    }
+
     //Align stack pointer on 16-byte boundary
     if (regs_used & 1)
         sp_offset += 8;
@@ -3065,43 +3350,54 @@ void VU_JIT64::call_abi_func(uint64_t addr)
         if (int_regs[saved_regs[i]].used)
             emitter.POP(saved_regs[i]);
     }
+
+    for (int i = 0; i < 16; i++)
+    {
+        if (saved_xmm[i])
+        {
+            emitter.load_addr((uint64_t)&xmm_spill[i], REG_64::RAX);
+            emitter.MOVAPS_FROM_MEM(REG_64::RAX, (REG_64)i);
+        }
+    }
     abi_int_count = 0;
     abi_xmm_count = 0;
 }
 
 void VU_JIT64::fallback_interpreter(VectorUnit &vu, IR::Instruction &instr)
 {
-    flush_regs(vu);
-    for (int i = 0; i < 16; i++)
-    {
-        int_regs[i].age = 0;
-        int_regs[i].used = false;
-        xmm_regs[i].age = 0;
-        xmm_regs[i].used = false;
-    }
-
     uint32_t instr_word = instr.get_source();
+    bool is_upper = instr.get_field();
+
+    //Only the registers the instruction can name have to go back to the VU state.
+    //Upper instructions never touch VI registers.
+    uint64_t vf_mask = (1ULL << ((instr_word >> 6) & 0x1F)) | (1ULL << ((instr_word >> 11) & 0x1F)) |
+                       (1ULL << ((instr_word >> 16) & 0x1F));
+    flush_touched_regs(vu, vf_mask, !is_upper);
 
     //VU_Interpreter::upper/lower
     prepare_abi(vu, (uint64_t)&vu);
     prepare_abi(vu, instr_word);
 
-    bool is_upper = instr.get_field();
-
     if (is_upper)
-        call_abi_func((uint64_t)&interpreter_upper);
+        call_abi_func(vu, (uint64_t)&interpreter_upper);
     else
-        call_abi_func((uint64_t)&interpreter_lower);
+        call_abi_func(vu, (uint64_t)&interpreter_lower);
 }
 
 extern "C"
 uint8_t* exec_block(VU_JIT64& jit, VectorUnit& vu)
 {
     //printf("[VU_JIT64] Executing block at $%04X, Prev PC $%04X Current Program %08X: recompiling\n", vu.PC, jit.prev_pc, jit.current_program);
-    if (jit.cache.find_block(BlockState { vu.get_PC(), jit.prev_pc, jit.current_program, vu.pipeline_state[0], vu.pipeline_state[1] }) == nullptr)
+    BlockState state = jit.get_block_state(vu);
+    jit.cache_stats.lookups++;
+    if (state.param1 != vu.pipeline_state[0] || state.param2 != vu.pipeline_state[1])
+        jit.cache_stats.states_normalized++;
+
+    if (jit.cache.find_block(state) == nullptr)
     {
         //printf("[VU_JIT64] Block not found at $%04X, Prev PC $%04X Current Program %08X: recompiling\n", vu.PC, jit.prev_pc, jit.current_program);
         IR::Block block = jit.ir.translate(vu, vu.get_instr_mem(), jit.prev_pc);
+        jit.optimizer.optimize(block, vu.mem_mask);
         jit.recompile_block(vu, block);
     }
     return jit.cache.get_current_block_start();
@@ -2,6 +2,7 @@
 #define VU_JIT64_HPP
 #include "../jitcommon/emitter64.hpp"
 #include "../jitcommon/ir_block.hpp"
+#include "vu_jitopt.hpp"
 #include "vu_jittrans.hpp"
 #include "vu.hpp"
 
@@ -10,7 +11,7 @@ struct AllocReg
     bool used;
     bool locked; //Prevent the register from being allocated
     bool modified;
-    int age;
+    int last_use; //Index of the last IR instruction that touched the register
     int vu_reg;
     uint8_t needs_clamping;
 };
@@ -30,6 +31,21 @@ enum class REG_STATE
 
 extern "C" uint8_t* exec_block(VU_JIT64& jit, VectorUnit& vu);
 
+struct VU_JitAllocStats
+{
+    uint64_t blocks;
+    uint64_t spills; //Evictions of a register that is used again later in the block
+    uint64_t spill_stores; //Spills that also had to write the register back
+    uint64_t call_saves; //Registers kept alive across a call to C++ code
+};
+
+struct VU_JitCacheStats
+{
+    uint64_t lookups;
+    uint64_t states_normalized; //Lookups whose entry pipeline state had bits the translator never reads
+    uint64_t blocks_compiled;
+};
+
 class VU_JIT64
 {
     private:
@@ -38,6 +54,15 @@ class VU_JIT64
         JitCache cache;
         Emitter64 emitter;
         VU_JitTranslator ir;
+        VU_JitOptimizer optimizer;
+
+        //Per-block live ranges: the IR instruction indices where each register is used
+        std::vector<int> vf_uses[VU_SpecialReg::R + 1];
+        std::vector<int> vi_uses[16];
+        int cur_instr;
+        VU_GPR xmm_spill[16];
+        VU_JitAllocStats alloc_stats;
+        VU_JitCacheStats cache_stats;
 
         //Set to 0x7FFFFFFF, repeated four times
         VU_GPR abs_constant;
@@ -59,8 +84,17 @@ class VU_JIT64
         uint16_t vu_branch_delay_dest, vu_branch_delay_fail_dest;
         uint16_t cycle_count;
 
+        //Emit VEX-encoded AVX instructions where they save a copy; SSE4.1 is the baseline
+        bool use_avx;
+
         void clamp_vfreg(uint8_t field, REG_64 xmm_reg);
         void sse_abs(REG_64 source, REG_64 dest);
+        void sse_broadcast(uint8_t bc, REG_64 source, REG_64 dest);
+        void sse_add(REG_64 op1, REG_64 op2, REG_64 dest);
+        void sse_sub(REG_64 op1, REG_64 op2, REG_64 dest);
+        void sse_mul(REG_64 op1, REG_64 op2, REG_64 dest);
+        void sse_max(REG_64 op1, REG_64 op2, REG_64 dest);
+        void sse_min(REG_64 op1, REG_64 op2, REG_64 dest);
         void sse_div_check(REG_64 num, REG_64 denom, VU_R& dest);
 
         void handle_branch(VectorUnit& vu);
@@ -170,6 +204,8 @@ class VU_JIT64
         void save_pipeline_state(VectorUnit& vu, IR::Instruction& instr);
         void move_delayed_branch(VectorUnit& vu, IR::Instruction& instr);
 
+        void compute_live_ranges(std::vector<IR::Instruction>& instrs);
+        int next_use(AllocReg* regs, int vu_reg, int pos);
         int search_for_register(AllocReg* regs, int vu_reg);
         REG_64 alloc_int_reg(VectorUnit& vu, int vi_reg, REG_STATE state = REG_STATE::READ_WRITE);
         REG_64 alloc_sse_reg(VectorUnit& vu, int vf_reg, REG_STATE state = REG_STATE::READ_WRITE);
@@ -178,16 +214,19 @@ class VU_JIT64
         bool needs_clamping(int xmmreg, uint8_t field);
         void flush_regs(VectorUnit& vu);
         void flush_sse_reg(VectorUnit& vu, int vf_reg);
+        void flush_touched_regs(VectorUnit& vu, uint64_t vf_mask, bool flush_vi);
+        void expire_regs(VectorUnit& vu);
 
         void emit_prologue();
         void emit_instruction(VectorUnit& vu, IR::Instruction& instr);
+        BlockState get_block_state(VectorUnit& vu);
         void recompile_block(VectorUnit& vu, IR::Block& block);
         //uint8_t* exec_block(VectorUnit& vu);
         void cleanup_recompiler(VectorUnit& vu, bool clear_regs);
         void emit_epilogue();
 
         void prepare_abi(VectorUnit& vu, uint64_t value);
-        void call_abi_func(uint64_t addr);
+        void call_abi_func(VectorUnit& vu, uint64_t addr);
         void fallback_interpreter(VectorUnit& vu, IR::Instruction& instr);
     public:
         VU_JIT64();
@@ -196,6 +235,14 @@ class VU_JIT64
         void set_current_program(uint32_t crc);
         uint16_t run(VectorUnit& vu);
 
+        bool get_avx();
+        void set_avx(bool enabled);
+
+        const VU_JitOptStats& get_opt_stats();
+        const VU_JitAllocStats& get_alloc_stats();
+        const VU_JitCacheStats& get_cache_stats();
+        int get_block_variants(uint16_t pc);
+
         friend uint8_t* exec_block(VU_JIT64& jit, VectorUnit& vu);
 };
 
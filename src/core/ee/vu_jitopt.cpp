@@ -0,0 +1,870 @@
+#include <cstring>
+#include "vu_jitopt.hpp"
+#include "vu_jittrans.hpp"
+
+VU_JitOptimizer::VU_JitOptimizer()
+{
+    mem_mask = 0x3FFF;
+    reset_stats();
+}
+
+void VU_JitOptimizer::reset_stats()
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+const VU_JitOptStats& VU_JitOptimizer::get_stats()
+{
+    return stats;
+}
+
+void VU_JitOptimizer::optimize(IR::Block& block, uint16_t mem_mask)
+{
+    this->mem_mask = mem_mask;
+
+    std::list<IR::Instruction>& list = block.get_instructions();
+    instrs.assign(list.begin(), list.end());
+
+    stats.blocks++;
+    stats.instrs_in += instrs.size();
+
+    propagate_values();
+    forward_loads();
+    //Forwarded loads turn into moves which can be propagated in turn
+    propagate_values();
+
+    find_mac_producers();
+    eliminate_dead_flags();
+    find_mac_producers();
+    merge_pipeline_updates();
+    eliminate_dead_writes();
+
+    //Removed instructions are left behind as Null, which the backend doesn't accept
+    list.clear();
+    for (unsigned int i = 0; i < instrs.size(); i++)
+    {
+        if (instrs[i].op != IR::Opcode::Null)
+            list.push_back(instrs[i]);
+    }
+
+    stats.instrs_out += list.size();
+}
+
+void VU_JitOptimizer::remove(int index)
+{
+    instrs[index].op = IR::Opcode::Null;
+}
+
+static void add_read(VU_OpReg* regs, int& count, int reg, VU_OpSlot slot)
+{
+    regs[count].reg = reg;
+    regs[count].slot = slot;
+    count++;
+}
+
+void VU_JitOptimizer::get_op_info(IR::Instruction &instr, VU_OpInfo &info)
+{
+    info.vf_read_count = 0;
+    info.vi_read_count = 0;
+    info.vf_write = -1;
+    info.vf_write_field = 0;
+    info.vi_write_count = 0;
+    info.barrier = false;
+    info.pure = false;
+    info.mem_write = false;
+    info.flags_read = false;
+    info.flags_write = false;
+    info.mac_capable = false;
+
+    switch (instr.op)
+    {
+        case IR::Opcode::Null:
+            break;
+        case IR::Opcode::LoadConst:
+            info.vi_write[info.vi_write_count++] = instr.get_dest();
+            info.pure = true;
+            break;
+        case IR::Opcode::LoadFloatConst:
+            info.vf_write = instr.get_dest();
+            info.vf_write_field = 0xF;
+            info.pure = true;
+            break;
+        case IR::Opcode::LoadInt:
+            if (instr.get_base())
+                add_read(info.vi_read, info.vi_read_count, instr.get_base(), SLOT_BASE);
+            info.vi_write[info.vi_write_count++] = instr.get_dest();
+            info.pure = true;
+            break;
+        case IR::Opcode::StoreInt:
+            add_read(info.vi_read, info.vi_read_count, instr.get_source(), SLOT_SOURCE);
+            if (instr.get_base())
+                add_read(info.vi_read, info.vi_read_count, instr.get_base(), SLOT_BASE);
+            info.mem_write = true;
+            break;
+        case IR::Opcode::LoadQuad:
+            if (instr.get_base())
+                add_read(info.vi_read, info.vi_read_count, instr.get_base(), SLOT_BASE);
+            info.vf_write = instr.get_dest();
+            info.vf_write_field = instr.get_field();
+            info.pure = true;
+            break;
+        case IR::Opcode::StoreQuad:
+            add_read(info.vf_read, info.vf_read_count, instr.get_source(), SLOT_SOURCE);
+            if (instr.get_base())
+                add_read(info.vi_read, info.vi_read_count, instr.get_base(), SLOT_BASE);
+            info.mem_write = true;
+            break;
+        case IR::Opcode::LoadQuadInc:
+        case IR::Opcode::LoadQuadDec:
+            //The base is incremented in place, so it can't be swapped for a copy
+            add_read(info.vi_read, info.vi_read_count, instr.get_base(), SLOT_NONE);
+            if (instr.get_base())
+                info.vi_write[info.vi_write_count++] = instr.get_base();
+            info.vf_write = instr.get_dest();
+            info.vf_write_field = instr.get_field();
+            break;
+        case IR::Opcode::StoreQuadInc:
+        case IR::Opcode::StoreQuadDec:
+            add_read(info.vf_read, info.vf_read_count, instr.get_source(), SLOT_SOURCE);
+            add_read(info.vi_read, info.vi_read_count, instr.get_base(), SLOT_NONE);
+            if (instr.get_base())
+                info.vi_write[info.vi_write_count++] = instr.get_base();
+            info.mem_write = true;
+            break;
+        case IR::Opcode::MoveIntReg:
+        case IR::Opcode::AddUnsignedImm:
+        case IR::Opcode::SubUnsignedImm:
+            add_read(info.vi_read, info.vi_read_count, instr.get_source(), SLOT_SOURCE);
+            info.vi_write[info.vi_write_count++] = instr.get_dest();
+            info.pure = true;
+            break;
+        case IR::Opcode::AndInt:
+        case IR::Opcode::OrInt:
+        case IR::Opcode::AddIntReg:
+        case IR::Opcode::SubIntReg:
+            add_read(info.vi_read, info.vi_read_count, instr.get_source(), SLOT_SOURCE);
+            add_read(info.vi_read, info.vi_read_count, instr.get_source2(), SLOT_SOURCE2);
+            info.vi_write[info.vi_write_count++] = instr.get_dest();
+            info.pure = true;
+            break;
+        case IR::Opcode::Jump:
+            break;
+        case IR::Opcode::JumpAndLink:
+            info.vi_write[info.vi_write_count++] = instr.get_dest();
+            break;
+        case IR::Opcode::JumpIndirect:
+            add_read(info.vi_read, info.vi_read_count, instr.get_source(), SLOT_SOURCE);
+            break;
+        case IR::Opcode::JumpAndLinkIndirect:
+            add_read(info.vi_read, info.vi_read_count, instr.get_source(), SLOT_SOURCE);
+            info.vi_write[info.vi_write_count++] = instr.get_dest();
+            break;
+        case IR::Opcode::BranchEqual:
+        case IR::Opcode::BranchNotEqual:
+        {
+            //When the branch uses the backed up VI, the backend matches the register number itself
+            VU_OpSlot slot = instr.get_field() ? SLOT_NONE : SLOT_SOURCE;
+            VU_OpSlot slot2 = instr.get_field() ? SLOT_NONE : SLOT_SOURCE2;
+            add_read(info.vi_read, info.vi_read_count, instr.get_source(), slot);
+            add_read(info.vi_read, info.vi_read_count, instr.get_source2(), slot2);
+        }
+            break;
+        case IR::Opcode::BranchLessThanZero:
+        case IR::Opcode::BranchGreaterThanZero:
+        case IR::Opcode::BranchLessOrEqualThanZero:
+        case IR::Opcode::BranchGreaterOrEqualThanZero:
+            add_read(info.vi_read, info.vi_read_count, instr.get_source(),
+                     instr.get_field() ? SLOT_NONE : SLOT_SOURCE);
+            break;
+        case IR::Opcode::VAbs:
+        case IR::Opcode::VFixedToFloat0:
+        case IR::Opcode::VFixedToFloat4:
+        case IR::Opcode::VFixedToFloat12:
+        case IR::Opcode::VFixedToFloat15:
+        case IR::Opcode::VFloatToFixed0:
+        case IR::Opcode::VFloatToFixed4:
+        case IR::Opcode::VFloatToFixed12:
+        case IR::Opcode::VFloatToFixed15:
+        case IR::Opcode::VMoveFloat:
+        case IR::Opcode::VMoveRotatedFloat:
+            add_read(info.vf_read, info.vf_read_count, instr.get_source(), SLOT_SOURCE);
+            info.vf_write = instr.get_dest();
+            info.vf_write_field = instr.get_field();
+            info.pure = true;
+            break;
+        case IR::Opcode::VMaxVectorByScalar:
+        case IR::Opcode::VMaxVectors:
+        case IR::Opcode::VMinVectorByScalar:
+        case IR::Opcode::VMinVectors:
+            add_read(info.vf_read, info.vf_read_count, instr.get_source(), SLOT_SOURCE);
+            add_read(info.vf_read, info.vf_read_count, instr.get_source2(), SLOT_SOURCE2);
+            info.vf_write = instr.get_dest();
+            info.vf_write_field = instr.get_field();
+            info.pure = true;
+            break;
+        case IR::Opcode::VAddVectorByScalar:
+        case IR::Opcode::VAddVectors:
+        case IR::Opcode::VSubVectorByScalar:
+        case IR::Opcode::VSubVectors:
+        case IR::Opcode::VMulVectorByScalar:
+        case IR::Opcode::VMulVectors:
+            add_read(info.vf_read, info.vf_read_count, instr.get_source(), SLOT_SOURCE);
+            add_read(info.vf_read, info.vf_read_count, instr.get_source2(), SLOT_SOURCE2);
+            info.vf_write = instr.get_dest();
+            info.vf_write_field = instr.get_field();
+            info.pure = true;
+            info.mac_capable = true;
+            break;
+        case IR::Opcode::VMaddVectors:
+        case IR::Opcode::VMaddAccAndVectors:
+        case IR::Opcode::VMaddVectorByScalar:
+        case IR::Opcode::VMaddAccByScalar:
+        case IR::Opcode::VMsubVectors:
+        case IR::Opcode::VMsubVectorByScalar:
+        case IR::Opcode::VMsubAccByScalar:
+            add_read(info.vf_read, info.vf_read_count, instr.get_source(), SLOT_SOURCE);
+            add_read(info.vf_read, info.vf_read_count, instr.get_source2(), SLOT_SOURCE2);
+            add_read(info.vf_read, info.vf_read_count, VU_SpecialReg::ACC, SLOT_NONE);
+            info.vf_write = instr.get_dest();
+            info.vf_write_field = instr.get_field();
+            info.pure = true;
+            info.mac_capable = true;
+            break;
+        case IR::Opcode::VOpMula:
+            add_read(info.vf_read, info.vf_read_count, instr.get_source(), SLOT_SOURCE);
+            add_read(info.vf_read, info.vf_read_count, instr.get_source2(), SLOT_SOURCE2);
+            info.vf_write = VU_SpecialReg::ACC;
+            info.vf_write_field = 0xE;
+            info.pure = true;
+            info.mac_capable = true;
+            break;
+        case IR::Opcode::VOpMsub:
+            add_read(info.vf_read, info.vf_read_count, instr.get_source(), SLOT_SOURCE);
+            add_read(info.vf_read, info.vf_read_count, instr.get_source2(), SLOT_SOURCE2);
+            add_read(info.vf_read, info.vf_read_count, VU_SpecialReg::ACC, SLOT_NONE);
+            info.vf_write = instr.get_dest();
+            info.vf_write_field = 0xE;
+            info.pure = true;
+            info.mac_capable = true;
+            break;
+        case IR::Opcode::VDiv:
+        case IR::Opcode::VRsqrt:
+            add_read(info.vf_read, info.vf_read_count, instr.get_source(), SLOT_SOURCE);
+            add_read(info.vf_read, info.vf_read_count, instr.get_source2(), SLOT_SOURCE2);
+            break;
+        case IR::Opcode::VEleng:
+        case IR::Opcode::VErleng:
+        case IR::Opcode::VESqrt:
+        case IR::Opcode::VERsqrt:
+        case IR::Opcode::VRInit:
+            add_read(info.vf_read, info.vf_read_count, instr.get_source(), SLOT_SOURCE);
+            break;
+        case IR::Opcode::VMoveToInt:
+            add_read(info.vf_read, info.vf_read_count, instr.get_source(), SLOT_SOURCE);
+            info.vi_write[info.vi_write_count++] = instr.get_dest();
+            info.pure = true;
+            break;
+        case IR::Opcode::VMoveFromInt:
+            add_read(info.vi_read, info.vi_read_count, instr.get_source(), SLOT_SOURCE);
+            info.vf_write = instr.get_dest();
+            info.vf_write_field = instr.get_field();
+            info.pure = true;
+            break;
+        case IR::Opcode::VMoveFromP:
+            add_read(info.vf_read, info.vf_read_count, VU_SpecialReg::P, SLOT_NONE);
+            info.vf_write = instr.get_dest();
+            info.vf_write_field = instr.get_field();
+            info.pure = true;
+            break;
+        case IR::Opcode::VMacEq:
+        case IR::Opcode::VMacAnd:
+            add_read(info.vi_read, info.vi_read_count, instr.get_source(), SLOT_SOURCE);
+            info.vi_write[info.vi_write_count++] = instr.get_dest();
+            info.flags_read = true;
+            info.pure = true;
+            break;
+        case IR::Opcode::GetClipFlags:
+        case IR::Opcode::AndStatFlags:
+            info.vi_write[info.vi_write_count++] = instr.get_dest();
+            info.flags_read = true;
+            info.pure = true;
+            break;
+        case IR::Opcode::AndClipFlags:
+        case IR::Opcode::OrClipFlags:
+            info.vi_write[info.vi_write_count++] = 1;
+            info.flags_read = true;
+            info.pure = true;
+            break;
+        case IR::Opcode::SetClipFlags:
+            info.flags_write = true;
+            break;
+        case IR::Opcode::MoveXTOP:
+        case IR::Opcode::MoveXITOP:
+            info.vi_write[info.vi_write_count++] = instr.get_dest();
+            info.pure = true;
+            break;
+        case IR::Opcode::BackupVF:
+            add_read(info.vf_read, info.vf_read_count, instr.get_source(), SLOT_NONE);
+            break;
+        case IR::Opcode::RestoreVF:
+            info.vf_write = instr.get_source();
+            info.vf_write_field = 0xF;
+            break;
+        case IR::Opcode::BackupVI:
+            add_read(info.vi_read, info.vi_read_count, instr.get_source(), SLOT_NONE);
+            break;
+        case IR::Opcode::UpdateQ:
+            info.vf_write = VU_SpecialReg::Q;
+            info.vf_write_field = 0xF;
+            break;
+        case IR::Opcode::UpdateP:
+            info.vf_write = VU_SpecialReg::P;
+            info.vf_write_field = 0xF;
+            break;
+        case IR::Opcode::UpdateMacFlags:
+        case IR::Opcode::UpdateMacPipeline:
+        case IR::Opcode::UpdateXgkick:
+        case IR::Opcode::SavePC:
+        case IR::Opcode::SavePipelineState:
+        case IR::Opcode::MoveDelayedBranch:
+        case IR::Opcode::ClearIntDelay:
+            break;
+        default:
+            //Xgkick can leave the block on a stall, Stop flushes the pipelines,
+            //and VClip/FallbackInterpreter operate on the VU state directly
+            info.barrier = true;
+            break;
+    }
+
+    //vf0 and vi0 are hardwired
+    if (info.vf_write == 0)
+        info.vf_write = -1;
+    for (int i = 0; i < info.vi_write_count; i++)
+    {
+        if (!info.vi_write[i])
+        {
+            info.vi_write[i] = info.vi_write[info.vi_write_count - 1];
+            info.vi_write_count--;
+            i--;
+        }
+    }
+}
+
+void VU_JitOptimizer::find_mac_producers()
+{
+    //The backend only updates new_MAC_flags on the first MAC-capable op after an UpdateMacFlags marker
+    produces_mac.assign(instrs.size(), false);
+    bool pending = false;
+    VU_OpInfo info;
+    for (unsigned int i = 0; i < instrs.size(); i++)
+    {
+        if (instrs[i].op == IR::Opcode::UpdateMacFlags)
+        {
+            pending = true;
+            continue;
+        }
+        get_op_info(instrs[i], info);
+        if (pending && info.mac_capable)
+        {
+            produces_mac[i] = true;
+            pending = false;
+        }
+    }
+}
+
+void VU_JitOptimizer::clear_values()
+{
+    for (int i = 0; i < 16; i++)
+    {
+        vi_known[i] = false;
+        vi_copy[i] = -1;
+    }
+    for (int i = 0; i < 32; i++)
+        vf_copy[i] = -1;
+
+    vi_known[0] = true;
+    vi_value[0] = 0;
+}
+
+void VU_JitOptimizer::kill_vi(int reg)
+{
+    vi_known[reg] = false;
+    vi_copy[reg] = -1;
+    for (int i = 0; i < 16; i++)
+    {
+        if (vi_copy[i] == reg)
+            vi_copy[i] = -1;
+    }
+}
+
+void VU_JitOptimizer::kill_vf(int reg)
+{
+    if (reg < 32)
+        vf_copy[reg] = -1;
+    for (int i = 0; i < 32; i++)
+    {
+        if (vf_copy[i] == reg)
+            vf_copy[i] = -1;
+    }
+}
+
+static void set_slot(IR::Instruction& instr, VU_OpSlot slot, int reg)
+{
+    switch (slot)
+    {
+        case SLOT_SOURCE:
+            instr.set_source(reg);
+            break;
+        case SLOT_SOURCE2:
+            instr.set_source2(reg);
+            break;
+        case SLOT_BASE:
+            instr.set_base(reg);
+            break;
+        default:
+            break;
+    }
+}
+
+void VU_JitOptimizer::rewrite_reads(IR::Instruction &instr, VU_OpInfo &info)
+{
+    //Never substitute a register the instruction also writes: the backend allocates
+    //some destinations before their sources and relies on them being distinct
+    for (int i = 0; i < info.vi_read_count; i++)
+    {
+        VU_OpReg& op = info.vi_read[i];
+        if (op.slot == SLOT_NONE || op.reg >= 16 || vi_copy[op.reg] < 0)
+            continue;
+
+        int copy = vi_copy[op.reg];
+        bool clobbered = false;
+        for (int j = 0; j < info.vi_write_count; j++)
+            clobbered |= info.vi_write[j] == copy;
+        if (clobbered)
+            continue;
+
+        set_slot(instr, op.slot, copy);
+        op.reg = copy;
+        stats.copies_propagated++;
+    }
+
+    for (int i = 0; i < info.vf_read_count; i++)
+    {
+        VU_OpReg& op = info.vf_read[i];
+        if (op.slot == SLOT_NONE || op.reg >= 32 || vf_copy[op.reg] < 0)
+            continue;
+
+        int copy = vf_copy[op.reg];
+        if (info.vf_write == copy)
+            continue;
+
+        set_slot(instr, op.slot, copy);
+        op.reg = copy;
+        stats.copies_propagated++;
+    }
+}
+
+bool VU_JitOptimizer::fold_int_op(IR::Instruction &instr)
+{
+    bool binary_op;
+    switch (instr.op)
+    {
+        case IR::Opcode::MoveIntReg:
+        case IR::Opcode::AddUnsignedImm:
+        case IR::Opcode::SubUnsignedImm:
+            binary_op = false;
+            break;
+        case IR::Opcode::AndInt:
+        case IR::Opcode::OrInt:
+        case IR::Opcode::AddIntReg:
+        case IR::Opcode::SubIntReg:
+            binary_op = true;
+            break;
+        default:
+            return false;
+    }
+
+    int dest = instr.get_dest();
+    int s1 = instr.get_source();
+    int s2 = binary_op ? instr.get_source2() : 0;
+    bool k1 = vi_known[s1], k2 = vi_known[s2];
+    uint16_t v1 = vi_value[s1], v2 = vi_value[s2];
+    uint16_t imm = binary_op ? 0 : instr.get_source2();
+
+    //result < 0 means the op doesn't fold, otherwise it becomes a LoadConst or a MoveIntReg
+    int result = -1;
+    int move_from = -1;
+    switch (instr.op)
+    {
+        case IR::Opcode::MoveIntReg:
+            if (k1)
+                result = v1;
+            break;
+        case IR::Opcode::AddUnsignedImm:
+            if (k1)
+                result = (uint16_t)(v1 + imm);
+            else if (!imm)
+                move_from = s1;
+            break;
+        case IR::Opcode::SubUnsignedImm:
+            if (k1)
+                result = (uint16_t)(v1 - imm);
+            else if (!imm)
+                move_from = s1;
+            break;
+        case IR::Opcode::AddIntReg:
+            if (k1 && k2)
+                result = (uint16_t)(v1 + v2);
+            else if (k1 && !v1)
+                move_from = s2;
+            else if (k2 && !v2)
+                move_from = s1;
+            break;
+        case IR::Opcode::SubIntReg:
+            if (k1 && k2)
+                result = (uint16_t)(v1 - v2);
+            else if (s1 == s2)
+                result = 0;
+            else if (k2 && !v2)
+                move_from = s1;
+            break;
+        case IR::Opcode::AndInt:
+            if (k1 && k2)
+                result = v1 & v2;
+            else if ((k1 && !v1) || (k2 && !v2))
+                result = 0;
+            else if (s1 == s2)
+                move_from = s1;
+            break;
+        case IR::Opcode::OrInt:
+            if (k1 && k2)
+                result = v1 | v2;
+            else if (k1 && !v1)
+                move_from = s2;
+            else if ((k2 && !v2) || s1 == s2)
+                move_from = s1;
+            break;
+        default:
+            break;
+    }
+
+    if (result >= 0)
+    {
+        instr.op = IR::Opcode::LoadConst;
+        instr.set_dest(dest);
+        instr.set_source(result);
+        stats.constants_folded++;
+        return true;
+    }
+    else if (move_from >= 0 && instr.op != IR::Opcode::MoveIntReg)
+    {
+        instr.op = IR::Opcode::MoveIntReg;
+        instr.set_dest(dest);
+        instr.set_source(move_from);
+        stats.constants_folded++;
+        return true;
+    }
+    return false;
+}
+
+bool VU_JitOptimizer::fold_address(IR::Instruction &instr)
+{
+    //A known base turns into an absolute address, matching the masking the backend does at runtime
+    bool offset_in_source;
+    switch (instr.op)
+    {
+        case IR::Opcode::LoadInt:
+        case IR::Opcode::LoadQuad:
+            offset_in_source = true;
+            break;
+        case IR::Opcode::StoreInt:
+        case IR::Opcode::StoreQuad:
+            offset_in_source = false;
+            break;
+        default:
+            return false;
+    }
+
+    int base = instr.get_base();
+    if (!base || !vi_known[base])
+        return false;
+
+    uint16_t imm = offset_in_source ? instr.get_source() : instr.get_source2();
+    uint16_t addr = (uint16_t)((uint16_t)(vi_value[base] << 4) + imm) & mem_mask;
+
+    instr.set_base(0);
+    if (offset_in_source)
+        instr.set_source(addr);
+    else
+        instr.set_source2(addr);
+    stats.constants_folded++;
+    return true;
+}
+
+void VU_JitOptimizer::propagate_values()
+{
+    //Forward pass: constant folding, copy propagation, and removal of moves that do nothing
+    clear_values();
+    VU_OpInfo info;
+    for (unsigned int i = 0; i < instrs.size(); i++)
+    {
+        IR::Instruction& instr = instrs[i];
+        if (instr.op == IR::Opcode::Null)
+            continue;
+
+        get_op_info(instr, info);
+        if (info.barrier)
+        {
+            clear_values();
+            continue;
+        }
+
+        rewrite_reads(instr, info);
+        if (fold_int_op(instr) || fold_address(instr))
+            get_op_info(instr, info);
+
+        if ((instr.op == IR::Opcode::MoveIntReg || instr.op == IR::Opcode::VMoveFloat) &&
+            instr.get_dest() == (int)instr.get_source())
+        {
+            remove(i);
+            stats.moves_removed++;
+            continue;
+        }
+
+        for (int j = 0; j < info.vi_write_count; j++)
+            kill_vi(info.vi_write[j]);
+        if (info.vf_write >= 0)
+            kill_vf(info.vf_write);
+
+        switch (instr.op)
+        {
+            case IR::Opcode::LoadConst:
+                if (instr.get_dest())
+                {
+                    vi_known[instr.get_dest()] = true;
+                    vi_value[instr.get_dest()] = instr.get_source();
+                }
+                break;
+            case IR::Opcode::MoveIntReg:
+                if (instr.get_dest())
+                    vi_copy[instr.get_dest()] = instr.get_source();
+                break;
+            case IR::Opcode::VMoveFloat:
+                if (instr.get_dest() > 0 && instr.get_dest() < 32 &&
+                    instr.get_source() < 32 && instr.get_field() == 0xF)
+                    vf_copy[instr.get_dest()] = instr.get_source();
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void VU_JitOptimizer::forward_loads()
+{
+    //Tracks which VF register holds the quadword at a fixed address, so that
+    //reloading it (or loading back what was just stored) becomes a register move
+    mem_quads.clear();
+    VU_OpInfo info;
+    for (unsigned int i = 0; i < instrs.size(); i++)
+    {
+        IR::Instruction& instr = instrs[i];
+        if (instr.op == IR::Opcode::Null)
+            continue;
+
+        get_op_info(instr, info);
+        if (info.barrier)
+        {
+            mem_quads.clear();
+            continue;
+        }
+
+        int known_reg = -1;
+        uint16_t addr = 0;
+        bool fixed_addr = !instr.get_base() && instr.get_field() == 0xF;
+        if (instr.op == IR::Opcode::LoadQuad && fixed_addr && instr.get_dest())
+        {
+            addr = instr.get_source() & 0x3FFF;
+            for (unsigned int j = 0; j < mem_quads.size(); j++)
+            {
+                if (mem_quads[j].first == addr)
+                    known_reg = mem_quads[j].second;
+            }
+
+            if (known_reg >= 0)
+            {
+                stats.loads_forwarded++;
+                if (known_reg == instr.get_dest())
+                {
+                    remove(i);
+                    continue;
+                }
+                instr.op = IR::Opcode::VMoveFloat;
+                instr.set_source(known_reg);
+                get_op_info(instr, info);
+            }
+        }
+
+        if (info.mem_write)
+        {
+            if (instr.op == IR::Opcode::StoreQuad && !instr.get_base())
+            {
+                addr = instr.get_source2() & 0x3FFF;
+                for (unsigned int j = 0; j < mem_quads.size(); j++)
+                {
+                    if (mem_quads[j].first == addr)
+                        mem_quads.erase(mem_quads.begin() + j--);
+                }
+            }
+            else if (instr.op == IR::Opcode::StoreInt && !instr.get_base())
+            {
+                addr = (instr.get_source2() & mem_mask) & ~0xF;
+                for (unsigned int j = 0; j < mem_quads.size(); j++)
+                {
+                    if (mem_quads[j].first == addr)
+                        mem_quads.erase(mem_quads.begin() + j--);
+                }
+            }
+            else
+                mem_quads.clear();
+        }
+
+        if (info.vf_write >= 0)
+        {
+            for (unsigned int j = 0; j < mem_quads.size(); j++)
+            {
+                if (mem_quads[j].second == info.vf_write)
+                    mem_quads.erase(mem_quads.begin() + j--);
+            }
+        }
+
+        if (instr.op == IR::Opcode::StoreQuad && fixed_addr)
+            mem_quads.push_back(std::make_pair(addr, (int)instr.get_source()));
+        else if (instr.op == IR::Opcode::LoadQuad && fixed_addr && instr.get_dest())
+            mem_quads.push_back(std::make_pair(addr, instr.get_dest()));
+    }
+}
+
+void VU_JitOptimizer::eliminate_dead_flags()
+{
+    //A MAC result that is overwritten before the pipeline advances is never observed
+    bool mac_live = true;
+    VU_OpInfo info;
+    for (int i = instrs.size() - 1; i >= 0; i--)
+    {
+        IR::Instruction& instr = instrs[i];
+        if (instr.op == IR::Opcode::UpdateMacPipeline)
+        {
+            mac_live = true;
+            continue;
+        }
+
+        get_op_info(instr, info);
+        if (info.barrier)
+        {
+            mac_live = true;
+            continue;
+        }
+
+        if (produces_mac[i])
+        {
+            if (!mac_live)
+            {
+                for (int j = i - 1; j >= 0; j--)
+                {
+                    if (instrs[j].op == IR::Opcode::UpdateMacFlags)
+                    {
+                        remove(j);
+                        stats.dead_flags_removed++;
+                        break;
+                    }
+                }
+            }
+            mac_live = false;
+        }
+    }
+}
+
+void VU_JitOptimizer::merge_pipeline_updates()
+{
+    //Advancing the flag pipelines N cycles then M cycles is the same as advancing N + M cycles
+    //once, as long as nothing in between reads the pipelines or feeds them a new value
+    int last_update = -1;
+    VU_OpInfo info;
+    for (unsigned int i = 0; i < instrs.size(); i++)
+    {
+        IR::Instruction& instr = instrs[i];
+        if (instr.op == IR::Opcode::Null)
+            continue;
+
+        if (instr.op == IR::Opcode::UpdateMacPipeline)
+        {
+            if (last_update >= 0)
+            {
+                IR::Instruction& update = instrs[last_update];
+                update.set_source(update.get_source() + instr.get_source());
+                remove(i);
+                stats.pipeline_updates_merged++;
+            }
+            else
+                last_update = i;
+            continue;
+        }
+
+        get_op_info(instr, info);
+        if (info.barrier || info.flags_read || info.flags_write || produces_mac[i] ||
+            instr.op == IR::Opcode::UpdateMacFlags)
+            last_update = -1;
+    }
+}
+
+void VU_JitOptimizer::eliminate_dead_writes()
+{
+    //Backward liveness, tracked per field for VF registers. Everything is live at the block exit.
+    uint8_t vf_live[VU_SpecialReg::R + 1];
+    bool vi_live[16];
+    memset(vf_live, 0xF, sizeof(vf_live));
+    memset(vi_live, true, sizeof(vi_live));
+
+    VU_OpInfo info;
+    for (int i = instrs.size() - 1; i >= 0; i--)
+    {
+        IR::Instruction& instr = instrs[i];
+        if (instr.op == IR::Opcode::Null)
+            continue;
+
+        get_op_info(instr, info);
+        if (info.barrier)
+        {
+            memset(vf_live, 0xF, sizeof(vf_live));
+            memset(vi_live, true, sizeof(vi_live));
+            continue;
+        }
+
+        if (info.pure && !produces_mac[i])
+        {
+            bool dead = true;
+            if (info.vf_write >= 0 && (vf_live[info.vf_write] & info.vf_write_field))
+                dead = false;
+            for (int j = 0; j < info.vi_write_count; j++)
+                dead &= !vi_live[info.vi_write[j]];
+
+            if (dead)
+            {
+                remove(i);
+                stats.dead_writes_removed++;
+                continue;
+            }
+        }
+
+        if (info.vf_write >= 0)
+            vf_live[info.vf_write] &= ~info.vf_write_field;
+        for (int j = 0; j < info.vi_write_count; j++)
+            vi_live[info.vi_write[j]] = false;
+
+        for (int j = 0; j < info.vf_read_count; j++)
+            vf_live[info.vf_read[j].reg] = 0xF;
+        for (int j = 0; j < info.vi_read_count; j++)
+            vi_live[info.vi_read[j].reg] = true;
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef VU_JITOPT_HPP
+#define VU_JITOPT_HPP
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "../jitcommon/ir_block.hpp"
+
+struct VU_JitOptStats
+{
+    uint64_t blocks;
+    uint64_t instrs_in;
+    uint64_t instrs_out;
+
+    uint64_t constants_folded;
+    uint64_t copies_propagated;
+    uint64_t moves_removed;
+    uint64_t loads_forwarded;
+    uint64_t dead_flags_removed;
+    uint64_t pipeline_updates_merged;
+    uint64_t dead_writes_removed;
+};
+
+//Which field of an IR instruction holds a register operand, so that it can be rewritten
+enum VU_OpSlot
+{
+    SLOT_NONE,
+    SLOT_SOURCE,
+    SLOT_SOURCE2,
+    SLOT_BASE
+};
+
+struct VU_OpReg
+{
+    int reg;
+    VU_OpSlot slot;
+};
+
+struct VU_OpInfo
+{
+    VU_OpReg vf_read[3];
+    int vf_read_count;
+    VU_OpReg vi_read[2];
+    int vi_read_count;
+
+    int vf_write;
+    uint8_t vf_write_field;
+    int vi_write[2];
+    int vi_write_count;
+
+    bool barrier; //Touches all VU state or can leave the block early
+    bool pure; //Only effect is the register writes above
+    bool mem_write;
+    bool flags_read; //Reads MAC/CLIP/status pipelines
+    bool flags_write; //Writes clip_flags directly
+    bool mac_capable; //Writes new_MAC_flags when preceded by UpdateMacFlags
+};
+
+//Runs between VU_JitTranslator::translate and VU_JIT64::recompile_block.
+//Blocks are straight-line code, so each pass is a single forward or backward walk.
+class VU_JitOptimizer
+{
+    private:
+        VU_JitOptStats stats;
+
+        std::vector<IR::Instruction> instrs;
+        std::vector<bool> produces_mac;
+        uint16_t mem_mask;
+
+        //Forward state
+        bool vi_known[16];
+        uint16_t vi_value[16];
+        int vi_copy[16];
+        int vf_copy[32];
+        std::vector<std::pair<uint16_t, int>> mem_quads;
+
+        void remove(int index);
+        void find_mac_producers();
+
+        void clear_values();
+        void kill_vi(int reg);
+        void kill_vf(int reg);
+        void rewrite_reads(IR::Instruction& instr, VU_OpInfo& info);
+        bool fold_int_op(IR::Instruction& instr);
+        bool fold_address(IR::Instruction& instr);
+
+        void propagate_values();
+        void forward_loads();
+        void eliminate_dead_flags();
+        void merge_pipeline_updates();
+        void eliminate_dead_writes();
+    public:
+        VU_JitOptimizer();
+
+        static void get_op_info(IR::Instruction& instr, VU_OpInfo& info);
+        void optimize(IR::Block& block, uint16_t mem_mask);
+
+        void reset_stats();
+        const VU_JitOptStats& get_stats();
+};
+
+#endif // VU_JITOPT_HPP
@@ -0,0 +1,127 @@
+#include <cfenv>
+#include <cstdio>
+#include "vu_thread.hpp"
+#include "vu.hpp"
+
+//How many times the thread polls for new work before it goes to sleep.
+//Slices arrive every few microseconds while a microprogram runs, so sleeping right away costs more than it saves.
+#define SPIN_COUNT 4096
+
+VectorUnitThread::VectorUnitThread(VectorUnit* vu, std::function<void(VectorUnit&, int)>* run_func) :
+    vu(vu), run_func(run_func)
+{
+    pending_cycles = 0;
+    sleeping = false;
+    busy = false;
+}
+
+VectorUnitThread::~VectorUnitThread()
+{
+    stop();
+}
+
+void VectorUnitThread::start()
+{
+    if (is_active())
+        return;
+
+    pending_cycles = 0;
+    sleeping = false;
+    busy = false;
+    error = nullptr;
+    vu->set_defer_IRQ(true);
+    thread = std::thread(&VectorUnitThread::thread_loop, this);
+    printf("[VU%d] Running on a separate thread\n", vu->get_id());
+}
+
+void VectorUnitThread::stop()
+{
+    if (!is_active())
+        return;
+
+    //Let the current slice finish, but don't throw from here, as this can be called from a destructor
+    while (busy && pending_cycles.load(std::memory_order_acquire) > 0)
+        std::this_thread::yield();
+    busy = false;
+
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        pending_cycles = -1;
+    }
+    wake.notify_one();
+    thread.join();
+
+    error = nullptr;
+    vu->set_defer_IRQ(false);
+}
+
+void VectorUnitThread::run(int cycles)
+{
+    sync();
+    if (cycles <= 0)
+        return;
+
+    vu->begin_threaded_slice();
+    busy = true;
+    pending_cycles.store(cycles);
+    if (sleeping.load())
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wake.notify_one();
+    }
+}
+
+void VectorUnitThread::wait_for_idle()
+{
+    while (pending_cycles.load(std::memory_order_acquire) > 0)
+        std::this_thread::yield();
+    busy = false;
+
+    vu->raise_deferred_IRQ();
+
+    if (error)
+    {
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+void VectorUnitThread::thread_loop()
+{
+    //The rounding mode is per thread, and the VU relies on the one Emulator::run sets
+    fesetround(FE_TOWARDZERO);
+
+    while (true)
+    {
+        int cycles = 0;
+        for (int i = 0; i < SPIN_COUNT && !cycles; i++)
+        {
+            cycles = pending_cycles.load(std::memory_order_acquire);
+            if (!cycles)
+                std::this_thread::yield();
+        }
+
+        if (!cycles)
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            sleeping.store(true);
+            wake.wait(lock, [this] { return pending_cycles.load() != 0; });
+            sleeping.store(false);
+            continue;
+        }
+
+        if (cycles < 0)
+            return;
+
+        try
+        {
+            (*run_func)(*vu, cycles);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        pending_cycles.store(0, std::memory_order_release);
+    }
+}
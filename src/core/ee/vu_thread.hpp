@@ -0,0 +1,59 @@
+#ifndef VU_THREAD_HPP
+#define VU_THREAD_HPP
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class VectorUnit;
+
+//Runs slices of a VU on a dedicated thread while the caller carries on with other work.
+//The caller must call sync() before touching anything the VU can touch: its memory and registers,
+//the GIF (through XGKICK), and the scheduler. Interrupts raised by the VU are held until sync().
+class VectorUnitThread
+{
+    private:
+        VectorUnit* vu;
+        std::function<void(VectorUnit&, int)>* run_func;
+
+        std::thread thread;
+        std::mutex wake_mutex;
+        std::condition_variable wake;
+
+        //Cycles handed to the thread, 0 when it is idle, negative to make it exit
+        std::atomic<int> pending_cycles;
+        std::atomic<bool> sleeping;
+        std::exception_ptr error;
+
+        //Only touched by the owning thread: a slice was handed over and hasn't been collected yet
+        bool busy;
+
+        void thread_loop();
+        void wait_for_idle();
+    public:
+        VectorUnitThread(VectorUnit* vu, std::function<void(VectorUnit&, int)>* run_func);
+        ~VectorUnitThread();
+
+        void start();
+        void stop();
+        bool is_active();
+
+        void run(int cycles);
+        void sync();
+};
+
+inline bool VectorUnitThread::is_active()
+{
+    return thread.joinable();
+}
+
+inline void VectorUnitThread::sync()
+{
+    //Cheap enough to call on every MMIO access when the thread is idle or disabled
+    if (busy)
+        wait_for_idle();
+}
+
+#endif // VU_THREAD_HPP
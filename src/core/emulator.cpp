@@ -18,7 +18,7 @@
 Emulator::Emulator() :
     cdvd(this, &iop_dma),
     cp0(&dmac),
-    cpu(&cp0, &fpu, this, &vu0, &vu1, &ee_breakpoints),
+    cpu(&cp0, &fpu, this, &vu0, &vu1, &ee_breakpoints, &RDRAM_pages),
     dmac(&cpu, this, &gif, &ipu, &sif, &vif0, &vif1, &vu0, &vu1),
     gif(&gs, &dmac),
     gs(&intc),
@@ -35,7 +35,8 @@ Emulator::Emulator() :
     vif1(&gif, &vu1, &intc, &dmac, 1),
     vu0(0, this, &intc, &cpu),
     vu1(1, this, &intc, &cpu),
-    sif(&iop_dma, &dmac)
+    sif(&iop_dma, &dmac),
+    vu1_thread(&vu1, &vu1_run_func)
 {
     BIOS = nullptr;
     RDRAM = nullptr;
@@ -43,13 +44,19 @@ Emulator::Emulator() :
     SPU_RAM = nullptr;
     ELF_file = nullptr;
     ELF_size = 0;
+    save_incremental = false;
+    rewind_requested = false;
+    rewind_interval = 0;
+    rewind_frame_count = 0;
     gsdump_single_frame = false;
+    deterministic = false;
     ee_log.open("ee_log.txt", std::ios::out);
     set_vu1_mode(VU_MODE::DONT_CARE);
 }
 
 Emulator::~Emulator()
 {
+    movie.stop();
     if (ee_log.is_open())
         ee_log.close();
     delete[] RDRAM;
@@ -61,6 +68,8 @@ Emulator::~Emulator()
 
 void Emulator::run()
 {
+    profiler.begin_frame();
+    movie.begin_frame(pad);
     gs.start_frame();
     VBLANK_sent = false;
     const int originalRounding = fegetround();
@@ -69,6 +78,10 @@ void Emulator::run()
         save_state(save_state_path.c_str());
     if (load_requested)
         load_state(save_state_path.c_str());
+    if (rewind_requested)
+        rewind();
+    else if (rewind_interval && ++rewind_frame_count >= rewind_interval)
+        capture_rewind_state();
     if (gsdump_requested)
     {
         gsdump_requested = false;
@@ -100,32 +113,60 @@ void Emulator::run()
         int bus_cycles = scheduler.get_bus_run_cycles();
         int iop_cycles = scheduler.get_iop_run_cycles();
         scheduler.update_cycle_counts();
+        profiler.begin_slice();
+
+        PROFILE(profiler, PROFILE_EE, ee_cycles, cpu.run(ee_cycles));
+
+        //VU1 gets a slice at the same point as below, and the next EE slice and the IOP run alongside it.
+        //Everything that follows can touch VU1, the GIF, or the INTC.
+        PROFILE(profiler, PROFILE_VU1_SYNC, 0, sync_vu1());
+
+        if (!dmac.is_idle())
+            PROFILE(profiler, PROFILE_DMAC, bus_cycles, dmac.run(bus_cycles));
+        PROFILE(profiler, PROFILE_TIMERS, bus_cycles, timers.run(bus_cycles));
+        PROFILE(profiler, PROFILE_IPU, 0, ipu.run());
+        PROFILE(profiler, PROFILE_VIF0, bus_cycles, vif0.update(bus_cycles));
+        PROFILE(profiler, PROFILE_VIF1, bus_cycles, vif1.update(bus_cycles));
+        PROFILE(profiler, PROFILE_GIF, bus_cycles, gif.run(bus_cycles));
+        PROFILE(profiler, PROFILE_VU0, bus_cycles, vu0.run(bus_cycles));
+        PROFILE(profiler, PROFILE_VU1, bus_cycles,
+            if (vu1_thread.is_active() && vu1.is_running())
+                vu1_thread.run(bus_cycles);
+            else
+                vu1_run_func(vu1, bus_cycles);
+        );
+
+        PROFILE(profiler, PROFILE_IOP_TIMERS, iop_cycles, iop_timers.run(iop_cycles));
+        PROFILE(profiler, PROFILE_IOP_DMA, iop_cycles, iop_dma.run(iop_cycles));
+        PROFILE(profiler, PROFILE_IOP, iop_cycles,
+            for (int i = 0; i < iop_cycles; i++)
+            {
+                iop.run(1);
+                iop.interrupt_check(IOP_I_CTRL && (IOP_I_MASK & IOP_I_STAT));
+            }
+        );
 
-        cpu.run(ee_cycles);
-        dmac.run(bus_cycles);
-        timers.run(bus_cycles);
-        ipu.run();
-        vif0.update(bus_cycles);
-        vif1.update(bus_cycles);
-        gif.run(bus_cycles);
-        vu0.run(bus_cycles);
-        vu1_run_func(vu1, bus_cycles);
-
-        iop_timers.run(iop_cycles);
-        iop_dma.run(iop_cycles);
-        for (int i = 0; i < iop_cycles; i++)
-        {
-            iop.run(1);
-            iop.interrupt_check(IOP_I_CTRL && (IOP_I_MASK & IOP_I_STAT));
-        }
-
-        scheduler.process_events(this);
+        if (scheduler.events_pending())
+            PROFILE(profiler, PROFILE_VU1_SYNC, 0, sync_vu1());
+        PROFILE(profiler, PROFILE_EVENTS, 0, scheduler.process_events(this));
     }
+    PROFILE(profiler, PROFILE_VU1_SYNC, 0, sync_vu1());
     fesetround(originalRounding);
+
+    if (movie.is_active())
+        movie.end_frame(hash_state());
+
+    if (Profiler::is_enabled())
+    {
+        uint64_t gs_ticks, gs_messages;
+        gs.take_profile_counters(gs_ticks, gs_messages);
+        profiler.end_frame(gs_ticks, gs_messages);
+    }
 }
 
 void Emulator::reset()
 {
+    sync_vu1();
     save_requested = false;
     load_requested = false;
     gsdump_requested = false;
@@ -134,7 +175,11 @@ void Emulator::reset()
     frames = 0;
     skip_BIOS_hack = NONE;
     if (!RDRAM)
+    {
         RDRAM = new uint8_t[1024 * 1024 * 32];
+        RDRAM_pages.init(RDRAM, 1024 * 1024 * 32);
+    }
+    RDRAM_pages.mark_all();
     if (!IOP_RAM)
         IOP_RAM = new uint8_t[1024 * 1024 * 2];
     if (!BIOS)
@@ -147,7 +192,7 @@ void Emulator::reset()
     cp0.init_mem_pointers(RDRAM, BIOS, (uint8_t*)&scratchpad);
     cpu.reset();
     cpu.init_tlb();
-    dmac.reset(RDRAM, (uint8_t*)&scratchpad);
+    dmac.reset(RDRAM, (uint8_t*)&scratchpad, &RDRAM_pages);
     fpu.reset();
     gs.reset();
     gif.reset();
@@ -168,6 +213,7 @@ void Emulator::reset()
     vu0.reset();
     vu1.reset();
     VU_JIT::reset();
+    profiler.reset();
 
     MCH_DRD = 0;
     MCH_RICM = 0;
@@ -224,8 +270,10 @@ void Emulator::cdvd_event()
 
 void Emulator::gen_sound_sample()
 {
-    spu.gen_sample();
-    spu2.gen_sample();
+    PROFILE(profiler, PROFILE_SPU, 768,
+        spu.gen_sample();
+        spu2.gen_sample();
+    );
     add_iop_event(SPU_SAMPLE, &Emulator::gen_sound_sample, 768);
 }
 
@@ -235,19 +283,29 @@ void Emulator::ee_irq_check()
     intc.int0_check();
 }
 
+//While a movie is active, the pad only changes at the start of a frame, see movie.hpp
 void Emulator::press_button(PAD_BUTTON button)
 {
-    pad.press_button(button);
+    if (movie.is_active())
+        movie.queue_input(MOVIE_INPUT::PRESS, (uint8_t)button, 0, 0);
+    else
+        pad.press_button(button);
 }
 
 void Emulator::release_button(PAD_BUTTON button)
 {
-    pad.release_button(button);
+    if (movie.is_active())
+        movie.queue_input(MOVIE_INPUT::RELEASE, (uint8_t)button, 0, 0);
+    else
+        pad.release_button(button);
 }
 
 void Emulator::update_joystick(JOYSTICK joystick, JOYSTICK_AXIS axis, uint8_t val)
 {
-    pad.update_joystick(joystick, axis, val);
+    if (movie.is_active())
+        movie.queue_input(MOVIE_INPUT::JOYSTICK, (uint8_t)joystick, (uint8_t)axis, val);
+    else
+        pad.update_joystick(joystick, axis, val);
 }
 
 uint32_t* Emulator::get_framebuffer()
@@ -319,6 +377,7 @@ void Emulator::fast_boot()
             {
                 printf("OSDSYS string found at $%08X\n", str);
                 strcpy((char*)&RDRAM[str], path.c_str());
+                RDRAM_pages.mark_range(&RDRAM[str], path.size() + 1);
             }
         }
 
@@ -345,6 +404,32 @@ void Emulator::set_vu1_mode(VU_MODE mode)
     }
 }
 
+void Emulator::set_vu1_thread(bool enabled)
+{
+    if (enabled && deterministic)
+    {
+        printf("[EE] VU1 can't run on its own thread in deterministic mode\n");
+        return;
+    }
+    if (enabled)
+        vu1_thread.start();
+    else
+        vu1_thread.stop();
+}
+
+/**
+ * Makes a run depend only on the BIOS, the game, and the pad input, which movies need to play back.
+ * The RTC is pinned to a fixed date, and VU1 stays on the emulator thread, where its slices line up with the EE's
+ * the same way every run. Call before reset() so the RTC is set up with the fixed time.
+ */
+void Emulator::set_deterministic(bool enabled)
+{
+    deterministic = enabled;
+    cdvd.set_fixed_RTC(enabled);
+    if (enabled)
+        vu1_thread.stop();
+}
+
 void Emulator::load_BIOS(const uint8_t *BIOS_file)
 {
     if (!BIOS)
@@ -361,6 +446,7 @@ void Emulator::load_ELF(const uint8_t *ELF, uint32_t size)
         return;
     }
     printf("Valid elf\n");
+    rewind_buffer.clear();
     delete[] ELF_file;
     ELF_file = new uint8_t[size];
     ELF_size = size;
@@ -369,6 +455,7 @@ void Emulator::load_ELF(const uint8_t *ELF, uint32_t size)
 
 bool Emulator::load_CDVD(const char *name, CDVD_CONTAINER type)
 {
+    rewind_buffer.clear();
     return cdvd.load_disc(name, type);
 }
 
@@ -453,6 +540,7 @@ bool Emulator::interlock_cop2_check(bool isCOP2)
 
 uint8_t Emulator::read8(uint32_t address)
 {
+    sync_vu1();
     if (address >= 0x1C000000 && address < 0x1C200000)
         return IOP_RAM[address & 0x1FFFFF];
     if (address >= 0x10008000 && address < 0x1000F000)
@@ -472,6 +560,7 @@ uint8_t Emulator::read8(uint32_t address)
 
 uint16_t Emulator::read16(uint32_t address)
 {
+    sync_vu1();
     if (address >= 0x10000000 && address < 0x10002000)
         return (uint16_t)timers.read32(address);
     if (address >= 0x1C000000 && address < 0x1C200000)
@@ -489,6 +578,7 @@ uint16_t Emulator::read16(uint32_t address)
 
 uint32_t Emulator::read32(uint32_t address)
 {
+    sync_vu1();
     if (address >= 0x10000000 && address < 0x10002000)
         return timers.read32(address);
     if ((address & (0xFF000000)) == 0x12000000)
@@ -600,6 +690,7 @@ uint32_t Emulator::read32(uint32_t address)
 
 uint64_t Emulator::read64(uint32_t address)
 {
+    sync_vu1();
     if (address >= 0x10000000 && address < 0x10002000)
         return timers.read32(address);
     if (address >= 0x10008000 && address < 0x1000F000)
@@ -625,12 +716,14 @@ uint64_t Emulator::read64(uint32_t address)
 
 uint128_t Emulator::read128(uint32_t address)
 {
+    sync_vu1();
     printf("Unrecognized read128 at physical addr $%08X\n", address);
     return uint128_t::from_u32(0);
 }
 
 void Emulator::write8(uint32_t address, uint8_t value)
 {
+    sync_vu1();
     if (address >= 0x10008000 && address < 0x1000F000)
     {
         dmac.write8(address, value);
@@ -653,6 +746,7 @@ void Emulator::write8(uint32_t address, uint8_t value)
 
 void Emulator::write16(uint32_t address, uint16_t value)
 {
+    sync_vu1();
     if (address >= 0x10008000 && address < 0x1000F000)
     {
         dmac.write16(address, value);
@@ -673,6 +767,7 @@ void Emulator::write16(uint32_t address, uint16_t value)
 
 void Emulator::write32(uint32_t address, uint32_t value)
 {
+    sync_vu1();
     if (address >= 0x1C000000 && address < 0x1C200000)
     {
         *(uint32_t*)&IOP_RAM[address & 0x1FFFFF] = value;
@@ -797,6 +892,7 @@ void Emulator::write32(uint32_t address, uint32_t value)
 
 void Emulator::write64(uint32_t address, uint64_t value)
 {
+    sync_vu1();
     if (address >= 0x1C000000 && address < 0x1C200000)
     {
         *(uint64_t*)&IOP_RAM[address & 0x1FFFFF] = value;
@@ -843,6 +939,7 @@ void Emulator::write64(uint32_t address, uint64_t value)
 
 void Emulator::write128(uint32_t address, uint128_t value)
 {
+    sync_vu1();
     if (address >= 0x11000000 && address < 0x11010000)
     {
         if (address < 0x11004000)
@@ -1662,6 +1759,43 @@ GraphicsSynthesizer& Emulator::get_gs()
 {
     return gs;
 }
+
+Profiler& Emulator::get_profiler()
+{
+    return profiler;
+}
+
+InputMovie& Emulator::get_movie()
+{
+    return movie;
+}
+
+/**
+ * Hashes of the state a movie checks at the end of each frame. Hashing the GS waits for its thread to finish
+ * the frame, so the hash doesn't depend on how far behind the emulator thread it was running.
+ */
+StateHash Emulator::hash_state()
+{
+    StateHash hash;
+    hash.RDRAM = InputMovie::hash_memory(RDRAM, 1024 * 1024 * 32);
+    hash.GS = gs.hash_local_mem();
+
+    uint64_t regs[32 * 2 + 3 + 32 + 1];
+    int index = 0;
+    for (int i = 0; i < 32; i++)
+    {
+        regs[index++] = cpu.get_gpr<uint64_t>(i, 0);
+        regs[index++] = cpu.get_gpr<uint64_t>(i, 1);
+    }
+    regs[index++] = cpu.get_PC();
+    regs[index++] = cpu.get_LO();
+    regs[index++] = cpu.get_HI();
+    for (int i = 0; i < 32; i++)
+        regs[index++] = iop.get_gpr(i);
+    regs[index++] = iop.get_PC();
+    hash.CPU = InputMovie::hash_memory(regs, sizeof(regs));
+    return hash;
+}
 EEBreakpointList* Emulator::get_ee_breakpoint_list()
 {
     return &ee_breakpoints;
@@ -1681,6 +1815,16 @@ void Emulator::request_gsdump_single_frame()
     gsdump_single_frame = true;
 }
 
+void Emulator::request_rewind()
+{
+    if (movie.is_active())
+    {
+        printf("[MOVIE] Can't rewind while a movie is active\n");
+        return;
+    }
+    rewind_requested = true;
+}
+
 void Emulator::add_ee_event(EVENT_ID id, event_func func, uint64_t delta_time_to_run)
 {
     SchedulerEvent event;
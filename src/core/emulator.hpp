@@ -10,6 +10,7 @@
 #include "ee/timers.hpp"
 #include "ee/vif.hpp"
 #include "ee/vu.hpp"
+#include "ee/vu_thread.hpp"
 
 #include "iop/cdvd.hpp"
 #include "iop/gamepad.hpp"
@@ -23,6 +24,10 @@
 #include "int128.hpp"
 #include "gs.hpp"
 #include "gif.hpp"
+#include "movie.hpp"
+#include "profiler.hpp"
+#include "rewind.hpp"
+#include "savestate.hpp"
 #include "sif.hpp"
 #include "scheduler.hpp"
 
@@ -44,6 +49,14 @@ class Emulator
     private:
         std::atomic_bool save_requested, load_requested, gsdump_requested, gsdump_single_frame, gsdump_running;
         std::string save_state_path;
+        bool save_incremental;
+        SaveStateWriter state_writer;
+        std::atomic_bool rewind_requested;
+        RewindBuffer rewind_buffer;
+        int rewind_interval, rewind_frame_count;
+        Profiler profiler;
+        InputMovie movie;
+        bool deterministic;
         int frames;
         Cop0 cp0;
         Cop1 fpu;
@@ -75,8 +88,10 @@ class Emulator
         std::ofstream ee_log;
         std::string ee_stdout;
         std::function<void(VectorUnit&, int)> vu1_run_func;
+        VectorUnitThread vu1_thread;
 
         uint8_t* RDRAM;
+        DirtyPageMap RDRAM_pages; //For the rewind buffer
         uint8_t* IOP_RAM;
         uint8_t* BIOS;
         uint8_t* SPU_RAM;
@@ -102,7 +117,16 @@ class Emulator
 
         void iop_IRQ_check(uint32_t new_stat, uint32_t new_mask);
 
+        void save_snapshot(StateSnapshot& snapshot);
+        void save_core_snapshot(StateSnapshot& snapshot);
+        void load_snapshot(StateSnapshot& snapshot);
+        void capture_rewind_state();
+        void rewind();
+        StateHash hash_state();
+
         bool frame_ended;
+
+        friend class CoreBench;
     public:
         Emulator();
         ~Emulator();
@@ -116,6 +140,9 @@ class Emulator
         void fast_boot();
         void set_skip_BIOS_hack(SKIP_HACK type);
         void set_vu1_mode(VU_MODE mode);
+        void set_vu1_thread(bool enabled);
+        void set_deterministic(bool enabled);
+        void sync_vu1();
         void load_BIOS(const uint8_t* BIOS);
         void load_ELF(const uint8_t* ELF, uint32_t size);
         bool load_CDVD(const char* name, CDVD_CONTAINER type);
@@ -123,6 +150,8 @@ class Emulator
         uint32_t* get_framebuffer();
         void get_resolution(int& w, int& h);
         void get_inner_resolution(int& w, int& h);
+        Profiler& get_profiler();
+        InputMovie& get_movie();
 
         //Events
         void vblank_start();
@@ -132,8 +161,10 @@ class Emulator
         void ee_irq_check();
 
         bool request_load_state(const char* file_name);
-        bool request_save_state(const char* file_name);
+        bool request_save_state(const char* file_name, bool incremental = false);
         void request_gsdump_toggle();
+        void set_rewind(int interval, int max_snapshots);
+        void request_rewind();
         void request_gsdump_single_frame();
         void load_state(const char* file_name);
         void save_state(const char* file_name);
@@ -168,6 +199,7 @@ class Emulator
         void iop_puts();
 
         void test_iop();
+        bool test_vu_jit();
         GraphicsSynthesizer& get_gs();//used for gs dumps
 
         void add_ee_event(EVENT_ID id, event_func func, uint64_t delta_time_to_run);
@@ -176,4 +208,9 @@ class Emulator
         IOPBreakpointList* get_iop_breakpoint_list();
 };
 
+inline void Emulator::sync_vu1()
+{
+    vu1_thread.sync();
+}
+
 #endif // EMULATOR_HPP
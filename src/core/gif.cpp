@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstdio>
 #include "ee/dmac.hpp"
 #include "gif.hpp"
@@ -21,8 +22,7 @@ void GraphicsInterface::reset()
     path_status[1] = 4;
     path_status[2] = 4;
     path_status[3] = 4;
-    std::queue<uint128_t> empty;
-    FIFO.swap(empty);
+    FIFO.clear();
 
     intermittent_mode = false;
     path3_vif_masked = false;
@@ -61,18 +61,25 @@ void GraphicsInterface::write_MODE(uint32_t value)
     resume_path3();
 }
 
-void GraphicsInterface::process_PACKED(uint128_t data)
+//Decodes the register list of a PACKED tag once, so the per-quad paths just index into it
+void GraphicsInterface::compile_PACKED_regs(int index)
+{
+    GIFtag& tag = path[index].current_tag;
+    for (int i = 0; i < 16; i++)
+        packed_regs[index][i] = (tag.regs >> (i << 2)) & 0xF;
+}
+
+//Turns one PACKED quad into the GS message it produces. Returns false for NOPs.
+bool GraphicsInterface::decode_PACKED(uint8_t reg, uint128_t data, GSMessage& message)
 {
     uint64_t data1 = data._u64[0];
     uint64_t data2 = data._u64[1];
-    //printf("[GIF] PACKED: $%08X_%08X_%08X_%08X\n", data._u32[3], data._u32[2], data._u32[1], data._u32[0]);
-    uint64_t reg_offset = (path[active_path].current_tag.reg_count - path[active_path].current_tag.regs_left) << 2;
-    uint8_t reg = (path[active_path].current_tag.regs >> reg_offset) & 0xF;
     switch (reg)
     {
         case 0x0:
             //PRIM
-            gs->write64(0, data1);
+            message.type = GSCommand::write64_t;
+            message.payload.write64_payload = { 0, data1 };
             break;
         case 0x1:
             //RGBAQ - set RGBA
@@ -82,7 +89,8 @@ void GraphicsInterface::process_PACKED(uint128_t data)
             uint8_t g = (data1 >> 32) & 0xFF;
             uint8_t b = data2 & 0xFF;
             uint8_t a = (data2 >> 32) & 0xFF;
-            gs->set_RGBA(r, g, b, a, internal_Q);
+            message.type = GSCommand::set_rgba_t;
+            message.payload.rgba_payload = { r, g, b, a, internal_Q };
         }
             break;
         case 0x2:
@@ -101,7 +109,8 @@ void GraphicsInterface::process_PACKED(uint128_t data)
             if ((q & 0x7F800000) == 0x7F800000)
                 q = (q & 0x80000000) | 0x7F7FFFFF;
             internal_Q = *(float*)&q;
-            gs->set_ST(s, t);
+            message.type = GSCommand::set_st_t;
+            message.payload.st_payload = { s, t };
         }
             break;
         case 0x3:
@@ -109,7 +118,8 @@ void GraphicsInterface::process_PACKED(uint128_t data)
         {
             uint16_t u = data1 & 0x3FFF;
             uint16_t v = (data1 >> 32) & 0x3FFF;
-            gs->set_UV(u, v);
+            message.type = GSCommand::set_uv_t;
+            message.payload.uv_payload = { u, v };
         }
             break;
         case 0x4:
@@ -120,7 +130,8 @@ void GraphicsInterface::process_PACKED(uint128_t data)
             uint32_t z = (data2 >> 4) & 0xFFFFFF;
             bool disable_drawing = (data2 >> (111 - 64)) & 0x1;
             uint8_t fog = (data2 >> (100 - 64)) & 0xFF;
-            gs->set_XYZF(x, y, z, fog, !disable_drawing);
+            message.type = GSCommand::set_xyzf_t;
+            message.payload.xyzf_payload = { x, y, z, fog, !disable_drawing };
         }
             break;
         case 0x5:
@@ -130,30 +141,84 @@ void GraphicsInterface::process_PACKED(uint128_t data)
             uint32_t y = (data1 >> 32) & 0xFFFF;
             uint32_t z = data2 & 0xFFFFFFFF;
             bool disable_drawing = (data2 >> (111 - 64)) & 0x1;
-            gs->set_XYZ(x, y, z, !disable_drawing);
+            message.type = GSCommand::set_xyz_t;
+            message.payload.xyz_payload = { x, y, z, !disable_drawing };
         }
             break;
         case 0xA:
-        {
             //FOG
-            uint64_t value = data2 << 20;
-            gs->write64(0xA, value);
-        }
+            message.type = GSCommand::write64_t;
+            message.payload.write64_payload = { 0xA, data2 << 20 };
             break;
         case 0xE:
-        {
             //A+D: output data to address
-            uint32_t addr = data2 & 0xFF;
-            gs->write64(addr, data1);
-        }
+            message.type = GSCommand::write64_t;
+            message.payload.write64_payload = { (uint32_t)(data2 & 0xFF), data1 };
             break;
         case 0xF:
             //NOP
-            break;
+            return false;
         default:
-            gs->write64(reg, data1);
+            message.type = GSCommand::write64_t;
+            message.payload.write64_payload = { reg, data1 };
             break;
     }
+    return true;
+}
+
+void GraphicsInterface::process_PACKED(uint128_t data)
+{
+    //printf("[GIF] PACKED: $%08X_%08X_%08X_%08X\n", data._u32[3], data._u32[2], data._u32[1], data._u32[0]);
+    GIFtag& tag = path[active_path].current_tag;
+    uint8_t reg = packed_regs[active_path][tag.reg_count - tag.regs_left];
+
+    GSMessage message;
+    if (!decode_PACKED(reg, data, message))
+        return;
+
+    //Register writes go through write64 so the GS can handle SIGNAL and friends on this thread
+    if (message.type == GSCommand::write64_t)
+        gs->write64(message.payload.write64_payload.addr, message.payload.write64_payload.value);
+    else
+        gs->send_message(message);
+}
+
+/**
+ * Decodes a run of PACKED quads belonging to the current tag of the active path and hands all of the resulting
+ * messages to the GS at once. Returns the number of quads consumed. Stops before any A+D write to SIGNAL, FINISH
+ * or LABEL, as those need GraphicsSynthesizer::write64 and can stall the path.
+ */
+int GraphicsInterface::process_PACKED_burst(const uint128_t* quads, int count)
+{
+    GIFtag& tag = path[active_path].current_tag;
+    const uint8_t* regs = packed_regs[active_path];
+
+    GSMessage messages[MAX_PACKED_BURST];
+    int message_count = 0;
+    int processed = 0;
+    if (count > MAX_PACKED_BURST)
+        count = MAX_PACKED_BURST;
+    while (processed < count && tag.data_left)
+    {
+        uint8_t reg = regs[tag.reg_count - tag.regs_left];
+        uint32_t AD_addr = quads[processed]._u32[2] & 0xFF;
+        if (reg == 0xE && AD_addr >= 0x60 && AD_addr <= 0x62)
+            break;
+
+        if (decode_PACKED(reg, quads[processed], messages[message_count]))
+            message_count++;
+        processed++;
+
+        tag.regs_left--;
+        if (!tag.regs_left)
+        {
+            tag.regs_left = tag.reg_count;
+            tag.data_left--;
+        }
+    }
+
+    gs->send_messages(messages, message_count);
+    return processed;
 }
 
 void GraphicsInterface::process_REGLIST(uint128_t data)
@@ -198,6 +263,8 @@ void GraphicsInterface::feed_GIF(uint128_t data)
         path[active_path].current_tag.regs = data2;
         path[active_path].current_tag.regs_left = path[active_path].current_tag.reg_count;
         path[active_path].current_tag.data_left = path[active_path].current_tag.NLOOP;
+        if (path[active_path].current_tag.format == 0)
+            compile_PACKED_regs(active_path);
 
         //Q is initialized to 1.0 upon reading a GIFtag
         internal_Q = 1.0f;
@@ -235,8 +302,7 @@ void GraphicsInterface::feed_GIF(uint128_t data)
                 break;
             case 2:
             case 3:
-                gs->write64(0x54, data1);
-                gs->write64(0x54, data2);
+                gs->send_image_data(data._u64, 2);
                 path[active_path].current_tag.data_left--;
                 break;
             default:
@@ -244,6 +310,41 @@ void GraphicsInterface::feed_GIF(uint128_t data)
                 break;
         }
     }
+    check_end_of_packet();
+}
+
+//Sends as many quads as possible in one go, returning how many were consumed.
+//The bodies of PACKED and IMAGE tags are batched; tags and REGLIST data go through feed_GIF a quad at a time.
+int GraphicsInterface::feed_GIF_burst(const uint128_t* quads, int count)
+{
+    GIFtag& tag = path[active_path].current_tag;
+    if (!tag.data_left || tag.format == 1)
+    {
+        feed_GIF(quads[0]);
+        return 1;
+    }
+
+    if (tag.format >= 2)
+    {
+        int processed = std::min((uint32_t)count, tag.data_left);
+        gs->send_image_data(&quads[0]._u64[0], processed * 2);
+        tag.data_left -= processed;
+        check_end_of_packet();
+        return processed;
+    }
+
+    int processed = process_PACKED_burst(quads, count);
+    if (!processed)
+    {
+        feed_GIF(quads[0]);
+        return 1;
+    }
+    check_end_of_packet();
+    return processed;
+}
+
+void GraphicsInterface::check_end_of_packet()
+{
     if (!path[active_path].current_tag.data_left && path[active_path].current_tag.end_of_packet)
     {
         path_status[active_path] = 4;
@@ -401,6 +502,34 @@ void GraphicsInterface::send_PATH3(uint128_t data)
     }
 }
 
+//Sends quads from a PATH3 DMA until the path stops accepting them or the packet ends.
+//Returns the number of quads sent.
+int GraphicsInterface::send_PATH3_burst(const uint128_t* quads, int count)
+{
+    int sent = 0;
+    while (sent < count)
+    {
+        request_PATH(3, false);
+        if (!path_active(3) || fifo_full() || fifo_draining())
+        {
+            path3_dma_waiting = true;
+            break;
+        }
+
+        path3_dma_waiting = false;
+        if (path3_masked(3))
+        {
+            send_PATH3(quads[sent]);
+            sent++;
+        }
+        else
+            sent += feed_GIF_burst(quads + sent, count - sent);
+        if (path3_done())
+            break;
+    }
+    return sent;
+}
+
 uint128_t GraphicsInterface::read_GSFIFO()
 {
     return gs->request_gs_download();
@@ -423,12 +552,12 @@ void GraphicsInterface::flush_path3_fifo()
 
 bool GraphicsInterface::fifo_full()
 {
-    return FIFO.size() == 16;
+    return FIFO.full();
 }
 
 bool GraphicsInterface::fifo_empty()
 {
-    return FIFO.size() == 0;
+    return FIFO.empty();
 }
 
 bool GraphicsInterface::fifo_draining()
@@ -1,11 +1,11 @@
 #ifndef GIF_HPP
 #define GIF_HPP
 #include <cstdint>
-#include <queue>
 #include <fstream>
 
 #include "gs.hpp"
 #include "int128.hpp"
+#include "ringbuffer.hpp"
 
 class DMAC;
 
@@ -36,7 +36,7 @@ class GraphicsInterface
         
         GIFPath path[4];
 
-        std::queue<uint128_t> FIFO;
+        RingBuffer<uint128_t, 16> FIFO;
 
         uint8_t active_path;
         uint8_t path_queue;
@@ -50,9 +50,18 @@ class GraphicsInterface
 
         float internal_Q;
 
+        //Register list of each path's current PACKED tag, decoded when the tag is read
+        uint8_t packed_regs[4][16];
+        constexpr static int MAX_PACKED_BURST = 16;
+
+        void compile_PACKED_regs(int index);
+        bool decode_PACKED(uint8_t reg, uint128_t quad, GSMessage& message);
         void process_PACKED(uint128_t quad);
+        int process_PACKED_burst(const uint128_t* quads, int count);
         void process_REGLIST(uint128_t quad);
         void feed_GIF(uint128_t quad);
+        int feed_GIF_burst(const uint128_t* quads, int count);
+        void check_end_of_packet();
 
         void flush_path3_fifo();
     public:
@@ -83,12 +92,13 @@ class GraphicsInterface
         bool send_PATH1(uint128_t quad);
         void send_PATH2(uint32_t data[4]);
         void send_PATH3(uint128_t quad);
+        int send_PATH3_burst(const uint128_t* quads, int count);
         uint128_t read_GSFIFO();
 
         void intermittent_check();
 
-        void load_state(std::ifstream& state);
-        void save_state(std::ofstream& state);
+        void load_state(std::istream& state);
+        void save_state(std::ostream& state);
 };
 
 inline int GraphicsInterface::get_active_path()
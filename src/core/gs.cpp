@@ -291,10 +291,15 @@ void GraphicsSynthesizer::set_XYZF(uint32_t x, uint32_t y, uint32_t z, uint8_t f
     gs_thread.send_message({ GSCommand::set_xyzf_t, payload });
 }
 
-void GraphicsSynthesizer::load_state(std::ifstream &state)
+void GraphicsSynthesizer::load_state(std::istream &state)
+{
+    load_state(state, state);
+}
+
+void GraphicsSynthesizer::load_state(std::istream &state, std::istream &thread_state)
 {
     GSMessagePayload payload;
-    payload.load_state_payload = {&state};
+    payload.load_state_payload = {&thread_state};
     gs_thread.send_message({ GSCommand::load_state_t, payload });
     gs_thread.wake_thread();
     GSReturnMessage data;
@@ -303,13 +308,21 @@ void GraphicsSynthesizer::load_state(std::ifstream &state)
     state.read((char*)&reg, sizeof(reg));
 }
 
-void GraphicsSynthesizer::save_state(std::ofstream &state)
+/**
+ * Saving is split in two so the GS thread can copy out its state (VRAM included) while the caller serializes
+ * everything else. thread_state must stay alive and untouched until end_save_state returns.
+ */
+void GraphicsSynthesizer::begin_save_state(std::ostream &thread_state)
 {
     GSMessagePayload payload;
-    payload.save_state_payload = {&state};
+    payload.save_state_payload = {&thread_state};
 
     gs_thread.send_message({ GSCommand::save_state_t, payload });
     gs_thread.wake_thread();
+}
+
+void GraphicsSynthesizer::end_save_state(std::ostream &state)
+{
     GSReturnMessage data;
     gs_thread.wait_for_return(GSReturn::save_state_done_t, data);
     
@@ -330,11 +343,28 @@ void GraphicsSynthesizer::send_message(GSMessage message)
     gs_thread.send_message(message);
 }
 
+//Messages sent this way skip the register pre-processing done in write64, so they must not touch SIGNAL/FINISH/LABEL
+void GraphicsSynthesizer::send_messages(const GSMessage* messages, int count)
+{
+    gs_thread.send_messages(messages, count);
+}
+
+//Equivalent to writing each doubleword to HWREG
+void GraphicsSynthesizer::send_image_data(const uint64_t* data, int doublewords)
+{
+    gs_thread.send_image_data(data, doublewords);
+}
+
 void GraphicsSynthesizer::wake_gs_thread()
 {
     gs_thread.wake_thread();
 }
 
+void GraphicsSynthesizer::take_profile_counters(uint64_t& ticks, uint64_t& messages)
+{
+    gs_thread.take_profile_counters(ticks, messages);
+}
+
 uint128_t GraphicsSynthesizer::request_gs_download()
 {
     GSMessagePayload payload;
@@ -346,3 +376,15 @@ uint128_t GraphicsSynthesizer::request_gs_download()
     return data.payload.data_payload.quad_data;
 }
 
+//Waits for the GS thread to get through everything sent before it, so the hash is of the state at this point
+uint64_t GraphicsSynthesizer::hash_local_mem()
+{
+    GSMessagePayload payload;
+    payload.no_payload = {};
+    gs_thread.send_message({ GSCommand::hash_state_t, payload });
+    gs_thread.wake_thread();
+    GSReturnMessage data;
+    gs_thread.wait_for_return(GSReturn::state_hash_t, data);
+    return data.payload.hash_payload.hash;
+}
+
@@ -23,6 +23,8 @@ class GraphicsSynthesizer
         GS_REGISTERS reg;
 
         GraphicsSynthesizerThread gs_thread;
+
+        friend class CoreBench;
     public:
         GraphicsSynthesizer(INTC* intc);
         ~GraphicsSynthesizer();
@@ -56,13 +58,19 @@ class GraphicsSynthesizer
         void set_XYZ(uint32_t x, uint32_t y, uint32_t z, bool drawing_kick);
         void set_XYZF(uint32_t x, uint32_t y, uint32_t z, uint8_t fog, bool drawing_kick);
 
-        void load_state(std::ifstream& state);
-        void save_state(std::ofstream& state);
+        void load_state(std::istream& state);
+        void load_state(std::istream& state, std::istream& thread_state);
+        void begin_save_state(std::ostream& thread_state);
+        void end_save_state(std::ostream& state);
         void send_dump_request();
 
         void send_message(GSMessage message);
+        void send_messages(const GSMessage* messages, int count);
+        void send_image_data(const uint64_t* data, int doublewords);
         void wake_gs_thread();
+        void take_profile_counters(uint64_t& ticks, uint64_t& messages);
 
         uint128_t request_gs_download();
+        uint64_t hash_local_mem();
 };
 #endif // GS_HPP
@@ -7,7 +7,9 @@
 
 #include "gsthread.hpp"
 #include "gsmem.hpp"
+#include "movie.hpp"
 #include "errors.hpp"
+#include "profiler.hpp"
 
 using namespace std;
 
@@ -23,6 +25,11 @@ static SwizzleTable<32,64,64> page_PSMCT16SZ;
 static SwizzleTable<32,64,128> page_PSMCT8;
 static SwizzleTable<32,128,128> page_PSMCT4;
 
+static float log2_lookup[32768][4];
+
+//None of the tables above depend on the GS state, so they're built once and shared by every GS thread
+static once_flag tables_initialized;
+
 #define printf(fmt, ...)(0)
 
 /**
@@ -73,7 +80,16 @@ float interpolate_f(int32_t x, float u1, int32_t x1, float u2, int32_t x2)
 const unsigned int GraphicsSynthesizerThread::max_vertices[8] = {1, 2, 2, 3, 3, 3, 2, 0};
 
 GraphicsSynthesizerThread::GraphicsSynthesizerThread()
-    : frame_complete(false), local_mem(nullptr)
+    : busy_ticks(0), messages_handled(0), frame_complete(false), local_mem(nullptr)
+{
+    call_once(tables_initialized, &GraphicsSynthesizerThread::init_tables, this);
+
+    //The FIFOs have to exist before the thread starts, messages can be sent as soon as the constructor returns
+    reset_fifos();
+    thread = std::thread(&GraphicsSynthesizerThread::event_loop, this);
+}
+
+void GraphicsSynthesizerThread::init_tables()
 {
     //Initialize swizzling tables
     for (int block = 0; block < 32; block++)
@@ -139,8 +155,6 @@ GraphicsSynthesizerThread::GraphicsSynthesizerThread()
         log2_lookup[i][2] = ldexp(calculation, 2);
         log2_lookup[i][3] = ldexp(calculation, 3);
     }
-
-    thread = std::thread(&GraphicsSynthesizerThread::event_loop, this);
 }
 
 GraphicsSynthesizerThread::~GraphicsSynthesizerThread()
@@ -148,6 +162,7 @@ GraphicsSynthesizerThread::~GraphicsSynthesizerThread()
     delete[] local_mem;
     delete message_queue;
     delete return_queue;
+    delete image_queue;
 }
 
 void GraphicsSynthesizerThread::wait_for_return(GSReturn type, GSReturnMessage &data)
@@ -203,6 +218,33 @@ void GraphicsSynthesizerThread::send_message(GSMessage message)
     send_data = true;
 }
 
+void GraphicsSynthesizerThread::send_messages(const GSMessage* messages, int count)
+{
+    if (!count)
+        return;
+    message_queue->push_bulk(messages, count);
+    send_data = true;
+}
+
+/**
+ * Queues HWREG data for an image transfer and sends a single message for all of it, instead of one write64 message
+ * per doubleword. If the staging buffer is full, waits for the GS thread to drain it.
+ */
+void GraphicsSynthesizerThread::send_image_data(const uint64_t* data, int doublewords)
+{
+    while (image_queue->free_space() < (size_t)doublewords)
+    {
+        send_data = true;
+        wake_thread();
+        std::this_thread::yield();
+    }
+    image_queue->push_bulk(data, doublewords);
+
+    GSMessagePayload payload;
+    payload.image_payload = { (uint32_t)doublewords };
+    send_message({ GSCommand::image_data_t, payload });
+}
+
 void GraphicsSynthesizerThread::wake_thread()
 {
     printf("[GS] Waking GS Thread\n");
@@ -216,12 +258,17 @@ void GraphicsSynthesizerThread::reset_fifos()
         message_queue = new gs_fifo();
     if (!return_queue)
         return_queue = new gs_return_fifo();
+    if (!image_queue)
+        image_queue = new gs_image_fifo();
 
     GSReturnMessage data;
     while (return_queue->pop(data));
 
     GSMessage data2;
     while (message_queue->pop(data2));
+
+    uint64_t data3;
+    while (image_queue->pop(data3));
 }
 
 void GraphicsSynthesizerThread::exit()
@@ -232,11 +279,19 @@ void GraphicsSynthesizerThread::exit()
         payload.no_payload = {0};
         
         send_message({ GSCommand::die_t, payload });
-        
+        wake_thread();
+
         thread.join();
     }
 }
 
+//Returns the profiling counters and starts them again from zero
+void GraphicsSynthesizerThread::take_profile_counters(uint64_t& ticks, uint64_t& messages)
+{
+    ticks = busy_ticks.exchange(0);
+    messages = messages_handled.exchange(0);
+}
+
 void GraphicsSynthesizerThread::event_loop()
 {
     printf("[GS_t] Starting GS Thread\n");
@@ -254,7 +309,12 @@ void GraphicsSynthesizerThread::event_loop()
 
             if (message_queue->pop(data))
             {
-                if (gsdump_recording)
+#ifdef PROFILER_ENABLED
+                uint64_t profile_start = Profiler::ticks();
+#endif
+                //Image data lives outside the message, so it gets recorded as HWREG writes instead.
+                //Movie hashes expect a reply, which nothing would wait for on replay.
+                if (gsdump_recording && data.type != image_data_t && data.type != hash_state_t)
                     gsdump_file.write((char*)&data, sizeof(data));
 
                 switch (data.type)
@@ -384,6 +444,7 @@ void GraphicsSynthesizerThread::event_loop()
                         GSReturnMessagePayload return_payload;
                         return_payload.no_payload = { 0 };
                         return_queue->push({ GSReturn::save_state_done_t,return_payload });
+                        std::unique_lock<std::mutex> lk(data_mutex);
                         recieve_data = true;
                         notifier.notify_one();
                         break;
@@ -419,9 +480,27 @@ void GraphicsSynthesizerThread::event_loop()
                         notifier.notify_one();
                         break;
                     }
+                    case hash_state_t:
+                    {
+                        GSReturnMessagePayload return_payload;
+                        return_payload.hash_payload.hash = InputMovie::hash_memory(local_mem, 1024 * 1024 * 4);
+                        return_queue->push({ GSReturn::state_hash_t, return_payload });
+                        std::unique_lock<std::mutex> lk(data_mutex);
+                        recieve_data = true;
+                        notifier.notify_one();
+                        break;
+                    }
+                    case image_data_t:
+                        write_image_data(data.payload.image_payload.doublewords,
+                                         gsdump_recording ? &gsdump_file : nullptr);
+                        break;
                     default:
                         Errors::die("corrupted command sent to GS thread");
                 }
+#ifdef PROFILER_ENABLED
+                busy_ticks += Profiler::ticks() - profile_start;
+                messages_handled++;
+#endif
             }
             else
             {
@@ -2748,6 +2827,31 @@ void GraphicsSynthesizerThread::write_HWREG(uint64_t data)
     }
 }
 
+void GraphicsSynthesizerThread::write_image_data(uint32_t doublewords, ofstream* gsdump)
+{
+    uint64_t buffer[64];
+    while (doublewords)
+    {
+        size_t count = image_queue->pop_bulk(buffer, std::min(doublewords, 64U));
+        if (!count)
+            Errors::die("[GS_t] Image data missing from staging buffer");
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (gsdump)
+            {
+                GSMessage message;
+                message.type = write64_t;
+                message.payload.write64_payload = { 0x54, buffer[i] };
+                gsdump->write((char*)&message, sizeof(message));
+            }
+            if (TRXDIR == 0)
+                write_HWREG(buffer[i]);
+        }
+        doublewords -= count;
+    }
+}
+
 uint128_t GraphicsSynthesizerThread::local_to_host()
 {
     int ppd = 0; //pixels per doubleword (64-bits)
@@ -3665,7 +3769,7 @@ void GraphicsSynthesizerThread::reload_clut(const GSContext& context)
     }
 }
 
-void GraphicsSynthesizerThread::load_state(ifstream *state)
+void GraphicsSynthesizerThread::load_state(istream *state)
 {
     state->read((char*)local_mem, 1024 * 1024 * 4);
     state->read((char*)&IMR, sizeof(IMR));
@@ -3715,7 +3819,7 @@ void GraphicsSynthesizerThread::load_state(ifstream *state)
     state->read((char*)&num_vertices, sizeof(num_vertices));
 }
 
-void GraphicsSynthesizerThread::save_state(ofstream *state)
+void GraphicsSynthesizerThread::save_state(ostream *state)
 {
     state->write((char*)local_mem, 1024 * 1024 * 4);
     state->write((char*)&IMR, sizeof(IMR));
@@ -1,5 +1,6 @@
 #ifndef GSTHREAD_HPP
 #define GSTHREAD_HPP
+#include <atomic>
 #include <cstdint>
 #include <thread>
 #include <mutex>
@@ -32,7 +33,7 @@ enum GSCommand:uint8_t
     write64_t, write64_privileged_t, write32_privileged_t,
     set_rgba_t, set_st_t, set_uv_t, set_xyz_t, set_xyzf_t, set_crt_t,
     render_crt_t, assert_finish_t, assert_vsync_t, set_vblank_t, memdump_t, die_t,
-    save_state_t, load_state_t, gsdump_t, request_local_host_tx,
+    save_state_t, load_state_t, gsdump_t, request_local_host_tx, image_data_t, hash_state_t,
 };
 
 union GSMessagePayload 
@@ -88,12 +89,16 @@ union GSMessagePayload
     } render_payload;
     struct
     {
-        std::ofstream* state;
+        std::ostream* state;
     } save_state_payload;
     struct
     {
-        std::ifstream* state;
+        std::istream* state;
     } load_state_payload;
+    struct
+    {
+        uint32_t doublewords;
+    } image_payload;
     struct 
     {
         uint8_t BLANK; 
@@ -115,6 +120,7 @@ enum GSReturn :uint8_t
     load_state_done_t,
     gsdump_render_partial_done_t,
     local_host_transfer,
+    state_hash_t,
 };
 
 union GSReturnMessagePayload
@@ -135,6 +141,10 @@ union GSReturnMessagePayload
     {
         uint128_t quad_data;
     } data_payload;
+    struct
+    {
+        uint64_t hash;
+    } hash_payload;
 };
 
 struct GSReturnMessage
@@ -145,6 +155,8 @@ struct GSReturnMessage
 
 typedef CircularFifo<GSMessage, 1024 * 1024 * 16> gs_fifo;
 typedef CircularFifo<GSReturnMessage, 1024> gs_return_fifo;
+//HWREG data for image transfers. An image_data_t message says how many doublewords to take from here.
+typedef CircularFifo<uint64_t, 1024 * 1024> gs_image_fifo;
 
 struct PRMODE_REG
 {
@@ -331,6 +343,10 @@ class GraphicsSynthesizerThread
 
         gs_fifo* message_queue = nullptr;
         gs_return_fifo* return_queue = nullptr;
+        gs_image_fifo* image_queue = nullptr;
+
+        //Time spent handling messages, only counted in profiling builds
+        std::atomic<uint64_t> busy_ticks, messages_handled;
 
         bool frame_complete;
         int frame_count;
@@ -386,8 +402,7 @@ class GraphicsSynthesizerThread
 
         static const unsigned int max_vertices[8];
 
-        float log2_lookup[32768][4];
-
+        void init_tables();
         void event_loop();
 
         inline const uint32_t get_word(uint32_t addr) { return *(uint32_t*)&local_mem[addr]; };
@@ -454,6 +469,7 @@ class GraphicsSynthesizerThread
                 float step_x0, float step_x1, float scx1, float scx2, TexLookupInfo& tex_info);
         void render_sprite();
         void write_HWREG(uint64_t data);
+        void write_image_data(uint32_t doublewords, std::ofstream* gsdump);
         uint128_t local_to_host();
         void unpack_PSMCT24(uint64_t data, int offset, bool z_format);
         uint64_t pack_PSMCT24(bool z_format);
@@ -478,17 +494,24 @@ class GraphicsSynthesizerThread
         void set_XYZ(uint32_t x, uint32_t y, uint32_t z, bool drawing_kick);
         void set_XYZF(uint32_t x, uint32_t y, uint32_t z, uint8_t fog, bool drawing_kick);
 
-        void load_state(std::ifstream* state);
-        void save_state(std::ofstream* state);
+        void load_state(std::istream* state);
+        void save_state(std::ostream* state);
+
+        //Benchmarks call the rasterizer directly
+        friend class CoreBench;
     public:
         GraphicsSynthesizerThread();
         ~GraphicsSynthesizerThread();
         
         // safe to access from emu thread
         void send_message(GSMessage message);
+        void send_messages(const GSMessage* messages, int count);
+        void send_image_data(const uint64_t* data, int doublewords);
         void wake_thread();
         void wait_for_return(GSReturn type, GSReturnMessage &data);
         void reset_fifos();
         void exit();
+
+        void take_profile_counters(uint64_t& ticks, uint64_t& messages);
 };
 #endif // GSTHREAD_HPP
@@ -19,14 +19,21 @@ static const uint8_t monthmap[13] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30
 #define btoi(b) ((b)/16*10 + (b)%16)    /* BCD to u_char */
 #define itob(i) ((i)/10*16 + (i)%10)    /* u_char to BCD */
 
+//2000-01-01 00:00:00 UTC
+#define FIXED_RTC_TIME 946684800
+
 uint32_t CDVD_Drive::get_block_timing(bool mode_DVD)
 {
     return (IOP_CLOCK * block_size) / (speed * (mode_DVD ? PSX_DVD_READSPEED : PSX_CD_READSPEED));
 }
 
-CDVD_Drive::CDVD_Drive(Emulator* e, IOP_DMA* dma) : e(e), dma(dma), container(CDVD_CONTAINER::ISO)
+CDVD_Drive::CDVD_Drive(Emulator* e, IOP_DMA* dma) : e(e), dma(dma), container(CDVD_CONTAINER::ISO),
+    reader([this] (uint64_t ofs, uint8_t* dst, size_t size) { return container_read_at(ofs, dst, size); })
 {
-
+    read_pos = 0;
+    sectors_left = 0;
+    block_size = 2048;
+    fixed_RTC = false;
 }
 
 CDVD_Drive::~CDVD_Drive()
@@ -36,6 +43,9 @@ CDVD_Drive::~CDVD_Drive()
 
 bool CDVD_Drive::container_open(const char* file_path)
 {
+    reader.stop();
+    read_pos = 0;
+
     if (container == CDVD_CONTAINER::ISO)
     {
         if (cdvd_file.is_open())
@@ -46,6 +56,7 @@ bool CDVD_Drive::container_open(const char* file_path)
             return false;
     
         file_size = cdvd_file.tellg();
+        reader.start(file_size);
         return true;
     }
     else if (container == CDVD_CONTAINER::CISO)
@@ -54,14 +65,31 @@ bool CDVD_Drive::container_open(const char* file_path)
             return false;
         
         file_size = cso_file.get_size();
+        reader.start(file_size);
         return true;
     }
+    else if (container == CDVD_CONTAINER::ISO_MMAP)
+    {
+        //Reads are already a memcpy, so the read-ahead thread isn't needed
+        if (iso_mapping.open(file_path))
+        {
+            file_size = iso_mapping.get_size();
+            return true;
+        }
+
+        //Fall back to streaming the file, e.g. when there isn't enough address space to map it
+        Errors::print_warning("[CDVD] Unable to map %s, reading it as a file instead\n", file_path);
+        container = CDVD_CONTAINER::ISO;
+        return container_open(file_path);
+    }
     
     return false;
 }
 
 void CDVD_Drive::container_close()
 {
+    reader.stop();
+
     if (container == CDVD_CONTAINER::ISO)
     {
         if (cdvd_file.is_open())
@@ -71,6 +99,10 @@ void CDVD_Drive::container_close()
     {
         cso_file.close();
     }
+    else if (container == CDVD_CONTAINER::ISO_MMAP)
+    {
+        iso_mapping.close();
+    }
 }
 
 bool CDVD_Drive::container_isopen()
@@ -83,51 +115,77 @@ bool CDVD_Drive::container_isopen()
     {
         return cso_file.isopen();
     }
+    else if (container == CDVD_CONTAINER::ISO_MMAP)
+    {
+        return iso_mapping.isopen();
+    }
     
     return false;
 }
 
+//The read position is kept here rather than in the container, as the read-ahead thread shares the container
 void CDVD_Drive::container_seek(std::ios::streamoff ofs, std::ios::seekdir whence)
 {
-    if (container == CDVD_CONTAINER::ISO)
-    {
-        cdvd_file.seekg(ofs, whence);
-    }
-    else if (container == CDVD_CONTAINER::CISO)
-    {
-        cso_file.seek((int64_t)ofs, whence);
-    }
+    if (whence == std::ios::cur)
+        read_pos += ofs;
+    else if (whence == std::ios::end)
+        read_pos = file_size + ofs;
+    else
+        read_pos = ofs;
 }
 
 uint64_t CDVD_Drive::container_tell()
 {
-    if (container == CDVD_CONTAINER::ISO)
-    {
-        return cdvd_file.tellg();
-    }
-    else if (container == CDVD_CONTAINER::CISO)
-    {
-        return cso_file.tell();
-    }
-    
-    return 0;
+    return read_pos;
 }
 
 size_t CDVD_Drive::container_read(void* dst, size_t size)
+{
+    size_t count = reader.read(read_pos, (uint8_t*)dst, size);
+    read_pos += count;
+    return count;
+}
+
+//Only called by the DiscReader, which makes sure one thread at a time is in here
+size_t CDVD_Drive::container_read_at(uint64_t ofs, uint8_t* dst, size_t size)
 {
     if (container == CDVD_CONTAINER::ISO)
     {
+        cdvd_file.clear();
+        cdvd_file.seekg(ofs);
         cdvd_file.read((char*)dst, size);
         return cdvd_file.gcount();
     }
     else if (container == CDVD_CONTAINER::CISO)
     {
-        return cso_file.read((uint8_t*)dst, size);
+        cso_file.seek((int64_t)ofs, std::ios::beg);
+        return cso_file.read(dst, size);
+    }
+    else if (container == CDVD_CONTAINER::ISO_MMAP)
+    {
+        return iso_mapping.read(ofs, dst, size);
     }
     
     return 0;
 }
 
+//How far each sector of the current read command advances through the image
+uint64_t CDVD_Drive::get_file_sector_size()
+{
+    //Raw CD sectors are rebuilt around 2048 bytes of data, and DVD sectors around 2048 bytes of user data
+    if (block_size == 2340 || block_size == 2064)
+        return 2048;
+    return block_size;
+}
+
+void CDVD_Drive::read_ahead()
+{
+    if (container == CDVD_CONTAINER::ISO_MMAP)
+        iso_mapping.read_ahead(read_pos, sectors_left * get_file_sector_size());
+    else
+        reader.read_ahead(read_pos, sectors_left * get_file_sector_size());
+}
+
 
 void CDVD_Drive::reset()
 {
@@ -147,9 +205,16 @@ void CDVD_Drive::reset()
     read_bytes_left = 0;
     ISTAT = 0;
     file_size = 0;
-    time_t raw_time;
+    init_RTC();
+}
+
+//The RTC starts at the host's time, converted to JST, or at a fixed time so runs don't depend on when they started
+void CDVD_Drive::init_RTC()
+{
+    time_t raw_time = FIXED_RTC_TIME;
     struct tm * time;
-    std::time(&raw_time);
+    if (!fixed_RTC)
+        std::time(&raw_time);
     time = std::gmtime(&raw_time);
     rtc.vsyncs = 0;
     rtc.second = time->tm_sec;
@@ -176,6 +241,12 @@ void CDVD_Drive::reset()
     }
 }
 
+void CDVD_Drive::set_fixed_RTC(bool fixed)
+{
+    fixed_RTC = fixed;
+    init_RTC();
+}
+
 string CDVD_Drive::get_serial()
 {
     if (!container_isopen())
@@ -750,6 +821,7 @@ void CDVD_Drive::start_seek()
         Errors::die("[CDVD] Invalid sector read $%08X (max size: $%08X)", seek_to, block_count);
 
     container_seek((uint64_t)seek_to * 2048);
+    read_ahead();
 
     add_event(cycles_to_seek);
 }
@@ -870,6 +942,7 @@ void CDVD_Drive::read_CD_sector()
     read_bytes_left = block_size;
     current_sector++;
     sectors_left--;
+    read_ahead();
     dma->set_DMA_request(IOP_CDVD);
 }
 
@@ -937,6 +1010,7 @@ void CDVD_Drive::read_DVD_sector()
     read_bytes_left = 2064;
     current_sector++;
     sectors_left--;
+    read_ahead();
 
     dma->set_DMA_request(IOP_CDVD);
 }
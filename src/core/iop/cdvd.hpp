@@ -2,6 +2,8 @@
 #define CDVD_HPP
 
 #include "cso_reader.hpp"
+#include "disc_reader.hpp"
+#include "iso_mapping.hpp"
 #include <fstream>
 
 class Emulator;
@@ -10,7 +12,8 @@ class IOP_DMA;
 enum CDVD_CONTAINER
 {
     ISO,
-    CISO
+    CISO,
+    ISO_MMAP
 };
 
 enum CDVD_STATUS
@@ -53,7 +56,10 @@ class CDVD_Drive
         CDVD_CONTAINER container;
         std::ifstream cdvd_file;
         CSO_Reader cso_file;
+        ISO_Mapping iso_mapping;
+        DiscReader reader;
         uint64_t file_size;
+        uint64_t read_pos;
         int read_bytes_left;
         int speed;
 
@@ -80,6 +86,7 @@ class CDVD_Drive
         uint8_t N_params;
         uint8_t N_status;
         RTC rtc;
+        bool fixed_RTC;
 
         uint8_t S_command;
         uint8_t S_command_params[16];
@@ -98,6 +105,9 @@ class CDVD_Drive
         void container_seek(std::ios::streamoff ofs, std::ios::seekdir whence = std::ios::beg);
         uint64_t container_tell();
         size_t container_read(void* dst, size_t size);
+        size_t container_read_at(uint64_t ofs, uint8_t* dst, size_t size);
+        uint64_t get_file_sector_size();
+        void read_ahead();
 
         void start_seek();
         void prepare_S_outdata(int amount);
@@ -113,6 +123,7 @@ class CDVD_Drive
         void N_command_readkey(uint32_t arg);
         void S_command_sub(uint8_t func);
         void add_event(uint64_t cycles);
+        void init_RTC();
     public:
         CDVD_Drive(Emulator* e, IOP_DMA* dma);
         ~CDVD_Drive();
@@ -120,6 +131,7 @@ class CDVD_Drive
         std::string get_serial();
 
         void reset();
+        void set_fixed_RTC(bool fixed);
         void vsync();
         void handle_N_command();
         int get_block_size();
@@ -146,8 +158,8 @@ class CDVD_Drive
         void write_S_data(uint8_t value);
         void write_ISTAT(uint8_t value);
 
-        void load_state(std::ifstream& state);
-        void save_state(std::ofstream& state);
+        void load_state(std::istream& state);
+        void save_state(std::ostream& state);
 };
 
 #endif // CDVD_HPP
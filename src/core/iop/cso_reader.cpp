@@ -1,5 +1,5 @@
 /*
-CISO (v0, v1) decoder implementation
+CISO (v0, v1, v2) and ZISO decoder implementation
  copyleft 2019 a dinosaur
 
 Based off reference by unknownbrackets:
@@ -8,8 +8,8 @@ Based off reference by unknownbrackets:
 
 #include "cso_reader.hpp"
 #include <libdeflate.h>
+#include <algorithm>
 #include <cstring>
-#include <cassert>
 
 constexpr uint32_t FOURCC(const char chars[4])
 {
@@ -42,13 +42,89 @@ struct CSO_Header
 
 #define IDX_COMPRESS_BIT (0x80000000)
 
+// decoded blocks kept around, within these limits
+#define CACHE_BYTES (4 * 1024 * 1024)
+#define MIN_FRAMES 32
+#define MAX_FRAMES 512
+#define MAX_PREFETCH 64
+#define MAX_WORKERS 4
+
+
+// decodes a raw LZ4 block (no frame header), returns the decoded size or -1 if the block is corrupt.
+// decoding stops once dst is full, as blocks can be followed by padding.
+static int lz4_decompress_block(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_len)
+{
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + src_len;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_len;
+
+    while (ip < iend)
+    {
+        uint8_t token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+        if (literals > (size_t)(iend - ip) || literals > (size_t)(oend - op))
+            return -1;
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        // the last sequence only has literals
+        if (ip >= iend || op == oend)
+            break;
+
+        if (iend - ip < 2)
+            return -1;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (!offset || offset > (size_t)(op - dst))
+            return -1;
+
+        size_t match = token & 0xF;
+        if (match == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                match += b;
+            } while (b == 255);
+        }
+        match += 4;
+        if (match > (size_t)(oend - op))
+            return -1;
+
+        // matches can overlap their own output
+        const uint8_t* from = op - offset;
+        for (size_t i = 0; i < match; ++i)
+            op[i] = from[i];
+        op += match;
+    }
+
+    return (int)(op - dst);
+}
+
 
 CSO_Reader::CSO_Reader() :
-    m_size(0), m_shift(0), m_blocksize(0), m_version(0), m_virtptr(0),
+    m_size(0), m_shift(0), m_blocksize(0), m_version(0), m_zso(false), m_virtptr(0),
     m_indices(nullptr),
-    m_framesize(0), m_curframe(0xFFFFFFFF),
-    m_frame(nullptr), m_readbuf(nullptr),
-    m_inflate(nullptr) {}
+    m_framesize(0), m_decoder{nullptr, nullptr},
+    m_frames(nullptr), m_numframes(0), m_tick(0),
+    m_prefetch_blocks(0), m_last_block(0xFFFFFFFF), m_quit(false) {}
 
 CSO_Reader::~CSO_Reader()
 {
@@ -86,19 +162,20 @@ void CSO_Reader::seek(int64_t ofs, std::ios::seekdir whence)
 {
     if (whence == std::ios::beg)
     {
-        if ((uint64_t)ofs < m_size)
+        // seeking to the end is allowed, reads from there return nothing
+        if ((uint64_t)ofs <= m_size)
             m_virtptr = (uint64_t)ofs;
     }
     else
     if (whence == std::ios::cur)
     {
-        if (m_virtptr + ofs < m_size)
+        if (m_virtptr + ofs <= m_size)
             m_virtptr = m_virtptr + ofs;
     }
     else
     if (whence == std::ios::end)
     {
-        if (m_size - ofs < m_size)
+        if (m_size - ofs <= m_size)
             m_virtptr = m_size - ofs;
     }
 }
@@ -108,87 +185,283 @@ uint64_t CSO_Reader::tell()
     return m_virtptr;
 }
 
-bool CSO_Reader::read_block_internal(uint32_t block)
+bool CSO_Reader::alloc_decoder(Decoder& decoder)
+{
+    decoder.inflate = libdeflate_alloc_decompressor();
+    decoder.readbuf = new uint8_t[m_framesize];
+    return decoder.inflate != nullptr;
+}
+
+void CSO_Reader::free_decoder(Decoder& decoder)
+{
+    libdeflate_free_decompressor(decoder.inflate);
+    decoder.inflate = nullptr;
+
+    delete[] decoder.readbuf;
+    decoder.readbuf = nullptr;
+}
+
+// safe to call from several threads at once, as long as each has its own decoder
+bool CSO_Reader::decode_block(uint32_t block, uint8_t* dst, Decoder& decoder)
 {
-    // if this block was decoded last time we don't need to do it again
-    if (block == m_curframe)
-        return true;
-    
     uint32_t index = m_indices[block];
     uint64_t ofs = (uint64_t)(index & ~IDX_COMPRESS_BIT) << m_shift;
     uint64_t len = ((uint64_t)(m_indices[block + 1] & ~IDX_COMPRESS_BIT) << m_shift) - ofs;
-    
-    if (index & IDX_COMPRESS_BIT) // if uncompressed
+
+    // the last block of the image can be short
+    uint64_t expected = std::min((uint64_t)m_blocksize, m_size - (uint64_t)block * m_blocksize);
+
+    // v0/v1 and ZSO flag uncompressed blocks, v2 flags LZ4 blocks and stores anything that didn't shrink as is
+    bool uncompressed, lz4;
+    if (m_version == 2)
+    {
+        uncompressed = len >= m_blocksize;
+        lz4 = (index & IDX_COMPRESS_BIT) != 0;
+    }
+    else
+    {
+        uncompressed = (index & IDX_COMPRESS_BIT) != 0;
+        lz4 = m_zso;
+    }
+
     {
+        std::lock_guard<std::mutex> lock(m_file_mutex);
+        m_file.clear();
         m_file.seekg(ofs, std::ios::beg);
-        m_file.read((char*)m_frame, len);
+        if (uncompressed)
+        {
+            len = std::min(len, (uint64_t)m_blocksize);
+            m_file.read((char*)dst, len);
+        }
+        else
+            m_file.read((char*)decoder.readbuf, len);
+
         if ((uint64_t)m_file.gcount() != len)
         {
-            fprintf(stderr, "read error reading (uncompressed) block %d\n", block);
-            m_curframe = 0xFFFFFFFF;
+            fprintf(stderr, "read error reading (%s) block %d\n", uncompressed ? "uncompressed" : "compressed", block);
             return false;
         }
     }
-    else // compressed
+
+    if (uncompressed)
+        return true;
+
+    size_t read;
+    if (lz4)
     {
-        m_file.seekg(ofs, std::ios::beg);
-        m_file.read((char*)m_readbuf, len);
-        if ((uint64_t)m_file.gcount() != len)
+        int res = lz4_decompress_block(decoder.readbuf, len, dst, expected);
+        if (res < 0)
         {
-            fprintf(stderr, "read error reading (compressed) block %d\n", block);
+            fprintf(stderr, "LZ4 error on block %d\n", block);
             return false;
         }
-        
-        size_t read;
-        auto res = libdeflate_deflate_decompress(m_inflate, m_readbuf, len, m_frame, m_framesize, &read);
+        read = res;
+    }
+    else
+    {
+        auto res = libdeflate_deflate_decompress(decoder.inflate, decoder.readbuf, len, dst, m_framesize, &read);
         if (res != LIBDEFLATE_SUCCESS)
         {
             fprintf(stderr, "libdeflate error on block %d: %d\n", block, res);
-            m_curframe = 0xFFFFFFFF;
             return false;
         }
-        
-        if (read < m_blocksize)
+    }
+
+    if (read < expected)
+    {
+        fprintf(stderr, "compressed sector %d decoded to less than the blocksize\n", block);
+        return false;
+    }
+
+    return true;
+}
+
+// takes the least recently used frame that no one is working on, m_cache_mutex must be held
+int CSO_Reader::claim_frame(uint32_t block, FrameState state)
+{
+    int victim = -1;
+    for (uint32_t i = 0; i < m_numframes; ++i)
+    {
+        const Frame& frame = m_frames[i];
+        if (frame.state == FRAME_QUEUED || frame.state == FRAME_LOADING)
+            continue;
+        if (victim < 0 || frame.last_used < m_frames[victim].last_used)
+            victim = i;
+    }
+    if (victim < 0)
+        return -1;
+
+    Frame& frame = m_frames[victim];
+    if (frame.state == FRAME_READY)
+        m_frame_lookup.erase(frame.block);
+    frame.block = block;
+    frame.state = state;
+    m_frame_lookup[block] = victim;
+    return victim;
+}
+
+// m_cache_mutex must be held
+void CSO_Reader::release_frame(uint32_t index, bool success)
+{
+    Frame& frame = m_frames[index];
+    if (success)
+    {
+        frame.state = FRAME_READY;
+        frame.last_used = ++m_tick;
+    }
+    else
+    {
+        frame.state = FRAME_EMPTY;
+        frame.last_used = 0;
+        m_frame_lookup.erase(frame.block);
+    }
+    m_frame_ready.notify_all();
+}
+
+// returns the index of a ready frame holding the block, or -1 if it couldn't be decoded
+int CSO_Reader::acquire_frame(uint32_t block, std::unique_lock<std::mutex>& lock)
+{
+    auto it = m_frame_lookup.find(block);
+    if (it != m_frame_lookup.end())
+    {
+        uint32_t index = it->second;
+        Frame& frame = m_frames[index];
+        if (frame.state == FRAME_LOADING)
         {
-            fprintf(stderr, "compressed sector %d decoded to less than the blocksize\n", block);
-            m_curframe = 0xFFFFFFFF;
-            return false;
+            m_frame_ready.wait(lock, [&] { return frame.block != block || frame.state != FRAME_LOADING; });
+            if (frame.block == block && frame.state == FRAME_READY)
+            {
+                frame.last_used = ++m_tick;
+                return index;
+            }
+        }
+        else if (frame.state == FRAME_READY)
+        {
+            frame.last_used = ++m_tick;
+            return index;
+        }
+        else if (frame.state == FRAME_QUEUED)
+        {
+            // no worker has got to it yet, so it's quicker to decode it here
+            frame.state = FRAME_LOADING;
+            lock.unlock();
+            bool success = decode_block(block, frame.data, m_decoder);
+            lock.lock();
+            release_frame(index, success);
+            return success ? (int)index : -1;
         }
     }
-    
-    m_curframe = block;
-    return true;
+
+    int index = claim_frame(block, FRAME_LOADING);
+    if (index < 0)
+        return -1;
+
+    lock.unlock();
+    bool success = decode_block(block, m_frames[index].data, m_decoder);
+    lock.lock();
+    release_frame(index, success);
+    return success ? index : -1;
+}
+
+// m_cache_mutex must be held
+void CSO_Reader::queue_prefetch(uint32_t block)
+{
+    if (!m_prefetch_blocks)
+        return;
+
+    // after a seek, whatever was queued for the old position is no longer wanted
+    if (block != m_last_block && block != m_last_block + 1)
+    {
+        for (uint32_t queued : m_queue)
+        {
+            auto it = m_frame_lookup.find(queued);
+            if (it != m_frame_lookup.end() && m_frames[it->second].state == FRAME_QUEUED)
+                release_frame(it->second, false);
+        }
+        m_queue.clear();
+    }
+    m_last_block = block;
+
+    uint32_t numblocks = (uint32_t)((m_size + m_blocksize - 1) / m_blocksize);
+    uint32_t end = std::min(block + 1 + m_prefetch_blocks, numblocks);
+    bool queued = false;
+    for (uint32_t i = block + 1; i < end; ++i)
+    {
+        if (m_frame_lookup.count(i))
+            continue;
+        if (claim_frame(i, FRAME_QUEUED) < 0)
+            break;
+        m_queue.push_back(i);
+        queued = true;
+    }
+
+    if (queued)
+        m_work.notify_all();
+}
+
+void CSO_Reader::worker_loop()
+{
+    Decoder decoder;
+    bool usable = alloc_decoder(decoder);
+
+    std::unique_lock<std::mutex> lock(m_cache_mutex);
+    while (usable)
+    {
+        m_work.wait(lock, [this] { return m_quit || !m_queue.empty(); });
+        if (m_quit)
+            break;
+
+        uint32_t block = m_queue.front();
+        m_queue.pop_front();
+
+        auto it = m_frame_lookup.find(block);
+        if (it == m_frame_lookup.end() || m_frames[it->second].state != FRAME_QUEUED)
+            continue;
+
+        uint32_t index = it->second;
+        m_frames[index].state = FRAME_LOADING;
+        lock.unlock();
+        bool success = decode_block(block, m_frames[index].data, decoder);
+        lock.lock();
+        release_frame(index, success);
+    }
+    lock.unlock();
+
+    free_decoder(decoder);
 }
 
 uint64_t CSO_Reader::read(uint8_t* dst, uint64_t size)
 {
-    assert(size);
-    assert(m_virtptr + size <= m_size);
-    
+    if (m_virtptr >= m_size)
+        return 0;
+    size = std::min(size, m_size - m_virtptr);
+    if (!size)
+        return 0;
+
     const uint64_t start = m_virtptr;
     const uint64_t end = start + size;
     const auto start_block = (uint32_t)(start / m_blocksize);
-    const auto end_block = (uint32_t)(end / m_blocksize);
-    
+    const auto end_block = (uint32_t)((end - 1) / m_blocksize);
+
+    std::unique_lock<std::mutex> lock(m_cache_mutex);
     uint64_t total_read = 0;
     for (uint32_t i = start_block; i <= end_block; ++i)
     {
-        if (!read_block_internal(i))
+        int index = acquire_frame(i, lock);
+        queue_prefetch(i);
+        if (index < 0)
             return total_read;
-        
-        const uint64_t local_ofs = start - (uint64_t)start_block * m_blocksize;
-        uint64_t readlen = m_blocksize;
-        if (i == start_block)
-            readlen -= local_ofs;
-        if (i == end_block)
-            readlen -= m_blocksize - (end - (uint64_t)end_block * m_blocksize);
-
-        memcpy(dst, m_frame + local_ofs, readlen);
+
+        const uint64_t block_start = (uint64_t)i * m_blocksize;
+        const uint64_t local_ofs = std::max(start, block_start) - block_start;
+        const uint64_t readlen = std::min(end, block_start + m_blocksize) - block_start - local_ofs;
+
+        memcpy(dst, m_frames[index].data + local_ofs, readlen);
         total_read += readlen;
         m_virtptr += readlen;
         dst += readlen;
     }
-    
+
     return total_read;
 }
 
@@ -215,24 +488,37 @@ bool CSO_Reader::open(const char* path)
     m_file.read((char*)header.reserved, 2 * sizeof(uint8_t));
     
     // validate header
-    if (header.magic != FOURCC("CISO"))
+    bool zso = header.magic == FOURCC("ZISO");
+    if (header.magic != FOURCC("CISO") && !zso)
     {
         fprintf(stderr, "file is not a CSO!\n");
+        close();
         return false;
     }
-    if (header.version > 1)
+    if (header.version > 2 || (zso && header.version == 2))
     {
         fprintf(stderr, "unsupported CSO version or corrupt file\n");
+        close();
         return false;
     }
-    
-    // reinstate these if CSOv2 support is ever added
-    /*
     if (header.version == 2 && header.header_len != 0x18)
+    {
+        fprintf(stderr, "CSOv2 header has the wrong size\n");
+        close();
         return false;
+    }
     if (header.version == 2 && (header.reserved[0] || header.reserved[1]))
+    {
+        fprintf(stderr, "CSOv2 header has reserved fields set\n");
+        close();
         return false;
-    */
+    }
+    if (!header.block_len)
+    {
+        fprintf(stderr, "CSO has a block size of 0\n");
+        close();
+        return false;
+    }
     
     // read indices
     auto num_entries = (uint32_t)((header.raw_len + header.block_len - 1) / header.block_len) + 1;
@@ -247,18 +533,19 @@ bool CSO_Reader::open(const char* path)
     
     // sanity check indices
     uint32_t lastidx = m_indices[0];
-    if ((lastidx & ~IDX_COMPRESS_BIT) << header.index_shift < 0x18)
+    if ((uint64_t)(lastidx & ~IDX_COMPRESS_BIT) << header.index_shift < 0x18)
     {
         fprintf(stderr, "CSO indices are corrupted (starts within header)\n");
         close();
         return false;
     }
     
-    uint32_t framesize = header.block_len + (1 << m_shift);
+    // blocks may be padded out to the index alignment
+    uint32_t framesize = header.block_len + (1 << header.index_shift);
     for (unsigned i = 1; i < num_entries; ++i)
     {
-        uint32_t lastpos = (lastidx & ~IDX_COMPRESS_BIT) << header.index_shift;
-        if (lastpos > file_len)
+        uint64_t lastpos = (uint64_t)(lastidx & ~IDX_COMPRESS_BIT) << header.index_shift;
+        if (lastpos > (uint64_t)file_len)
         {
             fprintf(stderr, "CSO indices are corrupted (outside file)\n");
             close();
@@ -266,21 +553,21 @@ bool CSO_Reader::open(const char* path)
         }
         
         uint32_t idx = m_indices[i];
-        uint32_t pos = (idx & ~IDX_COMPRESS_BIT) << header.index_shift;
-        uint32_t len = pos - lastpos;
-        if (len <= 0)
+        uint64_t pos = (uint64_t)(idx & ~IDX_COMPRESS_BIT) << header.index_shift;
+        if (pos <= lastpos)
         {
             fprintf(stderr, "CSO indices are corrupted (out of order)\n");
             close();
             return false;
         }
-        else if (len > framesize)
+        uint64_t len = pos - lastpos;
+        if (len > framesize)
         {
             fprintf(stderr, "CSO indices are corrupted (index too large)\n");
             close();
             return false;
         }
-        else if ((lastidx & IDX_COMPRESS_BIT) && len < header.block_len)
+        else if (header.version < 2 && (lastidx & IDX_COMPRESS_BIT) && len < header.block_len)
         {
             fprintf(stderr, "CSO indices are corrupted (uncompressed index smaller than block size)\n");
             close();
@@ -290,35 +577,70 @@ bool CSO_Reader::open(const char* path)
     }
     
     m_version = header.version;
+    m_zso = zso;
     m_size = header.raw_len;
     m_shift = header.index_shift;
     m_blocksize = header.block_len;
     m_framesize = framesize;
-    m_frame = new uint8_t[m_framesize];
-    m_readbuf = new uint8_t[m_framesize];
     
     // setup libdeflate
-    m_inflate = libdeflate_alloc_decompressor();
-    if (!m_inflate)
+    if (!alloc_decoder(m_decoder))
     {
         fprintf(stderr, "failed to allocate decompressor\n");
         close();
         return false;
     }
     
+    // setup the frame cache
+    m_numframes = std::max(MIN_FRAMES, std::min(MAX_FRAMES, (int)(CACHE_BYTES / m_framesize)));
+    m_frames = new Frame[m_numframes];
+    for (uint32_t i = 0; i < m_numframes; ++i)
+    {
+        m_frames[i].block = 0;
+        m_frames[i].state = FRAME_EMPTY;
+        m_frames[i].last_used = 0;
+        m_frames[i].data = new uint8_t[m_framesize];
+    }
+    m_tick = 0;
+    m_last_block = 0xFFFFFFFF;
+    
+    // decode ahead on the spare cores, using at most a quarter of the cache so prefetching never evicts what is being read
+    int workers = std::min(MAX_WORKERS, (int)std::thread::hardware_concurrency() / 2);
+    if (workers > 0)
+    {
+        m_prefetch_blocks = std::min(MAX_PREFETCH, (int)m_numframes / 4);
+        m_quit = false;
+        for (int i = 0; i < workers; ++i)
+            m_workers.emplace_back(&CSO_Reader::worker_loop, this);
+    }
+    
     return true;
 }
 
 void CSO_Reader::close()
 {
-    libdeflate_free_decompressor(m_inflate);
-    m_inflate = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_cache_mutex);
+        m_quit = true;
+    }
+    m_work.notify_all();
+    for (auto& worker : m_workers)
+        worker.join();
+    m_workers.clear();
+    m_queue.clear();
+    m_prefetch_blocks = 0;
     
-    delete[] m_readbuf;
-    m_readbuf = nullptr;
-
-    delete[] m_frame;
-    m_frame = nullptr;
+    free_decoder(m_decoder);
+    
+    if (m_frames)
+    {
+        for (uint32_t i = 0; i < m_numframes; ++i)
+            delete[] m_frames[i].data;
+        delete[] m_frames;
+        m_frames = nullptr;
+    }
+    m_numframes = 0;
+    m_frame_lookup.clear();
     
     delete[] m_indices;
     m_indices = nullptr;
@@ -327,10 +649,10 @@ void CSO_Reader::close()
         m_file.close();
     
     m_version = 0;
+    m_zso = false;
     m_virtptr = 0;
     m_size = 0;
     m_shift = 0;
     m_blocksize = 0;
     m_framesize = 0;
-    m_curframe = 0xFFFFFFFF;
 }
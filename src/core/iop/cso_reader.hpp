@@ -1,44 +1,95 @@
 #ifndef CSO_READER_H
 #define CSO_READER_H
 
-#include <fstream>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 class CSO_Reader
 {
 protected:
+    enum FrameState : uint8_t
+    {
+        FRAME_EMPTY,
+        FRAME_QUEUED,   // waiting for a worker
+        FRAME_LOADING,  // being decoded, either by a worker or by read()
+        FRAME_READY
+    };
+
+    struct Frame
+    {
+        uint32_t block;
+        FrameState state;
+        uint64_t last_used;
+        uint8_t* data;
+    };
+
+    // everything needed to decode a block, so each thread can decode independently
+    struct Decoder
+    {
+        struct libdeflate_decompressor* inflate;
+        uint8_t* readbuf;
+    };
+
     std::ifstream m_file;
+    std::mutex m_file_mutex;
     uint64_t m_size;
     uint32_t m_shift;
     uint32_t m_blocksize;
     uint8_t m_version;
+    bool m_zso;
     uint64_t m_virtptr;
-    
+
     uint32_t* m_indices;
-    
+
     uint32_t m_framesize;
-    uint32_t m_curframe;
-    uint8_t* m_frame;
-    uint8_t* m_readbuf;
-    
-    struct libdeflate_decompressor* m_inflate;
-    
-    bool read_block_internal(uint32_t block);
-    
+    Decoder m_decoder;
+
+    // decoded blocks, evicted least recently used first
+    Frame* m_frames;
+    uint32_t m_numframes;
+    std::unordered_map<uint32_t, uint32_t> m_frame_lookup;
+    uint64_t m_tick;
+
+    // blocks after the one being read are decoded ahead of time by the workers
+    uint32_t m_prefetch_blocks;
+    uint32_t m_last_block;
+    std::deque<uint32_t> m_queue;
+    bool m_quit;
+    std::vector<std::thread> m_workers;
+    std::mutex m_cache_mutex;
+    std::condition_variable m_work;
+    std::condition_variable m_frame_ready;
+
+    bool alloc_decoder(Decoder& decoder);
+    void free_decoder(Decoder& decoder);
+    bool decode_block(uint32_t block, uint8_t* dst, Decoder& decoder);
+
+    int claim_frame(uint32_t block, FrameState state);
+    void release_frame(uint32_t index, bool success);
+    int acquire_frame(uint32_t block, std::unique_lock<std::mutex>& lock);
+    void queue_prefetch(uint32_t block);
+    void worker_loop();
+
 public:
     CSO_Reader();
     ~CSO_Reader();
-    
+
     uint8_t get_version();
     uint64_t get_size();
     uint32_t get_blocksize();
     uint32_t get_numblocks();
-    
+
     bool isopen();
     void seek(int64_t ofs, std::ios::seekdir whence);
     uint64_t tell();
     uint64_t read(uint8_t* dst, uint64_t size);
-    
+
     bool open(const char* path);
     void close();
 };
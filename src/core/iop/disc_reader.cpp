@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "disc_reader.hpp"
+
+using namespace std;
+
+//Reads bigger than this (whole files read by the BIOS HLE, directory extents) skip the cache
+#define MAX_CACHED_READ (DiscReader::SECTOR_SIZE * 16)
+
+static uint64_t elapsed_us(chrono::steady_clock::time_point start)
+{
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
+
+DiscReader::DiscReader(Backend backend) : backend(backend), slots(nullptr), sector_count(0)
+{
+    quit = false;
+    ahead_start = ahead_end = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+DiscReader::~DiscReader()
+{
+    stop();
+}
+
+void DiscReader::start(uint64_t file_size)
+{
+    stop();
+
+    slots = new Slot[CACHE_SECTORS];
+    for (int i = 0; i < CACHE_SECTORS; i++)
+    {
+        slots[i].sector = 0;
+        slots[i].state = EMPTY;
+        slots[i].length = 0;
+    }
+    sector_count = (file_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    ahead_start = ahead_end = 0;
+    quit = false;
+    memset(&stats, 0, sizeof(stats));
+
+    thread = std::thread(&DiscReader::thread_loop, this);
+}
+
+void DiscReader::stop()
+{
+    if (!is_active())
+        return;
+
+    {
+        lock_guard<mutex> lock(cache_mutex);
+        quit = true;
+    }
+    wake.notify_one();
+    thread.join();
+
+    print_stats();
+    delete[] slots;
+    slots = nullptr;
+}
+
+size_t DiscReader::read_backend(uint64_t offset, uint8_t* dst, size_t size)
+{
+    lock_guard<mutex> lock(file_mutex);
+    return backend(offset, dst, size);
+}
+
+size_t DiscReader::read(uint64_t offset, uint8_t* dst, size_t size)
+{
+    if (!is_active())
+        return read_backend(offset, dst, size);
+
+    if (size > MAX_CACHED_READ)
+    {
+        auto start = chrono::steady_clock::now();
+        size_t count = read_backend(offset, dst, size);
+        lock_guard<mutex> lock(cache_mutex);
+        stats.uncached_reads++;
+        stats.stall_us += elapsed_us(start);
+        return count;
+    }
+
+    size_t count = 0;
+    while (count < size)
+    {
+        int sector_offset = (offset + count) % SECTOR_SIZE;
+        int chunk = SECTOR_SIZE - sector_offset;
+        if ((size_t)chunk > size - count)
+            chunk = size - count;
+
+        int copied = read_sector((offset + count) / SECTOR_SIZE, sector_offset, dst + count, chunk);
+        count += copied;
+
+        //End of the image
+        if (copied < chunk)
+            break;
+    }
+    return count;
+}
+
+size_t DiscReader::read_sector(uint64_t sector, int offset, uint8_t* dst, int size)
+{
+    unique_lock<mutex> lock(cache_mutex);
+    Slot& slot = slots[sector % CACHE_SECTORS];
+
+    if (slot.sector == sector && slot.state == LOADING)
+    {
+        auto start = chrono::steady_clock::now();
+        loaded.wait(lock, [&] { return slot.sector != sector || slot.state != LOADING; });
+        stats.late_hits++;
+        stats.stall_us += elapsed_us(start);
+    }
+    else if (slot.sector == sector && slot.state == READY)
+        stats.hits++;
+
+    if (slot.sector != sector || slot.state != READY)
+    {
+        //Read the sector ourselves. Don't claim the slot if the thread is busy filling it with another sector.
+        stats.misses++;
+        bool claim = slot.state != LOADING;
+        if (claim)
+        {
+            slot.sector = sector;
+            slot.state = LOADING;
+        }
+        lock.unlock();
+
+        auto start = chrono::steady_clock::now();
+        uint8_t buffer[SECTOR_SIZE];
+        int length = read_backend(sector * SECTOR_SIZE, buffer, SECTOR_SIZE);
+
+        lock.lock();
+        stats.stall_us += elapsed_us(start);
+        if (claim)
+        {
+            memcpy(slot.data, buffer, length);
+            slot.length = length;
+            slot.state = READY;
+            loaded.notify_all();
+        }
+        else
+        {
+            if (offset + size > length)
+                size = max(length - offset, 0);
+            memcpy(dst, buffer + offset, size);
+            return size;
+        }
+    }
+
+    if (offset + size > slot.length)
+        size = max(slot.length - offset, 0);
+    memcpy(dst, slot.data + offset, size);
+    return size;
+}
+
+/**
+ * Asks the thread to cache the sectors covering the given byte range, up to MAX_READ_AHEAD of them.
+ * This replaces any earlier range, so it's meant to be called at the start of each read and again after every sector.
+ */
+void DiscReader::read_ahead(uint64_t offset, uint64_t size)
+{
+    if (!is_active())
+        return;
+
+    uint64_t start = offset / SECTOR_SIZE;
+    uint64_t end = (offset + size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    if (end > start + MAX_READ_AHEAD)
+        end = start + MAX_READ_AHEAD;
+    if (end > sector_count)
+        end = sector_count;
+
+    {
+        lock_guard<mutex> lock(cache_mutex);
+        ahead_start = start;
+        ahead_end = end;
+    }
+    wake.notify_one();
+}
+
+void DiscReader::thread_loop()
+{
+    uint8_t* buffer = new uint8_t[READ_CHUNK * SECTOR_SIZE];
+    unique_lock<mutex> lock(cache_mutex);
+    while (true)
+    {
+        wake.wait(lock, [this] { return quit || ahead_start < ahead_end; });
+        if (quit)
+            break;
+
+        //Skip over what's already cached, then claim a run of consecutive sectors that isn't
+        uint64_t first = ahead_start;
+        while (first < ahead_end)
+        {
+            Slot& slot = slots[first % CACHE_SECTORS];
+            if (slot.sector != first || slot.state == EMPTY)
+                break;
+            first++;
+        }
+
+        uint64_t last = first;
+        while (last < ahead_end && last - first < READ_CHUNK)
+        {
+            Slot& slot = slots[last % CACHE_SECTORS];
+            if (slot.state == LOADING || (slot.sector == last && slot.state == READY))
+                break;
+            slot.sector = last;
+            slot.state = LOADING;
+            last++;
+        }
+        ahead_start = last;
+        if (first == last)
+        {
+            //The emulator thread is reading another sector into this slot, leave it alone
+            if (first < ahead_end)
+                ahead_start = first + 1;
+            continue;
+        }
+
+        lock.unlock();
+        size_t length = read_backend(first * SECTOR_SIZE, buffer, (last - first) * SECTOR_SIZE);
+        lock.lock();
+
+        for (uint64_t sector = first; sector < last; sector++)
+        {
+            Slot& slot = slots[sector % CACHE_SECTORS];
+            size_t start = (sector - first) * SECTOR_SIZE;
+            int count = 0;
+            if (length > start)
+                count = (length - start < SECTOR_SIZE) ? length - start : SECTOR_SIZE;
+            memcpy(slot.data, buffer + start, count);
+            slot.length = count;
+            slot.state = READY;
+        }
+        loaded.notify_all();
+    }
+    delete[] buffer;
+}
+
+DiscReaderStats DiscReader::get_stats()
+{
+    lock_guard<mutex> lock(cache_mutex);
+    return stats;
+}
+
+void DiscReader::print_stats()
+{
+    DiscReaderStats s = get_stats();
+    uint64_t cached = s.hits + s.late_hits + s.misses;
+    if (!cached && !s.uncached_reads)
+        return;
+
+    double hit_rate = cached ? (100.0 * (s.hits + s.late_hits) / cached) : 0.0;
+    printf("[CDVD] Read-ahead: %llu hits (%llu waited on), %llu misses, %llu uncached reads, %.1f%% hit rate, %.3f ms stalled\n",
+           (unsigned long long)s.hits, (unsigned long long)s.late_hits, (unsigned long long)s.misses,
+           (unsigned long long)s.uncached_reads, hit_rate, s.stall_us / 1000.0);
+}
@@ -0,0 +1,88 @@
+#ifndef DISC_READER_HPP
+#define DISC_READER_HPP
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+struct DiscReaderStats
+{
+    uint64_t hits;
+    uint64_t late_hits; //The sector was still being read by the thread
+    uint64_t misses;
+    uint64_t uncached_reads;
+    uint64_t stall_us;
+};
+
+//Sector cache in front of the disc image, filled ahead of the drive by a background thread.
+//The drive tells it which range the current N command is going to read. Reads of cached sectors are a memcpy;
+//anything else falls back to reading the image on the calling thread, which is counted as stall time.
+//The backend is only ever called with file_mutex held, so it doesn't need to be thread-safe.
+class DiscReader
+{
+    public:
+        typedef std::function<size_t(uint64_t offset, uint8_t* dst, size_t size)> Backend;
+
+        static constexpr int SECTOR_SIZE = 2048;
+        static constexpr int CACHE_SECTORS = 512;
+        static constexpr int MAX_READ_AHEAD = 128;
+    private:
+        enum SLOT_STATE
+        {
+            EMPTY,
+            LOADING,
+            READY
+        };
+
+        struct Slot
+        {
+            uint64_t sector;
+            SLOT_STATE state;
+            int length;
+            uint8_t data[SECTOR_SIZE];
+        };
+
+        //Sectors the thread reads in one backend call
+        static constexpr int READ_CHUNK = 16;
+
+        Backend backend;
+        Slot* slots;
+        uint64_t sector_count;
+
+        std::thread thread;
+        std::mutex file_mutex;
+        std::mutex cache_mutex;
+        std::condition_variable wake;
+        std::condition_variable loaded;
+        bool quit;
+
+        //Sectors the thread should have cached, guarded by cache_mutex
+        uint64_t ahead_start, ahead_end;
+
+        DiscReaderStats stats;
+
+        size_t read_backend(uint64_t offset, uint8_t* dst, size_t size);
+        size_t read_sector(uint64_t sector, int offset, uint8_t* dst, int size);
+        void thread_loop();
+    public:
+        DiscReader(Backend backend);
+        ~DiscReader();
+
+        void start(uint64_t file_size);
+        void stop();
+        bool is_active();
+
+        size_t read(uint64_t offset, uint8_t* dst, size_t size);
+        void read_ahead(uint64_t offset, uint64_t size);
+
+        DiscReaderStats get_stats();
+        void print_stats();
+};
+
+inline bool DiscReader::is_active()
+{
+    return thread.joinable();
+}
+
+#endif // DISC_READER_HPP
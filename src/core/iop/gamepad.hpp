@@ -83,8 +83,8 @@ class Gamepad
         uint8_t start_transfer(uint8_t value);
         uint8_t write_SIO(uint8_t value);
 
-        void load_state(std::ifstream& state);
-        void save_state(std::ofstream& state);
+        void load_state(std::istream& state);
+        void save_state(std::ostream& state);
 };
 
 #endif // GAMEPAD_HPP
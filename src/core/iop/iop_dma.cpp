@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <cstring>
 #include "cdvd.hpp"
 #include "iop_dma.hpp"
 #include "sio2.hpp"
@@ -33,6 +34,7 @@ void IOP_DMA::reset(uint8_t* RAM)
         channels[i].control.busy = false;
         channels[i].control.sync_mode = 0;
         channels[i].dma_req = false;
+        channels[i].delay = 0;
         channels[i].index = i;
 
         DPCR.enable[i] = false;
@@ -166,6 +168,31 @@ void IOP_DMA::process_SPU2()
 
 void IOP_DMA::process_SIF0()
 {
+    //Wait out the cost of the last bulk transfer
+    if (channels[IOP_SIF0].delay > 0)
+    {
+        channels[IOP_SIF0].delay--;
+        if (!channels[IOP_SIF0].delay && !channels[IOP_SIF0].word_count && channels[IOP_SIF0].tag_end)
+            transfer_end(IOP_SIF0);
+        return;
+    }
+
+    if (channels[IOP_SIF0].word_count >= 4 && channels[IOP_SIF0].addr + channels[IOP_SIF0].word_count * 4 <= RAM_SIZE)
+    {
+        //Whole quads can go straight to the EE if it's waiting on data, at the cost of a cycle per word
+        int quads = channels[IOP_SIF0].word_count / 4;
+        if (quads > SubsystemInterface::MAX_BULK_QUADS)
+            quads = SubsystemInterface::MAX_BULK_QUADS;
+        int count = sif->write_SIF0_bulk(&RAM[channels[IOP_SIF0].addr], quads);
+        if (count)
+        {
+            channels[IOP_SIF0].addr += count * 16;
+            channels[IOP_SIF0].word_count -= count * 4;
+            channels[IOP_SIF0].delay = (count * 4) - 1;
+            return;
+        }
+    }
+
     if (channels[IOP_SIF0].word_count)
     {
         uint32_t data = *(uint32_t*)&RAM[channels[IOP_SIF0].addr];
@@ -201,8 +228,35 @@ void IOP_DMA::process_SIF0()
 
 void IOP_DMA::process_SIF1()
 {
+    //Data from a bulk transfer is already in RAM, but the channel has to be busy for as long as it would have taken
+    if (channels[IOP_SIF1].delay > 0)
+    {
+        channels[IOP_SIF1].delay--;
+        if (!channels[IOP_SIF1].delay)
+        {
+            if (!sif->get_SIF1_size())
+                clear_DMA_request(IOP_SIF1);
+            if (!channels[IOP_SIF1].word_count && channels[IOP_SIF1].tag_end)
+                transfer_end(IOP_SIF1);
+        }
+        return;
+    }
+
     if (channels[IOP_SIF1].word_count)
     {
+        //Take everything that's already waiting in the FIFO at once, then pay for it a cycle per word
+        int words = sif->get_SIF1_size();
+        if (words > (int)channels[IOP_SIF1].word_count)
+            words = channels[IOP_SIF1].word_count;
+        if (words > 1 && channels[IOP_SIF1].addr + (words * 4) <= RAM_SIZE)
+        {
+            sif->read_SIF1_bulk(&RAM[channels[IOP_SIF1].addr], words);
+            channels[IOP_SIF1].addr += words * 4;
+            channels[IOP_SIF1].word_count -= words;
+            channels[IOP_SIF1].delay = words - 1;
+            return;
+        }
+
         uint32_t data = sif->read_SIF1();
 
         *(uint32_t*)&RAM[channels[IOP_SIF1].addr] = data;
@@ -429,6 +483,37 @@ void IOP_DMA::clear_DMA_request(int index)
         deactivate_dma(index);
 }
 
+/**
+Takes SIF1 data straight from the EE while the channel is in the middle of a block. Tags still come through the FIFO.
+The channel then stays busy for a cycle per word, the same rate as reading them from the FIFO.
+Returns how many quads were taken.
+**/
+int IOP_DMA::write_SIF1_direct(const uint128_t* quads, int count)
+{
+    IOP_DMA_Channel& channel = channels[IOP_SIF1];
+    if (!channel.control.busy || channel.word_count < 4)
+        return 0;
+
+    //The EE can only get so far ahead of the IOP
+    int budget = (SubsystemInterface::MAX_BULK_QUADS * 4) - channel.delay;
+    uint32_t words = count * 4;
+    if (words > channel.word_count)
+        words = channel.word_count & ~0x3;
+    if ((int)words > budget)
+        words = budget & ~0x3;
+    if (!words || channel.addr + (words * 4) > RAM_SIZE)
+        return 0;
+
+    memcpy(&RAM[channel.addr], quads, words * 4);
+    channel.addr += words * 4;
+    channel.word_count -= words;
+    channel.delay += words;
+
+    //Keep the channel running so the delay gets paid off
+    set_DMA_request(IOP_SIF1);
+    return words / 4;
+}
+
 void IOP_DMA::set_chan_addr(int index, uint32_t value)
 {
     printf("[IOP DMA] %s addr: $%08X\n", CHAN(index), value);
@@ -4,6 +4,8 @@
 #include <fstream>
 #include <list>
 
+#include "../int128.hpp"
+
 class IOP_DMA;
 
 struct IOP_DMA_Chan_Control
@@ -31,6 +33,7 @@ struct IOP_DMA_Channel
 
     bool dma_req;
 
+    //Cycles left before the next transfer. The SIF channels use this to pay for bulk transfers.
     int delay;
     int index;
 };
@@ -75,6 +78,7 @@ enum IOP_DMA_CHANNELS
 class IOP_DMA
 {
     private:
+        constexpr static uint32_t RAM_SIZE = 1024 * 1024 * 2;
         uint8_t* RAM;
         Emulator* e;
         CDVD_Drive* cdvd;
@@ -126,6 +130,8 @@ class IOP_DMA
         void set_DMA_request(int index);
         void clear_DMA_request(int index);
 
+        int write_SIF1_direct(const uint128_t* quads, int count);
+
         void set_chan_addr(int index, uint32_t value);
         void set_chan_block(int index, uint32_t value);
         void set_chan_size(int index, uint16_t value);
@@ -133,8 +139,8 @@ class IOP_DMA
         void set_chan_control(int index, uint32_t value);
         void set_chan_tag_addr(int index, uint32_t value);
 
-        void load_state(std::ifstream& state);
-        void save_state(std::ofstream& state);
+        void load_state(std::istream& state);
+        void save_state(std::ostream& state);
 };
 
 #endif // IOP_DMA_HPP
@@ -0,0 +1,160 @@
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+#include "iso_mapping.hpp"
+#include "disc_reader.hpp"
+
+//How far ahead of the drive the kernel is asked to have the image paged in
+#define WILLNEED_WINDOW ((uint64_t)DiscReader::MAX_READ_AHEAD * DiscReader::SECTOR_SIZE)
+
+ISO_Mapping::ISO_Mapping() : data(nullptr), size(0)
+{
+#ifdef _WIN32
+    file_handle = nullptr;
+    mapping_handle = nullptr;
+#endif
+    sequential_start = sequential_end = 0;
+    advised_end = 0;
+}
+
+ISO_Mapping::~ISO_Mapping()
+{
+    close();
+}
+
+bool ISO_Mapping::open(const char* path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER file_size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart)
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    data = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    file_handle = file;
+    mapping_handle = mapping;
+    size = file_size.QuadPart;
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (!fstat(fd, &info) && info.st_size > 0)
+        mapping = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    //The mapping keeps its own reference to the file
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    data = (uint8_t*)mapping;
+    size = info.st_size;
+#endif
+
+    sequential_start = sequential_end = 0;
+    advised_end = 0;
+    return true;
+}
+
+void ISO_Mapping::close()
+{
+    if (!data)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle((HANDLE)mapping_handle);
+    CloseHandle((HANDLE)file_handle);
+    file_handle = nullptr;
+    mapping_handle = nullptr;
+#else
+    munmap(data, size);
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+size_t ISO_Mapping::read(uint64_t ofs, uint8_t* dst, size_t count)
+{
+    if (ofs >= size)
+        return 0;
+    if (count > size - ofs)
+        count = size - ofs;
+    memcpy(dst, data + ofs, count);
+    return count;
+}
+
+/**
+ * Passes the range the drive is about to read on to the kernel.
+ * A new range is marked sequential, so pages behind the drive can be dropped early,
+ * and the next WILLNEED_WINDOW bytes are requested whenever the drive gets close to the end of the last request.
+ */
+void ISO_Mapping::read_ahead(uint64_t ofs, uint64_t count)
+{
+#ifndef _WIN32
+    if (!data || ofs >= size || !count)
+        return;
+
+    uint64_t end = ofs + count;
+    if (end > size)
+        end = size;
+
+    //Reads within the current command keep the same end and only move the start forward
+    if (end != sequential_end || ofs < sequential_start)
+    {
+        //Put the previous range back so its mapping can merge with the rest of the image again
+        if (sequential_start < sequential_end)
+            advise(sequential_start, sequential_end, MADV_NORMAL);
+        advise(ofs, end, MADV_SEQUENTIAL);
+        sequential_start = ofs;
+        sequential_end = end;
+        advised_end = ofs;
+    }
+
+    if (advised_end < ofs + WILLNEED_WINDOW && advised_end < end)
+    {
+        uint64_t start = (advised_end > ofs) ? advised_end : ofs;
+        uint64_t new_end = ofs + WILLNEED_WINDOW * 2;
+        if (new_end > end)
+            new_end = end;
+        advise(start, new_end, MADV_WILLNEED);
+        advised_end = new_end;
+    }
+#endif
+}
+
+#ifndef _WIN32
+void ISO_Mapping::advise(uint64_t start, uint64_t end, int advice)
+{
+    static const uint64_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+    start &= ~page_mask;
+    madvise(data + start, end - start, advice);
+}
+#endif
@@ -0,0 +1,46 @@
+#ifndef ISO_MAPPING_HPP
+#define ISO_MAPPING_HPP
+#include <cstddef>
+#include <cstdint>
+
+//Read-only mapping of a whole ISO, so reading a sector is a memcpy out of the page cache.
+//Instances mapping the same image share its pages.
+class ISO_Mapping
+{
+    private:
+        uint8_t* data;
+        uint64_t size;
+#ifdef _WIN32
+        void* file_handle;
+        void* mapping_handle;
+#endif
+
+        //Range currently marked for sequential access, and how far ahead the kernel has been asked to read
+        uint64_t sequential_start, sequential_end;
+        uint64_t advised_end;
+
+        void advise(uint64_t start, uint64_t end, int advice);
+    public:
+        ISO_Mapping();
+        ~ISO_Mapping();
+
+        bool open(const char* path);
+        void close();
+        bool isopen();
+        uint64_t get_size();
+
+        size_t read(uint64_t ofs, uint8_t* dst, size_t count);
+        void read_ahead(uint64_t ofs, uint64_t count);
+};
+
+inline bool ISO_Mapping::isopen()
+{
+    return data != nullptr;
+}
+
+inline uint64_t ISO_Mapping::get_size()
+{
+    return size;
+}
+
+#endif // ISO_MAPPING_HPP
@@ -113,8 +113,8 @@ class SPU
         uint16_t read16(uint32_t addr);
         void write16(uint32_t addr, uint16_t value);
 
-        void load_state(std::ifstream& state);
-        void save_state(std::ofstream& state);
+        void load_state(std::istream& state);
+        void save_state(std::ostream& state);
 };
 
 inline bool SPU::running_ADMA()
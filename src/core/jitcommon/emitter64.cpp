@@ -62,6 +62,25 @@ void Emitter64::modrm(uint8_t mode, uint8_t reg, uint8_t rm)
     cache->write<uint8_t>(((mode & 0x3) << 6) | ((reg & 0x7) << 3) | (rm & 0x7));
 }
 
+void Emitter64::vex(uint8_t pp, uint8_t map, REG_64 reg, REG_64 vvvv, REG_64 rm)
+{
+    //pp: 0 = none, 1 = 0x66, 2 = 0xF3, 3 = 0xF2
+    //map: 1 = 0x0F, 2 = 0x0F38, 3 = 0x0F3A
+    //Only 128-bit forms with W = 0 are emitted. R, B, and vvvv are stored inverted.
+    uint8_t last = ((~vvvv & 0xF) << 3) | (pp & 0x3);
+    if (map == 1 && !(rm & 0x8))
+    {
+        cache->write<uint8_t>(0xC5);
+        cache->write<uint8_t>(((~reg & 0x8) << 4) | last);
+    }
+    else
+    {
+        cache->write<uint8_t>(0xC4);
+        cache->write<uint8_t>(((~reg & 0x8) << 4) | 0x40 | ((~rm & 0x8) << 2) | (map & 0x1F));
+        cache->write<uint8_t>(last);
+    }
+}
+
 int Emitter64::get_rip_offset(uint64_t addr)
 {
     int64_t offset = (uint64_t)cache->get_literal_offset<uint64_t>(addr);
@@ -829,3 +848,67 @@ void Emitter64::CVTTPS2DQ(REG_64 xmm_source, REG_64 xmm_dest)
     cache->write<uint8_t>(0x5B);
     modrm(0b11, xmm_dest, xmm_source);
 }
+
+void Emitter64::VPAND_XMM_MEM(REG_64 indir_op2, REG_64 xmm_op1, REG_64 xmm_dest)
+{
+    vex(1, 1, xmm_dest, xmm_op1, indir_op2);
+    cache->write<uint8_t>(0xDB);
+    modrm(0, xmm_dest, indir_op2);
+}
+
+void Emitter64::VPMINSD_XMM_FROM_MEM(REG_64 indir_op2, REG_64 xmm_op1, REG_64 xmm_dest)
+{
+    vex(1, 2, xmm_dest, xmm_op1, indir_op2);
+    cache->write<uint8_t>(0x39);
+    modrm(0, xmm_dest, indir_op2);
+}
+
+void Emitter64::VPMINUD_XMM_FROM_MEM(REG_64 indir_op2, REG_64 xmm_op1, REG_64 xmm_dest)
+{
+    vex(1, 2, xmm_dest, xmm_op1, indir_op2);
+    cache->write<uint8_t>(0x3B);
+    modrm(0, xmm_dest, indir_op2);
+}
+
+void Emitter64::VPERMILPS(uint8_t imm, REG_64 xmm_source, REG_64 xmm_dest)
+{
+    vex(1, 3, xmm_dest, (REG_64)0, xmm_source);
+    cache->write<uint8_t>(0x04);
+    modrm(0b11, xmm_dest, xmm_source);
+    cache->write<uint8_t>(imm);
+}
+
+void Emitter64::VADDPS(REG_64 xmm_op2, REG_64 xmm_op1, REG_64 xmm_dest)
+{
+    vex(0, 1, xmm_dest, xmm_op1, xmm_op2);
+    cache->write<uint8_t>(0x58);
+    modrm(0b11, xmm_dest, xmm_op2);
+}
+
+void Emitter64::VMAXPS(REG_64 xmm_op2, REG_64 xmm_op1, REG_64 xmm_dest)
+{
+    vex(0, 1, xmm_dest, xmm_op1, xmm_op2);
+    cache->write<uint8_t>(0x5F);
+    modrm(0b11, xmm_dest, xmm_op2);
+}
+
+void Emitter64::VMINPS(REG_64 xmm_op2, REG_64 xmm_op1, REG_64 xmm_dest)
+{
+    vex(0, 1, xmm_dest, xmm_op1, xmm_op2);
+    cache->write<uint8_t>(0x5D);
+    modrm(0b11, xmm_dest, xmm_op2);
+}
+
+void Emitter64::VMULPS(REG_64 xmm_op2, REG_64 xmm_op1, REG_64 xmm_dest)
+{
+    vex(0, 1, xmm_dest, xmm_op1, xmm_op2);
+    cache->write<uint8_t>(0x59);
+    modrm(0b11, xmm_dest, xmm_op2);
+}
+
+void Emitter64::VSUBPS(REG_64 xmm_op2, REG_64 xmm_op1, REG_64 xmm_dest)
+{
+    vex(0, 1, xmm_dest, xmm_op1, xmm_op2);
+    cache->write<uint8_t>(0x5C);
+    modrm(0b11, xmm_dest, xmm_op2);
+}
@@ -35,6 +35,7 @@ class Emitter64
         void rexw_rm(REG_64 rm);
         void rexw_r_rm(REG_64 reg, REG_64 rm);
         void modrm(uint8_t mode, uint8_t reg, uint8_t rm);
+        void vex(uint8_t pp, uint8_t map, REG_64 reg, REG_64 vvvv, REG_64 rm);
 
         int get_rip_offset(uint64_t addr);
     public:
@@ -158,6 +159,19 @@ class Emitter64
 
         //Convert truncated floats into 32-bit signed integers
         void CVTTPS2DQ(REG_64 xmm_source, REG_64 xmm_dest);
+
+        //AVX three-operand forms: xmm_dest = xmm_op1 OP xmm_op2, leaving both operands intact.
+        //Only emit these if HostCPU::get_features().avx is set.
+        void VPAND_XMM_MEM(REG_64 indir_op2, REG_64 xmm_op1, REG_64 xmm_dest);
+        void VPMINSD_XMM_FROM_MEM(REG_64 indir_op2, REG_64 xmm_op1, REG_64 xmm_dest);
+        void VPMINUD_XMM_FROM_MEM(REG_64 indir_op2, REG_64 xmm_op1, REG_64 xmm_dest);
+        void VPERMILPS(uint8_t imm, REG_64 xmm_source, REG_64 xmm_dest);
+
+        void VADDPS(REG_64 xmm_op2, REG_64 xmm_op1, REG_64 xmm_dest);
+        void VMAXPS(REG_64 xmm_op2, REG_64 xmm_op1, REG_64 xmm_dest);
+        void VMINPS(REG_64 xmm_op2, REG_64 xmm_op1, REG_64 xmm_dest);
+        void VMULPS(REG_64 xmm_op2, REG_64 xmm_op1, REG_64 xmm_dest);
+        void VSUBPS(REG_64 xmm_op2, REG_64 xmm_op1, REG_64 xmm_dest);
 };
 
 #endif // EMITTER64_HPP
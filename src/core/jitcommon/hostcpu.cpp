@@ -0,0 +1,62 @@
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#include <cstdint>
+#include "hostcpu.hpp"
+
+namespace HostCPU
+{
+
+static void cpuid(uint32_t leaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+    __cpuidex((int*)regs, leaf, 0);
+#else
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t xgetbv()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    asm volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static HostCPUFeatures detect()
+{
+    HostCPUFeatures features = {};
+    uint32_t regs[4];
+
+    cpuid(0, regs);
+    if (regs[0] < 1)
+        return features;
+
+    cpuid(1, regs);
+    uint32_t ecx = regs[2];
+    features.sse41 = ecx & (1 << 19);
+
+    //AVX is only usable if the OS has enabled XSAVE and saves both the XMM and YMM state
+    bool osxsave = ecx & (1 << 27);
+    if (osxsave && (ecx & (1 << 28)) && (xgetbv() & 0x6) == 0x6)
+    {
+        features.avx = true;
+        features.fma = ecx & (1 << 12);
+    }
+    return features;
+}
+
+const HostCPUFeatures& get_features()
+{
+    static HostCPUFeatures features = detect();
+    return features;
+}
+
+};
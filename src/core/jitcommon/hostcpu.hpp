@@ -0,0 +1,19 @@
+#ifndef HOSTCPU_HPP
+#define HOSTCPU_HPP
+
+struct HostCPUFeatures
+{
+    bool sse41;
+    bool avx; //Also requires the OS to save the YMM state on context switches
+    bool fma;
+};
+
+namespace HostCPU
+{
+
+//Queried with CPUID once, on first use
+const HostCPUFeatures& get_features();
+
+};
+
+#endif // HOSTCPU_HPP
@@ -30,6 +30,11 @@ Instruction Block::get_next_instr()
     return instr;
 }
 
+std::list<Instruction>& Block::get_instructions()
+{
+    return instructions;
+}
+
 void Block::set_cycle_count(int cycles)
 {
     cycle_count = cycles;
@@ -19,6 +19,7 @@ class Block
         unsigned int get_instruction_count();
         int get_cycle_count();
         Instruction get_next_instr();
+        std::list<Instruction>& get_instructions();
 
         void set_cycle_count(int cycles);
 };
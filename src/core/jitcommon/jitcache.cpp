@@ -12,6 +12,12 @@ JitCache::JitCache()
     //We reserve blocks so that they don't get reallocated.
     blocks.reserve(1024 * 4);
     current_block = nullptr;
+    flushes = 0;
+}
+
+static uint64_t variant_key(uint32_t program, uint32_t pc)
+{
+    return ((uint64_t)program << 32) | pc;
 }
 
 //Allocate a block with read and write, but not executable, privileges.
@@ -38,10 +44,14 @@ void JitCache::alloc_block(BlockState state)
     new_block.pool_size = 0;
 
     if (blocks.size() > 0x2000)
+    {
         flush_all_blocks();
+        flushes++;
+    }
 
     blocks.insert({ state, new_block });
     current_block = &blocks[state];
+    variants[variant_key(state.program, state.pc)]++;
 }
 
 void JitCache::free_block(BlockState state)
@@ -59,6 +69,10 @@ void JitCache::free_block(BlockState state)
     munmap(search->second.block_start, BLOCK_SIZE);
 #endif
     blocks.erase(search);
+
+    auto count = variants.find(variant_key(state.program, state.pc));
+    if (count != variants.end() && --count->second == 0)
+        variants.erase(count);
 }
 
 void JitCache::flush_all_blocks()
@@ -79,6 +93,7 @@ void JitCache::flush_all_blocks()
     blocks = std::unordered_map<BlockState, JitBlock, BlockStateHash>();
     blocks.reserve(1024 * 4);
     current_block = nullptr;
+    variants.clear();
 }
 
 JitBlock *JitCache::find_block(BlockState state)
@@ -95,6 +110,41 @@ JitBlock *JitCache::find_block(BlockState state)
     return nullptr;
 }
 
+int JitCache::get_variant_count(uint32_t program, uint32_t pc)
+{
+    auto search = variants.find(variant_key(program, pc));
+    if (search == variants.end())
+        return 0;
+    return search->second;
+}
+
+int JitCache::get_max_variants(uint32_t &program, uint32_t &pc)
+{
+    int max = 0;
+    program = 0;
+    pc = 0;
+    for (auto it = variants.begin(); it != variants.end(); ++it)
+    {
+        if (it->second > max)
+        {
+            max = it->second;
+            program = it->first >> 32;
+            pc = it->first & 0xFFFFFFFF;
+        }
+    }
+    return max;
+}
+
+size_t JitCache::get_block_count()
+{
+    return blocks.size();
+}
+
+uint64_t JitCache::get_flush_count()
+{
+    return flushes;
+}
+
 uint8_t* JitCache::get_current_block_start()
 {
     return current_block->block_start;
@@ -66,6 +66,12 @@ class JitCache
         constexpr static int START_OF_POOL = BLOCK_SIZE - POOL_SIZE;
         std::unordered_map<BlockState, JitBlock, BlockStateHash> blocks;
 
+        //How many blocks are compiled for each (program, PC) pair, differing only in the rest of the state
+        std::unordered_map<uint64_t, int> variants;
+
+        //Times the cache filled up and had to be flushed
+        uint64_t flushes;
+
         JitBlock* current_block;
     public:
         JitCache();
@@ -76,6 +82,11 @@ class JitCache
 
         JitBlock *find_block(BlockState state);
 
+        int get_variant_count(uint32_t program, uint32_t pc);
+        int get_max_variants(uint32_t& program, uint32_t& pc);
+        size_t get_block_count();
+        uint64_t get_flush_count();
+
         uint8_t* get_current_block_start();
         uint8_t* get_current_block_pos();
         void set_current_block_pos(uint8_t* pos);
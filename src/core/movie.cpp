@@ -0,0 +1,278 @@
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "movie.hpp"
+
+#define MOVIE_VERSION 1
+
+using namespace std;
+
+static const char MOVIE_MAGIC[8] = {'D', 'O', 'B', 'I', 'E', 'M', 'O', 'V'};
+
+InputMovie::InputMovie() : mode(MOVIE_MODE::NONE), next_input(0), frame(0), divergent_frame(-1), divergent_count(0)
+{
+
+}
+
+/**
+ * A 64-bit multiply-xor hash, run as four independent lanes so the multiplies overlap.
+ * Hashing RDRAM every frame has to keep up with the emulator, which FNV-1a a byte at a time doesn't.
+ */
+uint64_t InputMovie::hash_memory(const void* data, size_t size)
+{
+    const uint64_t prime = 0x100000001B3ULL;
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t lanes[4] = {0xCBF29CE484222325ULL, 0x84222325CBF29CE4ULL, 0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL};
+
+    size_t pos = 0;
+    for (; pos + 32 <= size; pos += 32)
+    {
+        uint64_t words[4];
+        memcpy(words, bytes + pos, sizeof(words));
+        for (int i = 0; i < 4; i++)
+            lanes[i] = (lanes[i] ^ words[i]) * prime;
+    }
+
+    uint64_t hash = lanes[0];
+    for (int i = 1; i < 4; i++)
+        hash = (hash ^ lanes[i]) * prime;
+    for (; pos < size; pos++)
+        hash = (hash ^ bytes[pos]) * prime;
+    return (hash ^ size) * prime;
+}
+
+void InputMovie::start_recording(const char* file_name)
+{
+    stop();
+    this->file_name = file_name;
+    inputs.clear();
+    hashes.clear();
+    pending.clear();
+    next_input = 0;
+    frame = 0;
+    divergent_frame = -1;
+    divergent_count = 0;
+    mode = MOVIE_MODE::RECORDING;
+    printf("[MOVIE] Recording to %s\n", file_name);
+}
+
+bool InputMovie::start_playback(const char* file_name)
+{
+    stop();
+    ifstream file(file_name, ios::binary);
+    if (!file.is_open())
+    {
+        printf("[MOVIE] Couldn't open %s\n", file_name);
+        return false;
+    }
+
+    char magic[sizeof(MOVIE_MAGIC)];
+    uint32_t version, input_count, frame_count;
+    file.read(magic, sizeof(magic));
+    file.read((char*)&version, sizeof(version));
+    file.read((char*)&input_count, sizeof(input_count));
+    file.read((char*)&frame_count, sizeof(frame_count));
+    if (file.fail() || memcmp(magic, MOVIE_MAGIC, sizeof(magic)) || version != MOVIE_VERSION)
+    {
+        printf("[MOVIE] %s isn't a movie this version can play\n", file_name);
+        return false;
+    }
+
+    inputs.resize(input_count);
+    for (MovieInput& input : inputs)
+    {
+        file.read((char*)&input.frame, sizeof(input.frame));
+        file.read((char*)&input.type, sizeof(input.type));
+        file.read((char*)&input.id, sizeof(input.id));
+        file.read((char*)&input.axis, sizeof(input.axis));
+        file.read((char*)&input.value, sizeof(input.value));
+    }
+    hashes.resize(frame_count);
+    for (StateHash& hash : hashes)
+    {
+        file.read((char*)&hash.RDRAM, sizeof(hash.RDRAM));
+        file.read((char*)&hash.GS, sizeof(hash.GS));
+        file.read((char*)&hash.CPU, sizeof(hash.CPU));
+    }
+    if (file.fail() || hashes.empty())
+    {
+        printf("[MOVIE] %s is truncated or empty\n", file_name);
+        inputs.clear();
+        hashes.clear();
+        return false;
+    }
+
+    this->file_name = file_name;
+    next_input = 0;
+    frame = 0;
+    divergent_frame = -1;
+    divergent_count = 0;
+    mode = MOVIE_MODE::PLAYBACK;
+    printf("[MOVIE] Playing back %s, %u frames\n", file_name, frame_count);
+    return true;
+}
+
+//Writes the movie out if one was being recorded
+bool InputMovie::stop()
+{
+    MOVIE_MODE old_mode = mode;
+    mode = MOVIE_MODE::NONE;
+    if (old_mode != MOVIE_MODE::RECORDING)
+        return true;
+
+    ofstream file(file_name, ios::binary);
+    if (!file.is_open())
+    {
+        printf("[MOVIE] Couldn't write %s\n", file_name.c_str());
+        return false;
+    }
+
+    uint32_t version = MOVIE_VERSION;
+    uint32_t input_count = inputs.size();
+    uint32_t frame_count = hashes.size();
+    file.write(MOVIE_MAGIC, sizeof(MOVIE_MAGIC));
+    file.write((char*)&version, sizeof(version));
+    file.write((char*)&input_count, sizeof(input_count));
+    file.write((char*)&frame_count, sizeof(frame_count));
+    for (const MovieInput& input : inputs)
+    {
+        file.write((char*)&input.frame, sizeof(input.frame));
+        file.write((char*)&input.type, sizeof(input.type));
+        file.write((char*)&input.id, sizeof(input.id));
+        file.write((char*)&input.axis, sizeof(input.axis));
+        file.write((char*)&input.value, sizeof(input.value));
+    }
+    for (const StateHash& hash : hashes)
+    {
+        file.write((char*)&hash.RDRAM, sizeof(hash.RDRAM));
+        file.write((char*)&hash.GS, sizeof(hash.GS));
+        file.write((char*)&hash.CPU, sizeof(hash.CPU));
+    }
+
+    if (file.fail())
+    {
+        printf("[MOVIE] Couldn't write %s\n", file_name.c_str());
+        return false;
+    }
+    printf("[MOVIE] Recorded %u frames and %u inputs to %s\n", frame_count, input_count, file_name.c_str());
+    return true;
+}
+
+uint32_t InputMovie::get_frame() const
+{
+    return frame;
+}
+
+uint32_t InputMovie::get_frame_count() const
+{
+    return hashes.size();
+}
+
+//-1 if every frame played back so far has matched
+int64_t InputMovie::get_divergent_frame() const
+{
+    return divergent_frame;
+}
+
+uint32_t InputMovie::get_divergent_count() const
+{
+    return divergent_count;
+}
+
+//Called from the frontend thread. Input during playback comes from the movie, so anything else is dropped.
+void InputMovie::queue_input(MOVIE_INPUT type, uint8_t id, uint8_t axis, uint8_t value)
+{
+    if (mode != MOVIE_MODE::RECORDING)
+        return;
+
+    MovieInput input;
+    input.frame = 0;
+    input.type = type;
+    input.id = id;
+    input.axis = axis;
+    input.value = value;
+
+    lock_guard<mutex> lock(pending_mutex);
+    pending.push_back(input);
+}
+
+void InputMovie::apply_input(Gamepad& pad, const MovieInput& input)
+{
+    switch (input.type)
+    {
+        case MOVIE_INPUT::PRESS:
+            pad.press_button((PAD_BUTTON)input.id);
+            break;
+        case MOVIE_INPUT::RELEASE:
+            pad.release_button((PAD_BUTTON)input.id);
+            break;
+        case MOVIE_INPUT::JOYSTICK:
+            pad.update_joystick((JOYSTICK)input.id, (JOYSTICK_AXIS)input.axis, input.value);
+            break;
+    }
+}
+
+void InputMovie::begin_frame(Gamepad& pad)
+{
+    if (mode == MOVIE_MODE::RECORDING)
+    {
+        lock_guard<mutex> lock(pending_mutex);
+        for (MovieInput& input : pending)
+        {
+            input.frame = frame;
+            inputs.push_back(input);
+            apply_input(pad, input);
+        }
+        pending.clear();
+    }
+    else if (mode == MOVIE_MODE::PLAYBACK)
+    {
+        while (next_input < inputs.size() && inputs[next_input].frame <= frame)
+        {
+            apply_input(pad, inputs[next_input]);
+            next_input++;
+        }
+    }
+}
+
+void InputMovie::end_frame(const StateHash& hash)
+{
+    if (mode == MOVIE_MODE::RECORDING)
+    {
+        hashes.push_back(hash);
+        frame++;
+        return;
+    }
+
+    if (mode != MOVIE_MODE::PLAYBACK)
+        return;
+
+    const StateHash& expected = hashes[frame];
+    bool RDRAM_match = hash.RDRAM == expected.RDRAM;
+    bool GS_match = hash.GS == expected.GS;
+    bool CPU_match = hash.CPU == expected.CPU;
+    if (!RDRAM_match || !GS_match || !CPU_match)
+    {
+        if (divergent_frame < 0)
+        {
+            divergent_frame = frame;
+            printf("[MOVIE] Diverged from the recording on frame %u:%s%s%s\n", frame, RDRAM_match ? "" : " RDRAM",
+                   GS_match ? "" : " GS", CPU_match ? "" : " CPU");
+        }
+        divergent_count++;
+    }
+
+    frame++;
+    if (frame >= hashes.size())
+    {
+        if (divergent_frame < 0)
+            printf("[MOVIE] Playback finished, all %u frames matched\n", frame);
+        else
+        {
+            printf("[MOVIE] Playback finished, %u of %u frames differed, starting on frame %" PRId64 "\n",
+                   divergent_count, frame, divergent_frame);
+        }
+        mode = MOVIE_MODE::NONE;
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef MOVIE_HPP
+#define MOVIE_HPP
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "iop/gamepad.hpp"
+
+enum class MOVIE_INPUT : uint8_t
+{
+    PRESS,
+    RELEASE,
+    JOYSTICK
+};
+
+struct MovieInput
+{
+    uint32_t frame;
+    MOVIE_INPUT type;
+    uint8_t id; //PAD_BUTTON, or JOYSTICK for joystick updates
+    uint8_t axis;
+    uint8_t value;
+};
+
+//Taken at the end of every frame of a movie
+struct StateHash
+{
+    uint64_t RDRAM;
+    uint64_t GS; //Local memory
+    uint64_t CPU; //EE and IOP registers
+};
+
+enum class MOVIE_MODE
+{
+    NONE,
+    RECORDING,
+    PLAYBACK
+};
+
+/**
+Pad input for each frame of a run, and a hash of the emulated state at the end of each frame.
+Input is only ever applied at the start of a frame, both while recording and on playback: anything the frontend
+sends while a frame is running is queued until the next one. Played back in deterministic mode, a movie reproduces
+the run it was recorded from exactly, so the first frame whose hash doesn't match is where the two runs diverged.
+**/
+class InputMovie
+{
+    private:
+        std::atomic<MOVIE_MODE> mode; //Read by the frontend thread
+        std::string file_name;
+
+        std::vector<MovieInput> inputs;
+        std::vector<StateHash> hashes;
+        size_t next_input;
+        uint32_t frame;
+
+        //Input from the frontend thread, waiting for the next frame to start
+        std::mutex pending_mutex;
+        std::vector<MovieInput> pending;
+
+        int64_t divergent_frame;
+        uint32_t divergent_count;
+
+        void apply_input(Gamepad& pad, const MovieInput& input);
+    public:
+        InputMovie();
+
+        static uint64_t hash_memory(const void* data, size_t size);
+
+        void start_recording(const char* file_name);
+        bool start_playback(const char* file_name);
+        bool stop();
+
+        MOVIE_MODE get_mode() const;
+        bool is_active() const;
+        uint32_t get_frame() const;
+        uint32_t get_frame_count() const;
+        int64_t get_divergent_frame() const;
+        uint32_t get_divergent_count() const;
+
+        void queue_input(MOVIE_INPUT type, uint8_t id, uint8_t axis, uint8_t value);
+        void begin_frame(Gamepad& pad);
+        void end_frame(const StateHash& hash);
+};
+
+inline MOVIE_MODE InputMovie::get_mode() const
+{
+    return mode;
+}
+
+inline bool InputMovie::is_active() const
+{
+    return mode != MOVIE_MODE::NONE;
+}
+
+#endif // MOVIE_HPP
@@ -0,0 +1,192 @@
+#include <cstdio>
+#include <cstring>
+#include "profiler.hpp"
+
+//One minute at 60 FPS
+#define DEFAULT_MAX_FRAMES 3600
+
+using namespace std;
+
+static const char* zone_names[PROFILE_ZONE_COUNT] =
+{
+    "EE",
+    "DMAC",
+    "Timers",
+    "IPU",
+    "VIF0",
+    "VIF1",
+    "GIF",
+    "VU0",
+    "VU1",
+    "VU1 sync",
+    "IOP timers",
+    "IOP DMA",
+    "IOP",
+    "SPU",
+    "Events",
+    "GS thread"
+};
+
+Profiler::Profiler() : overhead_ticks(0), max_frames(DEFAULT_MAX_FRAMES)
+{
+    reset();
+}
+
+void Profiler::reset()
+{
+    memset(zones, 0, sizeof(zones));
+    nested_ticks = 0;
+    timing = false;
+    slices_until_sample = 0;
+    frame_start_ticks = 0;
+    has_epoch = false;
+    history.clear();
+    frame_count = 0;
+}
+
+void Profiler::set_max_frames(size_t max_frames)
+{
+    this->max_frames = max_frames;
+    while (history.size() > max_frames)
+        history.pop_front();
+}
+
+void Profiler::begin_frame()
+{
+    if (!is_enabled())
+        return;
+
+    //Anything left over is from a frame that was cut short by an error
+    memset(zones, 0, sizeof(zones));
+    nested_ticks = 0;
+
+    if (!has_epoch)
+    {
+        calibrate();
+        epoch = chrono::steady_clock::now();
+        has_epoch = true;
+    }
+    frame_start = chrono::steady_clock::now();
+    frame_start_ticks = ticks();
+}
+
+void Profiler::calibrate()
+{
+    const int samples = 1000;
+    uint64_t total = 0;
+    for (int i = 0; i < samples; i++)
+    {
+        uint64_t start = ticks();
+        total += ticks() - start;
+    }
+    overhead_ticks = total / samples;
+}
+
+/**
+ * Converts the frame's counters to microseconds and adds it to the history.
+ * The TSC rate is measured against the wall clock over the frame itself.
+ */
+void Profiler::end_frame(uint64_t gs_thread_ticks, uint64_t gs_thread_messages)
+{
+    if (!is_enabled() || !has_epoch)
+        return;
+
+    uint64_t frame_ticks = ticks() - frame_start_ticks;
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    zones[PROFILE_GS_THREAD].ticks = gs_thread_ticks;
+    zones[PROFILE_GS_THREAD].calls = gs_thread_messages;
+
+    ProfileFrame frame;
+    frame.number = frame_count++;
+    frame.start_us = chrono::duration<double, micro>(frame_start - epoch).count();
+    frame.wall_us = chrono::duration<double, micro>(now - frame_start).count();
+
+    double us_per_tick = frame_ticks ? frame.wall_us / frame_ticks : 0.0;
+    for (int i = 0; i < PROFILE_ZONE_COUNT; i++)
+    {
+        double zone_ticks = (double)zones[i].ticks;
+        if (zones[i].timed_calls)
+        {
+            uint64_t overhead = zones[i].timed_calls * overhead_ticks;
+            zone_ticks = (zones[i].ticks > overhead) ? zones[i].ticks - overhead : 0;
+            zone_ticks *= (double)zones[i].calls / zones[i].timed_calls;
+        }
+        frame.zones[i].time_us = zone_ticks * us_per_tick;
+        frame.zones[i].calls = zones[i].calls;
+        frame.zones[i].guest_cycles = zones[i].guest_cycles;
+    }
+
+    history.push_back(frame);
+    while (history.size() > max_frames)
+        history.pop_front();
+}
+
+const deque<ProfileFrame>& Profiler::get_frames() const
+{
+    return history;
+}
+
+//One row per zone per frame, with a "Frame" row holding the frame's wall time
+bool Profiler::write_csv(const char* file_name) const
+{
+    FILE* csv = fopen(file_name, "w");
+    if (!csv)
+        return false;
+
+    fprintf(csv, "frame,zone,time_us,calls,guest_cycles\n");
+    for (const ProfileFrame& frame : history)
+    {
+        fprintf(csv, "%llu,Frame,%.3f,1,0\n", (unsigned long long)frame.number, frame.wall_us);
+        for (int i = 0; i < PROFILE_ZONE_COUNT; i++)
+        {
+            const ProfileZoneStats& zone = frame.zones[i];
+            fprintf(csv, "%llu,%s,%.3f,%llu,%llu\n", (unsigned long long)frame.number, zone_names[i], zone.time_us,
+                    (unsigned long long)zone.calls, (unsigned long long)zone.guest_cycles);
+        }
+    }
+
+    bool ok = !ferror(csv);
+    fclose(csv);
+    return ok;
+}
+
+/**
+ * Writes the history in the Trace Event format read by chrome://tracing and Perfetto.
+ * Each frame is a span, and the time each zone took during it is a counter sampled at the start of the frame.
+ */
+bool Profiler::write_chrome_trace(const char* file_name) const
+{
+    FILE* trace = fopen(file_name, "w");
+    if (!trace)
+        return false;
+
+    fprintf(trace, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(trace, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"Emulator\"}}");
+    for (const ProfileFrame& frame : history)
+    {
+        unsigned long long number = frame.number;
+        fprintf(trace, ",\n{\"name\":\"Frame %llu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                number, frame.start_us, frame.wall_us);
+
+        fprintf(trace, ",\n{\"name\":\"Zone time (us)\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{", frame.start_us);
+        for (int i = 0; i < PROFILE_ZONE_COUNT; i++)
+            fprintf(trace, "%s\"%s\":%.3f", i ? "," : "", zone_names[i], frame.zones[i].time_us);
+        fprintf(trace, "}}");
+
+        fprintf(trace, ",\n{\"name\":\"Zone calls\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{", frame.start_us);
+        for (int i = 0; i < PROFILE_ZONE_COUNT; i++)
+            fprintf(trace, "%s\"%s\":%llu", i ? "," : "", zone_names[i], (unsigned long long)frame.zones[i].calls);
+        fprintf(trace, "}}");
+    }
+    fprintf(trace, "\n]}\n");
+
+    bool ok = !ferror(trace);
+    fclose(trace);
+    return ok;
+}
+
+const char* Profiler::get_zone_name(PROFILE_ZONE zone)
+{
+    return zone_names[zone];
+}
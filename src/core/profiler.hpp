@@ -0,0 +1,206 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+#include <chrono>
+#include <cstdint>
+#include <deque>
+
+#define PROFILE_SAMPLE_INTERVAL 16
+
+#ifdef PROFILER_ENABLED
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+enum PROFILE_ZONE
+{
+    PROFILE_EE,
+    PROFILE_DMAC,
+    PROFILE_TIMERS,
+    PROFILE_IPU,
+    PROFILE_VIF0,
+    PROFILE_VIF1,
+    PROFILE_GIF,
+    PROFILE_VU0,
+    PROFILE_VU1,
+    PROFILE_VU1_SYNC, //Waiting on the VU1 thread
+    PROFILE_IOP_TIMERS,
+    PROFILE_IOP_DMA,
+    PROFILE_IOP,
+    PROFILE_SPU,
+    PROFILE_EVENTS, //Scheduler events, minus the zones they run
+    PROFILE_GS_THREAD, //Busy time on the GS thread, which overlaps everything else
+    PROFILE_ZONE_COUNT
+};
+
+struct ProfileZoneStats
+{
+    double time_us;
+    uint64_t calls;
+    //Cycles handed to the zone, counted in the clock it runs on (EE, bus, or IOP)
+    uint64_t guest_cycles;
+};
+
+struct ProfileFrame
+{
+    uint64_t number;
+    double start_us, wall_us;
+    ProfileZoneStats zones[PROFILE_ZONE_COUNT];
+};
+
+/**
+Per-frame time, call, and guest cycle totals for each subsystem Emulator::run drives.
+The timers read the TSC and only exist when built with PROFILER_ENABLED; otherwise every hook is empty and no frames are recorded.
+Zone times are exclusive, so a zone that runs inside another (SPU samples inside scheduler events) isn't counted twice.
+The main loop runs tens of thousands of short slices a frame, too many to time all of them without the timers
+drowning out the work. Calls and guest cycles are counted for every slice, but only one slice in PROFILE_SAMPLE_INTERVAL
+is timed, and each zone's time is scaled up by how many of its calls went untimed.
+**/
+class Profiler
+{
+    private:
+        struct ZoneCounters
+        {
+            uint64_t ticks, calls, timed_calls, guest_cycles;
+        };
+
+        ZoneCounters zones[PROFILE_ZONE_COUNT];
+        //Ticks spent in zones nested inside the one currently running
+        uint64_t nested_ticks;
+
+        bool timing;
+        int slices_until_sample;
+        //What an empty zone reads as, taken back out of every timed call
+        uint64_t overhead_ticks;
+        void calibrate();
+
+        uint64_t frame_start_ticks;
+        std::chrono::steady_clock::time_point epoch, frame_start;
+        bool has_epoch;
+
+        std::deque<ProfileFrame> history;
+        size_t max_frames;
+        uint64_t frame_count;
+    public:
+        Profiler();
+
+        static constexpr bool is_enabled()
+        {
+#ifdef PROFILER_ENABLED
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        static uint64_t ticks()
+        {
+#ifdef PROFILER_ENABLED
+            return __rdtsc();
+#else
+            return 0;
+#endif
+        }
+
+        void reset();
+        void set_max_frames(size_t max_frames);
+
+        void begin_frame();
+        void begin_slice();
+        void end_frame(uint64_t gs_thread_ticks, uint64_t gs_thread_messages);
+
+        //Used by ProfileScope
+        bool is_timing() const;
+        uint64_t enter_zone();
+        void exit_zone(PROFILE_ZONE zone, uint64_t start, uint64_t saved_nested, uint64_t guest_cycles);
+        void count_zone(PROFILE_ZONE zone, uint64_t guest_cycles);
+        uint64_t get_nested_ticks() const;
+
+        const std::deque<ProfileFrame>& get_frames() const;
+        bool write_csv(const char* file_name) const;
+        bool write_chrome_trace(const char* file_name) const;
+
+        static const char* get_zone_name(PROFILE_ZONE zone);
+};
+
+inline uint64_t Profiler::get_nested_ticks() const
+{
+    return nested_ticks;
+}
+
+inline bool Profiler::is_timing() const
+{
+    return timing;
+}
+
+//Decides whether the zones run until the next call are timed or only counted
+inline void Profiler::begin_slice()
+{
+    if (!is_enabled())
+        return;
+    timing = --slices_until_sample <= 0;
+    if (timing)
+        slices_until_sample = PROFILE_SAMPLE_INTERVAL;
+}
+
+inline uint64_t Profiler::enter_zone()
+{
+    nested_ticks = 0;
+    return ticks();
+}
+
+inline void Profiler::exit_zone(PROFILE_ZONE zone, uint64_t start, uint64_t saved_nested, uint64_t guest_cycles)
+{
+    uint64_t elapsed = ticks() - start;
+    ZoneCounters& counters = zones[zone];
+    counters.ticks += elapsed - nested_ticks;
+    counters.calls++;
+    counters.timed_calls++;
+    counters.guest_cycles += guest_cycles;
+    nested_ticks = saved_nested + elapsed;
+}
+
+inline void Profiler::count_zone(PROFILE_ZONE zone, uint64_t guest_cycles)
+{
+    zones[zone].calls++;
+    zones[zone].guest_cycles += guest_cycles;
+}
+
+#ifdef PROFILER_ENABLED
+class ProfileScope
+{
+    private:
+        Profiler& profiler;
+        PROFILE_ZONE zone;
+        uint64_t guest_cycles, saved_nested, start;
+        bool timed;
+    public:
+        ProfileScope(Profiler& profiler, PROFILE_ZONE zone, uint64_t guest_cycles)
+            : profiler(profiler), zone(zone), guest_cycles(guest_cycles), timed(profiler.is_timing())
+        {
+            if (timed)
+            {
+                saved_nested = profiler.get_nested_ticks();
+                start = profiler.enter_zone();
+            }
+        }
+
+        ~ProfileScope()
+        {
+            if (timed)
+                profiler.exit_zone(zone, start, saved_nested, guest_cycles);
+            else
+                profiler.count_zone(zone, guest_cycles);
+        }
+};
+
+//Runs the code that follows as one call of zone
+#define PROFILE(profiler, zone, guest_cycles, ...) \
+    { ProfileScope profile_scope(profiler, zone, guest_cycles); __VA_ARGS__; }
+#else
+#define PROFILE(profiler, zone, guest_cycles, ...) { __VA_ARGS__; }
+#endif
+
+#endif // PROFILER_HPP
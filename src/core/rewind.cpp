@@ -0,0 +1,278 @@
+#include <algorithm>
+#include <cstring>
+#include "rewind.hpp"
+
+//Sections are compared a page at a time, and only the pages that changed go through the XOR encoder
+#define PAGE_SIZE (4 * 1024)
+#define PAGE_WORDS (PAGE_SIZE / 8)
+
+static_assert(PAGE_SIZE == 1 << DirtyPageMap::PAGE_SHIFT, "Rewind pages must match dirty pages");
+
+#define END_OF_SECTION 0xFFFFFFFF
+
+//Older states are dropped early if the deltas outgrow this, e.g. while a game streams in a new area
+#define MAX_DELTA_BYTES (256 * 1024 * 1024)
+
+using namespace std;
+
+template <typename T>
+static void append(vector<uint8_t>& dest, const T& value)
+{
+    const uint8_t* bytes = (const uint8_t*)&value;
+    dest.insert(dest.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+static T take(const uint8_t*& src)
+{
+    T value;
+    memcpy(&value, src, sizeof(T));
+    src += sizeof(T);
+    return value;
+}
+
+//Copies a page out of a buffer that may end partway through it, padding the rest with zeroes
+static void load_page(uint8_t* dest, const uint8_t* src, size_t start, size_t size)
+{
+    size_t len = 0;
+    if (start < size)
+        len = min((size_t)PAGE_SIZE, size - start);
+    memcpy(dest, src + start, len);
+    memset(dest + len, 0, PAGE_SIZE - len);
+}
+
+/**
+ * A page delta is a series of (zero word count, literal word count) pairs, each followed by its literal words.
+ * Most of a changed page is usually still the same, which XORs to runs of zero words that cost nothing to store.
+ */
+static void encode_page(const uint8_t* old_page, const uint8_t* new_page, vector<uint8_t>& delta)
+{
+    uint64_t diff[PAGE_WORDS];
+    for (int i = 0; i < PAGE_WORDS; i++)
+    {
+        uint64_t old_word, new_word;
+        memcpy(&old_word, old_page + i * 8, 8);
+        memcpy(&new_word, new_page + i * 8, 8);
+        diff[i] = old_word ^ new_word;
+    }
+
+    int i = 0;
+    while (i < PAGE_WORDS)
+    {
+        int zero_start = i;
+        while (i < PAGE_WORDS && !diff[i])
+            i++;
+        int literal_start = i;
+        while (i < PAGE_WORDS && diff[i])
+            i++;
+
+        append(delta, (uint16_t)(literal_start - zero_start));
+        append(delta, (uint16_t)(i - literal_start));
+        delta.insert(delta.end(), (const uint8_t*)&diff[literal_start], (const uint8_t*)&diff[i]);
+    }
+}
+
+//XORs a page delta into dest, which holds len bytes of the page
+static void apply_page(const uint8_t*& src, uint8_t* dest, size_t len)
+{
+    size_t offset = 0;
+    int words = 0;
+    while (words < PAGE_WORDS)
+    {
+        uint16_t zeroes = take<uint16_t>(src);
+        uint16_t literals = take<uint16_t>(src);
+        words += zeroes + literals;
+        offset += zeroes * 8;
+
+        for (int i = 0; i < literals; i++, offset += 8, src += 8)
+        {
+            if (offset + 8 <= len)
+            {
+                uint64_t word, diff;
+                memcpy(&word, dest + offset, 8);
+                memcpy(&diff, src, 8);
+                word ^= diff;
+                memcpy(dest + offset, &word, 8);
+            }
+            else
+            {
+                for (size_t j = offset; j < len; j++)
+                    dest[j] ^= src[j - offset];
+            }
+        }
+    }
+}
+
+RewindBuffer::RewindBuffer() : has_newest(false), newest_restored(false), delta_bytes(0), max_snapshots(60)
+{
+
+}
+
+void RewindBuffer::set_max_snapshots(size_t max_snapshots)
+{
+    this->max_snapshots = max(max_snapshots, (size_t)1);
+    trim();
+}
+
+void RewindBuffer::clear()
+{
+    deltas.clear();
+    delta_bytes = 0;
+    has_newest = false;
+    newest_restored = false;
+}
+
+//Streamed sections are written to the returned snapshot, then passed to capture along with the RAM sections
+StateSnapshot& RewindBuffer::begin_capture()
+{
+    for (int i = 0; i < STATE_SECTION_COUNT; i++)
+        capture_buffer.sections[i].clear();
+    return capture_buffer;
+}
+
+void RewindBuffer::capture(const StateRegion* regions)
+{
+    if (!has_newest)
+    {
+        for (int i = 0; i < STATE_SECTION_COUNT; i++)
+            newest.sections[i].assign(regions[i].data, regions[i].size);
+        has_newest = true;
+        newest_restored = false;
+        return;
+    }
+
+    vector<uint8_t> delta;
+    delta.swap(spare_delta);
+    delta.clear();
+    for (int i = 0; i < STATE_SECTION_COUNT; i++)
+        encode_section(newest.sections[i], regions[i], delta);
+
+    delta_bytes += delta.size();
+    deltas.push_back(move(delta));
+    newest_restored = false;
+    trim();
+}
+
+/**
+ * Appends what it takes to get from region back to section, then updates section to match region.
+ * The shorter of the two is treated as padded with zeroes, so sections can change size between captures.
+ */
+void RewindBuffer::encode_section(StateBuffer& section, const StateRegion& region, vector<uint8_t>& delta)
+{
+    size_t old_size = section.size();
+    size_t new_size = region.size;
+    size_t max_size = max(old_size, new_size);
+    append(delta, (uint64_t)old_size);
+
+    section.resize(max_size);
+    uint8_t* old_data = section.data();
+    if (max_size > old_size)
+        memset(old_data + old_size, 0, max_size - old_size);
+
+    alignas(8) uint8_t old_tail[PAGE_SIZE];
+    alignas(8) uint8_t new_tail[PAGE_SIZE];
+    uint32_t page_count = (max_size + PAGE_SIZE - 1) / PAGE_SIZE;
+    for (uint32_t page = 0; page < page_count; page++)
+    {
+        size_t start = (size_t)page * PAGE_SIZE;
+        const uint8_t* old_page = old_data + start;
+        const uint8_t* new_page = region.data + start;
+        if (region.dirty && old_size == new_size && !region.dirty->is_dirty(page))
+            continue;
+        if (start + PAGE_SIZE > new_size)
+        {
+            load_page(old_tail, old_data, start, max_size);
+            load_page(new_tail, region.data, start, new_size);
+            old_page = old_tail;
+            new_page = new_tail;
+        }
+
+        if (!memcmp(old_page, new_page, PAGE_SIZE))
+            continue;
+
+        append(delta, page);
+        encode_page(old_page, new_page, delta);
+        memcpy(old_data + start, new_page, min((size_t)PAGE_SIZE, max_size - start));
+    }
+
+    append(delta, (uint32_t)END_OF_SECTION);
+    section.resize(new_size);
+}
+
+//Turns newest back into the state captured before it
+void RewindBuffer::apply_delta(const vector<uint8_t>& delta)
+{
+    const uint8_t* src = delta.data();
+    for (int i = 0; i < STATE_SECTION_COUNT; i++)
+    {
+        StateBuffer& section = newest.sections[i];
+        size_t old_size = take<uint64_t>(src);
+        size_t cur_size = section.size();
+        size_t max_size = max(old_size, cur_size);
+
+        section.resize(max_size);
+        if (max_size > cur_size)
+            memset(section.data() + cur_size, 0, max_size - cur_size);
+
+        while (true)
+        {
+            uint32_t page = take<uint32_t>(src);
+            if (page == END_OF_SECTION)
+                break;
+            size_t start = (size_t)page * PAGE_SIZE;
+            apply_page(src, section.data() + start, min((size_t)PAGE_SIZE, max_size - start));
+        }
+        section.resize(old_size);
+    }
+}
+
+//Drops the oldest states until the buffer is within its limits
+void RewindBuffer::trim()
+{
+    while (!deltas.empty() && (deltas.size() + 1 > max_snapshots || delta_bytes > MAX_DELTA_BYTES))
+    {
+        delta_bytes -= deltas.front().size();
+        spare_delta.swap(deltas.front());
+        deltas.pop_front();
+    }
+}
+
+/**
+ * Returns the newest state that hasn't been returned yet, or nullptr once the oldest one has been.
+ * The snapshot stays valid until the next call to capture, step_back, or clear.
+ */
+StateSnapshot* RewindBuffer::step_back()
+{
+    if (!has_newest)
+        return nullptr;
+
+    if (newest_restored)
+    {
+        if (deltas.empty())
+            return nullptr;
+        apply_delta(deltas.back());
+        delta_bytes -= deltas.back().size();
+        spare_delta.swap(deltas.back());
+        deltas.pop_back();
+    }
+    newest_restored = true;
+    return &newest;
+}
+
+size_t RewindBuffer::get_count() const
+{
+    if (!has_newest)
+        return 0;
+    return deltas.size() + (newest_restored ? 0 : 1);
+}
+
+size_t RewindBuffer::get_memory_usage() const
+{
+    size_t usage = delta_bytes;
+    if (has_newest)
+    {
+        for (int i = 0; i < STATE_SECTION_COUNT; i++)
+            usage += newest.sections[i].size();
+    }
+    return usage;
+}
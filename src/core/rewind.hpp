@@ -0,0 +1,60 @@
+#ifndef REWIND_HPP
+#define REWIND_HPP
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "dirtypages.hpp"
+#include "savestate.hpp"
+
+//Memory a section is captured from, either a streamed snapshot section or emulated memory itself
+struct StateRegion
+{
+    const uint8_t* data;
+    size_t size;
+
+    //If set, only these pages can have changed since the last capture
+    const DirtyPageMap* dirty;
+};
+
+/**
+Recent states kept in memory for rewinding.
+Only the newest state is kept whole. Every older one is stored as the XOR of it and the state captured after it,
+with runs of zero words (everything that didn't change) left out, so most snapshots cost a small fraction of the full state.
+Stepping back undoes one delta at a time.
+**/
+class RewindBuffer
+{
+    private:
+        StateSnapshot newest;
+        bool has_newest;
+        //newest has already been handed out by step_back, the next step has to undo a delta first
+        bool newest_restored;
+
+        //Streamed sections are captured into this before being compared against newest
+        StateSnapshot capture_buffer;
+
+        std::deque<std::vector<uint8_t>> deltas;
+        std::vector<uint8_t> spare_delta;
+        size_t delta_bytes;
+
+        size_t max_snapshots;
+
+        void encode_section(StateBuffer& section, const StateRegion& region, std::vector<uint8_t>& delta);
+        void apply_delta(const std::vector<uint8_t>& delta);
+        void trim();
+    public:
+        RewindBuffer();
+
+        void set_max_snapshots(size_t max_snapshots);
+        void clear();
+
+        StateSnapshot& begin_capture();
+        void capture(const StateRegion* regions);
+        StateSnapshot* step_back();
+
+        size_t get_count() const;
+        size_t get_memory_usage() const;
+};
+
+#endif // REWIND_HPP
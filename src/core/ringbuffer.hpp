@@ -0,0 +1,117 @@
+#ifndef RINGBUFFER_HPP
+#define RINGBUFFER_HPP
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include "errors.hpp"
+
+/**
+Fixed-capacity FIFO used for the hardware FIFOs (VIF, GIF, SIF, IPU).
+Unlike CircularFifo this is not thread-safe - every device FIFO is only touched from the EE thread,
+so there's no need to pay for atomics. The head and tail counters run freely and are masked on access,
+which is why the capacity has to be a power of two.
+**/
+template <typename T, size_t Size>
+class RingBuffer
+{
+    static_assert(Size && !(Size & (Size - 1)), "RingBuffer size must be a power of two");
+    private:
+        T data[Size];
+        uint32_t head, tail;
+    public:
+        RingBuffer() : head(0), tail(0) {}
+
+        constexpr static size_t capacity() { return Size; }
+        size_t size() const { return tail - head; }
+        size_t free_space() const { return Size - size(); }
+        bool empty() const { return head == tail; }
+        bool full() const { return size() == Size; }
+
+        void clear() { head = tail = 0; }
+
+        void push(const T& item);
+        void pop();
+        T& front() { return data[head & (Size - 1)]; }
+        const T& front() const { return data[head & (Size - 1)]; }
+
+        //Element at the given offset from the front, without popping anything
+        const T& peek(size_t offset) const { return data[(head + offset) & (Size - 1)]; }
+
+        size_t push_bulk(const T* items, size_t count);
+        size_t pop_bulk(T* items, size_t count);
+
+        void load_state(std::istream& state);
+        void save_state(std::ostream& state) const;
+};
+
+template <typename T, size_t Size>
+inline void RingBuffer<T, Size>::push(const T& item)
+{
+    if (full())
+        Errors::die("RingBuffer full!");
+    data[tail & (Size - 1)] = item;
+    tail++;
+}
+
+template <typename T, size_t Size>
+inline void RingBuffer<T, Size>::pop()
+{
+    head++;
+}
+
+//Pushes as many items as will fit and returns how many that was
+template <typename T, size_t Size>
+inline size_t RingBuffer<T, Size>::push_bulk(const T* items, size_t count)
+{
+    count = std::min(count, free_space());
+    size_t start = tail & (Size - 1);
+    size_t first = std::min(count, Size - start);
+    std::copy(items, items + first, data + start);
+    std::copy(items + first, items + count, data);
+    tail += count;
+    return count;
+}
+
+//Pops up to count items into the buffer and returns how many that was
+template <typename T, size_t Size>
+inline size_t RingBuffer<T, Size>::pop_bulk(T* items, size_t count)
+{
+    count = std::min(count, size());
+    size_t start = head & (Size - 1);
+    size_t first = std::min(count, Size - start);
+    std::copy(data + start, data + start + first, items);
+    std::copy(data, data + (count - first), items + first);
+    head += count;
+    return count;
+}
+
+//Stored as an int count followed by the items from front to back, the same layout the old std::queue FIFOs used
+template <typename T, size_t Size>
+inline void RingBuffer<T, Size>::load_state(std::istream& state)
+{
+    int count;
+    T buffer[Size];
+    state.read((char*)&count, sizeof(count));
+    clear();
+    if (count < 0)
+        return;
+
+    //Keep the rest of the state in step even if this FIFO has shrunk since it was saved, by dropping the newest items
+    size_t stored = count;
+    size_t kept = std::min(stored, Size);
+    state.read((char*)buffer, sizeof(T) * kept);
+    state.ignore(sizeof(T) * (stored - kept));
+    push_bulk(buffer, kept);
+}
+
+template <typename T, size_t Size>
+inline void RingBuffer<T, Size>::save_state(std::ostream& state) const
+{
+    int count = size();
+    state.write((char*)&count, sizeof(count));
+    for (int i = 0; i < count; i++)
+        state.write((char*)&peek(i), sizeof(T));
+}
+
+#endif // RINGBUFFER_HPP
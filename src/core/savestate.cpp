@@ -0,0 +1,483 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <libdeflate.h>
+#include "savestate.hpp"
+
+#define VER_MAJOR 0
+#define VER_MINOR 0
+#define VER_REV 29
+
+//Incremental states compare sections in pages of this size
+#define PAGE_SIZE (4 * 1024)
+
+//Sections are compressed in chunks of this size, so no single allocation has to cover a whole section
+#define CHUNK_SIZE (1024 * 1024)
+
+//Fast enough to keep up with a save every few seconds, while still shrinking RAM several times over
+#define COMPRESSION_LEVEL 4
+
+#define STATE_INCREMENTAL 0x1
+
+using namespace std;
+
+StateBuffer::StateBuffer()
+{
+    clear();
+}
+
+void StateBuffer::grow(size_t needed)
+{
+    size_t used = pptr() - pbase();
+    size_t capacity = max(max(used + needed, storage.size() * 2), (size_t)64 * 1024);
+    storage.resize(capacity);
+    setp(storage.data(), storage.data() + capacity);
+    pbump((int)used);
+}
+
+StateBuffer::int_type StateBuffer::overflow(int_type ch)
+{
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+        return traits_type::not_eof(ch);
+
+    grow(1);
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+    return ch;
+}
+
+streamsize StateBuffer::xsputn(const char* s, streamsize count)
+{
+    if (epptr() - pptr() < count)
+        grow(count);
+    memcpy(pptr(), s, count);
+    pbump((int)count);
+    return count;
+}
+
+void StateBuffer::clear()
+{
+    setg(nullptr, nullptr, nullptr);
+    setp(storage.data(), storage.data() + storage.size());
+}
+
+void StateBuffer::assign(const uint8_t* src, size_t size)
+{
+    resize(size);
+    memcpy(storage.data(), src, size);
+}
+
+//Sizes the buffer for reading without filling it in, for callers that write to data() directly
+void StateBuffer::resize(size_t size)
+{
+    if (storage.size() < size)
+        storage.resize(size);
+    setp(nullptr, nullptr);
+    setg(storage.data(), storage.data(), storage.data() + size);
+}
+
+//Starts reading back what was written
+void StateBuffer::rewind()
+{
+    size_t length = size();
+    setp(nullptr, nullptr);
+    setg(storage.data(), storage.data(), storage.data() + length);
+}
+
+size_t StateBuffer::size() const
+{
+    if (pbase())
+        return pptr() - pbase();
+    return egptr() - eback();
+}
+
+uint8_t* StateBuffer::data()
+{
+    return (uint8_t*)storage.data();
+}
+
+const uint8_t* StateBuffer::data() const
+{
+    return (const uint8_t*)storage.data();
+}
+
+static uint64_t generate_id()
+{
+    static mt19937_64 generator(random_device{}() ^ chrono::system_clock::now().time_since_epoch().count());
+    uint64_t id;
+    do
+    {
+        id = generator();
+    } while (!id);
+    return id;
+}
+
+template <typename T>
+static bool read_value(ifstream& file, T& value)
+{
+    file.read((char*)&value, sizeof(T));
+    return (bool)file;
+}
+
+template <typename T>
+static void write_value(ofstream& file, const T& value)
+{
+    file.write((const char*)&value, sizeof(T));
+}
+
+static bool read_chunks(ifstream& file, libdeflate_decompressor* decompressor, uint8_t* dest, uint64_t size)
+{
+    uint32_t chunk_count;
+    if (!read_value(file, chunk_count) || chunk_count != (size + CHUNK_SIZE - 1) / CHUNK_SIZE)
+        return false;
+
+    vector<uint8_t> compressed;
+    for (uint32_t i = 0; i < chunk_count; i++)
+    {
+        uint32_t raw_len, compressed_len;
+        if (!read_value(file, raw_len) || !read_value(file, compressed_len))
+            return false;
+        if (raw_len != min((uint64_t)CHUNK_SIZE, size - (uint64_t)i * CHUNK_SIZE) || compressed_len > raw_len)
+            return false;
+
+        //Chunks that didn't compress are stored as is
+        if (compressed_len == raw_len)
+        {
+            if (!file.read((char*)dest, raw_len))
+                return false;
+        }
+        else
+        {
+            compressed.resize(compressed_len);
+            if (!file.read((char*)compressed.data(), compressed_len))
+                return false;
+            if (libdeflate_deflate_decompress(decompressor, compressed.data(), compressed_len,
+                                              dest, raw_len, nullptr) != LIBDEFLATE_SUCCESS)
+                return false;
+        }
+        dest += raw_len;
+    }
+    return true;
+}
+
+static void write_chunks(ofstream& file, libdeflate_compressor* compressor, const uint8_t* src, uint64_t size,
+                         vector<uint8_t>& compressed)
+{
+    uint32_t chunk_count = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    write_value(file, chunk_count);
+
+    for (uint32_t i = 0; i < chunk_count; i++)
+    {
+        uint32_t raw_len = min((uint64_t)CHUNK_SIZE, size - (uint64_t)i * CHUNK_SIZE);
+        compressed.resize(libdeflate_deflate_compress_bound(compressor, raw_len));
+        uint32_t compressed_len = libdeflate_deflate_compress(compressor, src, raw_len,
+                                                              compressed.data(), compressed.size());
+
+        write_value(file, raw_len);
+        if (!compressed_len || compressed_len >= raw_len)
+        {
+            write_value(file, raw_len);
+            file.write((const char*)src, raw_len);
+        }
+        else
+        {
+            write_value(file, compressed_len);
+            file.write((const char*)compressed.data(), compressed_len);
+        }
+        src += raw_len;
+    }
+}
+
+static StateLoadResult load_file(const char* file_name, StateSnapshot& snapshot, uint64_t& id, bool& incremental,
+                                 bool is_base)
+{
+    ifstream file(file_name, ios::binary);
+    if (!file.is_open())
+        return StateLoadResult::OPEN_FAILED;
+
+    //Perform sanity checks
+    char dobie_buffer[5];
+    file.read(dobie_buffer, sizeof(dobie_buffer));
+    if (!file || strncmp(dobie_buffer, "DOBIE", 5))
+        return StateLoadResult::INVALID;
+
+    uint32_t major, minor, rev;
+    if (!read_value(file, major) || !read_value(file, minor) || !read_value(file, rev))
+        return StateLoadResult::INVALID;
+    if (major != VER_MAJOR || minor != VER_MINOR || rev != VER_REV)
+        return StateLoadResult::WRONG_VERSION;
+
+    uint32_t flags;
+    if (!read_value(file, flags) || !read_value(file, id))
+        return StateLoadResult::INVALID;
+    incremental = flags & STATE_INCREMENTAL;
+
+    if (incremental)
+    {
+        uint64_t base_id;
+        uint32_t path_len;
+        if (is_base || !read_value(file, base_id) || !read_value(file, path_len) || path_len > 4096)
+            return StateLoadResult::INVALID;
+        string base_path(path_len, '\0');
+        if (!file.read(&base_path[0], path_len))
+            return StateLoadResult::INVALID;
+
+        uint64_t loaded_id;
+        bool base_incremental;
+        StateLoadResult result = load_file(base_path.c_str(), snapshot, loaded_id, base_incremental, true);
+        if (result == StateLoadResult::OPEN_FAILED || (result == StateLoadResult::OK && loaded_id != base_id))
+            return StateLoadResult::MISSING_BASE;
+        if (result != StateLoadResult::OK)
+            return result;
+    }
+
+    uint32_t section_count;
+    if (!read_value(file, section_count) || section_count != STATE_SECTION_COUNT)
+        return StateLoadResult::INVALID;
+
+    libdeflate_decompressor* decompressor = libdeflate_alloc_decompressor();
+    if (!decompressor)
+        return StateLoadResult::INVALID;
+
+    bool valid = true;
+    vector<uint8_t> bitmap, pages;
+    for (int i = 0; i < STATE_SECTION_COUNT && valid; i++)
+    {
+        StateBuffer& section = snapshot.sections[i];
+        uint64_t size, payload_size;
+        uint32_t page_count;
+        valid = read_value(file, size) && read_value(file, page_count) && size <= 0x40000000;
+        if (!valid)
+            break;
+
+        if (!page_count)
+        {
+            //Stored whole
+            valid = read_value(file, payload_size) && payload_size == size;
+            if (valid)
+            {
+                section.resize(size);
+                valid = read_chunks(file, decompressor, section.data(), size);
+            }
+            continue;
+        }
+
+        //Only the pages that changed since the base, which has already been loaded into the section
+        valid = incremental && section.size() == size && page_count == (size + PAGE_SIZE - 1) / PAGE_SIZE;
+        if (!valid)
+            break;
+        bitmap.resize((page_count + 7) / 8);
+        valid = file.read((char*)bitmap.data(), bitmap.size()) && read_value(file, payload_size);
+        if (!valid || payload_size > size)
+        {
+            valid = false;
+            break;
+        }
+        pages.resize(payload_size);
+        valid = read_chunks(file, decompressor, pages.data(), payload_size);
+
+        uint64_t offset = 0;
+        for (uint32_t page = 0; page < page_count && valid; page++)
+        {
+            if (!(bitmap[page / 8] & (1 << (page & 7))))
+                continue;
+            uint64_t start = (uint64_t)page * PAGE_SIZE;
+            uint64_t len = min((uint64_t)PAGE_SIZE, size - start);
+            valid = offset + len <= payload_size;
+            if (valid)
+                memcpy(section.data() + start, pages.data() + offset, len);
+            offset += len;
+        }
+        valid = valid && offset == payload_size;
+    }
+
+    libdeflate_free_decompressor(decompressor);
+    return valid ? StateLoadResult::OK : StateLoadResult::INVALID;
+}
+
+StateLoadResult SaveState::load(const char* file_name, StateSnapshot& snapshot, uint64_t& id, bool& incremental)
+{
+    return load_file(file_name, snapshot, id, incremental, false);
+}
+
+SaveStateWriter::SaveStateWriter() : pending(false), quit(false), incremental(false), base_id(0), has_base(false)
+{
+    current = new StateSnapshot;
+    base = new StateSnapshot;
+}
+
+SaveStateWriter::~SaveStateWriter()
+{
+    if (thread.joinable())
+    {
+        wait();
+        {
+            lock_guard<mutex> lock(state_mutex);
+            quit = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+    delete current;
+    delete base;
+}
+
+//Waits for the last save to be written, so the snapshot can be filled again
+StateSnapshot& SaveStateWriter::begin_snapshot()
+{
+    wait();
+    for (int i = 0; i < STATE_SECTION_COUNT; i++)
+        current->sections[i].clear();
+    return *current;
+}
+
+void SaveStateWriter::write(const string& file_name, bool incremental)
+{
+    if (!thread.joinable())
+        thread = std::thread(&SaveStateWriter::thread_loop, this);
+
+    {
+        lock_guard<mutex> lock(state_mutex);
+        path = file_name;
+        this->incremental = incremental;
+        pending = true;
+    }
+    wake.notify_one();
+}
+
+void SaveStateWriter::wait()
+{
+    unique_lock<mutex> lock(state_mutex);
+    idle.wait(lock, [this] { return !pending; });
+}
+
+//Makes a state that was just loaded the base for incremental saves
+void SaveStateWriter::set_base(StateSnapshot& snapshot, const string& file_name, uint64_t id)
+{
+    wait();
+    for (int i = 0; i < STATE_SECTION_COUNT; i++)
+        base->sections[i].assign(snapshot.sections[i].data(), snapshot.sections[i].size());
+    base_path = file_name;
+    base_id = id;
+    has_base = true;
+}
+
+void SaveStateWriter::thread_loop()
+{
+    libdeflate_compressor* compressor = libdeflate_alloc_compressor(COMPRESSION_LEVEL);
+
+    unique_lock<mutex> lock(state_mutex);
+    while (true)
+    {
+        wake.wait(lock, [this] { return quit || pending; });
+        if (quit)
+            break;
+
+        lock.unlock();
+        auto start = chrono::steady_clock::now();
+        bool success = compressor && write_file(compressor);
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+        if (success)
+            printf("[Emulator] Saved state to %s in %lld ms\n", path.c_str(), (long long)elapsed);
+        else
+            printf("[Emulator] Failed to write save state %s\n", path.c_str());
+        lock.lock();
+
+        pending = false;
+        idle.notify_all();
+    }
+
+    libdeflate_free_compressor(compressor);
+}
+
+bool SaveStateWriter::write_file(libdeflate_compressor* compressor)
+{
+    if (incremental && (!has_base || path == base_path))
+    {
+        printf("[Emulator] No full save state to compare against, saving a full state instead\n");
+        incremental = false;
+    }
+
+    ofstream file(path, ios::binary);
+    if (!file.is_open())
+        return false;
+
+    uint32_t major = VER_MAJOR;
+    uint32_t minor = VER_MINOR;
+    uint32_t rev = VER_REV;
+
+    //Sanity check and version
+    file << "DOBIE";
+    write_value(file, major);
+    write_value(file, minor);
+    write_value(file, rev);
+
+    uint32_t flags = incremental ? STATE_INCREMENTAL : 0;
+    uint64_t id = generate_id();
+    write_value(file, flags);
+    write_value(file, id);
+    if (incremental)
+    {
+        uint32_t path_len = base_path.size();
+        write_value(file, base_id);
+        write_value(file, path_len);
+        file.write(base_path.c_str(), path_len);
+    }
+
+    uint32_t section_count = STATE_SECTION_COUNT;
+    write_value(file, section_count);
+
+    vector<uint8_t> bitmap, pages, compressed;
+    for (int i = 0; i < STATE_SECTION_COUNT; i++)
+    {
+        const StateBuffer& section = current->sections[i];
+        const StateBuffer& base_section = base->sections[i];
+        uint64_t size = section.size();
+        write_value(file, size);
+
+        //Sections whose size changed since the base are stored whole
+        if (!incremental || base_section.size() != size || !size)
+        {
+            uint32_t page_count = 0;
+            write_value(file, page_count);
+            write_value(file, size);
+            write_chunks(file, compressor, section.data(), size, compressed);
+            continue;
+        }
+
+        uint32_t page_count = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+        bitmap.assign((page_count + 7) / 8, 0);
+        pages.clear();
+        for (uint32_t page = 0; page < page_count; page++)
+        {
+            uint64_t start = (uint64_t)page * PAGE_SIZE;
+            uint64_t len = min((uint64_t)PAGE_SIZE, size - start);
+            if (!memcmp(section.data() + start, base_section.data() + start, len))
+                continue;
+            bitmap[page / 8] |= 1 << (page & 7);
+            pages.insert(pages.end(), section.data() + start, section.data() + start + len);
+        }
+
+        uint64_t payload_size = pages.size();
+        write_value(file, page_count);
+        file.write((const char*)bitmap.data(), bitmap.size());
+        write_value(file, payload_size);
+        write_chunks(file, compressor, pages.data(), payload_size, compressed);
+    }
+
+    file.close();
+    if (file.fail())
+        return false;
+
+    //A full state becomes the base for the incremental states after it
+    if (!incremental)
+    {
+        swap(current, base);
+        base_path = path;
+        base_id = id;
+        has_base = true;
+    }
+    return true;
+}
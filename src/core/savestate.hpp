@@ -0,0 +1,103 @@
+#ifndef SAVESTATE_HPP
+#define SAVESTATE_HPP
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Growable in-memory buffer for the component save_state/load_state functions to stream to and from.
+//The storage is kept between uses, so taking the same snapshot again doesn't allocate.
+class StateBuffer : public std::streambuf
+{
+    private:
+        std::vector<char> storage;
+
+        void grow(size_t needed);
+    protected:
+        int_type overflow(int_type ch) override;
+        std::streamsize xsputn(const char* s, std::streamsize count) override;
+    public:
+        StateBuffer();
+
+        //Drops the contents and starts writing from the beginning again
+        void clear();
+        //Replaces the contents and starts reading from the beginning
+        void assign(const uint8_t* src, size_t size);
+        void resize(size_t size);
+        void rewind();
+
+        size_t size() const;
+        uint8_t* data();
+        const uint8_t* data() const;
+};
+
+enum STATE_SECTION
+{
+    STATE_SECTION_CORE, //Everything that isn't one of the large memories below
+    STATE_SECTION_GS, //Written by the GS thread while the core section is being serialized
+    STATE_SECTION_EE_RAM,
+    STATE_SECTION_IOP_RAM,
+    STATE_SECTION_SPU_RAM,
+    STATE_SECTION_COUNT
+};
+
+struct StateSnapshot
+{
+    StateBuffer sections[STATE_SECTION_COUNT];
+};
+
+enum class StateLoadResult
+{
+    OK,
+    OPEN_FAILED,
+    INVALID,
+    WRONG_VERSION,
+    MISSING_BASE
+};
+
+/**
+Save states are a version header followed by one record per section, each split into independently deflated chunks.
+An incremental state only stores the pages of each section that differ from a full state saved earlier (its base),
+along with the base's path and ID. Loading one loads the base first.
+**/
+namespace SaveState
+{
+    StateLoadResult load(const char* file_name, StateSnapshot& snapshot, uint64_t& id, bool& incremental);
+};
+
+//Compresses and writes snapshots on a background thread, so the emulator only pays for copying its state into memory
+class SaveStateWriter
+{
+    private:
+        std::thread thread;
+        std::mutex state_mutex;
+        std::condition_variable wake, idle;
+        bool pending, quit;
+
+        std::string path;
+        bool incremental;
+
+        //current is filled by the emulator, base holds the last full state for incremental saves to be compared against
+        StateSnapshot* current;
+        StateSnapshot* base;
+        std::string base_path;
+        uint64_t base_id;
+        bool has_base;
+
+        void thread_loop();
+        bool write_file(struct libdeflate_compressor* compressor);
+    public:
+        SaveStateWriter();
+        ~SaveStateWriter();
+
+        StateSnapshot& begin_snapshot();
+        void write(const std::string& file_name, bool incremental);
+        void wait();
+
+        void set_base(StateSnapshot& snapshot, const std::string& file_name, uint64_t id);
+};
+
+#endif // SAVESTATE_HPP
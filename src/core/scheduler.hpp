@@ -57,10 +57,11 @@ class Scheduler
         void add_event(SchedulerEvent& event);
 
         void update_cycle_counts();
+        bool events_pending();
         void process_events(Emulator* e);
 
-        void load_state(std::ifstream& state);
-        void save_state(std::ofstream& state);
+        void load_state(std::istream& state);
+        void save_state(std::ostream& state);
 };
 
 inline int64_t Scheduler::get_ee_cycles()
@@ -73,4 +74,9 @@ inline int64_t Scheduler::get_iop_cycles()
     return iop_cycles.count;
 }
 
+inline bool Scheduler::events_pending()
+{
+    return ee_cycles.count >= closest_event_time;
+}
+
 #endif // SCHEDULER_HPP
@@ -2,14 +2,16 @@
 #include <cstring>
 #include "emulator.hpp"
 
-#define VER_MAJOR 0
-#define VER_MINOR 0
-#define VER_REV 27
-
 using namespace std;
 
 bool Emulator::request_load_state(const char *file_name)
 {
+    //Movies start from power on
+    if (movie.is_active())
+    {
+        printf("[MOVIE] Can't load a state while a movie is active\n");
+        return false;
+    }
     ifstream state(file_name, ios::binary);
     if (!state.is_open())
         return false;
@@ -19,13 +21,20 @@ bool Emulator::request_load_state(const char *file_name)
     return true;
 }
 
-bool Emulator::request_save_state(const char *file_name)
+/**
+ * An incremental state only stores what changed since the last full state this session saved or loaded.
+ * It can't be loaded without that state, so it must not be overwritten or moved.
+ */
+bool Emulator::request_save_state(const char *file_name, bool incremental)
 {
+    //Don't truncate a file the writer thread may still be writing to
+    state_writer.wait();
     ofstream state(file_name, ios::binary);
     if (!state.is_open())
         return false;
     state.close();
     save_state_path = file_name;
+    save_incremental = incremental;
     save_requested = true;
     return true;
 }
@@ -34,45 +43,128 @@ void Emulator::load_state(const char *file_name)
 {
     load_requested = false;
     printf("[Emulator] Loading state...\n");
-    ifstream state(file_name, ios::binary);
-    if (!state.is_open())
+
+    //The state may be the one that's still being written
+    state_writer.wait();
+
+    StateSnapshot snapshot;
+    uint64_t id;
+    bool incremental;
+    switch (SaveState::load(file_name, snapshot, id, incremental))
     {
-        Errors::non_fatal("Failed to load save state");
-        return;
+        case StateLoadResult::OK:
+            break;
+        case StateLoadResult::OPEN_FAILED:
+            Errors::non_fatal("Failed to load save state");
+            return;
+        case StateLoadResult::WRONG_VERSION:
+            Errors::non_fatal("Save state doesn't match version");
+            return;
+        case StateLoadResult::MISSING_BASE:
+            Errors::non_fatal("Save state's base state is missing or has been overwritten");
+            return;
+        default:
+            Errors::non_fatal("Save state invalid");
+            return;
     }
 
-    //Perform sanity checks
-    char dobie_buffer[5];
-    state.read(dobie_buffer, sizeof(dobie_buffer));
-    if (strncmp(dobie_buffer, "DOBIE", 5))
+    if (snapshot.sections[STATE_SECTION_EE_RAM].size() != 1024 * 1024 * 32 ||
+        snapshot.sections[STATE_SECTION_IOP_RAM].size() != 1024 * 1024 * 2 ||
+        snapshot.sections[STATE_SECTION_SPU_RAM].size() != 1024 * 1024 * 2)
     {
-        state.close();
         Errors::non_fatal("Save state invalid");
         return;
     }
 
-    uint32_t major, minor, rev;
-    state.read((char*)&major, sizeof(major));
-    state.read((char*)&minor, sizeof(minor));
-    state.read((char*)&rev, sizeof(rev));
+    reset();
+    load_snapshot(snapshot);
+
+    if (!incremental)
+        state_writer.set_base(snapshot, file_name, id);
+    printf("[Emulator] Success!\n");
+}
 
-    if (major != VER_MAJOR || minor != VER_MINOR || rev != VER_REV)
-    {
-        state.close();
-        Errors::non_fatal("Save state doesn't match version");
-        return;
-    }
+/**
+ * Copies the state into memory and returns, the writer thread compresses it and writes it out.
+ * Only a save requested while the previous one is still being written has to wait.
+ */
+void Emulator::save_state(const char *file_name)
+{
+    save_requested = false;
+    printf("[Emulator] Saving state...\n");
 
+    save_snapshot(state_writer.begin_snapshot());
+    state_writer.write(file_name, save_incremental);
+}
+
+/**
+ * Keeps a state every interval frames for rewinding, up to max_snapshots of them.
+ * An interval of 0 turns rewinding off. Either way, the states kept so far are dropped.
+ */
+void Emulator::set_rewind(int interval, int max_snapshots)
+{
+    rewind_interval = interval;
+    rewind_frame_count = 0;
+    rewind_buffer.clear();
+    rewind_buffer.set_max_snapshots(max_snapshots);
+}
+
+/**
+ * RAM isn't copied into the snapshot, the rewind buffer compares it against the last state in place.
+ * Only the RDRAM pages written since the last capture are compared, the rest of RDRAM can't have changed.
+ */
+void Emulator::capture_rewind_state()
+{
+    rewind_frame_count = 0;
+
+    StateSnapshot& snapshot = rewind_buffer.begin_capture();
+    save_core_snapshot(snapshot);
+
+    StateRegion regions[STATE_SECTION_COUNT];
+    for (int i = 0; i < STATE_SECTION_COUNT; i++)
+        regions[i] = {snapshot.sections[i].data(), snapshot.sections[i].size()};
+    regions[STATE_SECTION_EE_RAM] = {RDRAM, 1024 * 1024 * 32, &RDRAM_pages};
+    regions[STATE_SECTION_IOP_RAM] = {IOP_RAM, 1024 * 1024 * 2};
+    regions[STATE_SECTION_SPU_RAM] = {SPU_RAM, 1024 * 1024 * 2};
+    rewind_buffer.capture(regions);
+    RDRAM_pages.clear();
+}
+
+//Each request goes back one state, so holding the rewind key keeps going further back
+void Emulator::rewind()
+{
+    rewind_requested = false;
+    rewind_frame_count = 0;
+
+    StateSnapshot* snapshot = rewind_buffer.step_back();
+    if (!snapshot)
+        return;
     reset();
+    load_snapshot(*snapshot);
+
+    //RDRAM is now the same as the newest state in the buffer again
+    RDRAM_pages.clear();
+}
+
+void Emulator::load_snapshot(StateSnapshot& snapshot)
+{
+    //RAM
+    memcpy(RDRAM, snapshot.sections[STATE_SECTION_EE_RAM].data(), 1024 * 1024 * 32);
+    RDRAM_pages.mark_all();
+    memcpy(IOP_RAM, snapshot.sections[STATE_SECTION_IOP_RAM].data(), 1024 * 1024 * 2);
+    memcpy(SPU_RAM, snapshot.sections[STATE_SECTION_SPU_RAM].data(), 1024 * 1024 * 2);
+
+    StateBuffer& core = snapshot.sections[STATE_SECTION_CORE];
+    core.rewind();
+    istream state(&core);
+    StateBuffer& gs_section = snapshot.sections[STATE_SECTION_GS];
+    gs_section.rewind();
+    istream gs_state(&gs_section);
 
     //Emulator info
     state.read((char*)&VBLANK_sent, sizeof(VBLANK_sent));
     state.read((char*)&frames, sizeof(frames));
 
-    //RAM
-    state.read((char*)RDRAM, 1024 * 1024 * 32);
-    state.read((char*)IOP_RAM, 1024 * 1024 * 2);
-    state.read((char*)SPU_RAM, 1024 * 1024 * 2);
     state.read((char*)scratchpad, 1024 * 16);
     state.read((char*)iop_scratchpad, 1024);
     state.read((char*)&iop_scratchpad_start, sizeof(iop_scratchpad_start));
@@ -111,46 +203,37 @@ void Emulator::load_state(const char *file_name)
 
     //GS
     //Important note - this serialization function is located in gs.cpp as it contains a lot of thread-specific details
-    gs.load_state(state);
+    gs.load_state(state, gs_state);
 
     scheduler.load_state(state);
     pad.load_state(state);
     spu.load_state(state);
     spu2.load_state(state);
-
-    state.close();
-    printf("[Emulator] Success!\n");
 }
 
-void Emulator::save_state(const char *file_name)
+void Emulator::save_snapshot(StateSnapshot& snapshot)
 {
-    save_requested = false;
-    printf("[Emulator] Saving state...\n");
-    ofstream state(file_name, ios::binary);
-    if (!state.is_open())
-    {
-        Errors::non_fatal("Failed to save state");
-        return;
-    }
+    //RAM
+    snapshot.sections[STATE_SECTION_EE_RAM].sputn((char*)RDRAM, 1024 * 1024 * 32);
+    snapshot.sections[STATE_SECTION_IOP_RAM].sputn((char*)IOP_RAM, 1024 * 1024 * 2);
+    snapshot.sections[STATE_SECTION_SPU_RAM].sputn((char*)SPU_RAM, 1024 * 1024 * 2);
 
-    uint32_t major = VER_MAJOR;
-    uint32_t minor = VER_MINOR;
-    uint32_t rev = VER_REV;
+    save_core_snapshot(snapshot);
+}
 
-    //Sanity check and version
-    state << "DOBIE";
-    state.write((char*)&major, sizeof(uint32_t));
-    state.write((char*)&minor, sizeof(uint32_t));
-    state.write((char*)&rev, sizeof(uint32_t));
+//Everything but the RAM sections, which the rewind buffer reads straight out of emulated memory
+void Emulator::save_core_snapshot(StateSnapshot& snapshot)
+{
+    ostream state(&snapshot.sections[STATE_SECTION_CORE]);
+    ostream gs_state(&snapshot.sections[STATE_SECTION_GS]);
+
+    //The GS thread copies out its state while the rest is being serialized
+    gs.begin_save_state(gs_state);
 
     //Emulator info
     state.write((char*)&VBLANK_sent, sizeof(VBLANK_sent));
     state.write((char*)&frames, sizeof(frames));
 
-    //RAM
-    state.write((char*)RDRAM, 1024 * 1024 * 32);
-    state.write((char*)IOP_RAM, 1024 * 1024 * 2);
-    state.write((char*)SPU_RAM, 1024 * 1024 * 2);
     state.write((char*)scratchpad, 1024 * 16);
     state.write((char*)iop_scratchpad, 1024);
     state.write((char*)&iop_scratchpad_start, sizeof(iop_scratchpad_start));
@@ -189,18 +272,15 @@ void Emulator::save_state(const char *file_name)
 
     //GS
     //Important note - this serialization function is located in gs.cpp as it contains a lot of thread-specific details
-    gs.save_state(state);
+    gs.end_save_state(state);
 
     scheduler.save_state(state);
     pad.save_state(state);
     spu.save_state(state);
     spu2.save_state(state);
-
-    state.close();
-    printf("Success!\n");
 }
 
-void EmotionEngine::load_state(ifstream &state)
+void EmotionEngine::load_state(istream &state)
 {
     state.read((char*)&cycle_count, sizeof(cycle_count));
     state.read((char*)&cycles_to_run, sizeof(cycles_to_run));
@@ -223,7 +303,7 @@ void EmotionEngine::load_state(ifstream &state)
     state.read((char*)&deci2handlers, sizeof(Deci2Handler) * deci2size);
 }
 
-void EmotionEngine::save_state(ofstream &state)
+void EmotionEngine::save_state(ostream &state)
 {
     state.write((char*)&cycle_count, sizeof(cycle_count));
     state.write((char*)&cycles_to_run, sizeof(cycles_to_run));
@@ -246,7 +326,7 @@ void EmotionEngine::save_state(ofstream &state)
     state.write((char*)&deci2handlers, sizeof(Deci2Handler) * deci2size);
 }
 
-void Cop0::load_state(ifstream &state)
+void Cop0::load_state(istream &state)
 {
     state.read((char*)&gpr, sizeof(uint32_t));
     state.read((char*)&status, sizeof(status));
@@ -263,7 +343,7 @@ void Cop0::load_state(ifstream &state)
         map_tlb(&tlb[i]);
 }
 
-void Cop0::save_state(ofstream &state)
+void Cop0::save_state(ostream &state)
 {
     state.write((char*)&gpr, sizeof(uint32_t));
     state.write((char*)&status, sizeof(status));
@@ -276,7 +356,7 @@ void Cop0::save_state(ofstream &state)
     state.write((char*)&tlb, sizeof(tlb));
 }
 
-void Cop1::load_state(ifstream &state)
+void Cop1::load_state(istream &state)
 {
     for (int i = 0; i < 32; i++)
         state.read((char*)&gpr[i].u, sizeof(uint32_t));
@@ -284,7 +364,7 @@ void Cop1::load_state(ifstream &state)
     state.read((char*)&control, sizeof(control));
 }
 
-void Cop1::save_state(ofstream &state)
+void Cop1::save_state(ostream &state)
 {
     for (int i = 0; i < 32; i++)
         state.write((char*)&gpr[i].u, sizeof(uint32_t));
@@ -292,7 +372,7 @@ void Cop1::save_state(ofstream &state)
     state.write((char*)&control, sizeof(control));
 }
 
-void IOP::load_state(ifstream &state)
+void IOP::load_state(istream &state)
 {
     state.read((char*)&gpr, sizeof(gpr));
     state.read((char*)&LO, sizeof(LO));
@@ -311,7 +391,7 @@ void IOP::load_state(ifstream &state)
     state.read((char*)&cop0.EPC, sizeof(cop0.EPC));
 }
 
-void IOP::save_state(ofstream &state)
+void IOP::save_state(ostream &state)
 {
     state.write((char*)&gpr, sizeof(gpr));
     state.write((char*)&LO, sizeof(LO));
@@ -330,7 +410,7 @@ void IOP::save_state(ofstream &state)
     state.write((char*)&cop0.EPC, sizeof(cop0.EPC));
 }
 
-void VectorUnit::load_state(ifstream &state)
+void VectorUnit::load_state(istream &state)
 {
     for (int i = 0; i < 32; i++)
         state.read((char*)&gpr[i].u, sizeof(uint32_t) * 4);
@@ -398,7 +478,7 @@ void VectorUnit::load_state(ifstream &state)
     state.read((char*)&ebit_delay_slot, sizeof(ebit_delay_slot));
 }
 
-void VectorUnit::save_state(ofstream &state)
+void VectorUnit::save_state(ostream &state)
 {
     for (int i = 0; i < 32; i++)
         state.write((char*)&gpr[i].u, sizeof(uint32_t) * 4);
@@ -465,7 +545,7 @@ void VectorUnit::save_state(ofstream &state)
     state.write((char*)&ebit_delay_slot, sizeof(ebit_delay_slot));
 }
 
-void INTC::load_state(ifstream &state)
+void INTC::load_state(istream &state)
 {
     state.read((char*)&INTC_MASK, sizeof(INTC_MASK));
     state.read((char*)&INTC_STAT, sizeof(INTC_STAT));
@@ -473,7 +553,7 @@ void INTC::load_state(ifstream &state)
     state.read((char*)&read_stat_count, sizeof(read_stat_count));
 }
 
-void INTC::save_state(ofstream &state)
+void INTC::save_state(ostream &state)
 {
     state.write((char*)&INTC_MASK, sizeof(INTC_MASK));
     state.write((char*)&INTC_STAT, sizeof(INTC_STAT));
@@ -481,35 +561,35 @@ void INTC::save_state(ofstream &state)
     state.write((char*)&read_stat_count, sizeof(read_stat_count));
 }
 
-void EmotionTiming::load_state(ifstream &state)
+void EmotionTiming::load_state(istream &state)
 {
     state.read((char*)&timers, sizeof(timers));
     state.read((char*)&cycle_count, sizeof(cycle_count));
     state.read((char*)&next_event, sizeof(next_event));
 }
 
-void EmotionTiming::save_state(ofstream &state)
+void EmotionTiming::save_state(ostream &state)
 {
     state.write((char*)&timers, sizeof(timers));
     state.write((char*)&cycle_count, sizeof(cycle_count));
     state.write((char*)&next_event, sizeof(next_event));
 }
 
-void IOPTiming::load_state(ifstream &state)
+void IOPTiming::load_state(istream &state)
 {
     state.read((char*)&timers, sizeof(timers));
     state.read((char*)&cycle_count, sizeof(cycle_count));
     state.read((char*)&next_event, sizeof(next_event));
 }
 
-void IOPTiming::save_state(ofstream &state)
+void IOPTiming::save_state(ostream &state)
 {
     state.write((char*)&timers, sizeof(timers));
     state.write((char*)&cycle_count, sizeof(cycle_count));
     state.write((char*)&next_event, sizeof(next_event));
 }
 
-void DMAC::load_state(ifstream &state)
+void DMAC::load_state(istream &state)
 {
     state.read((char*)&channels, sizeof(channels));
 
@@ -535,17 +615,15 @@ void DMAC::load_state(ifstream &state)
 
     int queued_size;
     state.read((char*)&queued_size, sizeof(queued_size));
-    if (queued_size > 0)
+    queued_count = 0;
+    for (int i = 0; i < queued_size; i++)
     {
-        for (int i = 0; i < queued_size; i++)
-        {
-            state.read((char*)&index, sizeof(index));
-            queued_channels.push_back(&channels[index]);
-        }
+        state.read((char*)&index, sizeof(index));
+        queue_channel(&channels[index]);
     }
 }
 
-void DMAC::save_state(ofstream &state)
+void DMAC::save_state(ostream &state)
 {
     state.write((char*)&channels, sizeof(channels));
 
@@ -567,22 +645,25 @@ void DMAC::save_state(ofstream &state)
         index = -1;
 
     state.write((char*)&index, sizeof(index));
-    int size = queued_channels.size();
-    state.write((char*)&size, sizeof(size));
-    if (size > 0)
+    state.write((char*)&queued_count, sizeof(queued_count));
+    for (int i = 0; i < queued_count; i++)
     {
-        for (auto it = queued_channels.begin(); it != queued_channels.end(); )
-        {
-            index = (*it)->index;
-            state.write((char*)&index, sizeof(index));
-        }
+        index = queued_channels[i]->index;
+        state.write((char*)&index, sizeof(index));
     }
 }
 
-void IOP_DMA::load_state(ifstream &state)
+void IOP_DMA::load_state(istream &state)
 {
     state.read((char*)&channels, sizeof(channels));
 
+    //Older states didn't initialize the SIF delays. A real one is never longer than a bulk transfer.
+    for (int i = IOP_SIF0; i <= IOP_SIF1; i++)
+    {
+        if (channels[i].delay < 0 || channels[i].delay > SubsystemInterface::MAX_BULK_QUADS * 4)
+            channels[i].delay = 0;
+    }
+
     int active_index;
     state.read((char*)&active_index, sizeof(active_index));
     if (active_index)
@@ -607,7 +688,7 @@ void IOP_DMA::load_state(ifstream &state)
     apply_dma_functions();
 }
 
-void IOP_DMA::save_state(ofstream &state)
+void IOP_DMA::save_state(ostream &state)
 {
     state.write((char*)&channels, sizeof(channels));
 
@@ -628,14 +709,9 @@ void IOP_DMA::save_state(ofstream &state)
     state.write((char*)&DICR, sizeof(DICR));
 }
 
-void GraphicsInterface::load_state(ifstream &state)
+void GraphicsInterface::load_state(istream &state)
 {
-    int size;
-    uint128_t FIFO_buffer[16];
-    state.read((char*)&size, sizeof(size));
-    state.read((char*)&FIFO_buffer, sizeof(uint128_t) * size);
-    for (int i = 0; i < size; i++)
-        FIFO.push(FIFO_buffer[i]);
+    FIFO.load_state(state);
 
     state.read((char*)&path, sizeof(path));
     state.read((char*)&active_path, sizeof(active_path));
@@ -643,21 +719,14 @@ void GraphicsInterface::load_state(ifstream &state)
     state.read((char*)&path3_vif_masked, sizeof(path3_vif_masked));
     state.read((char*)&internal_Q, sizeof(internal_Q));
     state.read((char*)&path3_dma_waiting, sizeof(path3_dma_waiting));
+
+    for (int i = 0; i < 4; i++)
+        compile_PACKED_regs(i);
 }
 
-void GraphicsInterface::save_state(ofstream &state)
+void GraphicsInterface::save_state(ostream &state)
 {
-    int size = FIFO.size();
-    uint128_t FIFO_buffer[16];
-    for (int i = 0; i < size; i++)
-    {
-        FIFO_buffer[i] = FIFO.front();
-        FIFO.pop();
-    }
-    state.write((char*)&size, sizeof(size));
-    state.write((char*)&FIFO_buffer, sizeof(uint128_t) * size);
-    for (int i = 0; i < size; i++)
-        FIFO.push(FIFO_buffer[i]);
+    FIFO.save_state(state);
 
     state.write((char*)&path, sizeof(path));
     state.write((char*)&active_path, sizeof(active_path));
@@ -667,7 +736,7 @@ void GraphicsInterface::save_state(ofstream &state)
     state.write((char*)&path3_dma_waiting, sizeof(path3_dma_waiting));
 }
 
-void SubsystemInterface::load_state(ifstream &state)
+void SubsystemInterface::load_state(istream &state)
 {
     state.read((char*)&mscom, sizeof(mscom));
     state.read((char*)&smcom, sizeof(smcom));
@@ -675,23 +744,11 @@ void SubsystemInterface::load_state(ifstream &state)
     state.read((char*)&smflag, sizeof(smflag));
     state.read((char*)&control, sizeof(control));
 
-    int size;
-    uint32_t buffer[32];
-    state.read((char*)&size, sizeof(int));
-    state.read((char*)&buffer, sizeof(uint32_t) * size);
-
-    //FIFOs are already cleared by the reset call, so no need to pop them
-    for (int i = 0; i < size; i++)
-        SIF0_FIFO.push(buffer[i]);
-
-    state.read((char*)&size, sizeof(int));
-    state.read((char*)&buffer, sizeof(uint32_t) * size);
-
-    for (int i = 0; i < size; i++)
-        SIF1_FIFO.push(buffer[i]);
+    SIF0_FIFO.load_state(state);
+    SIF1_FIFO.load_state(state);
 }
 
-void SubsystemInterface::save_state(ofstream &state)
+void SubsystemInterface::save_state(ostream &state)
 {
     state.write((char*)&mscom, sizeof(mscom));
     state.write((char*)&smcom, sizeof(smcom));
@@ -699,38 +756,13 @@ void SubsystemInterface::save_state(ofstream &state)
     state.write((char*)&smflag, sizeof(smflag));
     state.write((char*)&control, sizeof(control));
 
-    int size = SIF0_FIFO.size();
-    uint32_t buffer[32];
-    for (int i = 0; i < size; i++)
-    {
-        buffer[i] = SIF0_FIFO.front();
-        SIF0_FIFO.pop();
-    }
-    state.write((char*)&size, sizeof(int));
-    state.write((char*)&buffer, sizeof(uint32_t) * size);
-    for (int i = 0; i < size; i++)
-        SIF0_FIFO.push(buffer[i]);
-
-    size = SIF1_FIFO.size();
-    for (int i = 0; i < size; i++)
-    {
-        buffer[i] = SIF1_FIFO.front();
-        SIF1_FIFO.pop();
-    }
-    state.write((char*)&size, sizeof(int));
-    state.write((char*)&buffer, sizeof(uint32_t) * size);
-    for (int i = 0; i < size; i++)
-        SIF1_FIFO.push(buffer[i]);
+    SIF0_FIFO.save_state(state);
+    SIF1_FIFO.save_state(state);
 }
 
-void VectorInterface::load_state(ifstream &state)
+void VectorInterface::load_state(istream &state)
 {
-    int size;
-    uint32_t FIFO_buffer[64];
-    state.read((char*)&size, sizeof(size));
-    state.read((char*)&FIFO_buffer, sizeof(uint32_t) * size);
-    for (int i = 0; i < size; i++)
-        FIFO.push(FIFO_buffer[i]);
+    FIFO.load_state(state);
 
     state.read((char*)&imm, sizeof(imm));
     state.read((char*)&command, sizeof(command));
@@ -765,21 +797,13 @@ void VectorInterface::load_state(ifstream &state)
 
     state.read((char*)&mark_detected, sizeof(mark_detected));
     state.read((char*)&VIF_ERR, sizeof(VIF_ERR));
+
+    select_UNPACK_kernel();
 }
 
-void VectorInterface::save_state(ofstream &state)
+void VectorInterface::save_state(ostream &state)
 {
-    int size = FIFO.size();
-    uint32_t FIFO_buffer[64];
-    for (int i = 0; i < size; i++)
-    {
-        FIFO_buffer[i] = FIFO.front();
-        FIFO.pop();
-    }
-    state.write((char*)&size, sizeof(size));
-    state.write((char*)&FIFO_buffer, sizeof(uint32_t) * size);
-    for (int i = 0; i < size; i++)
-        FIFO.push(FIFO_buffer[i]);
+    FIFO.save_state(state);
 
     state.write((char*)&imm, sizeof(imm));
     state.write((char*)&command, sizeof(command));
@@ -816,7 +840,7 @@ void VectorInterface::save_state(ofstream &state)
     state.write((char*)&VIF_ERR, sizeof(VIF_ERR));
 }
 
-void CDVD_Drive::load_state(ifstream &state)
+void CDVD_Drive::load_state(istream &state)
 {
     state.read((char*)&file_size, sizeof(file_size));
     state.read((char*)&read_bytes_left, sizeof(read_bytes_left));
@@ -845,7 +869,7 @@ void CDVD_Drive::load_state(ifstream &state)
     state.read((char*)&rtc, sizeof(rtc));
 }
 
-void CDVD_Drive::save_state(ofstream &state)
+void CDVD_Drive::save_state(ostream &state)
 {
     state.write((char*)&file_size, sizeof(file_size));
     state.write((char*)&read_bytes_left, sizeof(read_bytes_left));
@@ -874,7 +898,7 @@ void CDVD_Drive::save_state(ofstream &state)
     state.write((char*)&rtc, sizeof(rtc));
 }
 
-void Scheduler::load_state(ifstream &state)
+void Scheduler::load_state(istream &state)
 {
     state.read((char*)&ee_cycles, sizeof(ee_cycles));
     state.read((char*)&bus_cycles, sizeof(bus_cycles));
@@ -885,6 +909,8 @@ void Scheduler::load_state(ifstream &state)
     int event_size = 0;
     state.read((char*)&event_size, sizeof(event_size));
 
+    //reset() registers the periodic events again, the state has its own copies of them
+    events.clear();
     for (int i = 0; i < event_size; i++)
     {
         SchedulerEvent event;
@@ -910,7 +936,7 @@ void Scheduler::load_state(ifstream &state)
     }
 }
 
-void Scheduler::save_state(ofstream &state)
+void Scheduler::save_state(ostream &state)
 {
     state.write((char*)&ee_cycles, sizeof(ee_cycles));
     state.write((char*)&bus_cycles, sizeof(bus_cycles));
@@ -929,7 +955,7 @@ void Scheduler::save_state(ofstream &state)
     }
 }
 
-void Gamepad::load_state(ifstream &state)
+void Gamepad::load_state(istream &state)
 {
     state.read((char*)&command_buffer, sizeof(command_buffer));
     state.read((char*)&rumble_values, sizeof(rumble_values));
@@ -941,7 +967,7 @@ void Gamepad::load_state(ifstream &state)
     state.read((char*)&config_mode, sizeof(config_mode));
 }
 
-void Gamepad::save_state(ofstream &state)
+void Gamepad::save_state(ostream &state)
 {
     state.write((char*)&command_buffer, sizeof(command_buffer));
     state.write((char*)&rumble_values, sizeof(rumble_values));
@@ -953,7 +979,7 @@ void Gamepad::save_state(ofstream &state)
     state.write((char*)&config_mode, sizeof(config_mode));
 }
 
-void SPU::load_state(ifstream &state)
+void SPU::load_state(istream &state)
 {
     state.read((char*)&voices, sizeof(voices));
     state.read((char*)&core_att, sizeof(core_att));
@@ -970,7 +996,7 @@ void SPU::load_state(ifstream &state)
     state.read((char*)&key_on, sizeof(key_on));
 }
 
-void SPU::save_state(ofstream &state)
+void SPU::save_state(ostream &state)
 {
     state.write((char*)&voices, sizeof(voices));
     state.write((char*)&core_att, sizeof(core_att));
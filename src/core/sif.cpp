@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <cstring>
 #include "sif.hpp"
 
 #include "iop/iop_dma.hpp"
@@ -11,9 +12,8 @@ SubsystemInterface::SubsystemInterface(IOP_DMA* iop_dma, DMAC* dmac) : iop_dma(i
 
 void SubsystemInterface::reset()
 {
-    std::queue<uint32_t> empty, empty2;
-    SIF0_FIFO.swap(empty);
-    SIF1_FIFO.swap(empty2);
+    SIF0_FIFO.clear();
+    SIF1_FIFO.clear();
     mscom = 0;
     smcom = 0;
     msflag = 0;
@@ -33,8 +33,7 @@ void SubsystemInterface::write_SIF0(uint32_t word)
 void SubsystemInterface::write_SIF1(uint128_t quad)
 {
     //printf("[SIF] Write SIF1: $%08X_%08X_%08X_%08X\n", quad._u32[3], quad._u32[2], quad._u32[1], quad._u32[0]);
-    for (int i = 0; i < 4; i++)
-        SIF1_FIFO.push(quad._u32[i]);
+    SIF1_FIFO.push_bulk(quad._u32, 4);
     iop_dma->set_DMA_request(IOP_SIF1);
     if (SIF1_FIFO.size() >= MAX_FIFO_SIZE / 2)
         dmac->clear_DMA_request(EE_SIF1);
@@ -62,6 +61,36 @@ uint32_t SubsystemInterface::read_SIF1()
     return value;
 }
 
+/**
+Bulk transfers move data straight from one side's memory to the other's, skipping the FIFO.
+They're only allowed while the FIFO is empty, so nothing can overtake data already queued in it.
+Tags and anything the other side isn't ready for still go through the FIFO a word at a time.
+Each function returns how many quads were moved.
+**/
+int SubsystemInterface::write_SIF0_bulk(const uint8_t* data, int quads)
+{
+    if (!SIF0_FIFO.empty())
+        return 0;
+    return dmac->write_SIF0_direct(data, quads);
+}
+
+int SubsystemInterface::write_SIF1_bulk(const uint128_t* quads, int count)
+{
+    if (!SIF1_FIFO.empty())
+        return 0;
+    return iop_dma->write_SIF1_direct(quads, count);
+}
+
+//Unlike read_SIF1, this leaves the IOP's request alone, as the channel stays busy while it pays for the words
+void SubsystemInterface::read_SIF1_bulk(uint8_t* data, int words)
+{
+    uint32_t buffer[64];
+    SIF1_FIFO.pop_bulk(buffer, words);
+    memcpy(data, buffer, words * 4);
+    if (SIF1_FIFO.size() < MAX_FIFO_SIZE / 2)
+        dmac->set_DMA_request(EE_SIF1);
+}
+
 uint32_t SubsystemInterface::get_mscom()
 {
     return mscom;
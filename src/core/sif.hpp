@@ -2,9 +2,9 @@
 #define SIF_HPP
 #include <cstdint>
 #include <fstream>
-#include <queue>
 
 #include "int128.hpp"
+#include "ringbuffer.hpp"
 
 class IOP_DMA;
 class DMAC;
@@ -20,10 +20,15 @@ class SubsystemInterface
         uint32_t smflag;
         uint32_t control; //???
 
-        std::queue<uint32_t> SIF0_FIFO;
-        std::queue<uint32_t> SIF1_FIFO;
+        //DMA requests are throttled at MAX_FIFO_SIZE, but an EE burst of up to 8 quads can overshoot that,
+        //so the buffers themselves are twice as large
+        RingBuffer<uint32_t, 64> SIF0_FIFO;
+        RingBuffer<uint32_t, 64> SIF1_FIFO;
     public:
         constexpr static int MAX_FIFO_SIZE = 32;
+
+        //Largest block moved in one go when a transfer bypasses the FIFO
+        constexpr static int MAX_BULK_QUADS = 256;
         SubsystemInterface(IOP_DMA* iop_dma, DMAC* dmac);
 
         void reset();
@@ -35,6 +40,10 @@ class SubsystemInterface
         uint32_t read_SIF0();
         uint32_t read_SIF1();
 
+        int write_SIF0_bulk(const uint8_t* data, int quads);
+        int write_SIF1_bulk(const uint128_t* quads, int count);
+        void read_SIF1_bulk(uint8_t* data, int words);
+
         uint32_t get_mscom();
         uint32_t get_smcom();
         uint32_t get_msflag();
@@ -50,8 +59,8 @@ class SubsystemInterface
         void set_control_EE(uint32_t value);
         void set_control_IOP(uint32_t value);
 
-        void load_state(std::ifstream& state);
-        void save_state(std::ofstream& state);
+        void load_state(std::istream& state);
+        void save_state(std::ostream& state);
 };
 
 inline int SubsystemInterface::get_SIF0_size()
@@ -0,0 +1,190 @@
+#include "../../emulator.hpp"
+#include "../../ee/vu_jit.hpp"
+#include <iomanip>
+
+using namespace std;
+
+//Runs the same VU1 microprogram through the interpreter and every JIT backend the host supports,
+//and checks that all of them leave VU1 in the same state.
+
+#define DEST_XYZW (0xFu << 21)
+
+#define UPPER_NOP 0x000002FF
+#define LOWER_NOP 0x8000033C
+#define E_BIT (1u << 30)
+
+#define LQ(ft, is, imm) ((0x00u << 25) | DEST_XYZW | ((ft) << 16) | ((is) << 11) | ((imm) & 0x7FF))
+#define SQ(fs, it, imm) ((0x01u << 25) | DEST_XYZW | ((it) << 16) | ((fs) << 11) | ((imm) & 0x7FF))
+#define IADDIU(it, is, imm) ((0x08u << 25) | ((it) << 16) | ((is) << 11) | ((imm) & 0x7FF))
+#define ISUBIU(it, is, imm) ((0x09u << 25) | ((it) << 16) | ((is) << 11) | ((imm) & 0x7FF))
+#define IBNE(it, is, offset) ((0x29u << 25) | ((it) << 16) | ((is) << 11) | ((offset) & 0x7FF))
+#define FCGET(it) ((0x1Cu << 25) | ((it) << 16))
+#define FMAND(it, is) ((0x1Au << 25) | ((it) << 16) | ((is) << 11))
+
+#define UPPER(op, fd, fs, ft) (DEST_XYZW | ((ft) << 16) | ((fs) << 11) | ((fd) << 6) | (op))
+#define UPPER_SPECIAL(op, fs, ft) (DEST_XYZW | ((ft) << 16) | ((fs) << 11) | (op))
+#define ADDbc(fd, fs, ft, bc) UPPER(0x00 + (bc), fd, fs, ft)
+#define SUBbc(fd, fs, ft, bc) UPPER(0x04 + (bc), fd, fs, ft)
+#define MADDbc(fd, fs, ft, bc) UPPER(0x08 + (bc), fd, fs, ft)
+#define MSUBbc(fd, fs, ft, bc) UPPER(0x0C + (bc), fd, fs, ft)
+#define MAXbc(fd, fs, ft, bc) UPPER(0x10 + (bc), fd, fs, ft)
+#define MINIbc(fd, fs, ft, bc) UPPER(0x14 + (bc), fd, fs, ft)
+#define MULbc(fd, fs, ft, bc) UPPER(0x18 + (bc), fd, fs, ft)
+#define ADD(fd, fs, ft) UPPER(0x28, fd, fs, ft)
+#define MUL(fd, fs, ft) UPPER(0x2A, fd, fs, ft)
+#define MAX(fd, fs, ft) UPPER(0x2B, fd, fs, ft)
+#define SUB(fd, fs, ft) UPPER(0x2C, fd, fs, ft)
+#define MINI(fd, fs, ft) UPPER(0x2F, fd, fs, ft)
+#define MADDAbc(fs, ft, bc) UPPER_SPECIAL(0x0BC + (bc), fs, ft)
+#define MULAbc(fs, ft, bc) UPPER_SPECIAL(0x1BC + (bc), fs, ft)
+#define ABS(ft, fs) UPPER_SPECIAL(0x1FD, fs, ft)
+#define CLIPw(fs, ft) ((0x7u << 21) | UPPER_SPECIAL(0x1FF, fs, ft))
+
+//A vertex transform loop that touches the arithmetic the JIT emits natively
+const static uint32_t TEST_PROGRAM[][2] =
+{
+    {LQ(1, 1, 0), UPPER_NOP},
+    {IADDIU(1, 1, 1), MULAbc(20, 1, 0)},
+    {LOWER_NOP, MADDAbc(21, 1, 1)},
+    {LOWER_NOP, MADDAbc(22, 1, 2)},
+    {LOWER_NOP, MADDbc(3, 23, 1, 3)},
+    {LOWER_NOP, CLIPw(3, 3)},
+    {FCGET(5), ADD(4, 3, 30)},
+    {FMAND(6, 7), MULbc(5, 4, 4, 1)},
+    {LOWER_NOP, SUB(7, 5, 3)},
+    {LOWER_NOP, SUBbc(8, 7, 4, 2)},
+    {LOWER_NOP, MSUBbc(9, 8, 5, 0)},
+    {LOWER_NOP, MAX(10, 9, 3)},
+    {LOWER_NOP, MINIbc(11, 10, 4, 3)},
+    {LOWER_NOP, ABS(12, 11)},
+    {LOWER_NOP, MAXbc(13, 12, 7, 1)},
+    {LOWER_NOP, MINI(14, 13, 8)},
+    {LOWER_NOP, MUL(15, 14, 9)},
+    {LOWER_NOP, ADDbc(16, 15, 10, 2)},
+    {SQ(3, 2, 0), UPPER_NOP},
+    {SQ(5, 2, 1), UPPER_NOP},
+    {SQ(16, 2, 2), UPPER_NOP},
+    {IADDIU(2, 2, 3), UPPER_NOP},
+    {ISUBIU(3, 3, 1), UPPER_NOP},
+    {SQ(6, 4, 0), UPPER_NOP},
+    {IBNE(3, 0, -25), UPPER_NOP},
+    {IADDIU(4, 4, 1), UPPER_NOP},
+    {LOWER_NOP, UPPER_NOP | E_BIT},
+    {LOWER_NOP, UPPER_NOP}
+};
+
+static void vu_jit_test_setup(VectorUnit& vu)
+{
+    vu.reset();
+
+    int instr_count = sizeof(TEST_PROGRAM) / sizeof(TEST_PROGRAM[0]);
+    for (int i = 0; i < instr_count; i++)
+    {
+        vu.write_instr<uint32_t>(i * 8, TEST_PROGRAM[i][0]);
+        vu.write_instr<uint32_t>(i * 8 + 4, TEST_PROGRAM[i][1]);
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+        float value = i * 0.5f - 7.0f;
+        vu.write_data<uint32_t>(i * 4, *(uint32_t*)&value);
+    }
+
+    for (int i = 1; i < 32; i++)
+    {
+        for (int j = 0; j < 4; j++)
+            vu.set_gpr_f(i, j, (i * 3 + j) * 0.25f - 4.0f);
+    }
+
+    vu.set_int(1, 0);
+    vu.set_int(2, 64);
+    vu.set_int(3, 24);
+    vu.set_int(4, 200);
+}
+
+static void vu_jit_test_run(VectorUnit& vu, bool jit)
+{
+    vu.start_program(0);
+
+    //The program is bounded, but don't hang the test if a backend loops forever
+    for (int i = 0; i < 100000 && vu.is_running(); i++)
+    {
+        if (jit)
+            vu.run_jit(8);
+        else
+            vu.run(8);
+    }
+}
+
+static void vu_jit_test_capture(VectorUnit& vu, vector<uint32_t>& state)
+{
+    state.clear();
+    for (int i = 0; i < 32; i++)
+    {
+        for (int j = 0; j < 4; j++)
+            state.push_back(vu.get_gpr_u(i, j));
+    }
+    for (int i = 0; i < 16; i++)
+        state.push_back(vu.get_int(i));
+    for (int i = 0; i < 0x4000; i += 4)
+        state.push_back(vu.read_data<uint32_t>(i));
+}
+
+bool Emulator::test_vu_jit()
+{
+    ofstream test_output("vu_jit_test_log.txt");
+    test_output << "-- TEST BEGIN\n";
+
+    bool old_avx = VU_JIT::get_avx();
+    vector<uint32_t> expected, result;
+
+    vu_jit_test_setup(vu1);
+    vu_jit_test_run(vu1, false);
+    vu_jit_test_capture(vu1, expected);
+    test_output << "interpreter: vi1 = " << dec << vu1.get_int(1) << ", vi2 = " << vu1.get_int(2) << "\n";
+
+    bool passed = true;
+    for (int backend = 0; backend < 2; backend++)
+    {
+        bool avx = backend == 1;
+        const char* name = avx ? "AVX" : "SSE4.1";
+
+        VU_JIT::set_avx(avx);
+        if (VU_JIT::get_avx() != avx)
+        {
+            test_output << name << ": skipped, not supported by the host CPU\n";
+            continue;
+        }
+        VU_JIT::reset();
+
+        vu_jit_test_setup(vu1);
+        vu_jit_test_run(vu1, true);
+        vu_jit_test_capture(vu1, result);
+
+        int mismatches = 0;
+        for (unsigned int i = 0; i < expected.size(); i++)
+        {
+            if (expected[i] == result[i])
+                continue;
+
+            if (mismatches < 16)
+            {
+                test_output << "  " << name << " word " << dec << i << ": expected $"
+                            << setw(8) << setfill('0') << hex << expected[i] << ", got $"
+                            << setw(8) << setfill('0') << hex << result[i] << "\n";
+            }
+            mismatches++;
+        }
+
+        test_output << name << ": " << (mismatches ? "FAIL" : "PASS") << "\n";
+        if (mismatches)
+            passed = false;
+    }
+
+    VU_JIT::set_avx(old_avx);
+    VU_JIT::reset();
+
+    test_output << "-- TEST END\n";
+    test_output.flush();
+    return passed;
+}
@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../core/emulator.hpp"
+#include "../core/errors.hpp"
+#include "../common/arg.h"
+
+#define BIOS_SIZE (1024 * 1024 * 4)
+#define DEFAULT_FRAMES 600
+
+using namespace std;
+
+typedef chrono::steady_clock frame_clock;
+
+struct FrameTimes
+{
+    //Time spent in Emulator::run, and waiting on the GS thread to finish the frame's output
+    double total_ms, core_ms, gs_ms;
+    uint64_t hash;
+};
+
+static double elapsed_ms(frame_clock::time_point start, frame_clock::time_point end)
+{
+    return chrono::duration<double, milli>(end - start).count();
+}
+
+static bool read_file(const char* name, vector<uint8_t>& data)
+{
+    ifstream file(name, ios::binary | ios::ate);
+    if (!file.is_open())
+        return false;
+
+    data.resize(file.tellg());
+    file.seekg(0);
+    file.read((char*)data.data(), data.size());
+    return !file.fail();
+}
+
+static string get_extension(const char* name)
+{
+    string ext(name);
+    size_t dot = ext.find_last_of('.');
+    if (dot == string::npos)
+        return "";
+    ext = ext.substr(dot + 1);
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+}
+
+//FNV-1a over the visible pixels, enough to tell whether two runs rendered the same frame
+static uint64_t hash_frame(const uint32_t* frame, int w, int h)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    const uint8_t* bytes = (const uint8_t*)frame;
+    size_t size = (size_t)w * h * sizeof(uint32_t);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static bool load_exec(Emulator& e, const char* file_name, bool skip_BIOS)
+{
+    string ext = get_extension(file_name);
+    if (ext == "elf")
+    {
+        vector<uint8_t> ELF;
+        if (!read_file(file_name, ELF))
+        {
+            printf("[HEADLESS] Couldn't open %s\n", file_name);
+            return false;
+        }
+        e.load_ELF(ELF.data(), ELF.size());
+        if (skip_BIOS)
+            e.set_skip_BIOS_hack(SKIP_HACK::LOAD_ELF);
+    }
+    else if (ext == "iso" || ext == "cso" || ext == "zso")
+    {
+        CDVD_CONTAINER type = (ext == "iso") ? CDVD_CONTAINER::ISO_MMAP : CDVD_CONTAINER::CISO;
+        if (!e.load_CDVD(file_name, type))
+        {
+            printf("[HEADLESS] Couldn't open %s\n", file_name);
+            return false;
+        }
+        if (skip_BIOS)
+            e.set_skip_BIOS_hack(SKIP_HACK::LOAD_DISC);
+    }
+    else
+    {
+        printf("[HEADLESS] Unrecognized file format %s\n", ext.c_str());
+        return false;
+    }
+    return true;
+}
+
+static void print_summary(const vector<FrameTimes>& frames)
+{
+    if (frames.empty())
+        return;
+
+    double total = 0.0, core = 0.0, gs = 0.0;
+    double fastest = frames[0].total_ms, slowest = frames[0].total_ms;
+    for (const FrameTimes& frame : frames)
+    {
+        total += frame.total_ms;
+        core += frame.core_ms;
+        gs += frame.gs_ms;
+        fastest = min(fastest, frame.total_ms);
+        slowest = max(slowest, frame.total_ms);
+    }
+
+    size_t count = frames.size();
+    printf("[HEADLESS] %zu frames in %.3f s, %.2f FPS\n", count, total / 1000.0, count * 1000.0 / total);
+    printf("[HEADLESS] Frame time: min %.3f ms, avg %.3f ms, max %.3f ms\n", fastest, total / count, slowest);
+    printf("[HEADLESS] Average core %.3f ms, GS output %.3f ms\n", core / count, gs / count);
+}
+
+//Average time per frame for each zone, slowest first
+static void print_profile(const Profiler& profiler)
+{
+    const deque<ProfileFrame>& frames = profiler.get_frames();
+    if (frames.empty())
+        return;
+
+    vector<pair<double, int>> totals;
+    for (int i = 0; i < PROFILE_ZONE_COUNT; i++)
+    {
+        double time = 0.0;
+        for (const ProfileFrame& frame : frames)
+            time += frame.zones[i].time_us;
+        totals.push_back(make_pair(time / frames.size(), i));
+    }
+    sort(totals.rbegin(), totals.rend());
+
+    printf("[HEADLESS] Average time per frame over the last %zu frames:\n", frames.size());
+    for (const pair<double, int>& total : totals)
+        printf("[HEADLESS]   %-12s %9.3f ms\n", Profiler::get_zone_name((PROFILE_ZONE)total.second), total.first / 1000.0);
+}
+
+static bool write_csv(const char* name, const vector<FrameTimes>& frames, bool hashes)
+{
+    FILE* csv = fopen(name, "w");
+    if (!csv)
+        return false;
+
+    fprintf(csv, hashes ? "frame,total_ms,core_ms,gs_ms,hash\n" : "frame,total_ms,core_ms,gs_ms\n");
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        const FrameTimes& frame = frames[i];
+        fprintf(csv, "%zu,%.4f,%.4f,%.4f", i, frame.total_ms, frame.core_ms, frame.gs_ms);
+        if (hashes)
+            fprintf(csv, ",%016" PRIx64, frame.hash);
+        fprintf(csv, "\n");
+    }
+    fclose(csv);
+    return true;
+}
+
+/**
+Boots a game without a window or frame limiter and runs it for a fixed number of frames as fast as possible,
+printing how long each one took. With -H, each frame's output is hashed so two runs can be compared.
+With -r or -m, the run is recorded to or checked against an input movie, frame by frame, see core/movie.hpp.
+**/
+int main(int argc, char** argv)
+{
+    char* argv0;
+    char* bios_name = nullptr, *file_name = nullptr, *csv_name = nullptr;
+    char* profile_name = nullptr, *trace_name = nullptr;
+    char* record_name = nullptr, *movie_name = nullptr;
+    bool skip_BIOS = false, print_hashes = false, vu1_interpreter = false, deterministic = false;
+    int frame_count = 0;
+
+    ARGBEGIN {
+        case 'b':
+            bios_name = ARGF();
+            break;
+        case 'f':
+            file_name = ARGF();
+            break;
+        case 'n':
+        {
+            char* frames = ARGF();
+            if (frames)
+                frame_count = atoi(frames);
+            break;
+        }
+        case 'o':
+            csv_name = ARGF();
+            break;
+        case 'p':
+            profile_name = ARGF();
+            break;
+        case 't':
+            trace_name = ARGF();
+            break;
+        case 'r':
+            record_name = ARGF();
+            break;
+        case 'm':
+            movie_name = ARGF();
+            break;
+        case 'd':
+            deterministic = true;
+            break;
+        case 's':
+            skip_BIOS = true;
+            break;
+        case 'H':
+            print_hashes = true;
+            break;
+        case 'i':
+            vu1_interpreter = true;
+            break;
+        case 'h':
+        default:
+            printf("usage: %s [options]\n\n", argv0);
+            printf("options:\n");
+            printf("-b {BIOS}\tspecify BIOS\n");
+            printf("-f {ELF/ISO}\tspecify ELF/ISO\n");
+            printf("-n {frames}\tnumber of frames to run (default %d, or the whole movie with -m)\n", DEFAULT_FRAMES);
+            printf("-o {CSV}\twrite per-frame timings to a CSV file\n");
+            if (Profiler::is_enabled())
+            {
+                printf("-p {CSV}\twrite the per-subsystem profile to a CSV file\n");
+                printf("-t {JSON}\twrite the per-subsystem profile as a Chrome trace\n");
+            }
+            printf("-r {movie}\trecord an input movie\n");
+            printf("-m {movie}\tplay back an input movie and check every frame against it\n");
+            printf("-d\t\tdeterministic mode, implied by -r and -m\n");
+            printf("-s\t\tskip BIOS\n");
+            printf("-H\t\thash each frame's output\n");
+            printf("-i\t\tuse the VU1 interpreter\n");
+            printf("-h\t\tshow this message\n");
+            return 1;
+    } ARGEND
+
+    if (record_name && movie_name)
+    {
+        printf("[HEADLESS] Can't record and play back a movie at the same time\n");
+        return 1;
+    }
+
+    if (!bios_name || !file_name || frame_count < 0)
+    {
+        printf("[HEADLESS] A BIOS, an ELF/ISO, and a positive frame count are required, see -h\n");
+        return 1;
+    }
+
+    if ((profile_name || trace_name) && !Profiler::is_enabled())
+    {
+        printf("[HEADLESS] Profiling needs a build with PROFILER_ENABLED\n");
+        return 1;
+    }
+
+    vector<uint8_t> BIOS;
+    if (!read_file(bios_name, BIOS) || BIOS.size() < BIOS_SIZE)
+    {
+        printf("[HEADLESS] Failed to load BIOS %s\n", bios_name);
+        return 1;
+    }
+
+    Emulator* e = new Emulator();
+    InputMovie& movie = e->get_movie();
+    if (movie_name)
+    {
+        if (!movie.start_playback(movie_name))
+            return 1;
+        if (!frame_count)
+            frame_count = movie.get_frame_count();
+    }
+    else if (record_name)
+        movie.start_recording(record_name);
+    if (!frame_count)
+        frame_count = DEFAULT_FRAMES;
+
+    //The RTC is set on reset, so this has to come first
+    e->set_deterministic(deterministic || record_name || movie_name);
+    e->reset();
+    e->load_BIOS(BIOS.data());
+    if (!load_exec(*e, file_name, skip_BIOS))
+        return 1;
+    e->set_vu1_mode(vu1_interpreter ? VU_MODE::INTERPRETER : VU_MODE::DONT_CARE);
+
+    e->get_profiler().set_max_frames(frame_count);
+
+    vector<FrameTimes> frames;
+    frames.reserve(frame_count);
+    int status = 0;
+    try
+    {
+        for (int i = 0; i < frame_count; i++)
+        {
+            FrameTimes times;
+            frame_clock::time_point start = frame_clock::now();
+            e->run();
+            frame_clock::time_point core_end = frame_clock::now();
+
+            //Waits for the GS thread, and has to be called every frame to collect its output anyway
+            uint32_t* frame = e->get_framebuffer();
+            frame_clock::time_point end = frame_clock::now();
+
+            times.core_ms = elapsed_ms(start, core_end);
+            times.gs_ms = elapsed_ms(core_end, end);
+            times.total_ms = elapsed_ms(start, end);
+            times.hash = 0;
+            if (print_hashes && frame)
+            {
+                int w, h;
+                e->get_inner_resolution(w, h);
+                times.hash = hash_frame(frame, w, h);
+                printf("[HEADLESS] Frame %d: %.3f ms (core %.3f ms, GS %.3f ms) hash %016" PRIx64 "\n",
+                       i, times.total_ms, times.core_ms, times.gs_ms, times.hash);
+            }
+            else
+            {
+                printf("[HEADLESS] Frame %d: %.3f ms (core %.3f ms, GS %.3f ms)\n",
+                       i, times.total_ms, times.core_ms, times.gs_ms);
+            }
+            frames.push_back(times);
+        }
+    }
+    catch (Emulation_error& error)
+    {
+        e->print_state();
+        printf("[HEADLESS] Fatal emulation error occurred on frame %zu\n%s\n", frames.size(), error.what());
+        status = 1;
+    }
+    catch (non_fatal_error& error)
+    {
+        printf("[HEADLESS] Emulation error occurred on frame %zu\n%s\n", frames.size(), error.what());
+        status = 1;
+    }
+
+    print_summary(frames);
+    print_profile(e->get_profiler());
+    if (movie_name)
+    {
+        if (movie.get_divergent_frame() >= 0)
+        {
+            printf("[HEADLESS] Diverged from %s on frame %" PRId64 "\n", movie_name, movie.get_divergent_frame());
+            status = 1;
+        }
+        else if (movie.get_frame() < movie.get_frame_count())
+            printf("[HEADLESS] Stopped on frame %u of %u in %s\n", movie.get_frame(), movie.get_frame_count(), movie_name);
+        else
+            printf("[HEADLESS] All %u frames matched %s\n", movie.get_frame_count(), movie_name);
+    }
+    if (!movie.stop())
+        status = 1;
+    if (csv_name && !write_csv(csv_name, frames, print_hashes))
+    {
+        printf("[HEADLESS] Failed to write %s\n", csv_name);
+        status = 1;
+    }
+    if (profile_name && !e->get_profiler().write_csv(profile_name))
+    {
+        printf("[HEADLESS] Failed to write %s\n", profile_name);
+        status = 1;
+    }
+    if (trace_name && !e->get_profiler().write_chrome_trace(trace_name))
+    {
+        printf("[HEADLESS] Failed to write %s\n", trace_name);
+        status = 1;
+    }
+
+    delete e;
+    return status;
+}
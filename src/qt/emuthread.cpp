@@ -4,6 +4,10 @@
 
 #include "emuthread.hpp"
 
+//A state every 10 frames, 20 seconds' worth at 60 FPS
+#define REWIND_INTERVAL 10
+#define REWIND_SNAPSHOTS 120
+
 using namespace std;
 
 EmuThread::EmuThread()
@@ -41,6 +45,41 @@ void EmuThread::set_vu1_mode(VU_MODE mode)
     load_mutex.unlock();
 }
 
+void EmuThread::set_vu1_thread(bool enabled)
+{
+    load_mutex.lock();
+    e.set_vu1_thread(enabled);
+    load_mutex.unlock();
+}
+
+void EmuThread::set_rewind(bool enabled)
+{
+    load_mutex.lock();
+    if (enabled)
+        e.set_rewind(REWIND_INTERVAL, REWIND_SNAPSHOTS);
+    else
+        e.set_rewind(0, 0);
+    load_mutex.unlock();
+}
+
+//Movies need deterministic mode from power on, so these have to be called before a game is loaded
+void EmuThread::record_movie(const char* name)
+{
+    load_mutex.lock();
+    e.set_deterministic(true);
+    e.get_movie().start_recording(name);
+    load_mutex.unlock();
+}
+
+bool EmuThread::play_movie(const char* name)
+{
+    load_mutex.lock();
+    e.set_deterministic(true);
+    bool success = e.get_movie().start_playback(name);
+    load_mutex.unlock();
+    return success;
+}
+
 void EmuThread::load_BIOS(const uint8_t *BIOS)
 {
     load_mutex.lock();
@@ -112,6 +151,13 @@ void EmuThread::gsdump_single_frame()
     load_mutex.unlock();
 }
 
+void EmuThread::rewind()
+{
+    load_mutex.lock();
+    e.request_rewind();
+    load_mutex.unlock();
+}
+
 GSMessage& EmuThread::get_next_gsdump_message()
 {
     if(!buffered_gs_messages) {
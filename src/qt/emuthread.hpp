@@ -48,6 +48,10 @@ class EmuThread : public QThread
 
         void set_skip_BIOS_hack(SKIP_HACK skip);
         void set_vu1_mode(VU_MODE mode);
+        void set_vu1_thread(bool enabled);
+        void set_rewind(bool enabled);
+        void record_movie(const char* name);
+        bool play_movie(const char* name);
         void load_BIOS(const uint8_t* BIOS);
         void load_ELF(const uint8_t* ELF, uint64_t ELF_size);
         void load_CDVD(const char* name, CDVD_CONTAINER type);
@@ -61,6 +65,7 @@ class EmuThread : public QThread
         bool gsdump_read(const char* name);
         void gsdump_write_toggle();
         void gsdump_single_frame();
+        void rewind();
         GSMessage& get_next_gsdump_message();
         bool gsdump_eof();
         bool frame_advance;
@@ -17,7 +17,7 @@
 #include "gamelistwidget.hpp"
 #include "bios.hpp"
 
-#include "arg.h"
+#include "../common/arg.h"
 
 using namespace std;
 
@@ -86,6 +86,7 @@ int EmuWindow::init(int argc, char** argv)
     char* argv0; // Program name; AKA argv[0]
 
     char* bios_name = nullptr, *file_name = nullptr, *gsdump = nullptr;
+    char* record_name = nullptr, *movie_name = nullptr;
 
     ARGBEGIN {
         case 'b':
@@ -103,6 +104,12 @@ int EmuWindow::init(int argc, char** argv)
         case 'g':
             gsdump = ARGF();
             break;
+        case 'r':
+            record_name = ARGF();
+            break;
+        case 'm':
+            movie_name = ARGF();
+            break;
         case 'h':
         default:
             printf("usage: %s [options]\n\n", argv0);
@@ -112,6 +119,8 @@ int EmuWindow::init(int argc, char** argv)
             printf("-h\t\tshow this message\n");
             printf("-s\t\tskip BIOS\n");
             printf("-g {.GSD}\t\trun a gsdump\n");
+            printf("-r {movie}\trecord an input movie\n");
+            printf("-m {movie}\tplay back an input movie\n");
             return 1;
     } ARGEND
 
@@ -120,6 +129,14 @@ int EmuWindow::init(int argc, char** argv)
         return load_exec(gsdump, false);
     }
 
+    if (movie_name)
+    {
+        if (!emu_thread.play_movie(movie_name))
+            return 1;
+    }
+    else if (record_name)
+        emu_thread.record_movie(record_name);
+
     if (file_name)
     {
         if (load_exec(file_name, skip_BIOS))
@@ -167,11 +184,12 @@ int EmuWindow::load_exec(const char* file_name, bool skip_BIOS)
     }
     else if (QString::compare(ext, "iso", Qt::CaseInsensitive) == 0)
     {
-        emu_thread.load_CDVD(file_name, CDVD_CONTAINER::ISO);
+        emu_thread.load_CDVD(file_name, CDVD_CONTAINER::ISO_MMAP);
         if (skip_BIOS)
             emu_thread.set_skip_BIOS_hack(SKIP_HACK::LOAD_DISC);
     }
-    else if (QString::compare(ext, "cso", Qt::CaseInsensitive) == 0)
+    else if (QString::compare(ext, "cso", Qt::CaseInsensitive) == 0 ||
+             QString::compare(ext, "zso", Qt::CaseInsensitive) == 0)
     {
         emu_thread.load_CDVD(file_name, CDVD_CONTAINER::CISO);
         if (skip_BIOS)
@@ -186,6 +204,7 @@ int EmuWindow::load_exec(const char* file_name, bool skip_BIOS)
     }
 
     set_vu1_mode();
+    emu_thread.set_rewind(Settings::instance().rewind_enabled);
 
     current_ROM = file_info;
     emu_thread.unpause(PAUSE_EVENT::GAME_NOT_LOADED);
@@ -483,6 +502,9 @@ void EmuWindow::keyPressEvent(QKeyEvent *event)
         case Qt::Key_F1:
             emu_thread.gsdump_single_frame();
             break;
+        case Qt::Key_Backspace:
+            emu_thread.rewind();
+            break;
         case Qt::Key_F8:
             render_widget->screenshot();
             break;
@@ -607,7 +629,7 @@ void EmuWindow::open_file_no_skip()
     emu_thread.pause(PAUSE_EVENT::FILE_DIALOG);
     QString file_name = QFileDialog::getOpenFileName(
         this, tr("Open Rom"), Settings::instance().last_used_directory,
-        tr("ROM Files (*.elf *.iso *.cso)")
+        tr("ROM Files (*.elf *.iso *.cso *.zso)")
     );
 
     if (!file_name.isEmpty())
@@ -624,7 +646,7 @@ void EmuWindow::open_file_skip()
     emu_thread.pause(PAUSE_EVENT::FILE_DIALOG);
     QString file_name = QFileDialog::getOpenFileName(
         this, tr("Open Rom"), Settings::instance().last_used_directory,
-        tr("ROM Files (*.elf *.iso *.cso)")
+        tr("ROM Files (*.elf *.iso *.cso *.zso)")
     );
 
     if (!file_name.isEmpty())
@@ -693,6 +715,7 @@ void EmuWindow::set_vu1_mode()
         vu1_mode = "Interpreter";
     }
     emu_thread.set_vu1_mode(mode);
+    emu_thread.set_vu1_thread(Settings::instance().vu1_thread_enabled);
 }
 
 void EmuWindow::show_debugger() {
@@ -81,6 +81,7 @@ QStringList GameListModel::get_directory_entries(QString path)
     const QStringList file_types({
         "*.iso",
         "*.cso",
+        "*.zso",
         "*.elf",
         "*.gsd"
     });
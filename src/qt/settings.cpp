@@ -30,6 +30,8 @@ void Settings::reset()
     rom_directories = qsettings().value("rom_directories", {}).toStringList();
     recent_roms = qsettings().value("recent_roms", {}).toStringList();
     vu1_jit_enabled = qsettings().value("vu1_jit_enabled", true).toBool();
+    vu1_thread_enabled = qsettings().value("vu1_thread_enabled", false).toBool();
+    rewind_enabled = qsettings().value("rewind_enabled", false).toBool();
     last_used_directory = qsettings().value("last_used_dir", QDir::homePath()).toString();
     screenshot_directory = qsettings().value("screenshot_directory", QDir::homePath()).toString();
 
@@ -64,6 +66,8 @@ void Settings::save()
     qsettings().setValue("rom_directories", rom_directories);
     qsettings().setValue("bios_path", bios_path);
     qsettings().setValue("vu1_jit_enabled", vu1_jit_enabled);
+    qsettings().setValue("vu1_thread_enabled", vu1_thread_enabled);
+    qsettings().setValue("rewind_enabled", rewind_enabled);
     qsettings().setValue("screenshot_directory", screenshot_directory);
     qsettings().sync();
     reset();
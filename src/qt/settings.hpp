@@ -29,6 +29,8 @@ class Settings final : public QObject
         QStringList recent_roms;
 
         bool vu1_jit_enabled;
+        bool vu1_thread_enabled;
+        bool rewind_enabled;
 
         void save();
         void reset();
@@ -11,6 +11,7 @@
 #include <QWidget>
 #include <QGroupBox>
 #include <QRadioButton>
+#include <QCheckBox>
 
 #include "settingswindow.hpp"
 #include "settings.hpp"
@@ -20,11 +21,16 @@ GeneralTab::GeneralTab(QWidget* parent)
 {
     QRadioButton* jit_checkbox = new QRadioButton(tr("JIT"));
     QRadioButton* interpreter_checkbox = new QRadioButton(tr("Interpreter"));
+    QCheckBox* thread_checkbox = new QCheckBox(tr("Run on a separate thread (experimental)"));
     QLabel* warning = new QLabel(tr("NOTE: Change will take effect the next time you load a game."));
+    QCheckBox* rewind_checkbox = new QCheckBox(tr("Keep recent states in memory (hold Backspace to rewind)"));
+    QLabel* rewind_warning = new QLabel(tr("NOTE: Change will take effect the next time you load a game."));
 
     bool vu1_jit = Settings::instance().vu1_jit_enabled;
     jit_checkbox->setChecked(vu1_jit);
     interpreter_checkbox->setChecked(!vu1_jit);
+    thread_checkbox->setChecked(Settings::instance().vu1_thread_enabled);
+    rewind_checkbox->setChecked(Settings::instance().rewind_enabled);
 
     connect(jit_checkbox, &QRadioButton::clicked, this, [=] (){
         Settings::instance().vu1_jit_enabled = true;
@@ -34,22 +40,41 @@ GeneralTab::GeneralTab(QWidget* parent)
         Settings::instance().vu1_jit_enabled = false;
     });
 
+    connect(thread_checkbox, &QCheckBox::toggled, this, [=] (bool checked){
+        Settings::instance().vu1_thread_enabled = checked;
+    });
+
+    connect(rewind_checkbox, &QCheckBox::toggled, this, [=] (bool checked){
+        Settings::instance().rewind_enabled = checked;
+    });
+
     connect(&Settings::instance(), &Settings::reload, this, [=]() {
         bool vu1_jit_enabled = Settings::instance().vu1_jit_enabled;
         jit_checkbox->setChecked(vu1_jit_enabled);
         interpreter_checkbox->setChecked(!vu1_jit_enabled);
+        thread_checkbox->setChecked(Settings::instance().vu1_thread_enabled);
+        rewind_checkbox->setChecked(Settings::instance().rewind_enabled);
     });
 
     QVBoxLayout* vu1_layout = new QVBoxLayout;
     vu1_layout->addWidget(jit_checkbox);
     vu1_layout->addWidget(interpreter_checkbox);
+    vu1_layout->addWidget(thread_checkbox);
     vu1_layout->addWidget(warning);
 
     QGroupBox* vu1_groupbox = new QGroupBox(tr("VU1"));
     vu1_groupbox->setLayout(vu1_layout);
 
+    QVBoxLayout* rewind_layout = new QVBoxLayout;
+    rewind_layout->addWidget(rewind_checkbox);
+    rewind_layout->addWidget(rewind_warning);
+
+    QGroupBox* rewind_groupbox = new QGroupBox(tr("Rewind"));
+    rewind_groupbox->setLayout(rewind_layout);
+
     QVBoxLayout* layout = new QVBoxLayout;
     layout->addWidget(vu1_groupbox);
+    layout->addWidget(rewind_groupbox);
     layout->addStretch(1);
 
     setLayout(layout);